@@ -0,0 +1,214 @@
+# Stand-in for an arm board, for testing the Eye's /av hub and the host
+# scripts without the hardware.
+#
+# Serves /ach1 the way the firmware does: 24 kHz 16-bit audio in 5 ms capture
+# blocks, ?ch=, ?framed=1 with the same 50-byte block header (sequence number,
+# capture time on the board's own clock, per-channel levels, capture-to-socket
+# latency), ?block_ms= / ?profile=low_latency, and ?raw=1 (plain response
+# closed by the server) or chunked transfer encoding otherwise. Every microphone
+# plays its own tone so the channel map can be checked by ear or FFT. /status
+# answers with a small JSON snapshot.
+#
+#   python arm_board_sim.py --port 8080                 then CONFIG_AV_HUB_SOURCE_1 = <pc ip>:8080
+#   python arm_board_sim.py --port 80 --ppm 40          as 192.168.4.254 on the Eye's AP, drifting clock
+#   python ../../../Software/Streaming/audio_blocks.py --ip 127.0.0.1:8080
+#
+# Only needs numpy.
+
+import argparse
+import http.server
+import json
+import math
+import socketserver
+import struct
+import threading
+import time
+import urllib.parse
+
+import numpy as np
+
+SAMPLE_RATE = 24000
+BLOCK_FRAMES = 120      # AUDIO_RING_BLOCK_FRAMES, 5 ms
+BLOCK_MS = BLOCK_FRAMES * 1000 // SAMPLE_RATE
+MAX_BLOCK_MS = 170
+HEADER = struct.Struct("<4sIqHBBBB" + "HHH" * 4 + "I")     # audio_block_header_t
+TONES_HZ = (300.0, 500.0, 700.0, 900.0)
+
+
+class Board:
+    """Capture clock and signal of the simulated board."""
+
+    def __init__(self, ppm, level_dbfs, send_delay_ms):
+        self.boot = time.monotonic()
+        self.rate = 1.0 + ppm * 1e-6        # board clock ticks per host second
+        self.amplitude = 32767 * 10 ** (level_dbfs / 20)
+        self.send_delay = send_delay_ms / 1000.0
+        self.lock = threading.Lock()
+        self.clients = 0
+
+    def now_us(self):
+        return int((time.monotonic() - self.boot) * self.rate * 1e6)
+
+    def host_time(self, board_us):
+        return self.boot + board_us / 1e6 / self.rate
+
+    def block_start_us(self, seq):
+        return seq * BLOCK_FRAMES * 1_000_000 // SAMPLE_RATE
+
+    def samples(self, seq, blocks):
+        """All four channels of blocks capture blocks starting at seq, (frames, 4) int16."""
+        n = np.arange(seq * BLOCK_FRAMES, (seq + blocks) * BLOCK_FRAMES)
+        t = n / SAMPLE_RATE
+        channels = [self.amplitude * np.sin(2 * math.pi * f * t) for f in TONES_HZ]
+        return np.clip(np.stack(channels, axis=1), -32768, 32767).astype(np.int16)
+
+
+def levels(block):
+    out = []
+    for ch in range(4):
+        s = block[:, ch].astype(np.int32)
+        peak = int(np.abs(s).max()) if len(s) else 0
+        rms = int(math.sqrt(float(np.mean(s.astype(np.float64) ** 2)))) if len(s) else 0
+        out += [min(peak, 32767), rms, 0]
+    return out
+
+
+def parse_channels(value):
+    try:
+        chans = sorted({int(c) for c in value.split(",") if c != ""})
+    except ValueError:
+        return None
+    return chans if chans and all(0 <= c <= 3 for c in chans) else None
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    board = None
+
+    def log_message(self, fmt, *args):
+        print(f"{self.client_address[0]} {fmt % args}")
+
+    def send_text(self, code, text):
+        body = text.encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "text/plain")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = {k: v[-1] for k, v in urllib.parse.parse_qs(url.query).items()}
+        if url.path == "/status":
+            body = json.dumps({"uptime_us": self.board.now_us(), "subscribers": self.board.clients,
+                               "simulated": True}).encode()
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        elif url.path == "/ach1":
+            self.ach1(query)
+        else:
+            self.send_text(404, "Not found")
+
+    def ach1(self, query):
+        block_ms = 40
+        raw = nodelay = False
+        if "profile" in query:
+            if query["profile"] != "low_latency":
+                return self.send_text(400, "profile must be low_latency")
+            block_ms, raw, nodelay = BLOCK_MS, True, True
+        if "block_ms" in query:
+            try:
+                block_ms = int(query["block_ms"])
+            except ValueError:
+                block_ms = 0
+            if not BLOCK_MS <= block_ms <= MAX_BLOCK_MS:
+                return self.send_text(400, "block_ms must be 5 to 170")
+        raw = query.get("raw", "1" if raw else "0") == "1"
+        framed = query.get("framed") == "1"
+        chans = parse_channels(query.get("ch", "0,1,2,3"))
+        if chans is None:
+            return self.send_text(400, "ch must list microphones 0-3, ex: ch=0,2")
+        blocks = -(-block_ms // BLOCK_MS)
+        mask = sum(1 << c for c in chans)
+
+        if raw:
+            self.wfile.write(b"HTTP/1.1 200 OK\r\nContent-Type: audio/raw\r\nCache-Control: no-cache\r\n"
+                             b"Connection: close\r\n")
+        else:
+            self.send_response(200)
+            self.send_header("Content-Type", "audio/raw")
+            self.send_header("Transfer-Encoding", "chunked")
+        headers = {"X-Audio-Sample-Rate": "24000", "X-Audio-Bits-Per-Sample": "16",
+                   "X-Audio-Channels": str(len(chans)), "X-Audio-Channel-Map": ",".join(map(str, chans)),
+                   "X-Audio-Framed": "1" if framed else "0", "X-Audio-Block-Ms": str(blocks * BLOCK_MS)}
+        if raw:
+            self.wfile.write("".join(f"{k}: {v}\r\n" for k, v in headers.items()).encode() + b"\r\n")
+        else:
+            for k, v in headers.items():
+                self.send_header(k, v)
+            self.end_headers()
+        self.wfile.flush()
+        self.close_connection = True
+
+        board = self.board
+        with board.lock:
+            board.clients += 1
+        # Start with the next block, as a ring subscriber does
+        seq = board.now_us() * SAMPLE_RATE // (BLOCK_FRAMES * 1_000_000) + 1
+        try:
+            while True:
+                # A chunk leaves once its last block is captured
+                end_us = board.block_start_us(seq + blocks)
+                wait = board.host_time(end_us) + board.send_delay - time.monotonic()
+                if wait > 0:
+                    time.sleep(wait)
+                audio = board.samples(seq, blocks)
+                payload = audio[:, chans].tobytes()
+                start_us = board.block_start_us(seq)
+                if framed:
+                    latency = board.now_us() - start_us
+                    payload = HEADER.pack(b"IRLA", seq & 0xFFFFFFFF, start_us, len(audio), len(chans), 16, mask, 0,
+                                          *levels(audio), latency) + payload
+                if raw:
+                    self.wfile.write(payload)
+                else:
+                    self.wfile.write(b"%x\r\n%s\r\n" % (len(payload), payload))
+                self.wfile.flush()
+                seq += blocks
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+        finally:
+            with board.lock:
+                board.clients -= 1
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Serve /ach1 like an arm board")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--ppm", type=float, default=0.0, help="board clock error against the host")
+    parser.add_argument("--level", type=float, default=-20.0, help="tone level in dBFS")
+    parser.add_argument("--send-delay-ms", type=float, default=0.5,
+                        help="time from the end of a chunk's capture to its send")
+    args = parser.parse_args()
+
+    Handler.board = Board(args.ppm, args.level, args.send_delay_ms)
+    server = Server((args.host, args.port), Handler)
+    print(f"Simulated arm board on {args.host}:{args.port}, tones {', '.join(f'{f:.0f}' for f in TONES_HZ)} Hz "
+          f"on channels 0-3, clock {args.ppm:+.0f} ppm")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,64 @@
+# When connected to the ESP32-S3 wifi AP, this script requests a burst capture from
+# <ip>/burst: all four microphones at full 32-bit resolution, recorded gap-free into
+# PSRAM on the arm board and uploaded afterwards as a WAV file.
+#
+# ex: python burst_capture.py --ms 2000 --rate 48000
+
+import argparse
+import datetime
+import json
+import struct
+
+import requests
+
+ESP32_IP = "192.168.4.254"  # IP address of the ESP32 (4-mic array)
+
+
+def read_capture_info(data):
+    """Return the JSON description stored in the 'irlb' chunk of a burst WAV."""
+    pos = 12
+    while pos + 8 <= len(data):
+        chunk_id, size = struct.unpack_from("<4sI", data, pos)
+        if chunk_id == b"irlb":
+            return json.loads(data[pos + 8:pos + 8 + size].decode().strip())
+        if chunk_id == b"data":
+            break
+        pos += 8 + size + (size & 1)
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record a burst capture from the arm board")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--ms", type=int, default=1000)
+    parser.add_argument("--rate", type=int, default=48000)
+    parser.add_argument("--output")
+    args = parser.parse_args()
+
+    url = f"http://{args.ip}/burst?ms={args.ms}&rate={args.rate}"
+    print(f"Requesting burst capture from {url}")
+    # The board records before it answers, so allow for the capture time
+    response = requests.get(url, timeout=10 + args.ms / 1000)
+    if response.status_code != 200:
+        print(f"Burst failed: {response.status_code} {response.text}")
+        return
+
+    data = response.content
+    info = read_capture_info(data)
+    filename = args.output or f"burst_{datetime.datetime.now().strftime('%Y-%m-%d_%H-%M-%S')}.wav"
+    with open(filename, "wb") as f:
+        f.write(data)
+
+    print(f"Saved {len(data) / 1024:.1f} KB to {filename}")
+    if info:
+        duration = info["frames"] / info["sample_rate"]
+        print(f"Captured at {info['capture_start_us']} us since boot: {duration:.3f} s, "
+              f"{info['sample_rate']} Hz, {info['channels']} x {info['bits_per_sample']}-bit")
+        if info["i2s_overflows"]:
+            print(f"WARNING: {info['i2s_overflows']} I2S overflows during capture, the recording has gaps")
+        else:
+            print("No I2S overflows, capture is gap-free")
+
+
+if __name__ == "__main__":
+    main()
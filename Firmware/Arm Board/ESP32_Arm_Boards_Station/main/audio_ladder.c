@@ -0,0 +1,288 @@
+#include <math.h>
+#include <string.h>
+#include "audio_levels.h"
+#include "audio_ladder.h"
+
+#define MIX     AUDIO_RING_CHANNELS     // history slot of the mix
+#define WORK    (AUDIO_LADDER_FIR_HISTORY + AUDIO_RING_BLOCK_FRAMES)
+
+_Static_assert(AUDIO_RING_BLOCK_FRAMES * 2 == AUDIO_LADDER_LOW_BLOCK_FRAMES * 3, "24 -> 16 kHz takes 3 frames to 2");
+
+static const char *quality_names[AUDIO_QUALITY_COUNT] = { "full", "16k", "2ch", "beam", "mulaw" };
+
+// Low-pass at 7 kHz for 24 -> 16 kHz, designed at 48 kHz (up 2, down 3), Q15
+static int16_t fir[AUDIO_LADDER_FIR_TAPS];
+static bool fir_ready = false;
+
+// Hamming windowed sinc. Each output only meets the taps of one parity (the
+// zeros of the upsampling fall on the others), so both halves are scaled to
+// a gain of exactly 1 on their own and DC passes without a ripple.
+static void fir_design(void) {
+    const float fc = 7000.0f / 48000.0f;
+    const float mid = (AUDIO_LADDER_FIR_TAPS - 1) / 2.0f;
+    float h[AUDIO_LADDER_FIR_TAPS];
+    float sum[2] = { 0 };
+    for (int k = 0; k < AUDIO_LADDER_FIR_TAPS; k++) {
+        float t = k - mid;
+        float sinc = 2 * fc * sinf((float)M_PI * 2 * fc * t) / ((float)M_PI * 2 * fc * t);
+        h[k] = sinc * (0.54f - 0.46f * cosf(2 * (float)M_PI * k / (AUDIO_LADDER_FIR_TAPS - 1)));
+        sum[k & 1] += h[k];
+    }
+    int32_t total[2] = { 0 };
+    for (int k = 0; k < AUDIO_LADDER_FIR_TAPS; k++) {
+        fir[k] = (int16_t)lrintf(h[k] / sum[k & 1] * 32768.0f);     // every tap is well below 1
+        total[k & 1] += fir[k];
+    }
+    // Rounding leaves a phase a few units off 1.0, the centre taps take the difference
+    fir[AUDIO_LADDER_FIR_TAPS / 2 - 1] += 32768 - total[(AUDIO_LADDER_FIR_TAPS / 2 - 1) & 1];
+    fir[AUDIO_LADDER_FIR_TAPS / 2] += 32768 - total[(AUDIO_LADDER_FIR_TAPS / 2) & 1];
+    fir_ready = true;
+}
+
+// in: AUDIO_LADDER_FIR_HISTORY samples of the previous block, then this
+// block's AUDIO_RING_BLOCK_FRAMES. Output n is sample 3n of the 48 kHz
+// upsampled signal, where only every other sample is non-zero:
+//   y[n] = sum_k fir[k] * up[3n - k],  up[2i] = in[i]
+// The filter delays by about 0.7 ms, which the timestamps ignore.
+static void resample(const int16_t *in, int16_t *out, size_t stride) {
+    for (int n = 0; n < AUDIO_LADDER_LOW_BLOCK_FRAMES; n++) {
+        int u = 3 * n + 2 * AUDIO_LADDER_FIR_HISTORY;
+        int32_t acc = 1 << 14;
+        for (int k = u & 1; k < AUDIO_LADDER_FIR_TAPS; k += 2) {
+            acc += (int32_t)fir[k] * in[(u - k) / 2];
+        }
+        acc >>= 15;
+        out[n * stride] = (int16_t)(acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : acc);
+    }
+}
+
+// G.711 mu-law
+static uint8_t mulaw_encode(int16_t pcm) {
+    int sign = pcm < 0 ? 0x80 : 0;
+    int32_t mag = sign ? -(int32_t)pcm : pcm;
+    if (mag > 32635) {
+        mag = 32635;
+    }
+    mag += 0x84;
+    int exponent = 7;
+    for (int32_t bit = 0x4000; (mag & bit) == 0 && exponent > 0; bit >>= 1) {
+        exponent--;
+    }
+    int mantissa = (mag >> (exponent + 3)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+static bool rung_useful(const audio_ladder_t *ladder, audio_quality_t quality) {
+    switch (quality) {
+    case AUDIO_QUALITY_2CH:
+        return ladder->channel_count > 2;
+    case AUDIO_QUALITY_BEAM:
+        return ladder->channel_count > 1;
+    default:
+        return true;
+    }
+}
+
+// The next rung down (dir 1) or up (dir -1) that changes anything, or the current one
+static audio_quality_t next_rung(const audio_ladder_t *ladder, int dir) {
+    int q = ladder->quality + dir;
+    while (q >= AUDIO_QUALITY_FULL && q <= (int)ladder->lowest) {
+        if (rung_useful(ladder, (audio_quality_t)q)) {
+            return (audio_quality_t)q;
+        }
+        q += dir;
+    }
+    return ladder->quality;
+}
+
+void audio_ladder_init(audio_ladder_t *ladder, uint8_t channel_mask, audio_quality_t lowest, int64_t now_us) {
+    if (!fir_ready) {
+        fir_design();
+    }
+    memset(ladder, 0, sizeof(*ladder));
+    ladder->channel_mask = channel_mask;
+    for (uint8_t ch = 0; ch < AUDIO_RING_CHANNELS; ch++) {
+        if (channel_mask & (1 << ch)) {
+            ladder->channel_map[ladder->channel_count++] = ch;
+        }
+    }
+    ladder->quality = AUDIO_QUALITY_FULL;
+    ladder->lowest = lowest;
+    ladder->changed_us = now_us;
+    ladder->calm_since_us = now_us;
+    ladder->stepped_down_us = now_us - AUDIO_LADDER_HOLD_MS * 1000LL;
+    ladder->up_hold_ms = AUDIO_LADDER_UP_HOLD_MS;
+}
+
+bool audio_ladder_update(audio_ladder_t *ladder, uint32_t lag_blocks, int64_t now_us) {
+    if (ladder->lowest == AUDIO_QUALITY_FULL) {
+        return false;
+    }
+    if (lag_blocks > AUDIO_LADDER_UP_BLOCKS) {
+        ladder->calm_since_us = now_us;
+    }
+    if (ladder->stepped_up_us && now_us - ladder->stepped_up_us >= AUDIO_LADDER_PROBE_MS * 1000LL) {
+        // The step up held, the next one may come as early as ever
+        ladder->stepped_up_us = 0;
+        ladder->up_hold_ms = AUDIO_LADDER_UP_HOLD_MS;
+    }
+
+    audio_quality_t next = ladder->quality;
+    if (lag_blocks >= AUDIO_LADDER_DOWN_BLOCKS) {
+        // After a step down the backlog needs time to drain, unless it keeps growing at the new rung
+        if (now_us - ladder->stepped_down_us >= AUDIO_LADDER_HOLD_MS * 1000LL ||
+            lag_blocks >= ladder->stepped_down_lag + AUDIO_LADDER_DOWN_BLOCKS) {
+            next = next_rung(ladder, 1);
+        }
+        if (next != ladder->quality && ladder->stepped_up_us) {
+            ladder->stepped_up_us = 0;
+            ladder->up_hold_ms *= 2;
+            if (ladder->up_hold_ms > AUDIO_LADDER_MAX_UP_HOLD_MS) {
+                ladder->up_hold_ms = AUDIO_LADDER_MAX_UP_HOLD_MS;
+            }
+        }
+    } else if (now_us - ladder->calm_since_us >= ladder->up_hold_ms * 1000LL &&
+               now_us - ladder->changed_us >= ladder->up_hold_ms * 1000LL) {
+        next = next_rung(ladder, -1);
+        if (next != ladder->quality) {
+            ladder->stepped_up_us = now_us;
+        }
+    }
+    if (next == ladder->quality) {
+        return false;
+    }
+    if (next > ladder->quality) {
+        ladder->steps_down++;
+        ladder->stepped_down_us = now_us;
+        ladder->stepped_down_lag = lag_blocks;
+    } else {
+        ladder->steps_up++;
+    }
+    ladder->quality = next;
+    ladder->changed_us = now_us;
+    ladder->calm_since_us = now_us;
+    return true;
+}
+
+void audio_ladder_get_format(const audio_ladder_t *ladder, audio_ladder_format_t *format) {
+    *format = (audio_ladder_format_t){
+        .sample_rate = AUDIO_LADDER_RATE_LOW,
+        .block_frames = AUDIO_LADDER_LOW_BLOCK_FRAMES,
+        .channels = ladder->channel_count,
+        .channel_mask = ladder->channel_mask,
+        .bits_per_sample = 16,
+        .flags = AUDIO_BLOCK_FLAG_16K,
+    };
+    uint8_t first = ladder->channel_map[0];
+    uint8_t last = ladder->channel_map[ladder->channel_count - 1];
+    switch (ladder->quality) {
+    case AUDIO_QUALITY_FULL:
+        format->sample_rate = AUDIO_LADDER_RATE_FULL;
+        format->block_frames = AUDIO_RING_BLOCK_FRAMES;
+        format->flags = 0;
+        break;
+    case AUDIO_QUALITY_16K:
+        break;
+    case AUDIO_QUALITY_2CH:
+        format->channels = 2;
+        format->channel_mask = (1 << first) | (1 << last);
+        break;
+    case AUDIO_QUALITY_BEAM:
+        format->channels = 1;
+        format->flags |= AUDIO_BLOCK_FLAG_BEAM;
+        break;
+    default:
+        format->channels = 1;
+        format->bits_per_sample = 8;
+        format->flags |= AUDIO_BLOCK_FLAG_MULAW | (ladder->channel_count > 1 ? AUDIO_BLOCK_FLAG_BEAM : 0);
+        break;
+    }
+}
+
+size_t audio_ladder_convert(audio_ladder_t *ladder, const int16_t *samples, uint8_t *out) {
+    const int frames = AUDIO_RING_BLOCK_FRAMES;
+    const uint8_t count = ladder->channel_count;
+    int16_t *pcm = (int16_t *)out;
+    int16_t work[WORK];
+    int16_t mix[AUDIO_RING_BLOCK_FRAMES];
+    size_t bytes;
+
+    if (ladder->lowest >= AUDIO_QUALITY_BEAM) {
+        // Zero-delay delay-and-sum: the average of the selected microphones
+        for (int i = 0; i < frames; i++) {
+            int32_t sum = 0;
+            for (uint8_t c = 0; c < count; c++) {
+                sum += samples[i * AUDIO_RING_CHANNELS + ladder->channel_map[c]];
+            }
+            mix[i] = (int16_t)(sum / count);
+        }
+    }
+
+    switch (ladder->quality) {
+    case AUDIO_QUALITY_FULL:
+        for (int i = 0; i < frames; i++) {
+            for (uint8_t c = 0; c < count; c++) {
+                *pcm++ = samples[i * AUDIO_RING_CHANNELS + ladder->channel_map[c]];
+            }
+        }
+        bytes = (size_t)frames * count * sizeof(int16_t);
+        break;
+    case AUDIO_QUALITY_16K:
+    case AUDIO_QUALITY_2CH: {
+        uint8_t out_count = ladder->quality == AUDIO_QUALITY_2CH ? 2 : count;
+        for (uint8_t c = 0; c < out_count; c++) {
+            uint8_t mic = ladder->quality == AUDIO_QUALITY_2CH && c == 1 ? ladder->channel_map[count - 1]
+                                                                          : ladder->channel_map[c];
+            memcpy(work, ladder->history[mic], sizeof(ladder->history[mic]));
+            for (int i = 0; i < frames; i++) {
+                work[AUDIO_LADDER_FIR_HISTORY + i] = samples[i * AUDIO_RING_CHANNELS + mic];
+            }
+            resample(work, pcm + c, out_count);
+        }
+        bytes = (size_t)AUDIO_LADDER_LOW_BLOCK_FRAMES * out_count * sizeof(int16_t);
+        break;
+    }
+    default:
+        memcpy(work, ladder->history[MIX], sizeof(ladder->history[MIX]));
+        memcpy(work + AUDIO_LADDER_FIR_HISTORY, mix, sizeof(mix));
+        resample(work, pcm, 1);
+        bytes = AUDIO_LADDER_LOW_BLOCK_FRAMES * sizeof(int16_t);
+        if (ladder->quality == AUDIO_QUALITY_MULAW) {
+            // In place, each byte goes where it no longer overwrites unread samples
+            for (int i = 0; i < AUDIO_LADDER_LOW_BLOCK_FRAMES; i++) {
+                out[i] = mulaw_encode(pcm[i]);
+            }
+            bytes = AUDIO_LADDER_LOW_BLOCK_FRAMES;
+        }
+        break;
+    }
+
+    // Keep the tail of every input, a later rung may need it
+    if (ladder->lowest > AUDIO_QUALITY_FULL) {
+        for (int ch = 0; ch < AUDIO_RING_CHANNELS; ch++) {
+            for (int i = 0; i < AUDIO_LADDER_FIR_HISTORY; i++) {
+                ladder->history[ch][i] = samples[(frames - AUDIO_LADDER_FIR_HISTORY + i) * AUDIO_RING_CHANNELS + ch];
+            }
+        }
+        if (ladder->lowest >= AUDIO_QUALITY_BEAM) {
+            memcpy(ladder->history[MIX], mix + frames - AUDIO_LADDER_FIR_HISTORY, sizeof(ladder->history[MIX]));
+        }
+    }
+    return bytes;
+}
+
+const char *audio_quality_name(audio_quality_t quality) {
+    return quality < AUDIO_QUALITY_COUNT ? quality_names[quality] : "?";
+}
+
+audio_quality_t audio_quality_parse(const char *name) {
+    if (strcmp(name, "1") == 0) {
+        return AUDIO_QUALITY_MULAW;
+    }
+    for (int q = 0; q < AUDIO_QUALITY_COUNT; q++) {
+        if (strcmp(name, quality_names[q]) == 0) {
+            return (audio_quality_t)q;
+        }
+    }
+    return AUDIO_QUALITY_COUNT;
+}
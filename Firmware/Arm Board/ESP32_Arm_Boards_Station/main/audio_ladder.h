@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "audio_ring.h"
+
+// Quality ladder for /ach1?adapt=, steps the stream down when the client cannot keep up
+//
+// A client that reads slower than the capture falls behind in the audio ring
+// (audio_ring_lag()), and once a whole ring behind it loses audio. With the
+// ladder the stream first gives up bandwidth instead:
+//
+//   rung   format                                   bytes/s, four microphones
+//   full   selected microphones, 24 kHz 16-bit      192000
+//   16k    selected microphones, 16 kHz              128000
+//   2ch    first and last selected microphone        64000
+//   beam   one channel, the mix of the selection     32000
+//   mulaw  the mix as G.711 mu-law, 8-bit            16000
+//
+// Rungs that would not save anything for the selection (2ch with two or
+// fewer microphones, beam with one) are skipped. The mix is a delay-and-sum
+// beam with zero delays, it points broadside; the firmware does not know the
+// array geometry to steer it. G.711 stands in for a real codec, which needs
+// an encoder component this project does not have; 16 kHz mu-law is still
+// good enough for speech recognition.
+//
+// The stream steps down one rung when the lag reaches AUDIO_LADDER_DOWN_BLOCKS.
+// The next step down waits AUDIO_LADDER_HOLD_MS, so the cheaper format gets a
+// chance to drain the backlog, unless the lag grows by another
+// AUDIO_LADDER_DOWN_BLOCKS meanwhile. The backlog is in capture blocks, which
+// are converted when read, so a step down also shrinks what is already queued
+// (but not what sits in the socket buffer). It steps up again after the lag stayed at or below
+// AUDIO_LADDER_UP_BLOCKS for up_hold_ms. A step up that has to be undone within
+// AUDIO_LADDER_PROBE_MS doubles up_hold_ms, up to AUDIO_LADDER_MAX_UP_HOLD_MS,
+// so a link that cannot carry the better format is not probed every few seconds.
+//
+// Every framed chunk describes its own format (channels, channel_mask,
+// bits_per_sample and the AUDIO_BLOCK_FLAG_16K / BEAM / MULAW flags), and a
+// chunk never mixes formats, so a change shows in-band at the first chunk of
+// the new rung.
+
+#define AUDIO_LADDER_RATE_FULL          24000   // the capture rate
+#define AUDIO_LADDER_RATE_LOW           16000
+#define AUDIO_LADDER_LOW_BLOCK_FRAMES   80      // AUDIO_RING_BLOCK_FRAMES at 16 kHz
+#define AUDIO_LADDER_DOWN_BLOCKS        16      // 80 ms behind, a quarter of the ring
+#define AUDIO_LADDER_UP_BLOCKS          2
+#define AUDIO_LADDER_HOLD_MS            1000
+#define AUDIO_LADDER_UP_HOLD_MS         5000
+#define AUDIO_LADDER_MAX_UP_HOLD_MS     80000
+#define AUDIO_LADDER_PROBE_MS           10000
+#define AUDIO_LADDER_FIR_TAPS           72      // 24 -> 16 kHz low-pass, at the 48 kHz intermediate rate
+#define AUDIO_LADDER_FIR_HISTORY        (AUDIO_LADDER_FIR_TAPS / 2)    // input samples it reaches back
+
+typedef enum {
+    AUDIO_QUALITY_FULL,
+    AUDIO_QUALITY_16K,
+    AUDIO_QUALITY_2CH,
+    AUDIO_QUALITY_BEAM,
+    AUDIO_QUALITY_MULAW,
+    AUDIO_QUALITY_COUNT,
+} audio_quality_t;
+
+// What a chunk at the current rung carries, for its audio_block_header_t
+typedef struct {
+    uint32_t sample_rate;
+    uint16_t block_frames;      // frames per capture block
+    uint8_t channels;
+    uint8_t channel_mask;
+    uint8_t bits_per_sample;
+    uint8_t flags;              // AUDIO_BLOCK_FLAG_16K / BEAM / MULAW
+} audio_ladder_format_t;
+
+typedef struct {
+    uint8_t channel_mask;       // the client's selection
+    uint8_t channel_count;
+    uint8_t channel_map[AUDIO_RING_CHANNELS];
+    audio_quality_t quality;
+    audio_quality_t lowest;     // the client's floor, ?adapt=<rung>
+    int64_t changed_us;
+    int64_t calm_since_us;      // lag last above AUDIO_LADDER_UP_BLOCKS
+    int64_t stepped_up_us;      // last step up, 0 once it held for AUDIO_LADDER_PROBE_MS
+    int64_t stepped_down_us;
+    uint32_t stepped_down_lag;
+    uint32_t up_hold_ms;
+    uint32_t steps_down;
+    uint32_t steps_up;
+    // Resampler input from the end of the previous block: the four microphones and their mix,
+    // kept for all of them so a rung change continues seamlessly
+    int16_t history[AUDIO_RING_CHANNELS + 1][AUDIO_LADDER_FIR_HISTORY];
+} audio_ladder_t;
+
+// Starts at full quality. lowest = AUDIO_QUALITY_FULL never steps down.
+void audio_ladder_init(audio_ladder_t *ladder, uint8_t channel_mask, audio_quality_t lowest, int64_t now_us);
+
+// Feed the client's ring lag after every read. Returns true when the rung changed.
+bool audio_ladder_update(audio_ladder_t *ladder, uint32_t lag_blocks, int64_t now_us);
+
+void audio_ladder_get_format(const audio_ladder_t *ladder, audio_ladder_format_t *format);
+
+// Convert one ring block (AUDIO_RING_BLOCK_FRAMES frames of all four
+// microphones) to the current format, returns the bytes written to out
+size_t audio_ladder_convert(audio_ladder_t *ladder, const int16_t *samples, uint8_t *out);
+
+const char *audio_quality_name(audio_quality_t quality);
+
+// "full", "16k", ... or "1" (all the way down), AUDIO_QUALITY_COUNT if unknown
+audio_quality_t audio_quality_parse(const char *name);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Per-block level metering for the capture path. The meter is updated while
+// each raw I2S slot is converted to its 16-bit stream sample, so it costs a
+// compare and a multiply-add per sample and no extra pass over the buffer.
+
+#define AUDIO_LEVEL_CHANNELS    4
+#define AUDIO_BLOCK_MAGIC       "IRLA"
+#define AUDIO_BLOCK_FLAG_CONCEALED  0x01    // set by a relay (the Eye's /av) when samples were lost and concealed
+#define AUDIO_BLOCK_FLAG_SYNCED     0x02    // timestamp_us is on the Eye's clock (time_sync), else on the board's
+// Format of a degraded /ach1?adapt= chunk (audio_ladder.h), none set: 24 kHz 16-bit PCM
+#define AUDIO_BLOCK_FLAG_16K        0x04    // 16 kHz, 80 frames per capture block instead of 120
+#define AUDIO_BLOCK_FLAG_BEAM       0x08    // one channel, the mix of the channel_mask microphones
+#define AUDIO_BLOCK_FLAG_MULAW      0x10    // G.711 mu-law, bits_per_sample is 8
+
+// Per-channel statistics of one block, in 16-bit stream units
+typedef struct __attribute__((packed)) {
+    uint16_t peak;
+    uint16_t rms;
+    uint16_t clips;         // samples outside the 16-bit window, saturated on output
+} audio_channel_level_t;
+
+// Prefix of every chunk sent on /ach1?framed=1, little endian
+typedef struct __attribute__((packed)) {
+    char magic[4];          // AUDIO_BLOCK_MAGIC
+    uint32_t seq;           // capture block number of the first frame, AUDIO_RING_BLOCK_FRAMES per block
+    int64_t timestamp_us;   // capture time of the first frame in the block
+    uint16_t frames;
+    uint8_t channels;       // channels in the payload
+    uint8_t bits_per_sample;
+    uint8_t channel_mask;   // bit n set: microphone n is in the payload, in ascending order
+    uint8_t flags;          // AUDIO_BLOCK_FLAG_*
+    audio_channel_level_t level[AUDIO_LEVEL_CHANNELS];  // always all four microphones
+    uint32_t latency_us;    // capture of the first frame to the chunk being handed to the socket
+} audio_block_header_t;
+
+typedef struct {
+    uint32_t peak[AUDIO_LEVEL_CHANNELS];
+    float sum_sq[AUDIO_LEVEL_CHANNELS];
+    uint32_t clips[AUDIO_LEVEL_CHANNELS];
+} audio_level_meter_t;
+
+static inline void audio_meter_reset(audio_level_meter_t *meter) {
+    memset(meter, 0, sizeof(*meter));
+}
+
+// Convert one raw slot (24-bit data left aligned in 32 bits) to the stream
+// sample. Bits 27..12 are kept as before, but samples that do not fit are
+// saturated instead of wrapping around, and counted as clipped.
+static inline int16_t audio_meter_convert(audio_level_meter_t *meter, int ch, uint32_t raw) {
+    int32_t s = (int32_t)raw >> 12;
+    if (s > INT16_MAX) {
+        s = INT16_MAX;
+        meter->clips[ch]++;
+    } else if (s < INT16_MIN) {
+        s = INT16_MIN;
+        meter->clips[ch]++;
+    }
+    uint32_t mag = (uint32_t)(s < 0 ? -s : s);
+    if (mag > meter->peak[ch]) {
+        meter->peak[ch] = mag;
+    }
+    meter->sum_sq[ch] += (float)s * (float)s;
+    return (int16_t)s;
+}
+
+// Fold the finished levels of a sub-block into a meter, for chunks made of several blocks
+static inline void audio_meter_add_levels(audio_level_meter_t *meter, const audio_channel_level_t *levels,
+                                          uint32_t frames) {
+    for (int ch = 0; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+        if (levels[ch].peak > meter->peak[ch]) {
+            meter->peak[ch] = levels[ch].peak;
+        }
+        meter->sum_sq[ch] += (float)levels[ch].rms * levels[ch].rms * frames;
+        meter->clips[ch] += levels[ch].clips;
+    }
+}
+
+static inline void audio_meter_finish(const audio_level_meter_t *meter, uint32_t frames,
+                                      audio_channel_level_t *levels) {
+    for (int ch = 0; ch < AUDIO_LEVEL_CHANNELS; ch++) {
+        levels[ch].peak = meter->peak[ch] > INT16_MAX ? INT16_MAX : meter->peak[ch];
+        levels[ch].rms = frames ? (uint16_t)sqrtf(meter->sum_sq[ch] / frames) : 0;
+        levels[ch].clips = meter->clips[ch] > UINT16_MAX ? UINT16_MAX : meter->clips[ch];
+    }
+}
@@ -0,0 +1,240 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "audio_ring.h"
+
+static const char *TAG = "audio_ring";
+
+#define SEQ_WRITING     UINT32_MAX      // slot is being overwritten, readers must not trust it
+// One live ring of slack past the replay window, so a client resuming at its
+// oldest block is not overrun by the next one produced
+#define REPLAY_SLOTS    (AUDIO_RING_REPLAY_BLOCKS + AUDIO_RING_BLOCKS)
+
+struct audio_ring_subscriber {
+    bool in_use;
+    bool replaying;                     // cursor may be older than the live ring, read from replay
+    TaskHandle_t task;
+    audio_ring_slow_policy_t policy;
+    uint32_t cursor;                    // seq of the next block to read
+    uint32_t dropped_blocks;
+};
+
+// Every slot's seq doubles as a sequence lock: the producer sets it to
+// SEQ_WRITING before touching the slot and to the block number once done, a
+// reader that sees the same block number before and after its copy got a
+// consistent block.
+static audio_ring_block_t *ring;
+static audio_ring_block_t *replay;      // PSRAM, NULL if it could not be allocated
+static uint32_t write_seq = 0;          // seq of the block being written next
+static uint32_t boot_id;                // random per boot, tells a resuming client whether its seq still counts
+static audio_ring_subscriber_t subscribers[AUDIO_RING_MAX_SUBSCRIBERS];
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t audio_ring_init(void) {
+    boot_id = esp_random();
+    ring = heap_caps_calloc(AUDIO_RING_BLOCKS, sizeof(audio_ring_block_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (ring == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u byte ring", (unsigned)(AUDIO_RING_BLOCKS * sizeof(audio_ring_block_t)));
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < AUDIO_RING_BLOCKS; i++) {
+        ring[i].seq = SEQ_WRITING;
+    }
+    // Streaming works without it, only resuming does not
+    replay = heap_caps_calloc(REPLAY_SLOTS, sizeof(audio_ring_block_t), MALLOC_CAP_SPIRAM);
+    if (replay == NULL) {
+        ESP_LOGW(TAG, "Failed to allocate %u byte replay ring, clients cannot resume",
+                 (unsigned)(REPLAY_SLOTS * sizeof(audio_ring_block_t)));
+    } else {
+        for (int i = 0; i < REPLAY_SLOTS; i++) {
+            replay[i].seq = SEQ_WRITING;
+        }
+    }
+    return ESP_OK;
+}
+
+audio_ring_block_t *audio_ring_write_begin(void) {
+    audio_ring_block_t *slot = &ring[write_seq % AUDIO_RING_BLOCKS];
+    __atomic_store_n(&slot->seq, SEQ_WRITING, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return slot;
+}
+
+void audio_ring_write_commit(void) {
+    audio_ring_block_t *slot = &ring[write_seq % AUDIO_RING_BLOCKS];
+    if (replay != NULL) {
+        // Same sequence lock; the copied seq is still SEQ_WRITING until the release below
+        audio_ring_block_t *copy = &replay[write_seq % REPLAY_SLOTS];
+        __atomic_store_n(&copy->seq, SEQ_WRITING, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        memcpy(copy, slot, sizeof(*copy));
+        __atomic_store_n(&copy->seq, write_seq, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&slot->seq, write_seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&write_seq, write_seq + 1, __ATOMIC_RELEASE);
+
+    // No FreeRTOS calls inside the critical section, wake the subscribers after it
+    TaskHandle_t wake[AUDIO_RING_MAX_SUBSCRIBERS];
+    int wake_count = 0;
+    taskENTER_CRITICAL(&ring_lock);
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i].in_use) {
+            wake[wake_count++] = subscribers[i].task;
+        }
+    }
+    taskEXIT_CRITICAL(&ring_lock);
+    for (int i = 0; i < wake_count; i++) {
+        xTaskNotifyGive(wake[i]);
+    }
+}
+
+uint32_t audio_ring_boot_id(void) {
+    return boot_id;
+}
+
+static audio_ring_subscriber_t *subscribe(audio_ring_slow_policy_t policy, bool resume, uint32_t from_seq) {
+    audio_ring_subscriber_t *sub = NULL;
+    taskENTER_CRITICAL(&ring_lock);
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        if (!subscribers[i].in_use) {
+            sub = &subscribers[i];
+            break;
+        }
+    }
+    if (sub != NULL) {
+        uint32_t head = __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE);
+        uint32_t kept = replay == NULL ? 0 : head < AUDIO_RING_REPLAY_BLOCKS ? head : AUDIO_RING_REPLAY_BLOCKS;
+        sub->in_use = true;
+        sub->task = xTaskGetCurrentTaskHandle();
+        sub->policy = policy;
+        sub->cursor = head;
+        sub->dropped_blocks = 0;
+        sub->replaying = false;
+        if (resume && (int32_t)(head - from_seq) > 0) {
+            sub->cursor = head - from_seq > kept ? head - kept : from_seq;
+            sub->dropped_blocks = sub->cursor - from_seq;
+            sub->replaying = sub->cursor != head;
+        }
+    }
+    taskEXIT_CRITICAL(&ring_lock);
+    return sub;
+}
+
+audio_ring_subscriber_t *audio_ring_subscribe(audio_ring_slow_policy_t policy) {
+    return subscribe(policy, false, 0);
+}
+
+audio_ring_subscriber_t *audio_ring_subscribe_from(audio_ring_slow_policy_t policy, uint32_t from_boot_id,
+                                                   uint32_t from_seq) {
+    // The seq of another boot says nothing about this one's blocks
+    return subscribe(policy, from_boot_id == boot_id, from_seq);
+}
+
+void audio_ring_unsubscribe(audio_ring_subscriber_t *sub) {
+    if (sub == NULL) {
+        return;
+    }
+    taskENTER_CRITICAL(&ring_lock);
+    sub->in_use = false;
+    sub->task = NULL;
+    taskEXIT_CRITICAL(&ring_lock);
+}
+
+// The subscriber's next block has been (or is being) overwritten
+static esp_err_t overrun(audio_ring_subscriber_t *sub, uint32_t head) {
+    if (sub->policy == AUDIO_RING_SLOW_DISCONNECT) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Resume half a ring behind the producer so the client has room to catch up.
+    // A replay that got overrun is slower than the capture and would never
+    // catch up, it goes live as well.
+    uint32_t resume = head - AUDIO_RING_BLOCKS / 2;
+    sub->replaying = false;
+    sub->dropped_blocks += resume - sub->cursor;
+    sub->cursor = resume;
+    return ESP_OK;
+}
+
+esp_err_t audio_ring_read(audio_ring_subscriber_t *sub, audio_ring_block_t *out, TickType_t timeout) {
+    while (true) {
+        uint32_t head = __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE);
+        if (head == sub->cursor) {
+            if (ulTaskNotifyTake(pdTRUE, timeout) == 0) {
+                return ESP_ERR_TIMEOUT;
+            }
+            continue;
+        }
+        // The slot of block `head` is the one being overwritten, so a whole ring
+        // behind means the cursor's slot is gone, from the live ring or the replay ring
+        audio_ring_block_t *slot;
+        if (head - sub->cursor < AUDIO_RING_BLOCKS) {
+            sub->replaying = false;
+            slot = &ring[sub->cursor % AUDIO_RING_BLOCKS];
+        } else if (sub->replaying && head - sub->cursor < REPLAY_SLOTS) {
+            slot = &replay[sub->cursor % REPLAY_SLOTS];
+        } else {
+            if (overrun(sub, head) != ESP_OK) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            continue;
+        }
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != sub->cursor) {
+            if (overrun(sub, __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE)) != ESP_OK) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            continue;
+        }
+        memcpy(out, slot, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != sub->cursor) {
+            // The producer lapped us during the copy
+            if (overrun(sub, __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE)) != ESP_OK) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            continue;
+        }
+        sub->cursor++;
+        return ESP_OK;
+    }
+}
+
+uint32_t audio_ring_lag(const audio_ring_subscriber_t *sub) {
+    return __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE) - sub->cursor;
+}
+
+bool audio_ring_replaying(const audio_ring_subscriber_t *sub) {
+    return sub->replaying;
+}
+
+uint8_t audio_ring_subscriber_count(void) {
+    uint8_t count = 0;
+    taskENTER_CRITICAL(&ring_lock);
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        count += subscribers[i].in_use;
+    }
+    taskEXIT_CRITICAL(&ring_lock);
+    return count;
+}
+
+void audio_ring_get_stats(audio_ring_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    uint32_t head = __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE);
+    stats->blocks = head;
+    stats->replay_blocks = replay == NULL ? 0 : AUDIO_RING_REPLAY_BLOCKS;
+    taskENTER_CRITICAL(&ring_lock);
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i].in_use) {
+            stats->subscribers++;
+            stats->sub[i].active = true;
+            stats->sub[i].replaying = subscribers[i].replaying;
+            stats->sub[i].policy = subscribers[i].policy;
+            stats->sub[i].lag_blocks = head - subscribers[i].cursor;
+            stats->sub[i].dropped_blocks = subscribers[i].dropped_blocks;
+        }
+    }
+    taskEXIT_CRITICAL(&ring_lock);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "audio_levels.h"
+
+// Single producer, multi subscriber ring for the captured audio
+//
+// The capture task in main.c is the only reader of the I2S ports. It converts
+// every block once and writes it into the ring. Each streaming client reads
+// through its own cursor, so extra clients cost a copy each, not another
+// capture. The producer never waits for a reader. A subscriber that falls a
+// whole ring behind either skips ahead to recent audio (AUDIO_RING_SLOW_DROP)
+// or is told to disconnect (AUDIO_RING_SLOW_DISCONNECT).
+//
+// The producer also copies every block into a much longer replay ring in
+// PSRAM. A client that lost its connection subscribes again with
+// audio_ring_subscribe_from() and the block it is missing; it reads the
+// backlog from PSRAM, as fast as it can send, until it is back within the
+// live ring and continues like any other subscriber. Only the live ring is
+// read at capture pace, so PSRAM sees one write per block and reads only
+// while somebody catches up.
+
+#define AUDIO_RING_CHANNELS         4
+#define AUDIO_RING_BLOCK_FRAMES     120     // 5 ms at 24 kHz, one RTP packet
+#define AUDIO_RING_BLOCKS           64      // ~320 ms of slack for a slow client
+#define AUDIO_RING_MAX_SUBSCRIBERS  4
+#define AUDIO_RING_REPLAY_MS        5000    // how far back a reconnecting client can resume
+#define AUDIO_RING_REPLAY_BLOCKS    (AUDIO_RING_REPLAY_MS / 5)     // ~1 MB of PSRAM
+
+typedef struct {
+    uint32_t seq;                   // block number since boot, a jump means blocks were skipped
+    int64_t timestamp_us;           // esp_timer time when capture of the block started
+    audio_channel_level_t level[AUDIO_RING_CHANNELS];
+    int16_t samples[AUDIO_RING_BLOCK_FRAMES * AUDIO_RING_CHANNELS];
+} audio_ring_block_t;
+
+typedef enum {
+    AUDIO_RING_SLOW_DROP,           // skip ahead, the skipped blocks are counted
+    AUDIO_RING_SLOW_DISCONNECT,     // audio_ring_read() fails, the client should be closed
+} audio_ring_slow_policy_t;
+
+typedef struct audio_ring_subscriber audio_ring_subscriber_t;
+
+typedef struct {
+    uint32_t blocks;                // blocks produced since boot
+    uint8_t subscribers;
+    uint32_t replay_blocks;         // AUDIO_RING_REPLAY_BLOCKS, 0 when the PSRAM ring could not be allocated
+    struct {
+        bool active;
+        bool replaying;             // reading the backlog from PSRAM
+        audio_ring_slow_policy_t policy;
+        uint32_t lag_blocks;        // how far the subscriber is behind the producer
+        uint32_t dropped_blocks;
+    } sub[AUDIO_RING_MAX_SUBSCRIBERS];
+} audio_ring_stats_t;
+
+esp_err_t audio_ring_init(void);
+
+// Producer side: fill the returned block (everything but seq), then commit it.
+// Only one task may write.
+audio_ring_block_t *audio_ring_write_begin(void);
+void audio_ring_write_commit(void);
+
+// Subscriber side. audio_ring_subscribe() returns NULL when AUDIO_RING_MAX_SUBSCRIBERS
+// are already reading. Reading starts with the next block produced. The
+// subscriber is woken through its task notification, so every subscriber
+// has to be read from the task that subscribed it.
+audio_ring_subscriber_t *audio_ring_subscribe(audio_ring_slow_policy_t policy);
+
+// Random number drawn by audio_ring_init(). Block numbers restart with every
+// boot, a client resuming has to know they are still the ones it counted.
+uint32_t audio_ring_boot_id(void);
+
+// Like audio_ring_subscribe(), but reading starts with block from_seq while it is
+// within the last AUDIO_RING_REPLAY_BLOCKS. Blocks older than that are counted
+// as dropped and reading starts with the oldest one kept. A from_seq the
+// producer has not reached yet starts with the next block. from_boot_id is the
+// audio_ring_boot_id() the client got its from_seq from; when the board has
+// restarted since, from_seq is ignored and reading starts with the next block.
+audio_ring_subscriber_t *audio_ring_subscribe_from(audio_ring_slow_policy_t policy, uint32_t from_boot_id,
+                                                   uint32_t from_seq);
+void audio_ring_unsubscribe(audio_ring_subscriber_t *sub);
+
+// True until a subscriber from audio_ring_subscribe_from() has caught up with the live ring
+bool audio_ring_replaying(const audio_ring_subscriber_t *sub);
+
+// Copy the subscriber's next block into out. Returns ESP_ERR_TIMEOUT if no block
+// was produced in time, ESP_ERR_INVALID_STATE when a DISCONNECT subscriber fell behind.
+esp_err_t audio_ring_read(audio_ring_subscriber_t *sub, audio_ring_block_t *out, TickType_t timeout);
+
+// Blocks produced that the subscriber has not read yet. For a stream this is
+// its send backlog: it grows while the socket holds the task up.
+uint32_t audio_ring_lag(const audio_ring_subscriber_t *sub);
+
+uint8_t audio_ring_subscriber_count(void);
+void audio_ring_get_stats(audio_ring_stats_t *stats);
@@ -9,13 +9,33 @@
 #include "freertos/semphr.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "lwip/sockets.h"
 #include "esp_mac.h"
+#include "esp_now.h"
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
 #include "esp_task_wdt.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_idf_version.h"
 #include "soc/i2s_struct.h"
 #include "string.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sound_events.h"
+#include "audio_levels.h"
+#include "rtp_audio.h"
+#include "audio_ring.h"
+#include "audio_ladder.h"
+#include "stream_socket.h"
+#include "cpu_load.h"
+#include "espnow_audio.h"
+#include "time_sync_net.h"
+#include "net_bench.h"
+#include "stream_frame.h"
+#include "wifi_cache.h"
 
 // WiFi configuration
 // #define EXAMPLE_ESP_WIFI_SSID      "test_ssid"
@@ -32,27 +52,189 @@
 #define I2S_BITS_PER_SAMPLE       I2S_BITS_PER_SAMPLE_32BIT
 #define I2S_DMA_BUF_COUNT         8
 #define I2S_DMA_BUF_LEN           128
-#define BUFFER_SIZE               8192 * 2
+
+// Capture and fan-out. One capture task reads the microphones into the audio
+// ring (audio_ring.h), every /ach1 and RTP client reads the ring.
+#define CAPTURE_TASK_PRIORITY     (tskIDLE_PRIORITY + 6)  // above the stream tasks, it must never fall behind
+#define STREAM_TASK_PRIORITY      (tskIDLE_PRIORITY + 5)
+#define AUDIO_BLOCK_MS            (AUDIO_RING_BLOCK_FRAMES * 1000 / I2S_SAMPLE_RATE)   // 5 ms
+#define ACH1_DEFAULT_BLOCK_MS     40                      // /ach1 chunk length, ?block_ms= overrides it
+#define ACH1_MAX_BLOCK_MS         170                     // the old fill-then-send buffer
+#define STREAM_READ_TIMEOUT_MS    1000
+
+// Burst capture into PSRAM
+#define BURST_MAX_BYTES           (6 * 1024 * 1024)   // leave PSRAM headroom for WiFi/lwIP
+#define BURST_MIN_RATE            8000
+#define BURST_MAX_RATE            48000
+#define BURST_READ_FRAMES         256
+#define BURST_SEND_BYTES          16384
+
+// Low-latency RTP mode, the client has to repeat its /rtp request within this time
+#define RTP_KEEPALIVE_MS          10000
+
+_Static_assert(AUDIO_RING_BLOCK_FRAMES <= RTP_AUDIO_FRAMES_PER_PACKET, "a ring block must fit in one RTP packet");
+
+// ESP-NOW link to the Eye (the access point), renewed like /rtp
+#define ESPNOW_KEEPALIVE_MS       10000
+#define ESPNOW_PHY_RATE           WIFI_PHY_RATE_24M   // the 1 Mbps default cannot carry more than one channel
+
+_Static_assert(AUDIO_RING_BLOCK_FRAMES <= ESPNOW_AUDIO_MAX_FRAMES, "a ring block must fit in one ESP-NOW block");
+
+// Sound event classifier
+#define SOUND_EVENTS_BENCHMARK_RUNS 20  // inferences timed at boot for /status, 0 to skip
 
 static const char *TAG = "WiFi_AP_Audio_Stream";
 
-// Audio buffers with volatile qualifier
-static volatile uint16_t audio_buffer_0a[BUFFER_SIZE];
-static volatile uint16_t audio_buffer_0b[BUFFER_SIZE];
-size_t bufIndexA = 0;
-size_t bufIndexB = 0;
-static volatile bool buffer_sel = true;
+// Held by the capture task while it reads a block; /burst takes it to borrow the I2S ports
+static SemaphoreHandle_t capture_mutex = NULL;
+
+// Levels of the most recently captured block, for /status
+static audio_channel_level_t last_levels[4];
+static uint32_t block_seq = 0;
+static int64_t last_block_us = 0;
+static portMUX_TYPE levels_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Cold start milestones in ms since the app started (esp_timer, the
+// bootloader before it is not included), 0 until reached. Battery swaps and
+// brownouts restart the board in the field; first_byte_ms is how long the
+// microphones were gone for the clients.
+typedef struct {
+    bool fast_connect;          // the first association used the cached access point
+    uint32_t wifi_start_ms;
+    uint32_t connected_ms;      // first association
+    uint32_t first_block_ms;    // first block captured
+    uint32_t first_byte_ms;     // first audio handed to a client's socket, /ach1, RTP or ESP-NOW
+    uint32_t reconnect_ms;      // last link loss to association again
+} boot_timing_t;
+
+static boot_timing_t boot_timing;
+
+// Station target: the cached access point (wifi_cache.h) or a scan for the SSID
+static wifi_config_t sta_config;
+static wifi_cache_t wifi_cached;
+static bool wifi_have_cache = false;
+static bool wifi_pinned = false;        // sta_config points at the cached access point
+static bool wifi_connected = false;
+static int64_t wifi_lost_us = 0;
 
-// Synchronization primitives
-//static SemaphoreHandle_t buffer_mutex = NULL;
-static volatile bool stream_active = false;
+// Capture-to-socket latency of a stream: from the capture of a chunk's first
+// frame until the chunk is handed to the socket, and how long that send took
+typedef struct {
+    uint32_t chunks;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t max_send_us;
+} stream_latency_t;
+
+// Per /ach1 client view for /status, written by the stream tasks
+typedef struct {
+    bool active;
+    bool raw;
+    bool nodelay;
+    uint16_t block_ms;
+    audio_quality_t quality;        // current rung of ?adapt= streams, always full otherwise
+    uint32_t steps_down;
+    uint32_t steps_up;
+    stream_latency_t latency;
+} ach1_client_t;
+
+static ach1_client_t ach1_clients[AUDIO_RING_MAX_SUBSCRIBERS];
+static stream_latency_t rtp_latency;
+static stream_latency_t espnow_latency;
+static portMUX_TYPE streams_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    httpd_req_t *req;       // async copy of the request, owned by the stream task
+    bool framed;
+    bool container;         // stream_frame.h frames instead of block headers, ?container=1
+    bool raw;               // write to the socket directly instead of chunked through httpd
+    bool nodelay;           // TCP_NODELAY, small chunks leave without waiting for an ACK
+    uint8_t blocks_per_chunk;
+    audio_quality_t lowest; // ?adapt= floor, AUDIO_QUALITY_FULL when not adaptive
+    bool resume;            // ?from_seq= given, replay from there
+    uint32_t from_seq;
+    uint32_t from_boot_id;  // ?boot_id=, the X-Audio-Boot-Id from_seq was counted in
+    int client;             // index in ach1_clients, -1 if none
+    stream_socket_t out;
+    audio_ring_slow_policy_t slow;
+    uint8_t channel_mask;   // microphones to send, bit n = channel n
+    uint8_t channel_count;
+    uint8_t channel_map[4];
+    char channels_hdr[4];   // header values must outlive the handler, keep them here
+    char channel_map_hdr[8];
+    char block_ms_hdr[8];
+    char replay_hdr[12];
+    char boot_id_hdr[12];
+    audio_ring_block_t block;
+    audio_ladder_t ladder;  // converts every block to the chunk format, full quality unless adaptive
+    uint8_t *chunk;         // blocks_per_chunk blocks in the current format
+} ach1_stream_ctx_t;
+
+// RTP mode, owned by rtp_stream_task while it runs
+typedef struct {
+    rtp_audio_session_t session;
+    uint32_t peer_addr;
+    uint16_t port;
+    uint8_t channel_count;
+    uint8_t channel_map[4];
+    char channel_map_hdr[8];
+    volatile int64_t deadline_us;   // stream stops when no keepalive arrived by then
+    audio_ring_block_t block;
+} rtp_stream_t;
+
+static rtp_stream_t rtp_stream;
+static volatile bool rtp_active = false;
+
+// One /burst, owned by burst_task while it runs
+typedef struct {
+    httpd_req_t *req;       // async copy of the request
+    uint32_t rate;
+    uint32_t frames;
+    size_t data_bytes;
+    uint32_t *capture;      // PSRAM, frames * 4 channels
+} burst_t;
+
+static volatile bool burst_active = false;
+
+// ESP-NOW mode, owned by espnow_stream_task while it runs. One ring block is
+// sent as espnow_audio_fragment_count() frames to the access point's MAC.
+typedef struct {
+    uint32_t requester_addr;        // host that keeps the stream alive, normally the Eye
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    uint8_t channel_mask;
+    uint8_t channel_count;
+    uint8_t channel_map[4];
+    char channel_map_hdr[8];
+    volatile int64_t deadline_us;
+    uint32_t packets;
+    uint32_t send_errors;           // not queued by esp_now_send, never retried
+    volatile uint32_t tx_failures;  // not acknowledged by the peer, from the send callback
+    audio_ring_block_t block;
+    uint8_t packet[ESPNOW_AUDIO_MAX_PACKET];
+} espnow_stream_t;
+
+static espnow_stream_t espnow_stream;
+static volatile bool espnow_active = false;
+static bool espnow_ready = false;
+
+// Incremented from the I2S ISR whenever the DMA queue overflows, i.e. samples were lost
+static volatile uint32_t i2s_overflow_count = 0;
 
 // Forward declarations
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static esp_err_t wifi_init_sta(void);
+static esp_err_t wifi_set_target(bool pinned);
+static bool boot_mark(uint32_t *milestone);
 void setup_i2s(void);
 static esp_err_t ach1_handler(httpd_req_t *req);
+static esp_err_t burst_handler(httpd_req_t *req);
+static void burst_task(void *arg);
+static esp_err_t status_handler(httpd_req_t *req);
+static esp_err_t rtp_handler(httpd_req_t *req);
+static esp_err_t espnow_handler(httpd_req_t *req);
 static void start_webserver(void);
+static void capture_task(void *arg);
 //static void i2s_sampling_task(void *arg);
 //static void wifi_task(void *arg);
 
@@ -63,9 +245,35 @@ i2s_chan_handle_t rx_handle_1;
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     if (event_base == WIFI_EVENT) {
         if (event_id == WIFI_EVENT_STA_START) {
-            ESP_LOGI(TAG, "WiFi station started, attempting to connect...");
+            ESP_LOGI(TAG, "WiFi station started, attempting to connect%s...", wifi_pinned ? " to the cached AP" : "");
             esp_wifi_connect();
+        } else if (event_id == WIFI_EVENT_STA_CONNECTED) {
+            wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+            wifi_cache_t ap = { .channel = event->channel };
+            memcpy(ap.bssid, event->bssid, sizeof(ap.bssid));
+            if (boot_mark(&boot_timing.connected_ms)) {
+                boot_timing.fast_connect = wifi_pinned;
+            }
+            if (wifi_lost_us != 0) {
+                boot_timing.reconnect_ms = (uint32_t)((esp_timer_get_time() - wifi_lost_us) / 1000);
+            }
+            wifi_connected = true;
+            ESP_LOGI(TAG, "WiFi associated on channel %u%s", ap.channel, wifi_pinned ? " (cached)" : "");
+            if (!wifi_have_cache || memcmp(&ap, &wifi_cached, sizeof(ap)) != 0) {
+                wifi_cached = ap;
+                wifi_have_cache = true;
+                wifi_cache_save(&ap);
+            }
         } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+            if (wifi_connected) {
+                // Lost the link, the access point is most likely still where it was
+                wifi_connected = false;
+                wifi_lost_us = esp_timer_get_time();
+                wifi_set_target(true);
+            } else if (wifi_pinned) {
+                ESP_LOGW(TAG, "Cached AP not found on channel %u, scanning", wifi_cached.channel);
+                wifi_set_target(false);
+            }
             ESP_LOGI(TAG, "WiFi disconnected, attempting to reconnect...");
             esp_wifi_connect();
         }
@@ -77,6 +285,24 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
     }
 }
 
+// Marks a boot_timing milestone once, returns true the first time
+static bool boot_mark(uint32_t *milestone) {
+    uint32_t unset = 0;
+    uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+    return __atomic_load_n(milestone, __ATOMIC_RELAXED) == 0 &&
+           __atomic_compare_exchange_n(milestone, &unset, ms ? ms : 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Pinned: associate with the cached access point, probing only its channel.
+// Otherwise scan all channels for the SSID.
+static esp_err_t wifi_set_target(bool pinned) {
+    wifi_pinned = pinned && wifi_have_cache;
+    sta_config.sta.channel = wifi_pinned ? wifi_cached.channel : 0;
+    sta_config.sta.bssid_set = wifi_pinned;
+    memcpy(sta_config.sta.bssid, wifi_cached.bssid, sizeof(sta_config.sta.bssid));
+    return esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+}
+
 // Replace wifi_init_softap with wifi_init_sta
 static esp_err_t wifi_init_sta(void) {
     esp_err_t ret;
@@ -147,7 +373,7 @@ static esp_err_t wifi_init_sta(void) {
     }
     
     // Configure with station mode parameters
-    wifi_config_t wifi_config = {
+    sta_config = (wifi_config_t){
         .sta = {
             .ssid = EXAMPLE_ESP_WIFI_SSID,
             .password = EXAMPLE_ESP_WIFI_PASS,
@@ -158,6 +384,7 @@ static esp_err_t wifi_init_sta(void) {
             },
         },
     };
+    wifi_have_cache = wifi_cache_load(&wifi_cached);
     
     ret = esp_wifi_set_mode(WIFI_MODE_STA);
     if (ret != ESP_OK) {
@@ -165,12 +392,13 @@ static esp_err_t wifi_init_sta(void) {
         return ret;
     }
     
-    ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    ret = wifi_set_target(true);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set WiFi config");
         return ret;
     }
     
+    boot_mark(&boot_timing.wifi_start_ms);
     ret = esp_wifi_start();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start WiFi");
@@ -185,7 +413,16 @@ static esp_err_t wifi_init_sta(void) {
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
 
+static IRAM_ATTR bool i2s_rx_overflow_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx) {
+    i2s_overflow_count++;
+    return false;
+}
+
 void setup_i2s(void) {
+    i2s_event_callbacks_t rx_callbacks = {
+        .on_recv_q_ovf = i2s_rx_overflow_cb,
+    };
+
     ESP_LOGI("I2S", "Initializing I2S peripherals...");
     // === Configure First I2S Peripheral (I2S_NUM_0) ===
     // Define the I2S channel configuration for RX
@@ -221,6 +458,8 @@ void setup_i2s(void) {
         return;
     }
 
+    i2s_channel_register_event_callback(rx_handle_0, &rx_callbacks, NULL);
+
     // Enable the RX channel to start receiving data
     if (i2s_channel_enable(rx_handle_0) != ESP_OK) {
         ESP_LOGE("I2S", "Failed to enable I2S_0 RX channel");
@@ -260,6 +499,8 @@ void setup_i2s(void) {
         return;
     }
 
+    i2s_channel_register_event_callback(rx_handle_1, &rx_callbacks, NULL);
+
     // Enable the RX channel to start receiving data
     if (i2s_channel_enable(rx_handle_1) != ESP_OK) {
         ESP_LOGE("I2S", "Failed to enable I2S_1 RX channel");
@@ -290,6 +531,34 @@ static void start_webserver(void) {
             .user_ctx  = NULL
         };
         
+        httpd_uri_t burst_uri = {
+            .uri       = "/burst",
+            .method    = HTTP_GET,
+            .handler   = burst_handler,
+            .user_ctx  = NULL
+        };
+        
+        httpd_uri_t status_uri = {
+            .uri       = "/status",
+            .method    = HTTP_GET,
+            .handler   = status_handler,
+            .user_ctx  = NULL
+        };
+        
+        httpd_uri_t rtp_uri = {
+            .uri       = "/rtp",
+            .method    = HTTP_GET,
+            .handler   = rtp_handler,
+            .user_ctx  = NULL
+        };
+
+        httpd_uri_t espnow_uri = {
+            .uri       = "/espnow",
+            .method    = HTTP_GET,
+            .handler   = espnow_handler,
+            .user_ctx  = NULL
+        };
+        
         // Register URI handlers
         ret = httpd_register_uri_handler(server, &audio_stream);
         if (ret == ESP_OK) {
@@ -297,6 +566,26 @@ static void start_webserver(void) {
         } else {
             ESP_LOGE(TAG, "Failed to register URI handler: %s", esp_err_to_name(ret));
         }
+        ret = httpd_register_uri_handler(server, &burst_uri);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register burst handler: %s", esp_err_to_name(ret));
+        }
+        ret = httpd_register_uri_handler(server, &status_uri);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register status handler: %s", esp_err_to_name(ret));
+        }
+        ret = httpd_register_uri_handler(server, &rtp_uri);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register RTP handler: %s", esp_err_to_name(ret));
+        }
+        ret = httpd_register_uri_handler(server, &espnow_uri);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register ESP-NOW handler: %s", esp_err_to_name(ret));
+        }
+        ret = net_bench_register(server, STREAM_TASK_PRIORITY);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register bench handler: %s", esp_err_to_name(ret));
+        }
     } else {
         ESP_LOGE(TAG, "Failed to start server: %s", esp_err_to_name(ret));
     }
@@ -325,6 +614,11 @@ void app_main(void) {
     }
     ESP_LOGI(TAG, "WiFi Initilization Successful");
 
+    // Stream timestamps follow the Eye's clock once this has synchronized
+    if (time_sync_client_start(ip_gw, TIME_SYNC_PORT) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start time sync");
+    }
+
     // Give some time for WiFi to initialize
     //vTaskDelay(pdMS_TO_TICKS(1000));
     
@@ -337,6 +631,18 @@ void app_main(void) {
 
     // Initialize I2S
     setup_i2s();
+
+    // Start the capture task that feeds every audio consumer
+    capture_mutex = xSemaphoreCreateMutex();
+    if (audio_ring_init() != ESP_OK || capture_mutex == NULL ||
+        xTaskCreatePinnedToCore(capture_task, "capture", 4096, NULL, CAPTURE_TASK_PRIORITY, NULL, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start audio capture");
+    }
+
+    if (SOUND_EVENTS_BENCHMARK_RUNS > 0) {
+        sound_events_benchmark(SOUND_EVENTS_BENCHMARK_RUNS);
+    }
+    sound_events_start();
     
     ESP_LOGI(TAG, "Application initialization completed");
 }
@@ -348,76 +654,1221 @@ void app_main(void) {
 //for multiple channels and "audio/raw", the data is expected to be interleaved
 // ex: [sample0, sample1] for two channels or [sample0, sample1, sample2, sample3] for four channels
 // audio is packed the same way in .wav format, so it should be easy to take this and make a .wav file with two or four channels 
-static esp_err_t ach1_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "Audio handler started");
+// Copies the requested channels of an interleaved 4-channel buffer to out (which
+// may be the input itself), returns the number of samples written
+static size_t pack_channels(const int16_t *in, size_t frames, const uint8_t *channel_map, uint8_t channel_count,
+                            int16_t *out) {
+    size_t n = 0;
+    for (size_t i = 0; i < frames * 4; i += 4) {
+        for (uint8_t c = 0; c < channel_count; c++) {
+            out[n++] = in[i + channel_map[c]];
+        }
+    }
+    return n;
+}
+
+// Fills channel_map (and its "0,2" header form) from a channel mask, returns the channel count
+static uint8_t channel_map_from_mask(uint8_t mask, uint8_t *channel_map, char *map_hdr, size_t map_hdr_size) {
+    uint8_t count = 0;
+    size_t map_len = 0;
+    for (uint8_t ch = 0; ch < 4; ch++) {
+        if (mask & (1 << ch)) {
+            channel_map[count++] = ch;
+            map_len += snprintf(map_hdr + map_len, map_hdr_size - map_len, "%s%u", map_len ? "," : "", ch);
+        }
+    }
+    return count;
+}
+
+// Parses a "0,2" style channel list into a bit mask, 0 if the list is invalid
+static uint8_t parse_channel_list(const char *list) {
+    uint8_t mask = 0;
+    for (const char *p = list; *p; p++) {
+        if (*p >= '0' && *p <= '3') {
+            mask |= 1 << (*p - '0');
+        } else if (*p != ',') {
+            return 0;
+        }
+    }
+    return mask;
+}
+
+static void fill_audio_buffer(int16_t *buffer, size_t frames, audio_level_meter_t *meter) {
+    size_t bytes_read = 0;
+    uint32_t raw_sample[4];  // Buffer to hold raw left0, right0, left1, and right1 samples
+
+    audio_meter_reset(meter);
+    for (size_t i = 0; i < frames * 4; i += 4) {
+        if ((i2s_channel_read(rx_handle_0, raw_sample, sizeof(uint32_t) * 2, &bytes_read, portMAX_DELAY)) == ESP_OK &&\
+            (i2s_channel_read(rx_handle_1, &raw_sample[2], sizeof(uint32_t) * 2, &bytes_read, portMAX_DELAY)) == ESP_OK) {
+            buffer[i] = audio_meter_convert(meter, 0, raw_sample[0]);
+            buffer[i+1] = audio_meter_convert(meter, 1, raw_sample[1]);
+            buffer[i+2] = audio_meter_convert(meter, 2, raw_sample[2]);
+            buffer[i+3] = audio_meter_convert(meter, 3, raw_sample[3]);
+        }
+    }
+}
+
+// Makes a finished block's levels visible to /status, returns the block's sequence number
+static uint32_t publish_levels(const audio_level_meter_t *meter, uint32_t frames, int64_t block_start_us,
+                               audio_channel_level_t *levels) {
+    taskENTER_CRITICAL(&levels_lock);
+    audio_meter_finish(meter, frames, last_levels);
+    memcpy(levels, last_levels, sizeof(last_levels));
+    uint32_t seq = block_seq++;
+    last_block_us = block_start_us;
+    taskEXIT_CRITICAL(&levels_lock);
+    return seq;
+}
+
+// The only reader of the I2S ports. Every block is converted and metered once,
+// handed to the classifier and published in the ring for the stream clients.
+static void capture_task(void *arg) {
+    audio_level_meter_t meter;
+    while (true) {
+        xSemaphoreTake(capture_mutex, portMAX_DELAY);
+        audio_ring_block_t *block = audio_ring_write_begin();
+        block->timestamp_us = esp_timer_get_time();
+        fill_audio_buffer(block->samples, AUDIO_RING_BLOCK_FRAMES, &meter);
+        xSemaphoreGive(capture_mutex);
+
+        publish_levels(&meter, AUDIO_RING_BLOCK_FRAMES, block->timestamp_us, block->level);
+        sound_events_feed(block->samples, AUDIO_RING_BLOCK_FRAMES * 4, block->timestamp_us);
+        audio_ring_write_commit();
+        boot_mark(&boot_timing.first_block_ms);
+    }
+}
+
+// Capture times leave the board on the Eye's clock once time_sync is
+// synchronized, so both arm boards and the camera share one time base. Until
+// then, and for the latency figures measured here, they are esp_timer times.
+static int64_t stream_timestamp(int64_t local_us, bool *synced) {
+    *synced = time_sync_synced();
+    return *synced ? time_sync_to_master(local_us) : local_us;
+}
+
+static void stream_latency_add(stream_latency_t *latency, uint32_t latency_us, uint32_t send_us) {
+    if (boot_mark(&boot_timing.first_byte_ms)) {
+        ESP_LOGI(TAG, "First audio sent %lu ms after boot, associated at %lu ms%s",
+                 (unsigned long)boot_timing.first_byte_ms, (unsigned long)boot_timing.connected_ms,
+                 boot_timing.fast_connect ? " through the cached AP" : "");
+    }
+    taskENTER_CRITICAL(&streams_lock);
+    latency->chunks++;
+    latency->last_us = latency_us;
+    latency->total_us += latency_us;
+    if (latency_us > latency->max_us) {
+        latency->max_us = latency_us;
+    }
+    if (send_us > latency->max_send_us) {
+        latency->max_send_us = send_us;
+    }
+    taskEXIT_CRITICAL(&streams_lock);
+}
+
+static int ach1_client_claim(const ach1_stream_ctx_t *ctx) {
+    int client = -1;
+    taskENTER_CRITICAL(&streams_lock);
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        if (!ach1_clients[i].active) {
+            ach1_clients[i] = (ach1_client_t){
+                .active = true,
+                .raw = ctx->raw,
+                .nodelay = ctx->nodelay,
+                .block_ms = ctx->blocks_per_chunk * AUDIO_BLOCK_MS,
+            };
+            client = i;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&streams_lock);
+    return client;
+}
+
+// Publishes a rung change of an adaptive stream to /status
+static void ach1_client_set_quality(const ach1_stream_ctx_t *ctx) {
+    if (ctx->client < 0) {
+        return;
+    }
+    taskENTER_CRITICAL(&streams_lock);
+    ach1_clients[ctx->client].quality = ctx->ladder.quality;
+    ach1_clients[ctx->client].steps_down = ctx->ladder.steps_down;
+    ach1_clients[ctx->client].steps_up = ctx->ladder.steps_up;
+    taskEXIT_CRITICAL(&streams_lock);
+}
+
+_Static_assert(sizeof(((stream_frame_levels_t *)0)->level) == sizeof(((audio_block_header_t *)0)->level),
+               "the levels frame carries the block header's levels");
+
+// The chunk as two stream_frame.h frames, its levels and then its samples,
+// from the block header ach1_send_chunk() filled in
+static esp_err_t ach1_send_frames(ach1_stream_ctx_t *ctx, const audio_block_header_t *header, size_t len) {
+    stream_frame_levels_t levels;
+    stream_frame_header_t frames[2];
+    uint8_t codec = (header->flags & AUDIO_BLOCK_FLAG_MULAW) ? STREAM_CODEC_MULAW_16K :
+                    (header->flags & AUDIO_BLOCK_FLAG_16K) ? STREAM_CODEC_PCM16_16K : STREAM_CODEC_PCM16_24K;
+    uint8_t flags = ((header->flags & AUDIO_BLOCK_FLAG_SYNCED) ? STREAM_FRAME_FLAG_SYNCED : 0) |
+                    ((header->flags & AUDIO_BLOCK_FLAG_BEAM) ? STREAM_FRAME_FLAG_BEAM : 0);
+    memcpy(levels.level, header->level, sizeof(levels.level));
+    levels.latency_us = header->latency_us;
+    stream_frame_encode(&frames[0], 0, STREAM_CODEC_LEVELS, header->seq, header->timestamp_us,
+                        header->channel_mask, flags, &levels, sizeof(levels));
+    stream_frame_encode(&frames[1], 0, codec, header->seq, header->timestamp_us,
+                        header->channel_mask, flags, ctx->chunk, len);
+    struct iovec iov[4] = {
+        { .iov_base = &frames[0], .iov_len = sizeof(frames[0]) },
+        { .iov_base = &levels, .iov_len = sizeof(levels) },
+        { .iov_base = &frames[1], .iov_len = sizeof(frames[1]) },
+        { .iov_base = ctx->chunk, .iov_len = len },
+    };
+    if (ctx->raw) {
+        return stream_socket_writev(&ctx->out, iov, 4);
+    }
     esp_err_t res = ESP_OK;
-    
-        // Set response type and headers
-    if ((res = httpd_resp_set_type(req, "audio/raw")) != ESP_OK) {
+    for (int i = 0; i < 4 && res == ESP_OK; i++) {
+        res = httpd_resp_send_chunk(ctx->req, iov[i].iov_base, iov[i].iov_len);
+    }
+    return res;
+}
+
+// Sends the chunk of `blocks` capture blocks, len bytes in ctx->chunk in the given format
+static esp_err_t ach1_send_chunk(ach1_stream_ctx_t *ctx, audio_block_header_t *header,
+                                 const audio_level_meter_t *levels, uint8_t blocks,
+                                 const audio_ladder_format_t *format, size_t len) {
+    esp_err_t res = ESP_OK;
+    int64_t send_start_us = esp_timer_get_time();
+    uint32_t latency_us = (uint32_t)(send_start_us - header->timestamp_us);
+    if (ctx->framed) {
+        bool synced;
+        header->frames = blocks * format->block_frames;
+        header->channels = format->channels;
+        header->bits_per_sample = format->bits_per_sample;
+        header->channel_mask = format->channel_mask;
+        header->latency_us = latency_us;
+        header->timestamp_us = stream_timestamp(header->timestamp_us, &synced);
+        header->flags = format->flags | (synced ? AUDIO_BLOCK_FLAG_SYNCED : 0);
+        // The levels are of the capture, all four microphones at 24 kHz whatever the format
+        audio_meter_finish(levels, blocks * AUDIO_RING_BLOCK_FRAMES, header->level);
+    }
+    if (ctx->container) {
+        res = ach1_send_frames(ctx, header, len);
+    } else if (ctx->raw) {
+        // Header and samples in one writev
+        struct iovec iov[2] = {
+            { .iov_base = header, .iov_len = sizeof(*header) },
+            { .iov_base = ctx->chunk, .iov_len = len },
+        };
+        res = ctx->framed ? stream_socket_writev(&ctx->out, iov, 2) : stream_socket_writev(&ctx->out, &iov[1], 1);
+    } else {
+        if (ctx->framed) {
+            res = httpd_resp_send_chunk(ctx->req, (const char *)header, sizeof(*header));
+        }
+        if (res == ESP_OK) {
+            res = httpd_resp_send_chunk(ctx->req, (const char *)ctx->chunk, len);
+        }
+    }
+    if (ctx->client >= 0) {
+        stream_latency_add(&ach1_clients[ctx->client].latency, latency_us,
+                           (uint32_t)(esp_timer_get_time() - send_start_us));
+    }
+    return res;
+}
+
+// Streams until the client goes away. Runs on its own task so /status and the
+// other URIs keep being served while audio is flowing. Ring blocks are
+// gathered into chunks of blocks_per_chunk; a gap in the block numbers
+// (the client was too slow and blocks were dropped) ends the chunk early, so
+// every framed chunk is contiguous audio. So does a rung change of an
+// adaptive stream, so every chunk has one format.
+static void ach1_stream_task(void *arg) {
+    ach1_stream_ctx_t *ctx = (ach1_stream_ctx_t *)arg;
+    httpd_req_t *req = ctx->req;
+    esp_err_t res = ESP_OK;
+    audio_level_meter_t levels;
+    audio_block_header_t header = {
+        .magic = AUDIO_BLOCK_MAGIC,
+    };
+    audio_ladder_format_t format;
+    uint8_t blocks = 0;
+    size_t chunk_bytes = 0;
+    audio_ring_subscriber_t *sub = NULL;
+
+    ctx->client = -1;
+    audio_ladder_init(&ctx->ladder, ctx->channel_mask, ctx->lowest, esp_timer_get_time());
+    audio_ladder_get_format(&ctx->ladder, &format);
+    // Full quality is the largest format
+    ctx->chunk = malloc((size_t)ctx->blocks_per_chunk * AUDIO_RING_BLOCK_FRAMES * ctx->channel_count * sizeof(int16_t));
+    if (ctx->chunk == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        goto cleanup;
+    }
+    sub = ctx->resume ? audio_ring_subscribe_from(ctx->slow, ctx->from_boot_id, ctx->from_seq)
+                      : audio_ring_subscribe(ctx->slow);
+    if (sub == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Too many audio clients");
+        goto cleanup;
+    }
+    ctx->client = ach1_client_claim(ctx);
+    snprintf(ctx->replay_hdr, sizeof(ctx->replay_hdr), "%lu", (unsigned long)audio_ring_lag(sub));
+    snprintf(ctx->boot_id_hdr, sizeof(ctx->boot_id_hdr), "%08lx", (unsigned long)audio_ring_boot_id());
+    if (ctx->resume && ctx->from_boot_id != audio_ring_boot_id()) {
+        ESP_LOGI(TAG, "Audio client %d resumes from before a restart, starting live", ctx->client);
+    } else if (ctx->resume) {
+        ESP_LOGI(TAG, "Audio client %d resumes at block %lu, %s blocks to replay", ctx->client,
+                 (unsigned long)ctx->from_seq, ctx->replay_hdr);
+    }
+
+    if (ctx->nodelay) {
+        // Without it lwIP holds a small chunk back until the previous one is acknowledged
+        int one = 1;
+        setsockopt(httpd_req_to_sockfd(req), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    // WMM voice, the chunks get ahead of bulk traffic in the WiFi queues
+    stream_socket_set_tos(httpd_req_to_sockfd(req), STREAM_SOCKET_TOS_VOICE);
+
+    if (ctx->raw) {
+        const stream_socket_header_t headers[] = {
+            { "X-Audio-Sample-Rate", "24000" },
+            { "X-Audio-Bits-Per-Sample", "16" },
+            { "X-Audio-Channels", ctx->channels_hdr },
+            { "X-Audio-Channel-Map", ctx->channel_map_hdr },
+            { "X-Audio-Framed", ctx->framed ? "1" : "0" },
+            { "X-Audio-Block-Ms", ctx->block_ms_hdr },
+            { "X-Audio-Adapt", audio_quality_name(ctx->lowest) },
+            { "X-Audio-Replay", ctx->replay_hdr },
+            { "X-Audio-Boot-Id", ctx->boot_id_hdr },
+            { STREAM_FRAME_HTTP_HEADER, "1" },     // last, only sent with ?container=1
+        };
+        if ((res = stream_socket_begin(&ctx->out, req, ctx->container ? "application/octet-stream" : "audio/raw",
+                                       headers, ctx->container ? 10 : 9)) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start raw stream: %s", esp_err_to_name(res));
+            goto cleanup;
+        }
+    } else if ((res = httpd_resp_set_type(req, ctx->container ? "application/octet-stream" : "audio/raw")) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set response type: %s", esp_err_to_name(res));
         goto cleanup;
     }
     
-    if ((res = httpd_resp_set_hdr(req, "X-Audio-Sample-Rate", "24000")) != ESP_OK ||
-        (res = httpd_resp_set_hdr(req, "X-Audio-Bits-Per-Sample", "16")) != ESP_OK ||
-        (res = httpd_resp_set_hdr(req, "X-Audio-Channels", "4")) != ESP_OK) {
+    if (!ctx->raw && ctx->container &&
+        (res = httpd_resp_set_hdr(req, STREAM_FRAME_HTTP_HEADER, "1")) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set audio headers: %s", esp_err_to_name(res));
+        goto cleanup;
+    }
+    if (!ctx->raw &&
+        ((res = httpd_resp_set_hdr(req, "X-Audio-Sample-Rate", "24000")) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Bits-Per-Sample", "16")) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Channels", ctx->channels_hdr)) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Channel-Map", ctx->channel_map_hdr)) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Framed", ctx->framed ? "1" : "0")) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Block-Ms", ctx->block_ms_hdr)) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Adapt", audio_quality_name(ctx->lowest))) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Replay", ctx->replay_hdr)) != ESP_OK ||
+         (res = httpd_resp_set_hdr(req, "X-Audio-Boot-Id", ctx->boot_id_hdr)) != ESP_OK)) {
         ESP_LOGE(TAG, "Failed to set audio headers: %s", esp_err_to_name(res));
         goto cleanup;
     }
 
-    size_t bytes_read = 0;
-    uint32_t raw_sample[4];  // Buffer to hold raw left0, right0, left1, and right1 samples
-    
     while (true) {
-        if (httpd_req_to_sockfd(req) < 0) {
-            ESP_LOGI(TAG, "Client disconnected");
+        res = audio_ring_read(sub, &ctx->block, pdMS_TO_TICKS(STREAM_READ_TIMEOUT_MS));
+        if (res == ESP_ERR_TIMEOUT) {
+            // Capture is paused (ex: /burst), keep the connection
+            if (httpd_req_to_sockfd(req) < 0) {
+                ESP_LOGI(TAG, "Client disconnected");
+                goto cleanup;
+            }
+            continue;
+        }
+        if (res != ESP_OK) {
+            ESP_LOGW(TAG, "Audio client fell behind the ring, disconnecting");
             goto cleanup;
         }
-        // Read from I2S
-        if (buffer_sel) {
-            //ESP_LOGI(TAG, "Filling buffer A");
-            for (bufIndexA = 0; bufIndexA < BUFFER_SIZE; bufIndexA += 4) {
-                if ((i2s_channel_read(rx_handle_0, raw_sample, sizeof(uint32_t) * 2, &bytes_read, portMAX_DELAY)) == ESP_OK &&\
-                    (i2s_channel_read(rx_handle_1, &raw_sample[2], sizeof(uint32_t) * 2, &bytes_read, portMAX_DELAY)) == ESP_OK) {
-                    audio_buffer_0a[bufIndexA] = (uint16_t)((raw_sample[0] & 0xFFFF000) >> 12);
-                    audio_buffer_0a[bufIndexA+1] = (uint16_t)((raw_sample[1] & 0xFFFF000) >> 12);
-                    audio_buffer_0a[bufIndexA+2] = (uint16_t)((raw_sample[2] & 0xFFFF000) >> 12);
-                    audio_buffer_0a[bufIndexA+3] = (uint16_t)((raw_sample[3] & 0xFFFF000) >> 12);
-                }
+
+        // The blocks still waiting in the ring are this client's send backlog.
+        // A replay is a backlog on purpose, it goes out at full quality.
+        uint32_t lag = audio_ring_lag(sub);
+        bool step = !audio_ring_replaying(sub) && audio_ladder_update(&ctx->ladder, lag, esp_timer_get_time());
+        if (blocks > 0 && (step || ctx->block.seq != header.seq + blocks)) {
+            if ((res = ach1_send_chunk(ctx, &header, &levels, blocks, &format, chunk_bytes)) != ESP_OK) {
+                break;
             }
-            //Transmitting buffer A
-            res = httpd_resp_send_chunk(req, (const char *)audio_buffer_0a, BUFFER_SIZE * sizeof(uint16_t));
-            bufIndexA = 0;
-
-            buffer_sel = false;
-
-        }else{
-            ESP_LOGI(TAG, "Filling buffer B");
-            for (bufIndexB = 0; bufIndexB < BUFFER_SIZE; bufIndexB += 4) {
-                if ((i2s_channel_read(rx_handle_0, raw_sample, sizeof(uint32_t) * 2, &bytes_read, portMAX_DELAY)) == ESP_OK &&\
-                (i2s_channel_read(rx_handle_1, &raw_sample[2], sizeof(uint32_t) * 2, &bytes_read, portMAX_DELAY)) == ESP_OK) {
-                    audio_buffer_0b[bufIndexB] = (uint16_t)((raw_sample[0] & 0xFFFF000) >> 12);
-                    audio_buffer_0b[bufIndexB+1] = (uint16_t)((raw_sample[1] & 0xFFFF000) >> 12);
-                    audio_buffer_0b[bufIndexB+2] = (uint16_t)((raw_sample[2] & 0xFFFF000) >> 12);
-                    audio_buffer_0b[bufIndexB+3] = (uint16_t)((raw_sample[3] & 0xFFFF000) >> 12);
-                }
+            blocks = 0;
+            chunk_bytes = 0;
+        }
+        if (step) {
+            audio_ladder_get_format(&ctx->ladder, &format);
+            ach1_client_set_quality(ctx);
+            ESP_LOGI(TAG, "Audio client %d now %s, %lu blocks behind", ctx->client,
+                     audio_quality_name(ctx->ladder.quality), (unsigned long)lag);
+        }
+        if (blocks == 0) {
+            header.seq = ctx->block.seq;
+            header.timestamp_us = ctx->block.timestamp_us;
+            audio_meter_reset(&levels);
+        }
+        audio_meter_add_levels(&levels, ctx->block.level, AUDIO_RING_BLOCK_FRAMES);
+        chunk_bytes += audio_ladder_convert(&ctx->ladder, ctx->block.samples, ctx->chunk + chunk_bytes);
+        blocks++;
+
+        if (blocks == ctx->blocks_per_chunk) {
+            if ((res = ach1_send_chunk(ctx, &header, &levels, blocks, &format, chunk_bytes)) != ESP_OK) {
+                break;
             }
-            //Transmitting buffer B
-            res = httpd_resp_send_chunk(req, (const char *)audio_buffer_0b, BUFFER_SIZE * sizeof(uint16_t));
-            bufIndexB = 0;
+            blocks = 0;
+            chunk_bytes = 0;
+        }
+    }
+    ESP_LOGE(TAG, "Failed to send chunk: %s", esp_err_to_name(res));
+
+cleanup:
+    audio_ring_unsubscribe(sub);
+    if (ctx->client >= 0) {
+        taskENTER_CRITICAL(&streams_lock);
+        ach1_clients[ctx->client].active = false;
+        taskEXIT_CRITICAL(&streams_lock);
+    }
+    if (ctx->raw) {
+        stream_socket_end(&ctx->out);
+    }
+    httpd_req_async_handler_complete(req);
+    free(ctx->chunk);
+    free(ctx);
+    vTaskDelete(NULL);
+}
 
-            buffer_sel = true;
+// Any number of clients, up to AUDIO_RING_MAX_SUBSCRIBERS, can stream at once.
+//   ?ch=0,2       send only these microphones (default all four), in ascending order
+//   ?framed=1     prefix every chunk with an audio_block_header_t carrying the block's
+//                 sequence number, timestamp and per-channel levels
+//   ?slow=close   disconnect instead of skipping audio when the client falls behind
+//   ?raw=1        plain response written straight to the socket, no chunked encoding
+//   ?block_ms=10  chunk length, 5 to 170 ms in steps of 5 (default 40)
+//   ?nodelay=1    set TCP_NODELAY so small chunks are not held back by Nagle
+//   ?profile=low_latency   5 ms chunks, raw and nodelay; block_ms still overrides the length
+//   ?adapt=1      step the format down while the client falls behind instead of dropping
+//                 audio, see audio_ladder.h; adapt=16k|2ch|beam|mulaw sets the lowest rung.
+//                 Implies framed=1, every chunk header says its format.
+//   ?from_seq=N   resume after a lost connection: start with capture block N (the seq the
+//                 client expected next) if it is still in the replay ring, and send the
+//                 backlog as fast as the connection takes it. Older blocks are skipped,
+//                 X-Audio-Replay says how many blocks are replayed. Implies framed=1.
+//   ?boot_id=H    with from_seq, the X-Audio-Boot-Id of the connection from_seq was counted
+//                 in. Every response carries this boot's id; after a restart the ids differ,
+//                 from_seq is ignored and the stream starts live. Without boot_id from_seq is trusted.
+//   ?container=1  send stream_frame.h frames instead: per chunk a STREAM_CODEC_LEVELS frame with
+//                 the levels and latency, then the samples with the codec of their format
+// Framed chunks report their capture-to-socket latency, /status sums it up per client.
+static esp_err_t ach1_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "Audio handler started");
+    if (audio_ring_subscriber_count() >= AUDIO_RING_MAX_SUBSCRIBERS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many audio clients");
+    }
+
+    ach1_stream_ctx_t *ctx = calloc(1, sizeof(ach1_stream_ctx_t));
+    if (ctx == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    char query[192];      // every option plus from_seq and boot_id
+    char value[16];
+    int block_ms = ACH1_DEFAULT_BLOCK_MS;
+    ctx->channel_mask = 0x0F;
+    ctx->slow = AUDIO_RING_SLOW_DROP;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "profile", value, sizeof(value)) == ESP_OK) {
+            if (strcmp(value, "low_latency") != 0) {
+                free(ctx);
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "profile must be low_latency");
+            }
+            block_ms = AUDIO_BLOCK_MS;
+            ctx->raw = true;
+            ctx->nodelay = true;
         }
-        
+        if (httpd_query_key_value(query, "block_ms", value, sizeof(value)) == ESP_OK) {
+            block_ms = atoi(value);
+            if (block_ms < AUDIO_BLOCK_MS || block_ms > ACH1_MAX_BLOCK_MS) {
+                free(ctx);
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "block_ms must be 5 to 170");
+            }
+        }
+        if (httpd_query_key_value(query, "nodelay", value, sizeof(value)) == ESP_OK) {
+            ctx->nodelay = (value[0] == '1');
+        }
+        if (httpd_query_key_value(query, "framed", value, sizeof(value)) == ESP_OK) {
+            ctx->framed = (value[0] == '1');
+        }
+        if (httpd_query_key_value(query, "container", value, sizeof(value)) == ESP_OK) {
+            ctx->container = (value[0] == '1');
+        }
+        if (httpd_query_key_value(query, "ch", value, sizeof(value)) == ESP_OK) {
+            ctx->channel_mask = parse_channel_list(value);
+        }
+        if (httpd_query_key_value(query, "raw", value, sizeof(value)) == ESP_OK) {
+            ctx->raw = (value[0] == '1');
+        }
+        if (httpd_query_key_value(query, "slow", value, sizeof(value)) == ESP_OK) {
+            if (strcmp(value, "close") == 0) {
+                ctx->slow = AUDIO_RING_SLOW_DISCONNECT;
+            } else if (strcmp(value, "drop") != 0) {
+                free(ctx);
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "slow must be drop or close");
+            }
+        }
+        if (httpd_query_key_value(query, "from_seq", value, sizeof(value)) == ESP_OK) {
+            char *end;
+            ctx->from_seq = strtoul(value, &end, 10);
+            if (end == value || *end != '\0') {
+                free(ctx);
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "from_seq must be a block number");
+            }
+            ctx->resume = true;
+            ctx->from_boot_id = audio_ring_boot_id();
+        }
+        if (ctx->resume && httpd_query_key_value(query, "boot_id", value, sizeof(value)) == ESP_OK) {
+            char *end;
+            ctx->from_boot_id = strtoul(value, &end, 16);
+            if (end == value || *end != '\0') {
+                free(ctx);
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "boot_id must be hex");
+            }
+        }
+        if (httpd_query_key_value(query, "adapt", value, sizeof(value)) == ESP_OK) {
+            ctx->lowest = audio_quality_parse(value);
+            if (ctx->lowest == AUDIO_QUALITY_COUNT) {
+                free(ctx);
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "adapt must be 1, 16k, 2ch, beam or mulaw");
+            }
+        }
+    }
+    if (ctx->lowest != AUDIO_QUALITY_FULL || ctx->resume || ctx->container) {
+        ctx->framed = true;     // raw samples could not say when their format changes, or where a replay ends
+    }
+    if (ctx->channel_mask == 0) {
+        free(ctx);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch must list microphones 0-3, ex: ch=0,2");
+    }
+    ctx->channel_count = channel_map_from_mask(ctx->channel_mask, ctx->channel_map,
+                                               ctx->channel_map_hdr, sizeof(ctx->channel_map_hdr));
+    snprintf(ctx->channels_hdr, sizeof(ctx->channels_hdr), "%u", ctx->channel_count);
+    // Whole capture blocks only, rounded up
+    ctx->blocks_per_chunk = (block_ms + AUDIO_BLOCK_MS - 1) / AUDIO_BLOCK_MS;
+    snprintf(ctx->block_ms_hdr, sizeof(ctx->block_ms_hdr), "%u", ctx->blocks_per_chunk * AUDIO_BLOCK_MS);
+
+    esp_err_t res = httpd_req_async_handler_begin(req, &ctx->req);
+    if (res != ESP_OK) {
+        free(ctx);
+        return res;
+    }
+    if (xTaskCreate(ach1_stream_task, "ach1_stream", 4096, ctx, STREAM_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create audio stream task");
+        httpd_req_async_handler_complete(ctx->req);
+        free(ctx);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Appends to the /status JSON in json[size]. A piece that does not fit leaves *len
+// past the end and every later append does nothing, so the handler checks once, at the end.
+static void json_append(char *json, size_t size, size_t *len, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+static void json_append(char *json, size_t size, size_t *len, const char *format, ...) {
+    if (*len >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(json + *len, size - *len, format, args);
+    va_end(args);
+    *len = n < 0 ? size : *len + n;
+}
+
+// "chunks":..,"latency_us":{..},"max_send_us":.. of a stream, for /status
+static void append_latency(char *json, size_t size, size_t *len, const stream_latency_t *latency) {
+    json_append(json, size, len, "\"chunks\":%lu,\"latency_us\":{\"last\":%lu,\"avg\":%lu,\"max\":%lu},\"max_send_us\":%lu",
+                (unsigned long)latency->chunks, (unsigned long)latency->last_us,
+                (unsigned long)(latency->chunks ? latency->total_us / latency->chunks : 0),
+                (unsigned long)latency->max_us, (unsigned long)latency->max_send_us);
+}
+
+static const char *reset_reason_name(esp_reset_reason_t reason) {
+    switch (reason) {
+    case ESP_RST_POWERON: return "power_on";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_EXT: return "external";
+    case ESP_RST_DEEPSLEEP: return "deep_sleep";
+    default: return "other";
+    }
+}
+
+// Health snapshot: I2S overflows, the levels of the last captured block, the classifier load
+// and the CPU load of both cores since the previous /status request
+static esp_err_t status_handler(httpd_req_t *req) {
+    static cpu_load_snapshot_t last_cpu;
+    static bool have_last_cpu = false;
+    cpu_load_snapshot_t cpu;
+    int cpu_load[2] = { -1, -1 };
+    audio_channel_level_t levels[4];
+    uint32_t seq;
+    int64_t block_us;
+    sound_events_stats_t events;
+    audio_ring_stats_t ring;
+    ach1_client_t clients[AUDIO_RING_MAX_SUBSCRIBERS];
+    stream_latency_t rtp;
+    stream_latency_t espnow;
+    time_sync_stats_t sync;
+    char json[3584];
+
+    taskENTER_CRITICAL(&levels_lock);
+    memcpy(levels, last_levels, sizeof(levels));
+    seq = block_seq;
+    block_us = last_block_us;
+    taskEXIT_CRITICAL(&levels_lock);
+    sound_events_get_stats(&events);
+    audio_ring_get_stats(&ring);
+    time_sync_get_stats(&sync);
+    taskENTER_CRITICAL(&streams_lock);
+    memcpy(clients, ach1_clients, sizeof(clients));
+    rtp = rtp_latency;
+    espnow = espnow_latency;
+    taskEXIT_CRITICAL(&streams_lock);
+    if (cpu_load_snapshot(&cpu)) {
+        if (have_last_cpu) {
+            cpu_load[0] = cpu_load_percent(&last_cpu, &cpu, 0);
+            cpu_load[1] = cpu_load_percent(&last_cpu, &cpu, 1);
+        }
+        last_cpu = cpu;
+        have_last_cpu = true;
+    }
+
+    size_t len = 0;
+    json_append(json, sizeof(json), &len,
+                "{\"uptime_us\":%lld,\"cpu_load\":[%d,%d],\"subscribers\":%u,\"rtp_active\":%s,\"i2s_overflows\":%lu,"
+                "\"blocks\":%lu,\"last_block_us\":%lld,\"replay_ms\":%lu,\"channels\":[",
+                (long long)esp_timer_get_time(), cpu_load[0], cpu_load[1], ring.subscribers, rtp_active ? "true" : "false",
+                (unsigned long)i2s_overflow_count, (unsigned long)seq, (long long)block_us,
+                (unsigned long)(ring.replay_blocks * AUDIO_BLOCK_MS));
+    for (int ch = 0; ch < 4; ch++) {
+        json_append(json, sizeof(json), &len,
+                    "%s{\"peak\":%u,\"rms\":%u,\"clips\":%u}", ch ? "," : "",
+                    levels[ch].peak, levels[ch].rms, levels[ch].clips);
+    }
+    json_append(json, sizeof(json), &len, "],\"clients\":[");
+    for (int i = 0, n = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        if (ring.sub[i].active) {
+            json_append(json, sizeof(json), &len,
+                        "%s{\"slow\":\"%s\",\"replaying\":%s,\"lag_blocks\":%lu,\"dropped_blocks\":%lu}", n++ ? "," : "",
+                        ring.sub[i].policy == AUDIO_RING_SLOW_DROP ? "drop" : "close",
+                        ring.sub[i].replaying ? "true" : "false",
+                        (unsigned long)ring.sub[i].lag_blocks, (unsigned long)ring.sub[i].dropped_blocks);
+        }
+    }
+    json_append(json, sizeof(json), &len, "],\"streams\":[");
+    for (int i = 0, n = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        if (clients[i].active) {
+            json_append(json, sizeof(json), &len,
+                        "%s{\"block_ms\":%u,\"raw\":%s,\"nodelay\":%s,\"quality\":\"%s\",\"steps_down\":%lu,"
+                        "\"steps_up\":%lu,", n++ ? "," : "", clients[i].block_ms,
+                        clients[i].raw ? "true" : "false", clients[i].nodelay ? "true" : "false",
+                        audio_quality_name(clients[i].quality), (unsigned long)clients[i].steps_down,
+                        (unsigned long)clients[i].steps_up);
+            append_latency(json, sizeof(json), &len, &clients[i].latency);
+            json_append(json, sizeof(json), &len, "}");
+        }
+    }
+    json_append(json, sizeof(json), &len, "],\"rtp\":{");
+    append_latency(json, sizeof(json), &len, &rtp);
+    json_append(json, sizeof(json), &len,
+                "},\"espnow\":{\"active\":%s,\"packets\":%lu,\"send_errors\":%lu,\"tx_failures\":%lu,",
+                espnow_active ? "true" : "false", (unsigned long)espnow_stream.packets,
+                (unsigned long)espnow_stream.send_errors, (unsigned long)espnow_stream.tx_failures);
+    append_latency(json, sizeof(json), &len, &espnow);
+    json_append(json, sizeof(json), &len,
+                "},\"time_sync\":{\"synced\":%s,\"offset_us\":%lld,\"drift_ppm\":%.2f,\"rtt_us\":%lu,"
+                "\"residual_us\":%lu,\"exchanges\":%lu,\"timeouts\":%lu,\"jumps\":%lu}",
+                sync.synced ? "true" : "false", (long long)sync.offset_us, sync.drift_ppm,
+                (unsigned long)sync.rtt_us, (unsigned long)sync.residual_us, (unsigned long)sync.exchanges,
+                (unsigned long)sync.timeouts, (unsigned long)sync.jumps);
+    json_append(json, sizeof(json), &len,
+                ",\"boot\":{\"reset\":\"%s\",\"fast_connect\":%s,\"wifi_start_ms\":%lu,\"connected_ms\":%lu,"
+                "\"first_block_ms\":%lu,\"first_byte_ms\":%lu,\"reconnect_ms\":%lu}",
+                reset_reason_name(esp_reset_reason()), boot_timing.fast_connect ? "true" : "false",
+                (unsigned long)boot_timing.wifi_start_ms, (unsigned long)boot_timing.connected_ms,
+                (unsigned long)boot_timing.first_block_ms, (unsigned long)boot_timing.first_byte_ms,
+                (unsigned long)boot_timing.reconnect_ms);
+    json_append(json, sizeof(json), &len, ",\"bench\":");
+    if (len < sizeof(json)) {
+        int n = net_bench_format_status(json + len, sizeof(json) - len);
+        len = n < 0 ? sizeof(json) : len + n;
+    }
+    json_append(json, sizeof(json), &len,
+                ",\"sound_events\":{\"inferences\":%lu,\"dropped_samples\":%lu,\"avg_us\":%lu,\"max_us\":%lu,"
+                "\"benchmark\":{\"runs\":%lu,\"min_us\":%lu,\"avg_us\":%lu,\"max_us\":%lu}}}",
+                (unsigned long)events.inferences, (unsigned long)events.dropped_samples,
+                (unsigned long)(events.inferences ? events.total_us / events.inferences : 0),
+                (unsigned long)events.max_us, (unsigned long)events.bench_runs,
+                (unsigned long)events.bench_min_us, (unsigned long)events.bench_avg_us,
+                (unsigned long)events.bench_max_us);
+
+    if (len >= sizeof(json)) {
+        ESP_LOGE(TAG, "/status does not fit in %u bytes", (unsigned)sizeof(json));
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Status too long");
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// Sends RTP until the client stops renewing its /rtp request. One ring block is
+// one packet (5 ms), so a packet leaves as soon as its audio is captured.
+static void rtp_stream_task(void *arg) {
+    audio_ring_block_t *block = &rtp_stream.block;
+    audio_ring_subscriber_t *sub = audio_ring_subscribe(AUDIO_RING_SLOW_DROP);
+    uint32_t next_seq = 0;
+    bool first = true;
+
+    taskENTER_CRITICAL(&streams_lock);
+    memset(&rtp_latency, 0, sizeof(rtp_latency));
+    taskEXIT_CRITICAL(&streams_lock);
+    if (sub == NULL) {
+        ESP_LOGE(TAG, "No audio ring subscriber left for RTP");
+        rtp_stream.deadline_us = 0;
+    } else {
+        ESP_LOGI(TAG, "RTP stream started, ssrc %08lx", (unsigned long)rtp_stream.session.ssrc);
+    }
+    while (esp_timer_get_time() < rtp_stream.deadline_us) {
+        if (audio_ring_read(sub, block, pdMS_TO_TICKS(STREAM_READ_TIMEOUT_MS)) != ESP_OK) {
+            continue;
+        }
+        // Blocks skipped by the ring still advance the RTP sequence and timestamp,
+        // the receiver sees them as lost packets and conceals them
+        if (!first && block->seq != next_seq) {
+            rtp_audio_skip(&rtp_stream.session, block->seq - next_seq, AUDIO_RING_BLOCK_FRAMES);
+        }
+        first = false;
+        next_seq = block->seq + 1;
+        if (rtp_stream.channel_count < 4) {
+            pack_channels(block->samples, AUDIO_RING_BLOCK_FRAMES, rtp_stream.channel_map, rtp_stream.channel_count,
+                          block->samples);
+        }
+        // Send errors are counted in the session; the stream keeps going, the receiver conceals the gap
+        bool synced;
+        int64_t capture_us = stream_timestamp(block->timestamp_us, &synced);
+        int64_t send_start_us = esp_timer_get_time();
+        rtp_audio_send(&rtp_stream.session, block->samples, AUDIO_RING_BLOCK_FRAMES, capture_us, synced);
+        stream_latency_add(&rtp_latency, (uint32_t)(send_start_us - block->timestamp_us),
+                           (uint32_t)(esp_timer_get_time() - send_start_us));
+    }
+
+    ESP_LOGI(TAG, "RTP stream stopped after %lu packets, %lu send errors",
+             (unsigned long)rtp_stream.session.packets, (unsigned long)rtp_stream.session.send_errors);
+    audio_ring_unsubscribe(sub);
+    rtp_audio_close(&rtp_stream.session);
+    rtp_active = false;
+    vTaskDelete(NULL);
+}
+
+// IPv4 address of the client, network byte order, 0 if unknown
+static uint32_t req_peer_addr(httpd_req_t *req) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&addr, &addr_len) != 0) {
+        return 0;
+    }
+    if (addr.ss_family == AF_INET) {
+        return ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+    }
+    // The server listens on an IPv6 socket when IPv6 is enabled, IPv4 clients are v4-mapped
+    uint32_t v4;
+    memcpy(&v4, &((struct sockaddr_in6 *)&addr)->sin6_addr.s6_addr[12], sizeof(v4));
+    return v4;
+}
+
+static esp_err_t rtp_send_session(httpd_req_t *req) {
+    char json[256];
+    int len = snprintf(json, sizeof(json),
+                       "{\"ssrc\":%lu,\"port\":%u,\"payload_type\":%d,\"sample_rate\":%d,\"channels\":%u,"
+                       "\"channel_map\":\"%s\",\"frames_per_packet\":%d,\"keepalive_ms\":%d}",
+                       (unsigned long)rtp_stream.session.ssrc, rtp_stream.port, RTP_AUDIO_PAYLOAD_TYPE,
+                       I2S_SAMPLE_RATE, rtp_stream.channel_count, rtp_stream.channel_map_hdr,
+                       RTP_AUDIO_FRAMES_PER_PACKET, RTP_KEEPALIVE_MS);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// Starts the low-latency RTP mode towards the requesting host. There is one RTP
+// session at a time; it runs alongside the /ach1 clients.
+//   ?port=5004  UDP port on the client (default RTP_AUDIO_DEFAULT_PORT)
+//   ?ch=0,2     microphones to send, as on /ach1
+//   ?stop=1     stop the stream now
+// Repeating the request from the same host and port within RTP_KEEPALIVE_MS keeps
+// the stream alive, so a receiver that goes away stops it within that time.
+// Replies with the session description as JSON.
+static esp_err_t rtp_handler(httpd_req_t *req) {
+    char query[64];
+    char value[16];
+    uint16_t port = RTP_AUDIO_DEFAULT_PORT;
+    uint8_t mask = 0x0F;
+    bool stop = false;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "port", value, sizeof(value)) == ESP_OK) {
+            long v = strtol(value, NULL, 10);
+            if (v <= 0 || v > 65535) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "port must be 1-65535");
+            }
+            port = (uint16_t)v;
+        }
+        if (httpd_query_key_value(query, "ch", value, sizeof(value)) == ESP_OK) {
+            mask = parse_channel_list(value);
+        }
+        if (httpd_query_key_value(query, "stop", value, sizeof(value)) == ESP_OK) {
+            stop = (value[0] == '1');
+        }
+    }
+    if (mask == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch must list microphones 0-3, ex: ch=0,2");
+    }
+    uint32_t peer = req_peer_addr(req);
+    if (peer == 0) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Unknown client address");
+    }
+    bool own_stream = rtp_active && rtp_stream.peer_addr == peer && rtp_stream.port == port;
+
+    if (stop) {
+        if (own_stream) {
+            rtp_stream.deadline_us = 0;
+        }
+        return httpd_resp_sendstr(req, "RTP stream stopped");
+    }
+    if (own_stream) {
+        rtp_stream.deadline_us = esp_timer_get_time() + RTP_KEEPALIVE_MS * 1000LL;
+        return rtp_send_session(req);
+    }
+    if (rtp_active) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "RTP stream already in use");
+    }
+    if (audio_ring_subscriber_count() >= AUDIO_RING_MAX_SUBSCRIBERS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many audio clients");
+    }
+
+    memset(&rtp_stream, 0, sizeof(rtp_stream));
+    rtp_stream.peer_addr = peer;
+    rtp_stream.port = port;
+    rtp_stream.channel_count = channel_map_from_mask(mask, rtp_stream.channel_map,
+                                                     rtp_stream.channel_map_hdr, sizeof(rtp_stream.channel_map_hdr));
+    if (rtp_audio_open(&rtp_stream.session, peer, port, rtp_stream.channel_count) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open RTP socket");
+    }
+    rtp_stream.deadline_us = esp_timer_get_time() + RTP_KEEPALIVE_MS * 1000LL;
+    rtp_active = true;
+    if (xTaskCreate(rtp_stream_task, "rtp_stream", 4096, NULL, STREAM_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create RTP stream task");
+        rtp_audio_close(&rtp_stream.session);
+        rtp_active = false;
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start RTP stream");
+    }
+    return rtp_send_session(req);
+}
+
+// The send callback gets the frame's tx info instead of the peer address since IDF 5.5
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+static void espnow_send_cb(const esp_now_send_info_t *tx_info, esp_now_send_status_t status) {
+#else
+static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status) {
+#endif
+    if (status != ESP_NOW_SEND_SUCCESS) {
+        espnow_stream.tx_failures++;
+    }
+}
+
+// Sends every ring block to the Eye over ESP-NOW until the stream is not
+// renewed anymore. Nothing is retransmitted: a fragment that is not queued or
+// not acknowledged is gone, and the Eye conceals it.
+static void espnow_stream_task(void *arg) {
+    audio_ring_block_t *block = &espnow_stream.block;
+    audio_ring_subscriber_t *sub = audio_ring_subscribe(AUDIO_RING_SLOW_DROP);
+    uint8_t fragments = espnow_audio_fragment_count(AUDIO_RING_BLOCK_FRAMES, espnow_stream.channel_count);
+
+    taskENTER_CRITICAL(&streams_lock);
+    memset(&espnow_latency, 0, sizeof(espnow_latency));
+    taskEXIT_CRITICAL(&streams_lock);
+    if (sub == NULL) {
+        ESP_LOGE(TAG, "No audio ring subscriber left for ESP-NOW");
+        espnow_stream.deadline_us = 0;
+    } else {
+        ESP_LOGI(TAG, "ESP-NOW stream started, %u fragments per block to " MACSTR,
+                 fragments, MAC2STR(espnow_stream.peer));
+    }
+    while (esp_timer_get_time() < espnow_stream.deadline_us) {
+        if (audio_ring_read(sub, block, pdMS_TO_TICKS(STREAM_READ_TIMEOUT_MS)) != ESP_OK) {
+            continue;
+        }
+        // Blocks skipped by the ring show up on the Eye as a gap in block_seq
+        if (espnow_stream.channel_count < 4) {
+            pack_channels(block->samples, AUDIO_RING_BLOCK_FRAMES, espnow_stream.channel_map,
+                          espnow_stream.channel_count, block->samples);
+        }
+        bool synced;
+        int64_t timestamp_us = stream_timestamp(block->timestamp_us, &synced);
+        int64_t send_start_us = esp_timer_get_time();
+        for (uint8_t i = 0; i < fragments; i++) {
+            size_t len = espnow_audio_build(espnow_stream.packet, block->seq, i, timestamp_us, block->samples,
+                                            AUDIO_RING_BLOCK_FRAMES, espnow_stream.channel_count,
+                                            espnow_stream.channel_mask, synced ? ESPNOW_AUDIO_FLAG_SYNCED : 0);
+            if (esp_now_send(espnow_stream.peer, espnow_stream.packet, len) == ESP_OK) {
+                espnow_stream.packets++;
+            } else {
+                espnow_stream.send_errors++;
+            }
+        }
+        stream_latency_add(&espnow_latency, (uint32_t)(send_start_us - block->timestamp_us),
+                           (uint32_t)(esp_timer_get_time() - send_start_us));
+    }
+
+    ESP_LOGI(TAG, "ESP-NOW stream stopped after %lu packets, %lu send errors, %lu not acknowledged",
+             (unsigned long)espnow_stream.packets, (unsigned long)espnow_stream.send_errors,
+             (unsigned long)espnow_stream.tx_failures);
+    audio_ring_unsubscribe(sub);
+    espnow_active = false;
+    vTaskDelete(NULL);
+}
+
+// ESP-NOW runs next to the station connection, on its channel. The Eye is the
+// access point, so its MAC is the BSSID.
+static esp_err_t espnow_setup_peer(uint8_t *peer_mac) {
+    wifi_ap_record_t ap;
+    esp_err_t res = esp_wifi_sta_get_ap_info(&ap);
+    if (res != ESP_OK) {
+        return res;
+    }
+    if (!espnow_ready) {
+        res = esp_now_init();
         if (res != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to send chunk: %s", esp_err_to_name(res));
-            goto cleanup;
+            return res;
+        }
+        esp_now_register_send_cb(espnow_send_cb);
+        espnow_ready = true;
+    }
+    if (!esp_now_is_peer_exist(ap.bssid)) {
+        esp_now_peer_info_t peer = {
+            .channel = 0,               // the current channel
+            .ifidx = WIFI_IF_STA,
+            .encrypt = false,
+        };
+        memcpy(peer.peer_addr, ap.bssid, ESP_NOW_ETH_ALEN);
+        res = esp_now_add_peer(&peer);
+        if (res != ESP_OK) {
+            return res;
+        }
+        esp_now_rate_config_t rate = {
+            .phymode = WIFI_PHY_MODE_11G,
+            .rate = ESPNOW_PHY_RATE,
+        };
+        res = esp_now_set_peer_rate_config(ap.bssid, &rate);
+        if (res != ESP_OK) {
+            ESP_LOGW(TAG, "ESP-NOW rate not set, staying at 1 Mbps: %s", esp_err_to_name(res));
+        }
+    }
+    memcpy(peer_mac, ap.bssid, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+static esp_err_t espnow_send_session(httpd_req_t *req) {
+    uint8_t mac[6];
+    char json[256];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    int len = snprintf(json, sizeof(json),
+                       "{\"mac\":\"" MACSTR "\",\"peer\":\"" MACSTR "\",\"sample_rate\":%d,\"channels\":%u,"
+                       "\"channel_map\":\"%s\",\"frames_per_block\":%d,\"fragments_per_block\":%u,\"keepalive_ms\":%d}",
+                       MAC2STR(mac), MAC2STR(espnow_stream.peer), I2S_SAMPLE_RATE, espnow_stream.channel_count,
+                       espnow_stream.channel_map_hdr, AUDIO_RING_BLOCK_FRAMES,
+                       espnow_audio_fragment_count(AUDIO_RING_BLOCK_FRAMES, espnow_stream.channel_count),
+                       ESPNOW_KEEPALIVE_MS);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// Streams the microphones to the Eye over ESP-NOW instead of TCP, for the Eye's
+// /av hub. The link format is in components/espnow_audio. One stream at a time.
+//   ?ch=0,1     microphones to send, as on /ach1 (four channels need 5 frames
+//               per 5 ms block, two channels 3)
+//   ?stop=1     stop the stream now
+// Repeating the request from the same host within ESPNOW_KEEPALIVE_MS keeps the
+// stream alive. Replies with this board's MAC and the stream layout as JSON.
+static esp_err_t espnow_handler(httpd_req_t *req) {
+    char query[64];
+    char value[16];
+    uint8_t mask = 0x0F;
+    bool stop = false;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "ch", value, sizeof(value)) == ESP_OK) {
+            mask = parse_channel_list(value);
         }
+        if (httpd_query_key_value(query, "stop", value, sizeof(value)) == ESP_OK) {
+            stop = (value[0] == '1');
+        }
+    }
+    if (mask == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch must list microphones 0-3, ex: ch=0,2");
+    }
+    uint32_t requester = req_peer_addr(req);
+    if (requester == 0) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Unknown client address");
+    }
+    bool own_stream = espnow_active && espnow_stream.requester_addr == requester;
 
-        // Small delay to prevent watchdog issues
-        //vTaskDelay(1);
+    if (stop) {
+        if (own_stream) {
+            espnow_stream.deadline_us = 0;
+        }
+        return httpd_resp_sendstr(req, "ESP-NOW stream stopped");
+    }
+    if (own_stream) {
+        espnow_stream.deadline_us = esp_timer_get_time() + ESPNOW_KEEPALIVE_MS * 1000LL;
+        return espnow_send_session(req);
+    }
+    if (espnow_active) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "ESP-NOW stream already in use");
+    }
+    if (audio_ring_subscriber_count() >= AUDIO_RING_MAX_SUBSCRIBERS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many audio clients");
     }
 
-cleanup:
+    memset(&espnow_stream, 0, sizeof(espnow_stream));
+    esp_err_t res = espnow_setup_peer(espnow_stream.peer);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "ESP-NOW setup failed: %s", esp_err_to_name(res));
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "ESP-NOW not available");
+    }
+    espnow_stream.requester_addr = requester;
+    espnow_stream.channel_mask = mask;
+    espnow_stream.channel_count = channel_map_from_mask(mask, espnow_stream.channel_map, espnow_stream.channel_map_hdr,
+                                                        sizeof(espnow_stream.channel_map_hdr));
+    espnow_stream.deadline_us = esp_timer_get_time() + ESPNOW_KEEPALIVE_MS * 1000LL;
+    espnow_active = true;
+    if (xTaskCreate(espnow_stream_task, "espnow_stream", 4096, NULL, STREAM_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create ESP-NOW stream task");
+        espnow_active = false;
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start ESP-NOW stream");
+    }
+    return espnow_send_session(req);
+}
+
+// Switch both I2S ports to a new sample rate. The ports are stopped together and
+// restarted back to back so the two stereo pairs stay aligned.
+static esp_err_t set_i2s_sample_rate(uint32_t rate) {
+    i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rate);
+    esp_err_t res;
+
+    i2s_channel_disable(rx_handle_0);
+    i2s_channel_disable(rx_handle_1);
+    if ((res = i2s_channel_reconfig_std_clock(rx_handle_0, &clk_cfg)) != ESP_OK ||
+        (res = i2s_channel_reconfig_std_clock(rx_handle_1, &clk_cfg)) != ESP_OK) {
+        ESP_LOGE("I2S", "Failed to set sample rate %lu: %s", (unsigned long)rate, esp_err_to_name(res));
+    }
+    i2s_channel_enable(rx_handle_0);
+    i2s_channel_enable(rx_handle_1);
     return res;
 }
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, v & 0xFFFF);
+    put_le16(p + 2, v >> 16);
+}
+
+// Records all four microphones at full 32-bit resolution into PSRAM, then uploads
+// the capture as a WAV file. The capture configuration is carried in an "irlb"
+// chunk (JSON) ahead of the sample data, and echoed in X-Burst-* headers.
+// The capture and upload run in burst_task, the server keeps answering meanwhile.
+// ex: /burst?ms=2000&rate=48000
+static esp_err_t burst_handler(httpd_req_t *req) {
+    char query[64];
+    char value[16];
+    uint32_t duration_ms = 1000;
+    uint32_t rate = BURST_MAX_RATE;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "ms", value, sizeof(value)) == ESP_OK) {
+            duration_ms = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "rate", value, sizeof(value)) == ESP_OK) {
+            rate = strtoul(value, NULL, 10);
+        }
+    }
+    // Only this handler sets it, and httpd runs one handler at a time
+    if (burst_active) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Burst capture already running");
+    }
+    if (audio_ring_subscriber_count() > 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Audio stream in use, stop /ach1, /rtp and /espnow first");
+    }
+    if (rate < BURST_MIN_RATE || rate > BURST_MAX_RATE || duration_ms == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "rate must be 8000-48000 and ms > 0");
+    }
+    uint32_t frames = (uint32_t)((uint64_t)rate * duration_ms / 1000);
+    size_t data_bytes = (size_t)frames * 4 * sizeof(uint32_t);
+    if (data_bytes > BURST_MAX_BYTES) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Capture does not fit in PSRAM");
+    }
+
+    burst_t *burst = calloc(1, sizeof(*burst));
+    uint32_t *capture = heap_caps_malloc(data_bytes, MALLOC_CAP_SPIRAM);
+    if (burst == NULL || capture == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes of PSRAM for burst", data_bytes);
+        free(burst);
+        free(capture);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "PSRAM allocation failed");
+    }
+    burst->rate = rate;
+    burst->frames = frames;
+    burst->data_bytes = data_bytes;
+    burst->capture = capture;
+    ESP_LOGI(TAG, "Burst capture: %lu ms at %lu Hz (%u bytes)", (unsigned long)duration_ms,
+             (unsigned long)rate, data_bytes);
+
+    esp_err_t res = httpd_req_async_handler_begin(req, &burst->req);
+    if (res != ESP_OK) {
+        free(capture);
+        free(burst);
+        return res;
+    }
+    burst_active = true;
+    if (xTaskCreate(burst_task, "burst", 4096, burst, STREAM_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create burst task");
+        burst_active = false;
+        httpd_req_async_handler_complete(burst->req);
+        free(capture);
+        free(burst);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Captures and uploads one /burst, then frees it
+static void burst_task(void *arg) {
+    burst_t *burst = arg;
+    httpd_req_t *req = burst->req;
+    uint32_t rate = burst->rate;
+    uint32_t frames = burst->frames;
+    size_t data_bytes = burst->data_bytes;
+    uint32_t *capture = burst->capture;
+    esp_err_t res = ESP_OK;
+
+    // Capture. The capture task is parked on capture_mutex, nothing but the I2S
+    // reads and the interleave runs until the buffer is full.
+    static uint32_t pair_0[BURST_READ_FRAMES * 2];
+    static uint32_t pair_1[BURST_READ_FRAMES * 2];
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    if (set_i2s_sample_rate(rate) != ESP_OK) {
+        set_i2s_sample_rate(I2S_SAMPLE_RATE);
+        xSemaphoreGive(capture_mutex);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set sample rate");
+        goto done;
+    }
+    uint32_t overflows_before = i2s_overflow_count;
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t frame = 0; frame < frames && res == ESP_OK; frame += BURST_READ_FRAMES) {
+        uint32_t n = frames - frame < BURST_READ_FRAMES ? frames - frame : BURST_READ_FRAMES;
+        size_t bytes_0 = 0, bytes_1 = 0;
+        if ((res = i2s_channel_read(rx_handle_0, pair_0, n * 2 * sizeof(uint32_t), &bytes_0, 1000)) != ESP_OK ||
+            (res = i2s_channel_read(rx_handle_1, pair_1, n * 2 * sizeof(uint32_t), &bytes_1, 1000)) != ESP_OK) {
+            break;
+        }
+        uint32_t *out = &capture[(size_t)frame * 4];
+        for (uint32_t i = 0; i < n; i++) {
+            out[i * 4] = pair_0[i * 2];
+            out[i * 4 + 1] = pair_0[i * 2 + 1];
+            out[i * 4 + 2] = pair_1[i * 2];
+            out[i * 4 + 3] = pair_1[i * 2 + 1];
+        }
+    }
+    uint32_t overflows = i2s_overflow_count - overflows_before;
+    set_i2s_sample_rate(I2S_SAMPLE_RATE);
+    xSemaphoreGive(capture_mutex);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Burst capture failed: %s", esp_err_to_name(res));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "I2S read failed");
+        goto done;
+    }
+    if (overflows > 0) {
+        ESP_LOGW(TAG, "Burst capture lost data: %lu I2S overflows", (unsigned long)overflows);
+    }
+
+    // WAV header with the capture description ahead of the data chunk
+    uint8_t header[44 + 8 + 320];
+    char *info = (char *)&header[44];
+    int info_len = snprintf(info, 320,
+                            "{\"capture_start_us\":%lld,\"sample_rate\":%lu,\"channels\":4,\"bits_per_sample\":32,"
+                            "\"frames\":%lu,\"i2s_overflows\":%lu,"
+                            "\"channel_order\":[\"left_back\",\"left_front\",\"right_front\",\"right_back\"]}",
+                            (long long)start_us, (unsigned long)rate, (unsigned long)frames, (unsigned long)overflows);
+    if (info_len & 1) {
+        info[info_len++] = ' ';
+    }
+    memcpy(&header[36], "irlb", 4);
+    put_le32(&header[40], info_len);
+    size_t header_len = 44 + info_len + 8;
+    uint8_t *data_hdr = &header[44 + info_len];
+    memcpy(data_hdr, "data", 4);
+    put_le32(data_hdr + 4, data_bytes);
+    memcpy(&header[0], "RIFF", 4);
+    put_le32(&header[4], header_len - 8 + data_bytes);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    put_le32(&header[16], 16);
+    put_le16(&header[20], 1);                       // PCM
+    put_le16(&header[22], 4);                       // channels
+    put_le32(&header[24], rate);
+    put_le32(&header[28], rate * 4 * sizeof(uint32_t));
+    put_le16(&header[32], 4 * sizeof(uint32_t));    // block align
+    put_le16(&header[34], 32);                      // bits per sample
+
+    char start_str[24], rate_str[12], overflow_str[12];
+    snprintf(start_str, sizeof(start_str), "%lld", (long long)start_us);
+    snprintf(rate_str, sizeof(rate_str), "%lu", (unsigned long)rate);
+    snprintf(overflow_str, sizeof(overflow_str), "%lu", (unsigned long)overflows);
+    if ((res = httpd_resp_set_type(req, "audio/wav")) != ESP_OK ||
+        (res = httpd_resp_set_hdr(req, "X-Burst-Start-Us", start_str)) != ESP_OK ||
+        (res = httpd_resp_set_hdr(req, "X-Burst-Sample-Rate", rate_str)) != ESP_OK ||
+        (res = httpd_resp_set_hdr(req, "X-Burst-Overflows", overflow_str)) != ESP_OK) {
+        goto cleanup;
+    }
+
+    // Upload from PSRAM as fast as the link takes it
+    if ((res = httpd_resp_send_chunk(req, (const char *)header, header_len)) != ESP_OK) {
+        goto cleanup;
+    }
+    for (size_t sent = 0; sent < data_bytes; sent += BURST_SEND_BYTES) {
+        size_t len = data_bytes - sent < BURST_SEND_BYTES ? data_bytes - sent : BURST_SEND_BYTES;
+        if ((res = httpd_resp_send_chunk(req, (const char *)capture + sent, len)) != ESP_OK) {
+            goto cleanup;
+        }
+    }
+    res = httpd_resp_send_chunk(req, NULL, 0);
+    ESP_LOGI(TAG, "Burst upload complete");
+
+cleanup:
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Burst upload failed: %s", esp_err_to_name(res));
+    }
+done:
+    httpd_req_async_handler_complete(req);
+    free(capture);
+    free(burst);
+    burst_active = false;
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,96 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "rtp_audio.h"
+#include "stream_socket.h"
+
+static const char *TAG = "rtp_audio";
+
+#define RTP_HEADER_BYTES    12
+#define RTP_EXT_BYTES       16      // 0xBEDE profile word + capture time and sync elements, padded to 32 bits
+
+esp_err_t rtp_audio_open(rtp_audio_session_t *session, uint32_t dest_addr, uint16_t port, uint8_t channels) {
+    memset(session, 0, sizeof(*session));
+    session->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (session->sock < 0) {
+        ESP_LOGE(TAG, "Failed to create RTP socket");
+        return ESP_FAIL;
+    }
+    stream_socket_set_tos(session->sock, STREAM_SOCKET_TOS_VOICE);
+    session->dest.sin_family = AF_INET;
+    session->dest.sin_port = htons(port);
+    session->dest.sin_addr.s_addr = dest_addr;
+    session->channels = channels;
+    // Random initial values, as RFC 3550 asks, so a restarted stream is never mistaken for the old one
+    session->seq = (uint16_t)esp_random();
+    session->timestamp = esp_random();
+    session->ssrc = esp_random();
+    session->first = true;
+    return ESP_OK;
+}
+
+esp_err_t rtp_audio_send(rtp_audio_session_t *session, const int16_t *samples, uint16_t frames, int64_t capture_us,
+                         bool synced) {
+    uint8_t packet[RTP_HEADER_BYTES + RTP_EXT_BYTES + RTP_AUDIO_FRAMES_PER_PACKET * 4 * sizeof(int16_t)];
+    size_t sample_count = (size_t)frames * session->channels;
+    if (frames > RTP_AUDIO_FRAMES_PER_PACKET) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *p = packet;
+    *p++ = 0x80 | 0x10;     // version 2, header extension present
+    *p++ = (session->first ? 0x80 : 0) | RTP_AUDIO_PAYLOAD_TYPE;
+    *p++ = session->seq >> 8;
+    *p++ = session->seq;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        *p++ = session->timestamp >> shift;
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        *p++ = session->ssrc >> shift;
+    }
+
+    *p++ = 0xBE;
+    *p++ = 0xDE;
+    *p++ = 0;
+    *p++ = (RTP_EXT_BYTES - 4) / 4;
+    *p++ = (RTP_AUDIO_EXT_CAPTURE_ID << 4) | (8 - 1);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        *p++ = (uint64_t)capture_us >> shift;
+    }
+    *p++ = (RTP_AUDIO_EXT_SYNC_ID << 4) | (1 - 1);
+    *p++ = synced;
+    *p++ = 0;
+
+    // L16 is big endian on the wire
+    for (size_t i = 0; i < sample_count; i++) {
+        uint16_t s = (uint16_t)samples[i];
+        *p++ = s >> 8;
+        *p++ = s;
+    }
+
+    int sent = sendto(session->sock, packet, p - packet, 0,
+                      (struct sockaddr *)&session->dest, sizeof(session->dest));
+    // The sequence number and timestamp advance even if the send failed, so the
+    // receiver accounts for the gap instead of playing the next packet early
+    session->seq++;
+    session->timestamp += frames;
+    session->first = false;
+    if (sent < 0) {
+        session->send_errors++;
+        return ESP_FAIL;
+    }
+    session->packets++;
+    return ESP_OK;
+}
+
+void rtp_audio_skip(rtp_audio_session_t *session, uint32_t packets, uint16_t frames_per_packet) {
+    session->seq += packets;
+    session->timestamp += packets * frames_per_packet;
+}
+
+void rtp_audio_close(rtp_audio_session_t *session) {
+    if (session->sock >= 0) {
+        close(session->sock);
+        session->sock = -1;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lwip/sockets.h"
+
+// RTP (RFC 3550) sender for the low-latency audio mode, /rtp in main.c
+//
+// Audio goes out as L16 (RFC 3551: 16-bit big endian, interleaved) in small
+// UDP packets. Unlike /ach1 over TCP, a lost packet only costs its own 5 ms;
+// the receiver conceals it and the stream carries on without waiting for a
+// retransmission. Every packet carries the capture time of its first frame in
+// a one-byte header extension (RFC 8285) so the host can measure the
+// end-to-end latency, and a second element says whether that time is on the
+// Eye's clock (time_sync) or still on the board's esp_timer.
+
+#define RTP_AUDIO_DEFAULT_PORT      5004
+#define RTP_AUDIO_PAYLOAD_TYPE      96      // dynamic, L16/24000/<channels>
+#define RTP_AUDIO_FRAMES_PER_PACKET 120     // 5 ms at 24 kHz, 960 byte payload with four channels
+#define RTP_AUDIO_EXT_CAPTURE_ID    1       // header extension element: int64 capture time in us
+#define RTP_AUDIO_EXT_SYNC_ID       2       // header extension element: 1 byte, 1 when the capture time is synchronized
+
+typedef struct {
+    int sock;
+    struct sockaddr_in dest;
+    uint8_t channels;
+    uint16_t seq;
+    uint32_t timestamp;     // in samples, advances by the frame count of every packet
+    uint32_t ssrc;
+    bool first;
+    uint32_t packets;
+    uint32_t send_errors;   // packets the WiFi stack refused, the receiver sees them as lost
+} rtp_audio_session_t;
+
+// dest_addr is in network byte order, as in sin_addr.s_addr
+esp_err_t rtp_audio_open(rtp_audio_session_t *session, uint32_t dest_addr, uint16_t port, uint8_t channels);
+
+// Send one packet of interleaved samples, at most RTP_AUDIO_FRAMES_PER_PACKET frames
+esp_err_t rtp_audio_send(rtp_audio_session_t *session, const int16_t *samples, uint16_t frames, int64_t capture_us,
+                         bool synced);
+
+// Account for packets that were never captured or sent: the sequence number and
+// timestamp jump, so the receiver conceals the gap instead of closing it up
+void rtp_audio_skip(rtp_audio_session_t *session, uint32_t packets, uint16_t frames_per_packet);
+
+void rtp_audio_close(rtp_audio_session_t *session);
@@ -0,0 +1,422 @@
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/stream_buffer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "sound_events.h"
+#include "sound_events_model.h"
+#include "time_sync_net.h"
+
+#define SOUND_EVENTS_DEST_IP        "192.168.4.255"
+#define SOUND_EVENTS_TASK_STACK     4096
+#define SOUND_EVENTS_TASK_PRIO      (tskIDLE_PRIORITY + 3)
+#define SOUND_EVENTS_QUEUE_HOPS     16      // ~170 ms of audio may queue up before dropping
+#define SOUND_EVENTS_REPEAT_US      1000000 // re-announce an ongoing event once per second
+
+static const char *TAG = "SoundEvents";
+
+static StreamBufferHandle_t audio_stream = NULL;
+static int event_sock = -1;
+static struct sockaddr_in event_addr;
+
+static sound_events_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Capture time of the audio in the stream buffer, under stats_lock: fed_frames
+// frames went in so far, the last one ending at fed_end_us (esp_timer)
+static uint32_t fed_frames = 0;
+static int64_t fed_end_us = 0;
+
+// Front-end state, only touched by the analysis task (or the benchmark before it starts)
+static float hann[SOUND_EVENTS_FFT_SIZE];
+static float twiddle_re[SOUND_EVENTS_FFT_SIZE / 2];
+static float twiddle_im[SOUND_EVENTS_FFT_SIZE / 2];
+static float mel_edges_hz[SOUND_EVENTS_MEL_BANDS + 2];
+static float mono_hist[SOUND_EVENTS_FFT_SIZE];
+static float fft_re[SOUND_EVENTS_FFT_SIZE];
+static float fft_im[SOUND_EVENTS_FFT_SIZE];
+static float logmel_ring[SOUND_EVENTS_WINDOW_FRAMES][SOUND_EVENTS_MEL_BANDS];
+static float energy_ring[SOUND_EVENTS_WINDOW_FRAMES][SOUND_EVENTS_CHANNELS];
+static size_t ring_pos = 0;
+static uint32_t frames_seen = 0;
+
+static float hz_to_mel(float hz) {
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float mel_to_hz(float mel) {
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+static void frontend_init(void) {
+    const size_t n = SOUND_EVENTS_FFT_SIZE;
+    for (size_t i = 0; i < n; i++) {
+        hann[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / n);
+    }
+    for (size_t i = 0; i < n / 2; i++) {
+        twiddle_re[i] = cosf(2.0f * (float)M_PI * i / n);
+        twiddle_im[i] = -sinf(2.0f * (float)M_PI * i / n);
+    }
+    float mel_lo = hz_to_mel(SOUND_EVENTS_MEL_FMIN);
+    float mel_hi = hz_to_mel(SOUND_EVENTS_MEL_FMAX);
+    for (size_t m = 0; m < SOUND_EVENTS_MEL_BANDS + 2; m++) {
+        mel_edges_hz[m] = mel_to_hz(mel_lo + (mel_hi - mel_lo) * m / (SOUND_EVENTS_MEL_BANDS + 1));
+    }
+    memset(mono_hist, 0, sizeof(mono_hist));
+    ring_pos = 0;
+    frames_seen = 0;
+}
+
+// In-place iterative radix-2 FFT over fft_re/fft_im
+static void fft_run(void) {
+    const size_t n = SOUND_EVENTS_FFT_SIZE;
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            float t = fft_re[i]; fft_re[i] = fft_re[j]; fft_re[j] = t;
+            t = fft_im[i]; fft_im[i] = fft_im[j]; fft_im[j] = t;
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t step = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < len / 2; k++) {
+                float wr = twiddle_re[k * step];
+                float wi = twiddle_im[k * step];
+                size_t a = i + k;
+                size_t b = a + len / 2;
+                float xr = fft_re[b] * wr - fft_im[b] * wi;
+                float xi = fft_re[b] * wi + fft_im[b] * wr;
+                fft_re[b] = fft_re[a] - xr;
+                fft_im[b] = fft_im[a] - xi;
+                fft_re[a] += xr;
+                fft_im[a] += xi;
+            }
+        }
+    }
+}
+
+// Consume one hop of interleaved samples and append a log-mel frame to the ring
+static void frontend_push_hop(const int16_t *samples) {
+    const size_t n = SOUND_EVENTS_FFT_SIZE;
+    const size_t hop = SOUND_EVENTS_HOP;
+    float *energy = energy_ring[ring_pos];
+
+    memmove(mono_hist, mono_hist + hop, (n - hop) * sizeof(float));
+    memset(energy, 0, SOUND_EVENTS_CHANNELS * sizeof(float));
+    for (size_t i = 0; i < hop; i++) {
+        const int16_t *frame = &samples[i * SOUND_EVENTS_CHANNELS];
+        float sum = 0.0f;
+        for (size_t ch = 0; ch < SOUND_EVENTS_CHANNELS; ch++) {
+            float s = frame[ch] / 32768.0f;
+            sum += s;
+            energy[ch] += s * s;
+        }
+        mono_hist[n - hop + i] = sum / SOUND_EVENTS_CHANNELS;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        fft_re[i] = mono_hist[i] * hann[i];
+        fft_im[i] = 0.0f;
+    }
+    fft_run();
+
+    const float bin_hz = (float)SOUND_EVENTS_SAMPLE_RATE / n;
+    float *logmel = logmel_ring[ring_pos];
+    for (size_t m = 0; m < SOUND_EVENTS_MEL_BANDS; m++) {
+        float lo = mel_edges_hz[m];
+        float center = mel_edges_hz[m + 1];
+        float hi = mel_edges_hz[m + 2];
+        size_t k_lo = (size_t)(lo / bin_hz) + 1;
+        size_t k_hi = (size_t)(hi / bin_hz);
+        float e = 0.0f;
+        for (size_t k = k_lo; k <= k_hi && k <= n / 2; k++) {
+            float f = k * bin_hz;
+            float w = (f <= center) ? (f - lo) / (center - lo) : (hi - f) / (hi - center);
+            if (w > 0.0f) {
+                e += w * (fft_re[k] * fft_re[k] + fft_im[k] * fft_im[k]);
+            }
+        }
+        logmel[m] = 10.0f * log10f(e + 1e-10f);
+    }
+
+    ring_pos = (ring_pos + 1) % SOUND_EVENTS_WINDOW_FRAMES;
+    frames_seen++;
+}
+
+// Per-band mean, max and standard deviation over the window
+static void frontend_features(float *features) {
+    for (size_t m = 0; m < SOUND_EVENTS_MEL_BANDS; m++) {
+        float sum = 0.0f, sum_sq = 0.0f, max = -1e30f;
+        for (size_t f = 0; f < SOUND_EVENTS_WINDOW_FRAMES; f++) {
+            float v = logmel_ring[f][m];
+            sum += v;
+            sum_sq += v * v;
+            if (v > max) {
+                max = v;
+            }
+        }
+        float mean = sum / SOUND_EVENTS_WINDOW_FRAMES;
+        float var = sum_sq / SOUND_EVENTS_WINDOW_FRAMES - mean * mean;
+        features[m] = mean;
+        features[SOUND_EVENTS_MEL_BANDS + m] = max;
+        features[2 * SOUND_EVENTS_MEL_BANDS + m] = sqrtf(var > 0.0f ? var : 0.0f);
+    }
+}
+
+static int8_t saturate_i8(float v, int lo) {
+    long q = lroundf(v);
+    if (q > 127) {
+        return 127;
+    }
+    return (q < lo) ? (int8_t)lo : (int8_t)q;
+}
+
+// Two-layer int8 MLP, returns the winning class and writes its softmax probability
+static int classify(const float *features, float *confidence) {
+    int8_t x[SOUND_EVENTS_FEATURES];
+    int8_t h[SOUND_EVENTS_HIDDEN];
+    float logits[SOUND_EVENTS_NUM_CLASSES];
+
+    for (size_t i = 0; i < SOUND_EVENTS_FEATURES; i++) {
+        float z = (features[i] - sound_events_feat_mean[i]) * sound_events_feat_inv_std[i];
+        x[i] = saturate_i8(z * SOUND_EVENTS_INPUT_SCALE, -127);
+    }
+    for (size_t j = 0; j < SOUND_EVENTS_HIDDEN; j++) {
+        int32_t acc = sound_events_b1[j];
+        for (size_t i = 0; i < SOUND_EVENTS_FEATURES; i++) {
+            acc += (int32_t)sound_events_w1[j][i] * x[i];
+        }
+        h[j] = saturate_i8(acc * sound_events_l1_requant, 0);
+    }
+    int best = 0;
+    float max_logit = -1e30f;
+    for (size_t c = 0; c < SOUND_EVENTS_NUM_CLASSES; c++) {
+        int32_t acc = 0;
+        for (size_t j = 0; j < SOUND_EVENTS_HIDDEN; j++) {
+            acc += (int32_t)sound_events_w2[c][j] * h[j];
+        }
+        logits[c] = acc * sound_events_l2_scale + sound_events_b2[c];
+        if (logits[c] > max_logit) {
+            max_logit = logits[c];
+            best = c;
+        }
+    }
+    float denom = 0.0f;
+    for (size_t c = 0; c < SOUND_EVENTS_NUM_CLASSES; c++) {
+        denom += expf(logits[c] - max_logit);
+    }
+    *confidence = 1.0f / denom;
+    return best;
+}
+
+// Coarse level-based bearing: 0 = straight ahead, +90 = right, +/-180 = behind.
+// Channel order follows the board: 0 left back, 1 left front, 2 right front, 3 right back.
+static int window_azimuth_deg(void) {
+    float e[SOUND_EVENTS_CHANNELS] = { 0 };
+    for (size_t f = 0; f < SOUND_EVENTS_WINDOW_FRAMES; f++) {
+        for (size_t ch = 0; ch < SOUND_EVENTS_CHANNELS; ch++) {
+            e[ch] += energy_ring[f][ch];
+        }
+    }
+    float right = (e[2] + e[3]) - (e[0] + e[1]);
+    float front = (e[1] + e[2]) - (e[0] + e[3]);
+    return (int)lroundf(atan2f(right, front) * 180.0f / (float)M_PI);
+}
+
+// Capture time of the first sample of the window that ends after consumed_frames
+static int64_t window_start_us(uint32_t consumed_frames) {
+    taskENTER_CRITICAL(&stats_lock);
+    uint32_t queued = fed_frames - consumed_frames;
+    int64_t end_us = fed_end_us;
+    taskEXIT_CRITICAL(&stats_lock);
+    // Frames dropped after the window shift it by their length, as good as it gets without per-hop times
+    end_us -= (int64_t)queued * 1000000 / SOUND_EVENTS_SAMPLE_RATE;
+    return end_us - (int64_t)SOUND_EVENTS_WINDOW_FRAMES * SOUND_EVENTS_HOP * 1000000 / SOUND_EVENTS_SAMPLE_RATE;
+}
+
+// t_us is the capture time of the start of the detection window, on the Eye's
+// clock once time_sync has synchronized, like the audio streams
+static void emit_event(int label, float confidence, int azimuth, uint32_t infer_us, int64_t start_us) {
+    char line[160];
+    bool synced = time_sync_synced();
+    int len = snprintf(line, sizeof(line),
+                       "{\"t_us\":%lld,\"synced\":%s,\"event\":\"%s\",\"confidence\":%.2f,\"azimuth_deg\":%d,"
+                       "\"infer_us\":%lu}\n",
+                       (long long)(synced ? time_sync_to_master(start_us) : start_us), synced ? "true" : "false",
+                       sound_events_labels[label], confidence, azimuth, (unsigned long)infer_us);
+    ESP_LOGI(TAG, "%.*s", len - 1, line);
+    if (event_sock >= 0) {
+        sendto(event_sock, line, len, 0, (struct sockaddr *)&event_addr, sizeof(event_addr));
+    }
+}
+
+static void record_latency(uint32_t us) {
+    taskENTER_CRITICAL(&stats_lock);
+    stats.inferences++;
+    stats.last_us = us;
+    stats.total_us += us;
+    if (stats.inferences == 1 || us < stats.min_us) {
+        stats.min_us = us;
+    }
+    if (us > stats.max_us) {
+        stats.max_us = us;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static void sound_events_task(void *arg) {
+    static int16_t hop_buf[SOUND_EVENTS_HOP * SOUND_EVENTS_CHANNELS];
+    const size_t hop_bytes = sizeof(hop_buf);
+    float features[SOUND_EVENTS_FEATURES];
+    int last_label = SOUND_EVENTS_BACKGROUND_CLASS;
+    int64_t last_emit_us = 0;
+    int64_t frontend_us = 0;        // front-end time spent on the hops since the last inference
+    uint32_t consumed_frames = 0;
+
+    while (true) {
+        size_t got = 0;
+        while (got < hop_bytes) {
+            got += xStreamBufferReceive(audio_stream, (uint8_t *)hop_buf + got, hop_bytes - got, portMAX_DELAY);
+        }
+        consumed_frames += SOUND_EVENTS_HOP;
+        int64_t t0 = esp_timer_get_time();
+        frontend_push_hop(hop_buf);
+        frontend_us += esp_timer_get_time() - t0;
+
+        if (frames_seen < SOUND_EVENTS_WINDOW_FRAMES || frames_seen % SOUND_EVENTS_STRIDE_FRAMES != 0) {
+            continue;
+        }
+
+        // Latency covers the classifier plus the front-end frames added since the last inference
+        t0 = esp_timer_get_time();
+        frontend_features(features);
+        float confidence;
+        int label = classify(features, &confidence);
+        uint32_t infer_us = (uint32_t)(esp_timer_get_time() - t0 + frontend_us);
+        frontend_us = 0;
+        record_latency(infer_us);
+
+        if (label == SOUND_EVENTS_BACKGROUND_CLASS || confidence < sound_events_threshold) {
+            last_label = SOUND_EVENTS_BACKGROUND_CLASS;
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if (label != last_label || now - last_emit_us >= SOUND_EVENTS_REPEAT_US) {
+            emit_event(label, confidence, window_azimuth_deg(), infer_us, window_start_us(consumed_frames));
+            last_emit_us = now;
+        }
+        last_label = label;
+    }
+}
+
+esp_err_t sound_events_start(void) {
+    if (!SOUND_EVENTS_MODEL_VALID) {
+        ESP_LOGW(TAG, "No trained model in sound_events_model.h, classifier disabled");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    frontend_init();
+
+    audio_stream = xStreamBufferCreate(SOUND_EVENTS_QUEUE_HOPS * SOUND_EVENTS_HOP * SOUND_EVENTS_CHANNELS * sizeof(int16_t),
+                                       SOUND_EVENTS_HOP * SOUND_EVENTS_CHANNELS * sizeof(int16_t));
+    if (audio_stream == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate audio stream buffer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    event_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (event_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create event socket");
+    } else {
+        int broadcast = 1;
+        setsockopt(event_sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+        memset(&event_addr, 0, sizeof(event_addr));
+        event_addr.sin_family = AF_INET;
+        event_addr.sin_port = htons(SOUND_EVENTS_UDP_PORT);
+        event_addr.sin_addr.s_addr = inet_addr(SOUND_EVENTS_DEST_IP);
+    }
+
+    if (xTaskCreatePinnedToCore(sound_events_task, "sound_events", SOUND_EVENTS_TASK_STACK,
+                                NULL, SOUND_EVENTS_TASK_PRIO, NULL, 1) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create classifier task");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Sound event classifier started, events on UDP port %d", SOUND_EVENTS_UDP_PORT);
+    return ESP_OK;
+}
+
+void sound_events_feed(const int16_t *samples, size_t sample_count, int64_t timestamp_us) {
+    if (audio_stream == NULL) {
+        return;
+    }
+    size_t bytes = sample_count * sizeof(int16_t);
+    // Whole blocks only: a partial write would split a frame and leave the
+    // classifier reading shifted channels from then on. The capture task is
+    // the only writer, so the space cannot shrink before the send.
+    if (xStreamBufferSpacesAvailable(audio_stream) < bytes) {
+        taskENTER_CRITICAL(&stats_lock);
+        stats.dropped_samples += sample_count;
+        taskEXIT_CRITICAL(&stats_lock);
+        return;
+    }
+    xStreamBufferSend(audio_stream, samples, bytes, 0);
+    size_t frames = sample_count / SOUND_EVENTS_CHANNELS;
+    taskENTER_CRITICAL(&stats_lock);
+    fed_frames += frames;
+    fed_end_us = timestamp_us + (int64_t)frames * 1000000 / SOUND_EVENTS_SAMPLE_RATE;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+void sound_events_get_stats(sound_events_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+void sound_events_benchmark(int iterations) {
+    static int16_t hop_buf[SOUND_EVENTS_HOP * SOUND_EVENTS_CHANNELS];
+    float features[SOUND_EVENTS_FEATURES];
+    uint32_t seed = 12345;
+    uint32_t min_us = UINT32_MAX, max_us = 0;
+    uint64_t total_us = 0;
+
+    for (size_t i = 0; i < sizeof(hop_buf) / sizeof(hop_buf[0]); i++) {
+        seed = seed * 1664525u + 1013904223u;
+        hop_buf[i] = (int16_t)(seed >> 16);
+    }
+    frontend_init();
+    for (int it = 0; it < iterations; it++) {
+        int64_t t0 = esp_timer_get_time();
+        for (int f = 0; f < SOUND_EVENTS_STRIDE_FRAMES; f++) {
+            frontend_push_hop(hop_buf);
+        }
+        frontend_features(features);
+        float confidence;
+        classify(features, &confidence);
+        uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+        total_us += us;
+        min_us = us < min_us ? us : min_us;
+        max_us = us > max_us ? us : max_us;
+    }
+    if (iterations <= 0) {
+        return;
+    }
+    uint32_t avg_us = (uint32_t)(total_us / iterations);
+    ESP_LOGI(TAG, "Benchmark: %d inferences (%d frames each), min %lu us, avg %lu us, max %lu us",
+             iterations, SOUND_EVENTS_STRIDE_FRAMES, (unsigned long)min_us, (unsigned long)avg_us,
+             (unsigned long)max_us);
+    taskENTER_CRITICAL(&stats_lock);
+    stats.bench_runs = iterations;
+    stats.bench_min_us = min_us;
+    stats.bench_avg_us = avg_us;
+    stats.bench_max_us = max_us;
+    taskEXIT_CRITICAL(&stats_lock);
+    frontend_init();
+}
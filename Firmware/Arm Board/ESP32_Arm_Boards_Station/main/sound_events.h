@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// On-device sound event classifier (alarms, doorbells, sirens, ...)
+//
+// Audio is handed over from the capture path with sound_events_feed() and
+// analysed on a separate task, so a slow inference never stalls the I2S reads.
+// Detected events are sent as one JSON line per UDP datagram to
+// SOUND_EVENTS_UDP_PORT on the access point's broadcast address.
+
+#define SOUND_EVENTS_UDP_PORT       5006
+#define SOUND_EVENTS_CHANNELS       4
+
+// Front-end parameters, keep in sync with sound_events_tool.py
+#define SOUND_EVENTS_SAMPLE_RATE    24000
+#define SOUND_EVENTS_FFT_SIZE       512
+#define SOUND_EVENTS_HOP            256
+#define SOUND_EVENTS_MEL_BANDS      32
+#define SOUND_EVENTS_MEL_FMIN       100.0f
+#define SOUND_EVENTS_MEL_FMAX       10000.0f
+#define SOUND_EVENTS_WINDOW_FRAMES  64      // ~680 ms of log-mel frames per inference
+#define SOUND_EVENTS_STRIDE_FRAMES  32      // one inference every ~340 ms
+#define SOUND_EVENTS_FEATURES       (SOUND_EVENTS_MEL_BANDS * 3)
+
+typedef struct {
+    uint32_t inferences;
+    uint32_t dropped_samples;   // samples lost because the analysis task fell behind
+    uint32_t last_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    // sound_events_benchmark() at boot: inferences of SOUND_EVENTS_STRIDE_FRAMES hops each
+    uint32_t bench_runs;
+    uint32_t bench_min_us;
+    uint32_t bench_avg_us;
+    uint32_t bench_max_us;
+} sound_events_stats_t;
+
+// Create the analysis task. Does nothing (and returns ESP_ERR_NOT_SUPPORTED)
+// if sound_events_model.h has not been generated from a trained model yet.
+esp_err_t sound_events_start(void);
+
+// Queue interleaved 4-channel 16-bit samples for analysis, timestamp_us is the
+// capture time (esp_timer) of their first frame. Never blocks, data that does
+// not fit is dropped and counted in the stats.
+void sound_events_feed(const int16_t *samples, size_t sample_count, int64_t timestamp_us);
+
+void sound_events_get_stats(sound_events_stats_t *stats);
+
+// Run the front-end and classifier on synthetic audio, log the latency and
+// keep it in the stats. Call before sound_events_start().
+void sound_events_benchmark(int iterations);
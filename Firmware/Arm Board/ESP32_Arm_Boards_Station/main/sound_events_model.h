@@ -0,0 +1,194 @@
+// Generated by sound_events_tool.py train -- do not edit by hand.
+#pragma once
+
+#include "sound_events.h"
+
+#define SOUND_EVENTS_MODEL_VALID        1
+#define SOUND_EVENTS_NUM_CLASSES        5
+#define SOUND_EVENTS_HIDDEN             32
+#define SOUND_EVENTS_BACKGROUND_CLASS   0
+#define SOUND_EVENTS_INPUT_SCALE        32.0f
+
+static const char *const sound_events_labels[SOUND_EVENTS_NUM_CLASSES] = {
+    "background", "alarm", "doorbell", "knock", "siren",
+};
+
+static const float sound_events_threshold = 0.60f;
+
+static const float sound_events_feat_mean[SOUND_EVENTS_FEATURES] = {
+    -3.50361562f, -3.61398196f, -5.33180428f, -5.33949375f, -3.95347905f, -2.28671026f, -1.95857978f, -3.08224511f,
+    -5.97132254f, -7.40111732f, -7.28568554f, -6.31683207f, -6.01965618f, -6.69808483f, -7.70496798f, -8.12541962f,
+    -8.39776421f, -9.89231968f, -11.1020651f, -11.6697187f, -11.8912296f, -12.6535597f, -13.6487513f, -14.0546741f,
+    -13.9580412f, -14.0015278f, -13.8789148f, -13.5553141f, -13.5735521f, -13.3676519f, -13.4693365f, -13.5175276f,
+    10.6367273f, 11.1864128f, 10.5457067f, 11.089612f, 12.1923075f, 13.4404364f, 13.5246849f, 12.2728157f,
+    10.0890694f, 8.56791019f, 8.24490643f, 8.48046875f, 8.67203999f, 8.53658676f, 8.05095196f, 7.85470295f,
+    7.83734941f, 6.59592819f, 5.02805328f, 3.75946927f, 2.56654239f, 1.10390127f, -0.386288524f, -1.31971478f,
+    -1.61416769f, -1.81819141f, -1.74276495f, -1.51056314f, -1.56005979f, -1.52624905f, -1.51907051f, -1.55875719f,
+    5.99249411f, 6.40315199f, 6.82304144f, 7.19756937f, 7.54907799f, 8.0757761f, 8.15849972f, 7.8673892f,
+    7.51045084f, 7.15563297f, 6.99730253f, 6.88211489f, 6.9727602f, 7.01270247f, 6.91862106f, 6.94878578f,
+    7.07976961f, 6.8198185f, 6.33325768f, 5.88037348f, 5.59046221f, 4.9746623f, 4.13713551f, 3.80301452f,
+    3.77552342f, 3.70703125f, 3.80050731f, 4.01812029f, 3.99280715f, 4.1287179f, 4.08712435f, 4.03031015f,
+};
+static const float sound_events_feat_inv_std[SOUND_EVENTS_FEATURES] = {
+    0.0793247446f, 0.083201617f, 0.0836318806f, 0.0785249993f, 0.0708054826f, 0.0666714534f, 0.0653486699f, 0.0644928664f,
+    0.0677023828f, 0.0692795888f, 0.065381296f, 0.0635216981f, 0.0647668913f, 0.0681166723f, 0.0696036294f, 0.0679726079f,
+    0.0649179146f, 0.064671278f, 0.0637460575f, 0.0627949759f, 0.061455451f, 0.0607723445f, 0.0627922267f, 0.0636036098f,
+    0.062838614f, 0.0622783229f, 0.0616771616f, 0.0604637824f, 0.0596164577f, 0.0595361963f, 0.0590028316f, 0.0585093759f,
+    0.0871109813f, 0.0867363438f, 0.0842947513f, 0.0836767554f, 0.0847243667f, 0.0784787759f, 0.0742601231f, 0.0718673766f,
+    0.0728075355f, 0.0748825893f, 0.0742609501f, 0.0751201361f, 0.0799936727f, 0.0856662467f, 0.0895754769f, 0.08548785f,
+    0.0810122341f, 0.0800184831f, 0.0775748044f, 0.0753813088f, 0.0722026229f, 0.0720237046f, 0.079491891f, 0.0839413255f,
+    0.0829790682f, 0.0819555372f, 0.0795586631f, 0.0764924437f, 0.0750017017f, 0.0738539025f, 0.0731484368f, 0.0725866109f,
+    0.245952249f, 0.213737637f, 0.199368f, 0.200891688f, 0.206727043f, 0.192554623f, 0.186168343f, 0.18311806f,
+    0.191316664f, 0.197171241f, 0.195547506f, 0.200558737f, 0.199658751f, 0.197833776f, 0.202490896f, 0.190744206f,
+    0.178039595f, 0.172226697f, 0.17100811f, 0.171765f, 0.169544205f, 0.181784198f, 0.247509882f, 0.288895905f,
+    0.281793982f, 0.275557667f, 0.249772936f, 0.227778062f, 0.220987946f, 0.206287846f, 0.210450456f, 0.206331462f,
+};
+
+static const int8_t sound_events_w1[SOUND_EVENTS_HIDDEN][SOUND_EVENTS_FEATURES] = {
+    {19, 5, 12, -4, -16, 16, 52, 52, -9, -26, 1, 18, -46, 7, -24, -14, -12, -4, 18, 37, 7, 38, -15, 10,
+    26, 6, -14, -20, -7, 10, -21, 1, 28, 39, 24, 24, -3, -3, 28, 51, -23, 50, 55, 37, 19, 4, 53, 69,
+    56, 44, 23, -15, 8, 21, -25, 15, 22, 29, -18, -8, 3, -17, 57, 2, 19, -6, 40, 40, 18, -69, -2, 14,
+    -2, -25, 40, -39, -16, 22, 2, 68, 0, -19, -2, -18, -31, 20, 15, 36, -14, 47, -5, 38, -10, -20, 6, 30},
+    {38, -17, -75, -88, 12, 62, 44, 25, 34, -1, 48, 76, -3, 33, -42, -26, -15, 10, 36, 4, 53, 20, 17, 28,
+    24, 27, 13, -25, 11, -4, -18, 25, -21, -72, -105, -46, 5, 6, -1, 18, 53, 80, -1, 80, 61, 27, 23, 1,
+    7, -7, -45, 5, -35, 8, -30, -27, -36, -28, -8, -52, 2, -17, -32, -66, 11, 2, -16, 29, 80, -57, -22, -102,
+    3, 40, 34, -2, 25, -2, 29, 26, -23, 46, -32, 6, -15, -19, 3, -15, -19, 5, -26, 20, -4, -29, -65, -51},
+    {4, -22, -32, 38, -42, -22, -7, 68, 14, -34, -57, 13, 3, -25, 14, -31, 6, 38, -13, 43, -35, 3, -10, 13,
+    0, -11, -19, 80, 4, -42, -7, 28, -4, 41, 34, 34, -6, -28, -12, -5, 50, 17, -36, -26, -73, -50, -73, -34,
+    43, -5, 17, -19, 27, -10, -14, 72, 3, -17, 15, 10, 44, -3, 37, 41, -4, 6, -22, 59, -49, -29, -28, 52,
+    16, 12, -11, 15, -41, -26, 74, 29, -19, -41, -31, -13, -15, -34, -41, 39, 17, -5, -8, -17, -72, 5, -28, -26},
+    {-4, 40, 9, -2, 21, 0, -26, -5, -4, 26, -21, 21, 12, -2, 14, -76, 5, -3, 1, -19, -2, 7, -7, -10,
+    30, -32, 17, -8, -34, -25, -43, -6, 0, -13, -12, 33, 66, 47, 71, 42, 20, -4, 12, -8, 44, 17, 15, 4,
+    -6, -54, 8, -69, -39, -11, 25, 2, -10, -43, -16, -12, 26, 3, -57, 31, -21, -32, 40, 3, 10, 40, 74, 71,
+    14, 44, 20, 13, -4, -24, 6, -4, -23, 5, -11, -39, -1, 2, -51, -28, 13, 11, -2, 16, -36, -44, -28, -7},
+    {-14, -11, -28, -21, -23, 16, 33, 10, 7, -7, 24, 15, 58, -8, 17, 5, -13, 16, -32, 54, -32, 24, -21, 41,
+    2, 16, 11, 34, 0, -64, -6, 17, -23, 2, -1, -24, -43, 32, 31, 1, 64, -2, -25, 0, 43, -8, 55, -38,
+    7, -2, -17, 9, -59, 15, -10, -12, 22, 30, 16, 39, 20, 28, -12, 2, 14, -2, 0, 7, 18, -13, -13, -25,
+    -27, 28, -6, 16, -30, -47, -31, 5, -1, -14, -38, -31, -43, -37, -84, -31, -14, 27, -17, 2, -38, -27, -114, -9},
+    {11, 58, 31, 41, -4, -33, -36, -70, 7, 4, -26, -8, -15, -37, 29, -16, 19, 45, -5, 24, 47, 34, -20, -1,
+    46, 20, 11, 24, 26, -8, 1, 6, -71, -39, 12, -49, 58, 71, -47, -42, -28, -34, -44, -47, -12, -31, 43, 48,
+    41, 67, 29, 5, 2, 60, 27, -11, -55, -5, -46, -57, -30, -10, 15, -20, -15, -43, 9, 21, 59, 42, 31, -39,
+    -8, -15, -63, -49, -40, -66, 27, 23, 23, 24, 15, 39, 5, 14, 35, -4, 4, -35, 5, -4, 17, -23, -17, 22},
+    {-23, -23, -22, -30, 34, -25, 4, 14, -13, -34, -31, -1, -29, 17, -44, -28, -19, -50, 5, -9, -35, -48, -41, 5,
+    -25, -29, -5, 56, 10, 23, 11, 27, 35, 52, 63, 51, 9, -11, -7, -20, -83, -52, 1, 27, 28, -13, -4, -6,
+    -56, -75, -12, -51, -17, 6, -30, 22, 60, 41, 36, 47, 79, 47, 70, 41, 12, 0, -30, -43, -36, -42, 11, -12,
+    -12, 29, -24, -32, 15, 0, -6, -47, -23, -56, -36, -2, -36, -9, 45, -36, -9, 40, -8, 17, -27, 12, 0, 12},
+    {8, -27, -17, 46, 11, -3, -15, -10, -35, -25, 25, -7, 9, -28, 40, 34, 40, 48, 12, -22, -6, 69, 55, 4,
+    3, 37, 13, -11, 50, 33, -44, 6, -32, -21, -20, -37, -12, -3, -24, -30, 11, -43, -37, -88, -23, -7, 9, 47,
+    47, 53, 43, 16, 53, 22, -20, 12, 31, -39, -6, -13, -11, 4, -32, -18, -59, -28, -35, -25, -34, 31, 5, -57,
+    -31, -31, -42, -68, -7, -22, 18, 42, 73, 7, 78, 55, 45, 98, 31, 10, -37, 11, 6, 11, 66, 15, 15, -4},
+    {-19, 14, 21, 12, -57, 27, -8, -29, 15, 13, -27, 62, -29, -43, -29, 36, -4, -10, -3, -16, -18, -16, 18, 26,
+    -26, 6, 20, -27, -12, -26, -32, 3, -15, 20, 5, 17, -4, -15, -3, 0, -17, 11, 19, 4, 43, -16, 13, -10,
+    7, -20, 29, 6, 31, -30, -11, -20, -12, -16, -1, 1, 0, -12, 6, 23, -23, 1, 0, 14, -2, -2, -26, 1,
+    -23, 12, -4, -1, -24, 20, 16, 20, 55, -3, 29, -4, 9, 10, 7, 17, -7, 1, 14, 44, -21, -45, -12, 2},
+    {10, -4, 10, -16, -66, -69, 4, 37, -3, -36, 28, 50, 61, 27, 3, -26, -31, 13, 18, 32, 38, 16, 7, -2,
+    24, 12, -4, 5, -21, -14, -35, -5, 5, -58, -27, -38, -60, -38, -17, -32, 52, 18, 44, 59, 66, 74, 52, -19,
+    -14, 10, 5, 14, 22, -2, -33, -9, -19, -30, -32, 0, -2, -2, -25, -6, -34, -23, 8, -6, 36, 49, -25, -40,
+    -21, -7, 21, -3, 18, -30, 43, 79, 57, -1, 0, 15, -78, -12, -19, -17, -45, -12, -32, 6, -32, -20, -15, 2},
+    {-64, -5, 27, 9, -24, 14, 2, -9, -30, -31, -28, -32, -51, -20, 1, -17, -6, -3, 10, 40, 4, -42, -71, -7,
+    -3, -34, -1, -31, 0, -19, 0, -53, 20, 28, 1, 83, 20, 60, -12, -7, 24, -4, -5, -1, -44, -17, -30, -6,
+    -24, -10, -16, -14, -9, -19, -23, -11, 32, 14, 16, 32, -32, 14, -27, -7, 25, 41, -13, 4, 41, -16, 13, -13,
+    -34, -11, 14, -20, 4, -6, -48, 16, 9, -36, -33, 4, -23, -53, 27, 3, 50, 13, 1, 58, -15, -33, -2, 25},
+    {-38, -36, -4, -90, -35, 26, -10, -21, 66, -50, -47, -41, -24, -7, 27, 17, 18, 7, -71, 2, -44, -57, 35, -31,
+    5, -19, -17, 11, -27, 7, 8, 29, 3, 30, 48, 37, -3, 17, 95, 78, -9, -5, -14, -27, -50, -13, 27, 7,
+    21, 38, -3, 7, 18, 38, 32, 15, 8, -29, 10, -23, -24, 16, -5, 14, -22, 6, -19, -2, -9, 1, 13, 25,
+    31, 0, -37, 19, -28, -2, -31, -10, -32, -17, -36, -25, -28, -17, -50, 16, 19, -17, -37, -25, 16, 3, -20, 16},
+    {-26, -16, 13, -8, -22, -63, 36, 27, -46, 13, 10, 24, 41, -13, 19, 22, 23, 45, 26, -1, 52, -29, -13, -25,
+    -3, 27, 35, 16, -12, -11, -11, 29, -44, 4, -17, -11, 21, -23, 46, -29, -23, -33, -12, 22, 26, 7, 15, -17,
+    -22, 18, 46, 5, -31, -46, -27, 29, -15, -34, -22, -16, 3, -23, -27, -9, -1, 16, 16, -10, -48, -29, 9, -35,
+    4, -10, -9, 21, -1, 25, -13, 51, 40, -63, 10, 52, 22, -14, -12, -39, -2, -51, -27, 31, -1, -12, -4, 70},
+    {31, -15, 47, 4, 25, -9, -25, 11, -26, -18, 26, -22, -33, 13, -48, -14, -6, -24, -13, 29, 17, -18, 15, 40,
+    -30, 3, 54, 19, 23, 0, -15, 32, 13, -5, -17, -45, 13, -9, -3, 9, 12, 19, 59, 35, -15, -22, 61, -10,
+    7, 61, 64, 17, 20, -34, -23, -12, -4, -12, 3, 54, 9, 11, 3, -5, 22, -32, -7, -23, 17, 10, 21, 19,
+    5, 35, 35, 8, 10, -52, 9, 6, -39, 7, 46, -11, 48, 19, -8, -6, 18, -37, 55, -16, -17, 42, 31, 40},
+    {23, 15, -10, -5, -1, -7, -64, -22, 25, 68, -4, 45, -27, 51, -57, 0, 9, 33, 24, -28, 6, 1, 20, 37,
+    27, 61, 21, -8, 42, -8, 7, 1, -80, -14, -14, -45, -34, -36, 25, 55, 17, 43, 17, 87, 31, 60, 0, 44,
+    28, 9, -24, 35, 46, -20, 29, -4, -12, -30, 26, 10, 7, 36, 19, 10, -14, -63, -16, -38, -3, 22, 65, 80,
+    22, 50, 19, 30, 42, 35, -26, -6, 21, -6, 49, -21, -28, -9, -19, -40, -10, 35, 42, -23, 13, -3, 3, 20},
+    {33, 7, -43, -48, 4, 49, 33, 54, 47, -86, 6, -25, 35, 27, 27, -22, 23, -36, 25, -9, -67, 28, 44, -22,
+    31, -17, -53, -4, 16, 14, 14, 18, 5, -13, -29, -12, -1, 19, -30, -12, 22, -14, -21, -7, -1, 14, 18, -51,
+    13, 35, 14, 20, 1, -17, 36, -37, 22, -2, -37, -13, 35, -10, -24, -5, -21, -26, 7, 25, 9, 58, -35, -18,
+    6, 26, 15, -12, 4, -2, -9, -34, 7, 10, -7, -37, -49, 17, 18, 54, -6, 21, 26, -6, 0, -8, 44, -43},
+    {-74, -29, -32, 41, 120, 127, 75, 127, 58, -4, -71, -19, 67, 51, 41, 16, 43, -33, -85, -66, 20, -53, -34, -31,
+    9, -53, -3, 34, 38, 23, 12, 70, -113, -20, 33, 75, 51, 22, -35, -44, -42, -3, -21, -26, 22, -44, 24, 1,
+    64, -31, -53, -26, 6, -48, 4, 7, -11, -10, -50, -13, -33, -21, 1, -8, -15, -19, -35, -20, -56, -46, -104, -23,
+    -5, 7, 104, 49, 97, -14, -34, 54, -22, 21, -3, -7, 63, -7, 25, 30, -25, -46, -36, -22, 7, 2, -18, -7},
+    {14, 11, 6, -20, 3, -7, -21, -9, 41, 45, -20, -58, 2, -23, 31, -3, 71, 15, 29, -23, -63, 12, 15, 25,
+    -8, -27, -34, 21, 25, -13, -6, -11, -62, -7, 15, -19, -64, -12, 43, 76, 25, -23, -64, -45, -18, 10, 11, -3,
+    -24, -20, 18, -6, 48, -22, 56, -5, 14, 13, -1, -39, -1, 52, -22, -35, -9, -14, -35, -30, -37, -17, 13, 53,
+    50, 17, 34, 24, -84, 2, -32, -22, 27, 7, -6, 39, -31, 5, 24, 4, -29, -2, 23, 14, 15, 17, 9, -27},
+    {-22, 17, -61, 63, 56, 20, 13, 50, 19, -56, -18, -8, -8, 26, 71, 49, 47, -3, -20, -17, 8, -28, 20, -37,
+    22, 21, 15, -39, 58, 42, 22, 39, -39, 24, 67, 18, 92, 27, 20, -14, -13, -94, -60, -31, -42, -10, 32, -23,
+    -18, -2, -35, -33, -10, -26, 6, 15, 4, 11, 38, 41, 8, -17, -31, -39, -21, -14, -7, -77, -3, 56, 17, 12,
+    -35, -60, 50, 1, 0, 54, 48, -41, -39, -103, 12, -12, -64, 0, -2, -20, -20, 8, -3, -7, 15, 11, -4, 2},
+    {26, 29, 84, 30, -24, -33, -47, -55, -28, 51, 56, -5, 39, 20, 17, -7, -50, -17, 33, 5, 33, 14, -1, 40,
+    47, -10, 14, 3, 2, -11, -42, 19, -42, -38, -16, -63, -49, -50, 4, -14, 43, 18, 37, 55, 48, 19, -15, -7,
+    -40, 10, -50, 24, -44, -2, -19, 33, -12, -24, -17, -20, -73, -13, -83, 2, -30, 29, -8, -2, 48, -23, -10, -15,
+    -13, 10, 28, 20, 13, 13, 1, -35, -17, -32, -37, -26, -74, 14, -10, -47, -7, -38, -29, -36, 12, -65, -20, -60},
+    {17, 18, -4, 63, 49, -11, 18, -3, 16, 42, -8, 51, -2, 0, 52, 13, -41, 13, -32, -44, -27, 7, -29, -37,
+    -13, 5, -26, -44, -65, -31, 9, 12, 27, 14, 23, 45, -6, 38, -25, 37, 3, -25, 26, -12, -5, 45, -32, -14,
+    -5, 26, -50, 25, -10, -12, -27, -8, 28, -5, -39, -27, -4, -14, -24, -2, 11, -22, -45, 5, 45, 6, 7, 47,
+    57, 3, 43, 38, -1, -54, -34, 3, 19, -10, -28, -47, -49, -10, -42, -6, -26, -17, 44, -14, -17, -11, -42, 28},
+    {37, 23, 73, 33, 16, -62, -31, -28, 11, 6, 17, 36, 6, 2, -15, 26, 57, -39, 34, 4, 43, 4, -36, 72,
+    -11, 34, 1, -1, 2, -17, 0, -1, -24, -12, 5, 3, -21, 25, 25, 25, 4, 4, -26, 22, 13, 49, -14, -3,
+    -27, -7, -18, -66, -24, -20, -32, -8, 49, -15, -25, -45, 11, 8, -7, -15, -34, -11, -2, 16, 26, 44, 66, 22,
+    47, 16, -57, -15, -36, 36, -48, 10, 17, -35, -80, -79, -13, -59, -67, -19, 31, 28, -31, -22, -9, -57, -29, -30},
+    {23, -7, -39, 7, -24, -46, -21, 25, 42, -21, 18, -64, -40, -57, 0, 48, 8, -21, 44, 11, 30, 13, 26, -12,
+    14, 9, 60, 10, -18, -26, -11, 15, 5, 52, 26, 4, -15, -33, 13, -7, 19, -52, -28, -2, -70, -52, 43, 28,
+    15, -4, 3, 91, 37, 100, 4, 9, -29, -19, 23, 19, 23, -47, -23, 47, -7, 0, -6, -12, -43, -50, 64, 23,
+    -58, -57, 8, -30, -31, -50, -13, 81, 15, 6, 23, 84, 71, 94, 63, -9, -23, -56, 5, 101, 2, 19, 29, 58},
+    {70, -3, -11, 1, -43, -7, -6, -66, -35, -5, -1, -47, -71, -59, -4, -2, -52, -9, -34, 2, -16, -8, 8, 17,
+    11, 39, 61, 21, -7, 15, -22, -27, 53, 85, 105, 97, 36, -10, -44, -49, -24, -35, 36, -44, -36, -19, 26, -54,
+    -32, 41, 7, 61, -7, 43, 18, 42, 1, -11, 37, 8, -2, -2, -2, 56, 12, 9, 79, 37, 69, 20, 2, -71,
+    -16, -37, -33, -62, -43, -52, -91, -9, -24, -9, -51, -29, -21, -20, -14, -25, 30, 23, 1, 21, 28, 34, 10, -5},
+    {-14, 12, -26, -2, 76, 102, 23, -11, 21, 30, 6, 14, 15, 68, 20, -81, -27, 30, -18, 8, 6, 22, -49, -22,
+    2, 6, -19, -8, -5, 12, 31, 9, -38, -91, -53, 44, -21, 85, -24, -102, 50, 52, -6, 43, -32, 16, 23, -38,
+    36, 35, -29, 2, -24, -7, -30, -17, 25, -29, -45, 27, 7, -24, -4, -26, -15, 1, -1, -5, -65, 25, -5, -118,
+    20, -5, 33, 27, 9, 28, 16, -36, 34, 85, -41, -24, 44, 25, -12, 11, 3, -22, -25, 10, 2, 20, 3, -27},
+    {52, -31, -25, -41, -64, 19, -22, 40, 78, 8, -16, -26, -12, -32, -11, -19, 33, 11, 0, 33, 8, 29, 17, 1,
+    -33, -34, 3, -5, -15, 21, 41, 8, 10, -29, -36, 58, -34, -13, -20, -4, 67, 13, 12, 43, -46, -4, 69, -27,
+    52, 76, -3, 9, -25, -47, -7, -37, 29, -12, -13, -5, 2, -8, -2, -21, -14, 18, -44, 20, 27, 27, -29, -8,
+    -20, -69, 43, 38, -27, 49, 43, -27, 44, 33, 36, -3, -19, -24, -24, -66, 23, -38, 12, -30, 7, -27, -1, -46},
+    {-3, 28, 18, 16, -12, -48, -17, -9, 41, 19, 14, -7, -11, 21, -4, -3, 54, -20, -3, -4, -14, -33, 35, -33,
+    -21, 8, -29, -1, -4, -4, -2, -34, -13, 36, 34, -8, 35, -18, -31, -49, -26, 14, -3, 50, 30, -4, -2, 0,
+    31, -5, 1, -19, 32, -10, -18, -41, 22, -18, -4, -12, -7, -52, -24, -32, 55, 38, 12, 64, 32, -36, -38, -1,
+    -7, 1, -19, 51, -6, 27, 35, -13, 17, 41, 34, 16, 8, -1, 28, 9, -2, -17, -37, -6, 45, -14, -20, -11},
+    {9, -9, 8, 1, 40, 29, 9, -32, 16, -3, 48, 21, -4, -11, -39, -22, 11, 35, 16, 27, 26, -9, 34, -36,
+    2, -13, -46, 44, -47, 21, 49, 0, -11, -65, -31, 22, -6, -25, -60, 40, 27, 12, 45, 7, 6, 54, -16, 8,
+    18, 11, -3, -33, -12, -16, -27, -34, -33, -28, 7, -7, 37, 7, -19, -18, -16, -13, -8, 57, 12, -4, -38, -34,
+    1, -5, 4, 38, -12, -18, 36, 6, 17, 10, 51, -41, -24, 18, 24, -32, 25, -16, -23, -22, 3, 5, -30, -1},
+    {-20, -42, 34, -32, -12, -44, -34, -21, 1, -29, -11, -10, 18, 8, 25, 20, -10, -2, 29, -11, -19, 12, -41, -22,
+    -32, -15, 33, 62, 15, -27, 13, 3, 45, 75, 48, 28, -7, -4, -38, -24, -64, -14, -32, -43, -106, -65, -43, 27,
+    -13, 19, 30, 2, -4, 66, 31, -23, 23, -7, 30, 52, 10, 39, -57, 30, -49, 46, 3, -28, 14, -23, -14, -35,
+    -12, -33, -18, -59, -34, -8, -9, 36, 24, 2, -5, 10, 8, 24, 26, 6, 8, 44, 43, 56, 42, 5, -11, 9},
+    {27, 45, 1, -17, 37, 10, -43, -38, 0, 17, -50, -19, -6, 16, 50, 25, -19, 24, -20, 16, 6, -24, 11, -9,
+    11, -7, 24, -19, -12, -22, -25, -13, -25, 10, 10, -29, -66, 14, -30, 2, -32, 8, -40, -69, 1, 57, 3, -29,
+    18, 41, -55, 8, -6, -6, 6, 13, 25, -25, -6, -25, -23, 66, -31, 4, -1, -40, -13, -56, -24, -37, -37, -32,
+    37, -2, -10, -44, 20, 50, 53, -40, -22, -38, -57, -5, 7, -56, -38, 7, -13, 5, -7, 25, 25, -50, 33, -13},
+    {-29, 9, -38, -47, -11, 53, -18, -3, -40, -35, -2, -25, 22, 17, 19, 38, -27, -15, -23, -14, 8, 12, -14, 33,
+    -6, -1, -20, 19, 23, 5, -48, 1, 24, -8, -12, 14, -62, 12, -38, 7, 17, -16, 7, 1, -21, -15, 9, -13,
+    2, 0, -29, -39, -41, -49, -68, -29, -38, -12, -21, -5, 16, -37, -18, -20, -17, -25, -1, 6, -15, 7, 23, 31,
+    -1, 5, 25, -18, 8, 35, 20, -3, 4, -21, 11, -24, -22, -16, -1, 26, 18, 16, 0, -16, -39, -32, -15, 26},
+    {38, 36, 39, -18, -10, 11, 18, -21, 12, -40, 24, 48, 3, -14, 68, 12, 46, -4, -18, -28, 34, -34, -42, -7,
+    -1, 2, -19, -5, 14, -37, 13, 25, 28, 14, 28, 6, 51, 9, 48, 13, -15, 12, -34, 43, 9, 37, 59, 15,
+    18, 9, 14, 58, 32, 3, 25, -53, 0, -74, 30, -50, 13, -26, 61, -39, -5, 64, 28, 24, 16, 8, -25, -9,
+    -8, 15, 4, 30, -28, 37, 14, 59, 29, 9, 6, -32, -12, -4, -7, -54, 1, -37, -8, 28, -18, -5, -17, 3},
+};
+static const int32_t sound_events_b1[SOUND_EVENTS_HIDDEN] = {
+    -221, -132, -317, 1076, 211, 1371, 379, 1416, -30, -211, 508, 1164,
+    314, 200, 627, 325, -195, 222, 108, 810, 644, 1083, 1334, 805,
+    616, -11, 172, 93, 1037, 24, 287, 332,
+};
+static const float sound_events_l1_requant = 0.00221724436f;
+
+static const int8_t sound_events_w2[SOUND_EVENTS_NUM_CLASSES][SOUND_EVENTS_HIDDEN] = {
+    {-43, -48, -37, 66, 17, 55, -26, 19, -10, -21, 26, -4, -16, 3, 52, -47, -103, 12, 0, 78, 35, 82, -90, 64, -97, -75, 11, -30, -32, 59, -39, 4},
+    {-12, -19, -43, -18, -43, 67, -60, 100, -3, -6, -38, -28, 25, 37, -2, 25, -6, 14, -10, -4, -39, -29, 93, 3, 12, 16, 5, 8, 45, -9, -15, 26},
+    {-9, -25, 51, -30, 18, -39, 24, -7, 1, -39, 19, 41, 2, -10, -61, 43, 127, 22, 105, -40, 19, 5, 7, -62, 63, 54, 13, 12, -59, 12, 11, -5},
+    {8, -34, 5, -19, -10, -44, 71, -21, -6, -1, 30, 20, -22, -7, -37, 2, -21, -14, -3, -49, -20, -29, -4, 81, 5, -17, -24, -13, 54, -5, 16, -47},
+    {46, 106, -25, -17, 32, -38, -25, -33, -6, 94, -29, -57, 36, 20, 10, 16, 9, -56, -31, 32, -17, -3, -37, -25, 25, 12, -1, 37, -31, -35, 29, 24},
+};
+static const float sound_events_b2[SOUND_EVENTS_NUM_CLASSES] = {
+    0.217533424f, 0.0772147924f, -0.00293606124f, -0.121738657f, -0.170073494f,
+};
+static const float sound_events_l2_scale = 0.00108695391f;
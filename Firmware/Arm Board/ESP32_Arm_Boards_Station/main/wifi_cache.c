@@ -0,0 +1,37 @@
+#include "esp_log.h"
+#include "nvs.h"
+#include "wifi_cache.h"
+
+static const char *TAG = "wifi_cache";
+
+#define NVS_NAMESPACE   "wifi_cache"
+#define NVS_KEY         "ap"
+
+bool wifi_cache_load(wifi_cache_t *cache) {
+    nvs_handle_t nvs;
+    size_t size = sizeof(*cache);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;   // never written
+    }
+    esp_err_t res = nvs_get_blob(nvs, NVS_KEY, cache, &size);
+    nvs_close(nvs);
+    return res == ESP_OK && size == sizeof(*cache) && cache->channel >= 1 && cache->channel <= 14;
+}
+
+esp_err_t wifi_cache_save(const wifi_cache_t *cache) {
+    nvs_handle_t nvs;
+    esp_err_t res = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(res));
+        return res;
+    }
+    res = nvs_set_blob(nvs, NVS_KEY, cache, sizeof(*cache));
+    if (res == ESP_OK) {
+        res = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save the access point: %s", esp_err_to_name(res));
+    }
+    return res;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// The access point the station last associated with, kept in NVS
+//
+// Without it the station scans every channel for the SSID before it
+// associates, which keeps the microphones offline for seconds after a battery
+// swap or a brownout. With the cached channel and BSSID it probes that one
+// channel and associates right away; main.c falls back to the full scan when
+// the access point is not found there. The IP configuration is static
+// (static_ip in main.c), so there is no DHCP exchange that would need caching.
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_cache_t;
+
+// false when nothing is cached yet or the entry is unusable
+bool wifi_cache_load(wifi_cache_t *cache);
+
+// Overwrites the cached entry; call it only when the access point changed, every call is a flash write
+esp_err_t wifi_cache_save(const wifi_cache_t *cache);
@@ -0,0 +1,481 @@
+# Host side companion for the on-device sound event classifier (main/sound_events.c)
+#
+#   python sound_events_tool.py train <dataset>   fit the int8 model and write main/sound_events_model.h
+#   python sound_events_tool.py eval <dataset>    run the quantized model over a WAV dataset
+#   python sound_events_tool.py synth <dataset>   write a synthetic dataset
+#   python sound_events_tool.py listen            print the events the arm board broadcasts
+#
+# A dataset is a folder with one sub folder per label, each holding WAV files:
+#   dataset/background/*.wav, dataset/alarm/*.wav, dataset/doorbell/*.wav, ...
+# The first label is always "background". WAVs can be mono or 4 channel 16-bit,
+# they are resampled to the board's 24 kHz by linear interpolation.
+#
+# The model in main/sound_events_model.h is trained on `synth` output: beeping
+# alarms, two-tone door chimes, wailing and yelping sirens and knock series
+# over noise, hum and babble. It is a starting point that works on clear
+# sounds; a model trained on recordings from the room does better.
+#
+# The front-end and the int8 inference below mirror the firmware step for step,
+# so the numbers reported by `eval` are the ones the board will produce.
+
+import argparse
+import json
+import os
+import socket
+import sys
+import time
+import wave
+
+import numpy as np
+
+# Keep in sync with main/sound_events.h
+SAMPLE_RATE = 24000
+CHANNELS = 4
+FFT_SIZE = 512
+HOP = 256
+MEL_BANDS = 32
+MEL_FMIN = 100.0
+MEL_FMAX = 10000.0
+WINDOW_FRAMES = 64
+STRIDE_FRAMES = 32
+FEATURES = MEL_BANDS * 3
+UDP_PORT = 5006
+
+HIDDEN = 32
+INPUT_SCALE = 32.0
+DEFAULT_LABELS = ["background", "alarm", "doorbell", "siren", "knock", "name"]
+MODEL_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "main", "sound_events_model.h")
+
+
+def c_round(x):
+    """Round half away from zero like lroundf()."""
+    return np.sign(x) * np.floor(np.abs(x) + 0.5)
+
+
+def hz_to_mel(hz):
+    return 2595.0 * np.log10(1.0 + hz / 700.0)
+
+
+def mel_to_hz(mel):
+    return 700.0 * (10.0 ** (mel / 2595.0) - 1.0)
+
+
+def mel_matrix():
+    """Triangular filters evaluated exactly like frontend_push_hop()."""
+    edges = mel_to_hz(np.linspace(hz_to_mel(MEL_FMIN), hz_to_mel(MEL_FMAX), MEL_BANDS + 2))
+    bin_hz = SAMPLE_RATE / FFT_SIZE
+    freqs = np.arange(FFT_SIZE // 2 + 1) * bin_hz
+    weights = np.zeros((MEL_BANDS, FFT_SIZE // 2 + 1), dtype=np.float32)
+    for m in range(MEL_BANDS):
+        lo, center, hi = edges[m], edges[m + 1], edges[m + 2]
+        k_lo = int(lo / bin_hz) + 1
+        k_hi = min(int(hi / bin_hz), FFT_SIZE // 2)
+        for k in range(k_lo, k_hi + 1):
+            f = freqs[k]
+            w = (f - lo) / (center - lo) if f <= center else (hi - f) / (hi - center)
+            if w > 0:
+                weights[m, k] = w
+    return weights
+
+
+MEL = mel_matrix()
+HANN = 0.5 - 0.5 * np.cos(2.0 * np.pi * np.arange(FFT_SIZE) / FFT_SIZE)
+
+
+def load_wav(path):
+    """Return an (n, CHANNELS) int16 array at SAMPLE_RATE."""
+    with wave.open(path, "rb") as wav_file:
+        if wav_file.getsampwidth() != 2:
+            raise ValueError(f"{path}: only 16-bit WAV files are supported")
+        channels = wav_file.getnchannels()
+        rate = wav_file.getframerate()
+        data = np.frombuffer(wav_file.readframes(wav_file.getnframes()), dtype=np.int16)
+    data = data.reshape(-1, channels).astype(np.float64)
+    if rate != SAMPLE_RATE:
+        t_out = np.arange(int(len(data) * SAMPLE_RATE / rate)) / SAMPLE_RATE
+        t_in = np.arange(len(data)) / rate
+        data = np.stack([np.interp(t_out, t_in, data[:, c]) for c in range(channels)], axis=1)
+    if channels != CHANNELS:
+        data = np.repeat(data.mean(axis=1, keepdims=True), CHANNELS, axis=1)
+    return np.clip(np.round(data), -32768, 32767).astype(np.int16)
+
+
+def logmel_frames(samples):
+    """Log-mel frames for every hop, same sliding history as the firmware."""
+    mono = samples.astype(np.float32).sum(axis=1) / 32768.0 / CHANNELS
+    hops = len(mono) // HOP
+    history = np.concatenate([np.zeros(FFT_SIZE - HOP, dtype=np.float32), mono[:hops * HOP]])
+    frames = np.lib.stride_tricks.sliding_window_view(history, FFT_SIZE)[::HOP][:hops]
+    power = np.abs(np.fft.rfft(frames * HANN, axis=1)) ** 2
+    return 10.0 * np.log10(power @ MEL.T + 1e-10)
+
+
+def window_features(samples):
+    """One feature vector per inference the firmware would run on this audio."""
+    logmel = logmel_frames(samples)
+    out = []
+    for end in range(WINDOW_FRAMES, len(logmel) + 1, STRIDE_FRAMES):
+        window = logmel[end - WINDOW_FRAMES:end]
+        out.append(np.concatenate([window.mean(axis=0), window.max(axis=0), window.std(axis=0)]))
+    return np.array(out, dtype=np.float32).reshape(-1, FEATURES)
+
+
+def synth_noise(rng, n):
+    """Background: white, pink or brown noise, mains hum and formant-filtered babble, mixed at random levels"""
+    t = np.arange(n) / SAMPLE_RATE
+    white = rng.normal(0, 1, n)
+    spectrum = np.fft.rfft(white)
+    f = np.maximum(np.fft.rfftfreq(n, 1 / SAMPLE_RATE), 20.0)
+    colored = np.fft.irfft(spectrum / f ** rng.choice([0.0, 0.5, 1.0]), n)
+    out = colored / (np.abs(colored).max() + 1e-9) * rng.uniform(0.005, 0.1)
+    if rng.random() < 0.5:
+        mains = rng.choice([50.0, 60.0])
+        out += sum(rng.uniform(0, 0.02) / k * np.sin(2 * np.pi * mains * k * t) for k in range(1, 6))
+    if rng.random() < 0.5:
+        # Voiced babble: a wandering pitch through two moving formants
+        pitch = rng.uniform(90, 250) * (1 + 0.2 * np.sin(2 * np.pi * rng.uniform(0.5, 3) * t))
+        pulses = np.sign(np.sin(2 * np.pi * np.cumsum(pitch) / SAMPLE_RATE))
+        spectrum = np.fft.rfft(pulses)
+        freqs = np.fft.rfftfreq(n, 1 / SAMPLE_RATE)
+        shape = sum(np.exp(-((freqs - rng.uniform(lo, hi)) / 150.0) ** 2) for lo, hi in ((300, 900), (900, 2500)))
+        voice = np.fft.irfft(spectrum * shape, n)
+        syllables = (np.sin(2 * np.pi * rng.uniform(2, 5) * t + rng.uniform(0, 6)) > 0).astype(float)
+        out += voice / (np.abs(voice).max() + 1e-9) * syllables * rng.uniform(0.02, 0.2)
+    return out
+
+
+def synth_event(rng, label, n):
+    """One clip of the event, repeating over the whole clip so every window holds some of it"""
+    t = np.arange(n) / SAMPLE_RATE
+    if label == "alarm":
+        # Beeps, 2-4 kHz square-ish tone switched on and off at 1.5-4 Hz
+        tone = np.tanh(3 * np.sin(2 * np.pi * rng.uniform(2000, 4000) * t))
+        gate = (np.sin(2 * np.pi * rng.uniform(1.5, 4) * t + rng.uniform(0, 6)) > rng.uniform(-0.3, 0.3))
+        return tone * gate
+    if label == "doorbell":
+        # Ding-dong: two decaying bell tones a third or fourth apart, with an inharmonic overtone
+        out = np.zeros(n)
+        period = int(rng.uniform(0.9, 1.4) * SAMPLE_RATE)
+        high = rng.uniform(500, 900)
+        for start in range(int(rng.uniform(0, 0.3) * SAMPLE_RATE), n, period):
+            for k, pitch in enumerate((high, high / rng.choice([1.26, 1.33]))):
+                begin = start + k * period // 2
+                tt = np.arange(n - begin) / SAMPLE_RATE if begin < n else np.zeros(0)
+                decay = np.exp(-tt / rng.uniform(0.3, 0.8))
+                out[begin:] += decay * (np.sin(2 * np.pi * pitch * tt) + 0.3 * np.sin(2 * np.pi * 2.76 * pitch * tt))
+        return out
+    if label == "siren":
+        # Wail (slow sweep) or yelp (fast sweep) between about 600 and 1600 Hz
+        rate = rng.uniform(0.2, 0.6) if rng.random() < 0.5 else rng.uniform(2.5, 5)
+        lo, hi = rng.uniform(500, 800), rng.uniform(1200, 1800)
+        pitch = lo + (hi - lo) * 0.5 * (1 + np.sin(2 * np.pi * rate * t + rng.uniform(0, 6)))
+        phase = 2 * np.pi * np.cumsum(pitch) / SAMPLE_RATE
+        return np.sin(phase) + 0.3 * np.sin(2 * phase)
+    if label == "knock":
+        # Series of 2-5 knocks: short damped low resonances with a click
+        out = np.zeros(n)
+        period = int(rng.uniform(0.5, 0.9) * SAMPLE_RATE)
+        for start in range(int(rng.uniform(0, 0.2) * SAMPLE_RATE), n, period):
+            gap = int(rng.uniform(0.1, 0.2) * SAMPLE_RATE)
+            for k in range(rng.integers(2, 6)):
+                begin = start + k * gap
+                length = min(int(0.08 * SAMPLE_RATE), n - begin)
+                if length <= 0:
+                    break
+                tt = np.arange(length) / SAMPLE_RATE
+                body = np.sin(2 * np.pi * rng.uniform(120, 400) * tt) * np.exp(-tt / rng.uniform(0.01, 0.03))
+                click = rng.normal(0, 1, length) * np.exp(-tt / 0.002)
+                out[begin:begin + length] += body + 0.5 * click
+        return out
+    raise ValueError(f"No synthetic sound for '{label}'")
+
+
+SYNTH_LABELS = ["background", "alarm", "doorbell", "siren", "knock"]
+
+
+def synth_dataset(root, clips, seconds, seed):
+    """Write clips of every SYNTH_LABELS label to root/<label>/*.wav, events at 0-30 dB over the background"""
+    rng = np.random.default_rng(seed)
+    n = int(seconds * SAMPLE_RATE)
+    for label in SYNTH_LABELS:
+        folder = os.path.join(root, label)
+        os.makedirs(folder, exist_ok=True)
+        for i in range(clips):
+            audio = synth_noise(rng, n)
+            if label != "background":
+                event = synth_event(rng, label, n)
+                noise_rms = np.sqrt(np.mean(audio ** 2)) + 1e-9
+                event *= noise_rms * 10 ** (rng.uniform(0, 30) / 20) / (np.sqrt(np.mean(event ** 2)) + 1e-9)
+                audio = audio + event
+            # Any level from quiet to nearly full scale
+            audio *= rng.uniform(0.02, 0.9) / (np.abs(audio).max() + 1e-9)
+            with wave.open(os.path.join(folder, f"{label}_{i:04d}.wav"), "wb") as wav_file:
+                wav_file.setnchannels(1)
+                wav_file.setsampwidth(2)
+                wav_file.setframerate(SAMPLE_RATE)
+                wav_file.writeframes(np.round(audio * 32767).astype(np.int16).tobytes())
+
+
+def load_dataset(root, labels=None):
+    if labels is None:
+        found = sorted(d for d in os.listdir(root) if os.path.isdir(os.path.join(root, d)))
+        if "background" not in found:
+            raise ValueError(f"{root} needs a 'background' folder")
+        labels = ["background"] + [d for d in found if d != "background"]
+    features, targets, files = [], [], []
+    for index, label in enumerate(labels):
+        folder = os.path.join(root, label)
+        if not os.path.isdir(folder):
+            continue
+        for name in sorted(os.listdir(folder)):
+            if not name.lower().endswith(".wav"):
+                continue
+            f = window_features(load_wav(os.path.join(folder, name)))
+            features.append(f)
+            targets.append(np.full(len(f), index))
+            files.extend([name] * len(f))
+    if not features:
+        raise ValueError(f"No WAV files found under {root}")
+    return labels, np.concatenate(features), np.concatenate(targets), files
+
+
+class QuantizedModel:
+    """The int8 MLP exactly as classify() runs it."""
+
+    def __init__(self, labels, mean, inv_std, w1, b1, l1_requant, w2, b2, l2_scale, threshold):
+        self.labels = labels
+        self.mean, self.inv_std = mean, inv_std
+        self.w1, self.b1, self.l1_requant = w1, b1, l1_requant
+        self.w2, self.b2, self.l2_scale = w2, b2, l2_scale
+        self.threshold = threshold
+
+    def predict(self, features):
+        z = (features - self.mean) * self.inv_std
+        x = np.clip(c_round(z * INPUT_SCALE), -127, 127).astype(np.int32)
+        acc = x @ self.w1.T.astype(np.int32) + self.b1
+        h = np.clip(c_round(np.maximum(acc, 0) * self.l1_requant), 0, 127).astype(np.int32)
+        logits = (h @ self.w2.T.astype(np.int32)) * self.l2_scale + self.b2
+        logits -= logits.max(axis=1, keepdims=True)
+        prob = np.exp(logits)
+        prob /= prob.sum(axis=1, keepdims=True)
+        return prob.argmax(axis=1), prob.max(axis=1)
+
+    def decide(self, features):
+        """Apply the firmware's confidence gate: weak detections count as background."""
+        label, confidence = self.predict(features)
+        label[confidence < self.threshold] = 0
+        return label, confidence
+
+
+def train(features, targets, n_classes, epochs, lr, seed=0):
+    """Plain numpy softmax MLP, float weights."""
+    rng = np.random.default_rng(seed)
+    mean = features.mean(axis=0)
+    std = features.std(axis=0) + 1e-3
+    z = (features - mean) / std
+    w1 = rng.normal(0, np.sqrt(2.0 / FEATURES), (HIDDEN, FEATURES))
+    b1 = np.zeros(HIDDEN)
+    w2 = rng.normal(0, np.sqrt(1.0 / HIDDEN), (n_classes, HIDDEN))
+    b2 = np.zeros(n_classes)
+    onehot = np.eye(n_classes)[targets]
+    # Balance classes, background windows usually dominate the dataset
+    weight = (len(targets) / (n_classes * np.maximum(np.bincount(targets, minlength=n_classes), 1)))[targets]
+    for epoch in range(epochs):
+        for batch in np.array_split(rng.permutation(len(z)), max(1, len(z) // 64)):
+            h_pre = z[batch] @ w1.T + b1
+            h = np.maximum(h_pre, 0)
+            logits = h @ w2.T + b2
+            logits -= logits.max(axis=1, keepdims=True)
+            prob = np.exp(logits)
+            prob /= prob.sum(axis=1, keepdims=True)
+            d_logits = (prob - onehot[batch]) * weight[batch, None] / len(batch)
+            d_h = (d_logits @ w2) * (h_pre > 0)
+            w2 -= lr * d_logits.T @ h
+            b2 -= lr * d_logits.sum(axis=0)
+            w1 -= lr * d_h.T @ z[batch]
+            b1 -= lr * d_h.sum(axis=0)
+    return mean, std, w1, b1, w2, b2
+
+
+def quantize(labels, mean, std, w1, b1, w2, b2, features, threshold):
+    """Symmetric per-layer int8 quantization, hidden scale calibrated on the training set."""
+    s_in = 1.0 / INPUT_SCALE
+    s_w1 = np.abs(w1).max() / 127.0
+    h = np.maximum(((features - mean) / std) @ w1.T + b1, 0)
+    s_h = max(np.percentile(h, 99.9), 1e-6) / 127.0
+    s_w2 = np.abs(w2).max() / 127.0
+    return QuantizedModel(
+        labels,
+        mean.astype(np.float32), (1.0 / std).astype(np.float32),
+        c_round(w1 / s_w1).astype(np.int8), c_round(b1 / (s_in * s_w1)).astype(np.int32),
+        np.float32(s_in * s_w1 / s_h),
+        c_round(w2 / s_w2).astype(np.int8), b2.astype(np.float32), np.float32(s_h * s_w2),
+        threshold)
+
+
+def c_array(values, per_line=12, fmt="{}"):
+    items = [fmt.format(v) for v in np.asarray(values).ravel()]
+    lines = [", ".join(items[i:i + per_line]) for i in range(0, len(items), per_line)]
+    return "\n    " + ",\n    ".join(lines) + ",\n"
+
+
+def write_header(model, path):
+    f32 = "{:.9g}f"
+    rows1 = "".join("    {" + c_array(r, 24).rstrip(",\n").strip() + "},\n" for r in model.w1)
+    rows2 = "".join("    {" + c_array(r, 32).rstrip(",\n").strip() + "},\n" for r in model.w2)
+    labels = ", ".join(f'"{l}"' for l in model.labels)
+    text = f"""// Generated by sound_events_tool.py train -- do not edit by hand.
+#pragma once
+
+#include "sound_events.h"
+
+#define SOUND_EVENTS_MODEL_VALID        1
+#define SOUND_EVENTS_NUM_CLASSES        {len(model.labels)}
+#define SOUND_EVENTS_HIDDEN             {HIDDEN}
+#define SOUND_EVENTS_BACKGROUND_CLASS   0
+#define SOUND_EVENTS_INPUT_SCALE        {INPUT_SCALE:.1f}f
+
+static const char *const sound_events_labels[SOUND_EVENTS_NUM_CLASSES] = {{
+    {labels},
+}};
+
+static const float sound_events_threshold = {model.threshold:.2f}f;
+
+static const float sound_events_feat_mean[SOUND_EVENTS_FEATURES] = {{{c_array(model.mean, 8, f32)}}};
+static const float sound_events_feat_inv_std[SOUND_EVENTS_FEATURES] = {{{c_array(model.inv_std, 8, f32)}}};
+
+static const int8_t sound_events_w1[SOUND_EVENTS_HIDDEN][SOUND_EVENTS_FEATURES] = {{
+{rows1}}};
+static const int32_t sound_events_b1[SOUND_EVENTS_HIDDEN] = {{{c_array(model.b1, 12)}}};
+static const float sound_events_l1_requant = {model.l1_requant:.9g}f;
+
+static const int8_t sound_events_w2[SOUND_EVENTS_NUM_CLASSES][SOUND_EVENTS_HIDDEN] = {{
+{rows2}}};
+static const float sound_events_b2[SOUND_EVENTS_NUM_CLASSES] = {{{c_array(model.b2, 8, f32)}}};
+static const float sound_events_l2_scale = {model.l2_scale:.9g}f;
+"""
+    with open(path, "w") as header:
+        header.write(text)
+
+
+def read_header(path):
+    """Load the model back from the generated header so eval runs what is flashed."""
+    import re
+    text = open(path).read()
+    if "SOUND_EVENTS_MODEL_VALID        1" not in text:
+        raise ValueError(f"{path} does not contain a trained model, run `train` first")
+
+    def block(name):
+        body = re.search(name + r"\[[^=]*=\s*\{(.*?)\};", text, re.S).group(1)
+        return np.array([float(v.rstrip("f")) for v in re.findall(r"-?[\d.]+(?:e[-+]?\d+)?f?", body)])
+
+    def scalar(name):
+        return np.float32(re.search(name + r"\s*=\s*([-\d.e+]+)f;", text).group(1))
+
+    labels = re.findall(r'"([^"]+)"', re.search(r"sound_events_labels.*?\{(.*?)\};", text, re.S).group(1))
+    return QuantizedModel(
+        labels,
+        block("sound_events_feat_mean").astype(np.float32), block("sound_events_feat_inv_std").astype(np.float32),
+        block("sound_events_w1").reshape(HIDDEN, FEATURES).astype(np.int8), block("sound_events_b1").astype(np.int32),
+        scalar("sound_events_l1_requant"),
+        block("sound_events_w2").reshape(len(labels), HIDDEN).astype(np.int8), block("sound_events_b2").astype(np.float32),
+        scalar("sound_events_l2_scale"), float(scalar("sound_events_threshold")))
+
+
+def report(model, features, targets):
+    start = time.perf_counter()
+    predicted, _ = model.decide(features)
+    elapsed = time.perf_counter() - start
+    n = len(model.labels)
+    confusion = np.zeros((n, n), dtype=int)
+    np.add.at(confusion, (targets, predicted), 1)
+
+    width = max(len(l) for l in model.labels) + 2
+    print("\nConfusion matrix (rows = truth, columns = prediction):")
+    print(" " * width + "".join(f"{l[:8]:>9}" for l in model.labels))
+    for i, label in enumerate(model.labels):
+        print(f"{label:<{width}}" + "".join(f"{v:>9}" for v in confusion[i]))
+    print(f"\n{'label':<{width}}{'precision':>10}{'recall':>10}{'windows':>10}")
+    for i, label in enumerate(model.labels):
+        precision = confusion[i, i] / max(confusion[:, i].sum(), 1)
+        recall = confusion[i, i] / max(confusion[i].sum(), 1)
+        print(f"{label:<{width}}{precision:>10.2f}{recall:>10.2f}{confusion[i].sum():>10}")
+    print(f"\nAccuracy: {np.trace(confusion) / max(len(targets), 1):.3f} over {len(targets)} windows")
+    print(f"Host inference: {elapsed / max(len(targets), 1) * 1e6:.1f} us per window "
+          f"(on-device latency is logged by the firmware, see SOUND_EVENTS_BENCHMARK_RUNS)")
+
+
+def cmd_train(args):
+    labels, features, targets, _ = load_dataset(args.dataset)
+    print(f"Training on {len(targets)} windows, labels: {', '.join(labels)}")
+    params = train(features, targets, len(labels), args.epochs, args.lr)
+    model = quantize(labels, *params, features, args.threshold)
+    report(model, features, targets)
+    write_header(model, args.output)
+    print(f"\nModel written to {args.output}")
+
+
+def cmd_eval(args):
+    model = read_header(args.model)
+    labels, features, targets, _ = load_dataset(args.dataset, model.labels)
+    report(model, features, targets)
+
+
+def cmd_synth(args):
+    synth_dataset(args.dataset, args.clips, args.seconds, args.seed)
+    print(f"Wrote {args.clips} clips of {args.seconds} s for {', '.join(SYNTH_LABELS)} to {args.dataset}")
+
+
+def cmd_listen(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", args.port))
+    print(f"Listening for sound events on UDP port {args.port}")
+    try:
+        while True:
+            data, addr = sock.recvfrom(1024)
+            event = json.loads(data)
+            print(f"{addr[0]}: {event['event']:<12} confidence {event['confidence']:.2f} "
+                  f"azimuth {event['azimuth_deg']:>4} deg  inference {event['infer_us']} us")
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sound event classifier tools")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("train", help="train the classifier and export main/sound_events_model.h")
+    p.add_argument("dataset")
+    p.add_argument("--output", default=MODEL_HEADER)
+    p.add_argument("--epochs", type=int, default=200)
+    p.add_argument("--lr", type=float, default=0.05)
+    p.add_argument("--threshold", type=float, default=0.6)
+    p.set_defaults(func=cmd_train)
+
+    p = sub.add_parser("eval", help="evaluate the exported model on a WAV dataset")
+    p.add_argument("dataset")
+    p.add_argument("--model", default=MODEL_HEADER)
+    p.set_defaults(func=cmd_eval)
+
+    p = sub.add_parser("synth", help="write a synthetic dataset of the sounds the shipped model knows")
+    p.add_argument("dataset")
+    p.add_argument("--clips", type=int, default=200, help="clips per label")
+    p.add_argument("--seconds", type=float, default=2.0)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=cmd_synth)
+
+    p = sub.add_parser("listen", help="print events broadcast by the arm board")
+    p.add_argument("--port", type=int, default=UDP_PORT)
+    p.set_defaults(func=cmd_listen)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except ValueError as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
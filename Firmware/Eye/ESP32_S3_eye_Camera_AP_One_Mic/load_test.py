@@ -0,0 +1,172 @@
+# Concurrent client load test for the board HTTP servers
+#
+# Opens several /stream (MJPEG) and /ach1 (audio) clients at once and polls
+# /status while they run. Each endpoint is served by its own worker task, so
+# every stream should keep its rate and /status should answer promptly the
+# whole time. A stream that stalls or a slow /status means a handler is
+# blocking the httpd task again.
+#
+#   python load_test.py                                  Eye: 2 video, 1 audio client, 20 s
+#   python load_test.py --video 3 --audio 2              expect 503 for the clients over the limits
+#   python load_test.py --ip 192.168.4.254 --video 0 --audio-path "/ach1?ch=0,1"   arm board
+#
+# On the Eye it also prints how much video the shaper held back for the audio
+# during the run (the shaper counters of /status), and the camera frames
+# captured, skipped and how old they were when sent.
+#
+# Needs requests. Exits non-zero if /status failed or was slower than --max-status-ms.
+
+import argparse
+import threading
+import time
+
+import requests
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+BOUNDARY = b"--123456789000000000000987654321"
+
+
+class ClientResult:
+    def __init__(self, name):
+        self.name = name
+        self.status = None
+        self.ttfb = None            # seconds to the first body byte
+        self.bytes = 0
+        self.units = 0              # frames for video, samples for audio
+        self.max_gap = 0.0          # longest time without data once streaming
+        self.duration = 0.0
+        self.error = None
+
+
+def stream_client(url, result, stop, kind):
+    start = time.monotonic()
+    try:
+        response = requests.get(url, stream=True, timeout=5)
+        result.status = response.status_code
+        if response.status_code != 200:
+            response.close()
+            return
+        sample_bytes = 2 * int(response.headers.get("X-Audio-Channels", "1"))
+        tail = b""
+        last = None
+        for chunk in response.iter_content(chunk_size=4096):
+            now = time.monotonic()
+            if last is None:
+                result.ttfb = now - start
+            else:
+                result.max_gap = max(result.max_gap, now - last)
+            last = now
+            result.bytes += len(chunk)
+            if kind == "video":
+                # Count part boundaries, keeping a tail in case one is split between chunks
+                data = tail + chunk
+                result.units += data.count(BOUNDARY)
+                tail = data[-(len(BOUNDARY) - 1):]
+            else:
+                result.units = result.bytes // sample_bytes
+            if stop.is_set():
+                break
+        response.close()
+    except requests.RequestException as e:
+        result.error = str(e)
+    finally:
+        result.duration = time.monotonic() - start
+
+
+def status_poller(url, interval, latencies, failures, stop, snapshots):
+    while not stop.is_set():
+        start = time.monotonic()
+        try:
+            response = requests.get(url, timeout=5)
+            if response.status_code == 200:
+                latencies.append(time.monotonic() - start)
+                # The first and the latest answer, for the counters over the run
+                snapshots[min(len(snapshots), 1):] = [response.json()]
+            else:
+                failures.append(f"HTTP {response.status_code}")
+        except requests.RequestException as e:
+            failures.append(str(e))
+        stop.wait(max(0.0, interval - (time.monotonic() - start)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Drive concurrent stream clients against a board")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--video", type=int, default=2, help="number of /stream clients")
+    parser.add_argument("--audio", type=int, default=1, help="number of /ach1 clients")
+    parser.add_argument("--video-path", default="/stream")
+    parser.add_argument("--audio-path", default="/ach1")
+    parser.add_argument("--status-path", default="/status")
+    parser.add_argument("--status-hz", type=float, default=2.0)
+    parser.add_argument("--duration", type=float, default=20.0, help="seconds")
+    parser.add_argument("--max-status-ms", type=float, default=500.0)
+    args = parser.parse_args()
+
+    base = f"http://{args.ip}"
+    stop = threading.Event()
+    results = []
+    threads = []
+    for kind, count, path in (("video", args.video, args.video_path), ("audio", args.audio, args.audio_path)):
+        for i in range(count):
+            result = ClientResult(f"{kind} {i + 1}")
+            results.append((kind, result))
+            threads.append(threading.Thread(target=stream_client, args=(base + path, result, stop, kind), daemon=True))
+    latencies, failures, snapshots = [], [], []
+    threads.append(threading.Thread(target=status_poller, daemon=True,
+                                    args=(base + args.status_path, 1.0 / args.status_hz, latencies, failures, stop,
+                                          snapshots)))
+
+    print(f"{args.video} video and {args.audio} audio clients against {base} for {args.duration:.0f} s")
+    for t in threads:
+        t.start()
+    try:
+        time.sleep(args.duration)
+    except KeyboardInterrupt:
+        pass
+    stop.set()
+    for t in threads:
+        t.join(timeout=10)
+
+    print(f"\n{'client':<10}{'HTTP':>6}{'TTFB ms':>10}{'kB/s':>10}{'rate':>14}{'max gap ms':>12}")
+    for kind, r in results:
+        if r.status != 200:
+            print(f"{r.name:<10}{r.status or '-':>6}   {r.error or ''}")
+            continue
+        seconds = max(r.duration - (r.ttfb or 0), 1e-6)
+        rate = f"{r.units / seconds:.1f} fps" if kind == "video" else f"{r.units / seconds:.0f} S/s"
+        print(f"{r.name:<10}{r.status:>6}{(r.ttfb or 0) * 1000:>10.0f}{r.bytes / seconds / 1000:>10.1f}"
+              f"{rate:>14}{r.max_gap * 1000:>12.0f}")
+
+    ok = not failures
+    if latencies:
+        ordered = sorted(latencies)
+        p95 = ordered[int(0.95 * (len(ordered) - 1))]
+        print(f"\n/status: {len(latencies)} answered, median {ordered[len(ordered) // 2] * 1000:.0f} ms, "
+              f"p95 {p95 * 1000:.0f} ms, max {ordered[-1] * 1000:.0f} ms, {len(failures)} failed")
+        ok = ok and ordered[-1] * 1000 <= args.max_status_ms
+    else:
+        print(f"\n/status: never answered ({len(failures)} failures)")
+        ok = False
+    for failure in failures[:5]:
+        print(f"  {failure}")
+    if len(snapshots) == 2 and "shaper" in snapshots[0]:
+        before, after = snapshots[0]["shaper"], snapshots[1]["shaper"]
+        d = {key: after[key] - before[key] for key in after if key not in ("kbps", "burst")}
+        print(f"\nshaper ({after['kbps']} kbit/s, {after['burst'] // 1024} KB burst): {d['bytes'] / 1000:.0f} kB video, "
+              f"{d['deferred']} of {d['slices']} slices deferred ({d['deferred_bytes'] / 1000:.0f} kB, "
+              f"{d['deferred_ms']} ms), {d['audio_yields']} yields to audio ({d['audio_wait_ms']} ms), "
+              f"{d['audio_timeouts']} timeouts")
+    if len(snapshots) == 2 and "camera" in snapshots[0]:
+        before, after = snapshots[0]["camera"], snapshots[1]["camera"]
+        d = {key: after[key] - before[key] for key in ("captured", "failures", "delivered", "skipped")}
+        capture, sent = after["capture_age_us"], after["sent_age_us"]
+        print(f"camera: {d['captured']} frames captured, {d['failures']} failures, {d['delivered']} delivered, "
+              f"{d['skipped']} skipped; age at capture avg {capture['avg'] / 1000:.1f} ms "
+              f"max {capture['max'] / 1000:.1f} ms, when sent avg {sent['avg'] / 1000:.1f} ms "
+              f"max {sent['max'] / 1000:.1f} ms (since boot)")
+    print("PASS" if ok else "FAIL")
+    raise SystemExit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,612 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "sdkconfig.h"
+#include "av_hub.h"
+#include "stream_frame.h"
+#include "video_shaper.h"
+
+static const char *TAG = "av_hub";
+
+#define HUB_TASK_STACK          4096
+#define HUB_TASK_PRIORITY       (tskIDLE_PRIORITY + 6)  // same as the audio worker
+#define HUB_RENEW_TASK_PRIORITY (tskIDLE_PRIORITY + 2)  // only HTTP requests every few seconds
+#define HUB_RETRY_MS            1000    // wait before reconnecting to an arm board
+#define HUB_IDLE_POLL_MS        500     // how often an idle source checks for a client
+#define HUB_READ_TIMEOUT_MS     2000
+#define HUB_OFFSET_WINDOW_US    5000000 // minimum transit over two such windows, follows clock drift
+#define ARM_SAMPLE_RATE         24000
+#define ARM_BLOCK_FRAMES        120     // AUDIO_RING_BLOCK_FRAMES on the arm board
+#define ARM_BLOCK_MAGIC         "IRLA"
+#define ARM_BLOCK_FLAG_CONCEALED 0x01   // AUDIO_BLOCK_FLAG_CONCEALED
+#define ARM_BLOCK_FLAG_SYNCED   0x02    // AUDIO_BLOCK_FLAG_SYNCED
+#define HUB_ESPNOW_RENEW_MS     3000    // the arm board stops after 10 s without a renewal
+#define HUB_ESPNOW_QUEUE_LEN    32      // about 30 ms of four-channel fragments
+#define HUB_ESPNOW_POLL_MS      5       // releases blocks that stopped waiting for fragments
+
+#ifdef CONFIG_AV_HUB_ESPNOW
+#define HUB_ESPNOW              1
+#else
+#define HUB_ESPNOW              0
+#endif
+
+/* Mirror of audio_block_header_t in the arm board's main/audio_levels.h */
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint32_t seq;
+    int64_t timestamp_us;   // first frame, on the Eye clock if ARM_BLOCK_FLAG_SYNCED
+    uint16_t frames;
+    uint8_t channels;
+    uint8_t bits_per_sample;
+    uint8_t channel_mask;
+    uint8_t flags;          // ARM_BLOCK_FLAG_*
+    uint16_t level[4][3];
+    uint32_t latency_us;    // capture to socket on the arm board
+} arm_block_header_t;
+
+_Static_assert(sizeof(arm_block_header_t) == 50, "must match audio_block_header_t on the arm board");
+
+// One ESP-NOW frame as received, queued from the WiFi task to the source task
+typedef struct {
+    uint8_t len;
+    int64_t rx_us;
+    uint8_t data[ESPNOW_AUDIO_MAX_PACKET];
+} hub_espnow_packet_t;
+
+typedef struct {
+    uint8_t number;
+    TaskHandle_t task;
+    av_hub_source_stats_t stats;    // guarded by stats_lock
+    // ESP-NOW mode. The receive callback only accepts frames from mac, which
+    // the arm board reports when the stream is requested.
+    uint8_t mac[6];
+    volatile bool mac_known;
+    QueueHandle_t rx_queue;
+    // The renewals run in their own task, the source task must keep draining
+    // rx_queue meanwhile. renew_lock is held for a renewal in flight.
+    char url[128];
+    volatile bool renewing;
+    SemaphoreHandle_t renew_lock;
+    hub_espnow_packet_t packet;
+    espnow_audio_reassembler_t reassembler;
+    espnow_audio_block_t block;
+} hub_source_t;
+
+// Arm board clock to Eye clock: the running minimum of the transit time over
+// one to two windows, so that it follows clock drift
+typedef struct {
+    int64_t window_start_us;
+    int64_t window_min;
+    int64_t previous_min;
+} hub_offset_t;
+
+// Block numbering of the relayed chunks, for the dropped_blocks count
+typedef struct {
+    hub_offset_t offset;
+    uint32_t next_seq;
+    bool first;
+} hub_relay_t;
+
+static hub_source_t sources[AV_HUB_MAX_SOURCES];
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// The attached /av client. client_lock keeps the records of the camera and of
+// every source from interleaving on the socket.
+static SemaphoreHandle_t client_lock = NULL;
+static stream_socket_t *client = NULL;
+static volatile bool attached = false;
+static bool container = false;     // stream_frame.h frames instead of av_record_header_t records
+
+_Static_assert(sizeof(stream_frame_levels_t) == sizeof(((arm_block_header_t *)0)->level) + sizeof(uint32_t),
+               "levels frame must match the arm board block header");
+
+esp_err_t av_hub_attach(stream_socket_t *out, bool use_container) {
+    esp_err_t res = ESP_OK;
+    xSemaphoreTake(client_lock, portMAX_DELAY);
+    if (client != NULL) {
+        res = ESP_ERR_INVALID_STATE;
+    } else {
+        client = out;
+        container = use_container;
+        attached = true;
+    }
+    xSemaphoreGive(client_lock);
+    if (res == ESP_OK) {
+        // Wake the sources, they connect to their arm boards now
+        for (int i = 0; i < AV_HUB_MAX_SOURCES; i++) {
+            if (sources[i].task != NULL) {
+                xTaskNotifyGive(sources[i].task);
+            }
+        }
+    }
+    return res;
+}
+
+void av_hub_detach(void) {
+    xSemaphoreTake(client_lock, portMAX_DELAY);
+    client = NULL;
+    attached = false;
+    xSemaphoreGive(client_lock);
+}
+
+bool av_hub_attached(void) {
+    return attached;
+}
+
+/* The record as stream_frame.h frames: a JPEG frame for a slice of video, a
+ * levels frame and a PCM frame for an arm board chunk. Everything on /av is
+ * on the Eye clock, so all frames are marked synced. */
+static int container_iov(av_record_type_t type, uint8_t source, uint32_t seq, int64_t timestamp_us,
+                         const void *payload, size_t len, bool more, stream_frame_header_t frames[2],
+                         struct iovec iov[4]) {
+    if (type == AV_RECORD_VIDEO) {
+        stream_frame_encode(&frames[0], source, STREAM_CODEC_JPEG, seq, timestamp_us, 0,
+                            STREAM_FRAME_FLAG_SYNCED | (more ? STREAM_FRAME_FLAG_MORE : 0), payload, len);
+        iov[0] = (struct iovec){ .iov_base = &frames[0], .iov_len = sizeof(frames[0]) };
+        iov[1] = (struct iovec){ .iov_base = (void *)payload, .iov_len = len };
+        return 2;
+    }
+    const arm_block_header_t *block = (const arm_block_header_t *)payload;
+    const uint8_t *samples = (const uint8_t *)payload + sizeof(*block);
+    size_t samples_len = len - sizeof(*block);
+    uint8_t flags = STREAM_FRAME_FLAG_SYNCED;
+    if (block->flags & ARM_BLOCK_FLAG_CONCEALED) {
+        flags |= STREAM_FRAME_FLAG_CONCEALED;
+    }
+    // level[] and latency_us are contiguous in the block header, the layout of stream_frame_levels_t
+    stream_frame_encode(&frames[0], source, STREAM_CODEC_LEVELS, seq, timestamp_us, block->channel_mask, flags,
+                        block->level, sizeof(stream_frame_levels_t));
+    stream_frame_encode(&frames[1], source, STREAM_CODEC_PCM16_24K, seq, timestamp_us, block->channel_mask, flags,
+                        samples, samples_len);
+    iov[0] = (struct iovec){ .iov_base = &frames[0], .iov_len = sizeof(frames[0]) };
+    iov[1] = (struct iovec){ .iov_base = (void *)block->level, .iov_len = sizeof(stream_frame_levels_t) };
+    iov[2] = (struct iovec){ .iov_base = &frames[1], .iov_len = sizeof(frames[1]) };
+    iov[3] = (struct iovec){ .iov_base = (void *)samples, .iov_len = samples_len };
+    return 4;
+}
+
+/* One record, or its container frames, in one writev under client_lock */
+static esp_err_t write_record(av_record_type_t type, uint8_t source, uint32_t seq, int64_t timestamp_us,
+                              const void *payload, size_t len, bool more) {
+    av_record_header_t header = {
+        .magic = AV_RECORD_MAGIC,
+        .type = type,
+        .source = source,
+        .flags = more ? AV_RECORD_FLAG_MORE : 0,
+        .seq = seq,
+        .timestamp_us = timestamp_us,
+        .length = len,
+    };
+    stream_frame_header_t frames[2];
+    struct iovec iov[4] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)payload, .iov_len = len },
+    };
+    int iovcnt = 2;
+    esp_err_t res = ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(client_lock, portMAX_DELAY);
+    if (client != NULL) {
+        if (container) {
+            iovcnt = container_iov(type, source, seq, timestamp_us, payload, len, more, frames, iov);
+        }
+        res = stream_socket_writev(client, iov, iovcnt);
+        if (res != ESP_OK) {
+            // The client is gone, the /av worker notices on its next write
+            client = NULL;
+            attached = false;
+        }
+    }
+    xSemaphoreGive(client_lock);
+    return res;
+}
+
+esp_err_t av_hub_write(av_record_type_t type, uint8_t source, uint32_t seq, int64_t timestamp_us,
+                       const void *payload, size_t len) {
+    if (type == AV_RECORD_AUDIO) {
+        // The camera slice waiting for its tokens lets this one go first
+        video_shaper_audio_begin();
+        esp_err_t res = write_record(type, source, seq, timestamp_us, payload, len, false);
+        video_shaper_audio_end();
+        return res;
+    }
+    // Between two slices the lock is free, an arm board chunk goes out there
+    size_t sent = 0;
+    esp_err_t res;
+    do {
+        size_t slice = len - sent < VIDEO_SHAPER_SLICE ? len - sent : VIDEO_SHAPER_SLICE;
+        video_shaper_wait(slice);
+        res = write_record(type, source, seq, timestamp_us, (const uint8_t *)payload + sent, slice,
+                           sent + slice < len);
+        sent += slice;
+    } while (res == ESP_OK && sent < len);
+    return res;
+}
+
+static esp_err_t read_full(esp_http_client_handle_t http, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        int n = esp_http_client_read(http, (char *)buf, len);
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        buf += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static void relay_init(hub_relay_t *relay) {
+    relay->offset.window_start_us = esp_timer_get_time();
+    relay->offset.window_min = INT64_MAX;
+    relay->offset.previous_min = INT64_MAX;
+    relay->first = true;
+}
+
+static int64_t offset_add(hub_offset_t *offset, int64_t arrival_us, int64_t transit_us) {
+    if (arrival_us - offset->window_start_us > HUB_OFFSET_WINDOW_US) {
+        offset->previous_min = offset->window_min;
+        offset->window_min = INT64_MAX;
+        offset->window_start_us = arrival_us;
+    }
+    if (transit_us < offset->window_min) {
+        offset->window_min = transit_us;
+    }
+    return offset->window_min < offset->previous_min ? offset->window_min : offset->previous_min;
+}
+
+/* Write one arm board chunk (block header plus samples in buf) to the /av
+ * client on the Eye clock and account for it */
+static esp_err_t relay_chunk(hub_source_t *src, hub_relay_t *relay, const uint8_t *buf, size_t len, int64_t arrival_us) {
+    const arm_block_header_t *header = (const arm_block_header_t *)buf;
+    // A synchronized arm board stamps on the Eye clock already. Otherwise: clock
+    // offset plus the fastest transit seen in the last one to two windows.
+    bool synced = header->flags & ARM_BLOCK_FLAG_SYNCED;
+    int64_t offset_us = 0;
+    if (!synced) {
+        offset_us = offset_add(&relay->offset, arrival_us, arrival_us - (header->timestamp_us + header->latency_us));
+    }
+    int64_t timestamp_us = header->timestamp_us + offset_us;
+
+    uint32_t dropped = relay->first ? 0 : header->seq - relay->next_seq;
+    relay->first = false;
+    relay->next_seq = header->seq + header->frames / ARM_BLOCK_FRAMES;
+
+    esp_err_t res = av_hub_write(AV_RECORD_AUDIO, src->number, header->seq, timestamp_us, buf, len);
+    taskENTER_CRITICAL(&stats_lock);
+    src->stats.chunks++;
+    src->stats.bytes += len;
+    src->stats.dropped_blocks += dropped;
+    if (header->flags & ARM_BLOCK_FLAG_CONCEALED) {
+        src->stats.concealed_blocks += header->frames / ARM_BLOCK_FRAMES;
+    }
+    src->stats.synced = synced;
+    src->stats.offset_us = offset_us;
+    src->stats.latency_us = (uint32_t)(esp_timer_get_time() - timestamp_us);
+    taskEXIT_CRITICAL(&stats_lock);
+    return res;
+}
+
+static void set_connected(hub_source_t *src, bool connected) {
+    taskENTER_CRITICAL(&stats_lock);
+    src->stats.connected = connected;
+    if (connected) {
+        src->stats.connects++;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+/* One connection to an arm board, relays its chunks until the connection or
+ * the /av client goes away */
+static void hub_stream(hub_source_t *src, const char *url, uint8_t *buf, size_t buf_size) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = HUB_READ_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t http = esp_http_client_init(&config);
+    if (http == NULL) {
+        return;
+    }
+    if (esp_http_client_open(http, 0) != ESP_OK || esp_http_client_fetch_headers(http) < 0 ||
+        esp_http_client_get_status_code(http) != 200) {
+        ESP_LOGW(TAG, "Source %u: %s not available", src->number, url);
+        esp_http_client_cleanup(http);
+        return;
+    }
+    ESP_LOGI(TAG, "Source %u: streaming %s", src->number, url);
+    set_connected(src, true);
+
+    arm_block_header_t *header = (arm_block_header_t *)buf;
+    hub_relay_t relay;
+    relay_init(&relay);
+
+    while (attached) {
+        if (read_full(http, buf, sizeof(*header)) != ESP_OK) {
+            ESP_LOGW(TAG, "Source %u: connection lost", src->number);
+            break;
+        }
+        int64_t arrival_us = esp_timer_get_time();
+        size_t payload = (size_t)header->frames * header->channels * header->bits_per_sample / 8;
+        if (memcmp(header->magic, ARM_BLOCK_MAGIC, 4) != 0 || sizeof(*header) + payload > buf_size) {
+            ESP_LOGE(TAG, "Source %u: lost block framing", src->number);
+            break;
+        }
+        if (read_full(http, buf + sizeof(*header), payload) != ESP_OK) {
+            ESP_LOGW(TAG, "Source %u: connection lost", src->number);
+            break;
+        }
+        if (relay_chunk(src, &relay, buf, sizeof(*header) + payload, arrival_us) != ESP_OK) {
+            break;
+        }
+    }
+
+    set_connected(src, false);
+    esp_http_client_close(http);
+    esp_http_client_cleanup(http);
+}
+
+/* ESP-NOW frames from the arm boards, called in the WiFi task. Frames are
+ * only copied to the queue of their source here. */
+static void hub_espnow_recv(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+    if (len <= 0 || len > ESPNOW_AUDIO_MAX_PACKET) {
+        return;
+    }
+    for (int i = 0; i < AV_HUB_MAX_SOURCES; i++) {
+        hub_source_t *src = &sources[i];
+        if (src->rx_queue == NULL || !src->mac_known || memcmp(info->src_addr, src->mac, sizeof(src->mac)) != 0) {
+            continue;
+        }
+        hub_espnow_packet_t packet = { .len = (uint8_t)len, .rx_us = esp_timer_get_time() };
+        memcpy(packet.data, data, len);
+        if (xQueueSend(src->rx_queue, &packet, 0) != pdTRUE) {
+            taskENTER_CRITICAL(&stats_lock);
+            src->stats.queue_drops++;
+            taskEXIT_CRITICAL(&stats_lock);
+        }
+        return;
+    }
+}
+
+/* Requests or renews the ESP-NOW stream on the arm board and reads its MAC
+ * from the reply */
+static esp_err_t espnow_request(const char *url, uint8_t mac_out[6]) {
+    char body[256];
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = HUB_READ_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t http = esp_http_client_init(&config);
+    if (http == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t res = ESP_FAIL;
+    if (esp_http_client_open(http, 0) == ESP_OK && esp_http_client_fetch_headers(http) >= 0 &&
+        esp_http_client_get_status_code(http) == 200) {
+        int len = esp_http_client_read(http, body, sizeof(body) - 1);
+        unsigned int mac[6];
+        body[len > 0 ? len : 0] = '\0';
+        const char *field = strstr(body, "\"mac\":\"");
+        if (field != NULL && sscanf(field + 7, "%x:%x:%x:%x:%x:%x",
+                                    &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6) {
+            for (int i = 0; i < 6; i++) {
+                mac_out[i] = (uint8_t)mac[i];
+            }
+            res = ESP_OK;
+        }
+    }
+    esp_http_client_close(http);
+    esp_http_client_cleanup(http);
+    return res;
+}
+
+/* Turns a reassembled ESP-NOW block into the chunk /ach1?framed=1 would have
+ * sent, so that /av looks the same for both links. The levels are computed here
+ * for the microphones in the payload; clips and latency_us are only known on
+ * the arm board and stay 0. */
+static size_t espnow_chunk(const espnow_audio_block_t *block, uint8_t *buf, size_t buf_size) {
+    arm_block_header_t *header = (arm_block_header_t *)buf;
+    size_t bytes = (size_t)block->frames * block->channels * sizeof(int16_t);
+    if (sizeof(*header) + bytes > buf_size) {
+        return 0;
+    }
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, ARM_BLOCK_MAGIC, 4);
+    header->seq = block->seq;
+    header->timestamp_us = block->timestamp_us;
+    header->frames = block->frames;
+    header->channels = block->channels;
+    header->bits_per_sample = 16;
+    header->channel_mask = block->channel_mask;
+    header->flags = (block->missing_fragments > 0 ? ARM_BLOCK_FLAG_CONCEALED : 0) |
+                    (block->flags & ESPNOW_AUDIO_FLAG_SYNCED ? ARM_BLOCK_FLAG_SYNCED : 0);
+    memcpy(buf + sizeof(*header), block->samples, bytes);
+
+    for (int mic = 0, c = 0; mic < 4 && c < block->channels; mic++) {
+        if (!(block->channel_mask & (1 << mic))) {
+            continue;
+        }
+        uint32_t peak = 0;
+        float sum_sq = 0.0f;
+        for (int i = 0; i < block->frames; i++) {
+            int32_t v = block->samples[i * block->channels + c];
+            uint32_t mag = (uint32_t)(v < 0 ? -v : v);
+            if (mag > peak) {
+                peak = mag;
+            }
+            sum_sq += (float)v * (float)v;
+        }
+        header->level[mic][0] = peak > INT16_MAX ? INT16_MAX : peak;
+        header->level[mic][1] = (uint16_t)sqrtf(sum_sq / block->frames);
+        c++;
+    }
+    return sizeof(*header) + bytes;
+}
+
+/* Receives one arm board over ESP-NOW until its frames stop or the /av client
+ * goes away. hub_renew_task renews the stream over HTTP meanwhile. */
+static void hub_espnow(hub_source_t *src, const char *url, const char *stop_url, uint8_t *buf, size_t buf_size) {
+    xQueueReset(src->rx_queue);
+    espnow_audio_reassembler_init(&src->reassembler, ARM_SAMPLE_RATE, CONFIG_AV_HUB_ESPNOW_WAIT_MS * 1000LL);
+    if (espnow_request(url, src->mac) != ESP_OK) {
+        ESP_LOGW(TAG, "Source %u: %s not available", src->number, url);
+        return;
+    }
+    src->mac_known = true;
+    src->renewing = true;
+    ESP_LOGI(TAG, "Source %u: receiving ESP-NOW from " MACSTR, src->number, MAC2STR(src->mac));
+    set_connected(src, true);
+
+    hub_relay_t relay;
+    relay_init(&relay);
+    int64_t last_rx_us = esp_timer_get_time();
+    bool relaying = true;
+    // At least one tick, 5 ms is 0 ticks at a 100 Hz tick rate and would busy poll
+    TickType_t poll_ticks = pdMS_TO_TICKS(HUB_ESPNOW_POLL_MS) > 0 ? pdMS_TO_TICKS(HUB_ESPNOW_POLL_MS) : 1;
+
+    while (attached && relaying) {
+        if (xQueueReceive(src->rx_queue, &src->packet, poll_ticks) == pdTRUE) {
+            espnow_audio_reassembler_push(&src->reassembler, src->packet.data, src->packet.len, src->packet.rx_us);
+            last_rx_us = src->packet.rx_us;
+        }
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_rx_us > HUB_READ_TIMEOUT_MS * 1000LL) {
+            ESP_LOGW(TAG, "Source %u: no ESP-NOW audio", src->number);
+            break;
+        }
+        // Released blocks are timed by their release, the running minimum of
+        // the transit picks the blocks that did not wait for fragments
+        while (relaying && espnow_audio_reassembler_pop(&src->reassembler, now_us, &src->block)) {
+            size_t len = espnow_chunk(&src->block, buf, buf_size);
+            relaying = len > 0 && relay_chunk(src, &relay, buf, len, now_us) == ESP_OK;
+        }
+        taskENTER_CRITICAL(&stats_lock);
+        src->stats.link = src->reassembler.stats;
+        taskEXIT_CRITICAL(&stats_lock);
+    }
+
+    // No renewal may restart the stream after the stop below
+    src->renewing = false;
+    xSemaphoreTake(src->renew_lock, portMAX_DELAY);
+    xSemaphoreGive(src->renew_lock);
+    src->mac_known = false;
+    set_connected(src, false);
+    // Best effort, the arm board stops on its own without renewals
+    uint8_t mac[6];
+    espnow_request(stop_url, mac);
+}
+
+/* Renews the ESP-NOW stream of a source every HUB_ESPNOW_RENEW_MS while it
+ * is received. A renewal can take up to HUB_READ_TIMEOUT_MS, rx_queue holds
+ * about 30 ms of fragments. */
+static void hub_renew_task(void *arg) {
+    hub_source_t *src = (hub_source_t *)arg;
+    uint8_t mac[6];
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(HUB_ESPNOW_RENEW_MS));
+        xSemaphoreTake(src->renew_lock, portMAX_DELAY);
+        // A failed renewal is not fatal, the next one follows
+        if (src->renewing && espnow_request(src->url, mac) != ESP_OK) {
+            ESP_LOGW(TAG, "Source %u: ESP-NOW renewal failed", src->number);
+        }
+        xSemaphoreGive(src->renew_lock);
+    }
+}
+
+static void hub_source_task(void *arg) {
+    hub_source_t *src = (hub_source_t *)arg;
+    char *url = src->url;
+    char stop_url[64];
+    // The arm board rounds the chunk length up to whole 5 ms blocks
+    int block_ms = (CONFIG_AV_HUB_BLOCK_MS + 4) / 5 * 5;
+    size_t buf_size = sizeof(arm_block_header_t) + (size_t)block_ms * (ARM_SAMPLE_RATE / 1000) * 4 * sizeof(int16_t);
+    uint8_t *buf = malloc(buf_size);
+    if (buf == NULL) {
+        ESP_LOGE(TAG, "Source %u: no memory for %u byte chunks", src->number, (unsigned)buf_size);
+        vTaskDelete(NULL);
+        return;
+    }
+    if (src->stats.espnow) {
+        snprintf(url, sizeof(src->url), "http://%s/espnow?ch=%s", src->stats.host, CONFIG_AV_HUB_CHANNELS);
+        snprintf(stop_url, sizeof(stop_url), "http://%s/espnow?stop=1", src->stats.host);
+    } else {
+        snprintf(url, sizeof(src->url), "http://%s/ach1?framed=1&nodelay=1&block_ms=%d&ch=%s",
+                 src->stats.host, block_ms, CONFIG_AV_HUB_CHANNELS);
+    }
+
+    while (true) {
+        if (!attached) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HUB_IDLE_POLL_MS));
+            continue;
+        }
+        if (src->stats.espnow) {
+            hub_espnow(src, url, stop_url, buf, buf_size);
+        } else {
+            hub_stream(src, url, buf, buf_size);
+        }
+        if (attached) {
+            vTaskDelay(pdMS_TO_TICKS(HUB_RETRY_MS));
+        }
+    }
+}
+
+esp_err_t av_hub_start(void) {
+    const char *hosts[AV_HUB_MAX_SOURCES] = { CONFIG_AV_HUB_SOURCE_1, CONFIG_AV_HUB_SOURCE_2 };
+    client_lock = xSemaphoreCreateMutex();
+    if (client_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (HUB_ESPNOW) {
+        // Receives on the access point interface, WiFi is up by now
+        esp_err_t res = esp_now_init();
+        if (res == ESP_OK) {
+            res = esp_now_register_recv_cb(hub_espnow_recv);
+        }
+        if (res != ESP_OK) {
+            ESP_LOGE(TAG, "ESP-NOW not available: %s", esp_err_to_name(res));
+            return res;
+        }
+    }
+    for (int i = 0; i < AV_HUB_MAX_SOURCES; i++) {
+        hub_source_t *src = &sources[i];
+        src->number = i + 1;
+        if (hosts[i][0] == '\0') {
+            continue;
+        }
+        strlcpy(src->stats.host, hosts[i], sizeof(src->stats.host));
+        if (HUB_ESPNOW) {
+            src->stats.espnow = true;
+            src->rx_queue = xQueueCreate(HUB_ESPNOW_QUEUE_LEN, sizeof(hub_espnow_packet_t));
+            src->renew_lock = xSemaphoreCreateMutex();
+            if (src->rx_queue == NULL || src->renew_lock == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            if (xTaskCreate(hub_renew_task, "av_hub_renew", HUB_TASK_STACK, src, HUB_RENEW_TASK_PRIORITY,
+                            NULL) != pdPASS) {
+                ESP_LOGE(TAG, "Failed to start the renewals of source %u", src->number);
+                return ESP_FAIL;
+            }
+        }
+        if (xTaskCreate(hub_source_task, "av_hub_source", HUB_TASK_STACK, src, HUB_TASK_PRIORITY, &src->task) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start source %u", src->number);
+            src->task = NULL;
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+void av_hub_get_stats(av_hub_source_stats_t stats[AV_HUB_MAX_SOURCES]) {
+    taskENTER_CRITICAL(&stats_lock);
+    for (int i = 0; i < AV_HUB_MAX_SOURCES; i++) {
+        stats[i] = sources[i].stats;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+}
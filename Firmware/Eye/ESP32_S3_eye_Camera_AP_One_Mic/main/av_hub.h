@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "stream_socket.h"
+#include "espnow_audio.h"
+
+/* Audio/video hub, serves /av on the Eye
+ *
+ * The Eye subscribes to the framed audio of the arm boards that joined its
+ * access point and re-serves it, together with its own camera frames, on one
+ * connection. Every record carries a timestamp on the Eye's esp_timer clock,
+ * so the host does not have to align separate /stream and /ach1 connections.
+ *
+ * The arm boards synchronize their clocks with the Eye (components/time_sync)
+ * and, once synchronized, stamp their chunks on the Eye's clock with
+ * AUDIO_BLOCK_FLAG_SYNCED set; those timestamps are relayed unchanged. Until
+ * then the timestamps are mapped with the lowest observed transit time:
+ * arrival on the Eye minus (capture time + latency_us on the arm board) is the
+ * clock offset plus the network delay, and its running minimum is the offset
+ * plus the smallest delay seen. That is good to a few ms, the
+ * uncertainty of the fastest chunk.
+ *
+ * With CONFIG_AV_HUB_ESPNOW the arm boards send over ESP-NOW instead of TCP
+ * (/espnow on the arm board, components/espnow_audio). The hub reassembles the
+ * fragments, conceals what was lost and relays the same chunks as over TCP,
+ * with AUDIO_BLOCK_FLAG_CONCEALED set in the block header of concealed ones.
+ *
+ * The stream is a sequence of records, an av_record_header_t followed by
+ * length payload bytes:
+ *   AV_RECORD_VIDEO  a JPEG, timestamp is when the frame was captured
+ *   AV_RECORD_AUDIO  an arm board chunk exactly as sent on /ach1?framed=1 (block
+ *                    header plus samples), timestamp is its first frame
+ *
+ * A JPEG goes out in VIDEO_SHAPER_SLICE pieces, each a record of its own with
+ * AV_RECORD_FLAG_MORE set on all but the last, and arm board chunks may come
+ * in between. So audio waits for one slice of video, not a whole frame. A
+ * reader joins the pieces of a source until the one without the flag.
+ *
+ * /av?container=1 sends stream_frame.h frames instead, with the source as the
+ * frame's stream: JPEG frames per camera frame, sliced the same way with
+ * STREAM_FRAME_FLAG_MORE, and a levels frame followed by a 24 kHz PCM frame
+ * per arm board chunk. The CRC covers every frame, and a reader can
+ * resynchronize after a corrupted one. */
+
+#define AV_HUB_MAX_SOURCES      2
+#define AV_RECORD_MAGIC         "IRAV"
+#define AV_SOURCE_CAMERA        0       // arm board sources are 1 and 2
+#define AV_RECORD_FLAG_MORE     0x0001  // the payload continues in the next record of this source
+
+typedef enum {
+    AV_RECORD_VIDEO = 1,
+    AV_RECORD_AUDIO = 2,
+} av_record_type_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];          // AV_RECORD_MAGIC
+    uint8_t type;           // av_record_type_t
+    uint8_t source;         // AV_SOURCE_CAMERA or the arm board source number
+    uint16_t flags;         // AV_RECORD_FLAG_*
+    uint32_t seq;           // per source, the capture frame number for video (a gap: frames skipped for
+                            // a slow client), the audio block number for audio
+    int64_t timestamp_us;   // Eye esp_timer time
+    uint32_t length;        // payload bytes that follow
+} av_record_header_t;
+
+typedef struct {
+    char host[32];          // ip or ip:port, empty when the source is not configured
+    bool connected;
+    uint32_t connects;
+    uint32_t chunks;
+    uint32_t dropped_blocks;    // gaps in the arm board block numbers
+    uint32_t concealed_blocks;  // relayed with lost samples filled in, ESP-NOW only
+    uint64_t bytes;
+    bool synced;            // the last chunk was stamped on the Eye clock by the arm board
+    int64_t offset_us;      // arm board clock to Eye clock, incl. the fastest transit; 0 when synced
+    uint32_t latency_us;    // last chunk: capture on the arm board to the /av client, minus the fastest transit unless synced
+    bool espnow;            // audio arrives over ESP-NOW
+    espnow_audio_stats_t link;  // ESP-NOW reassembly counters
+    uint32_t queue_drops;   // ESP-NOW frames dropped before reassembly, the source task fell behind
+} av_hub_source_stats_t;
+
+/* Start one task per arm board configured in menuconfig (AV_HUB_SOURCE_1/2).
+ * They only connect while a client is attached. */
+esp_err_t av_hub_start(void);
+
+/* Attach the /av client. Audio from every source is written to it until
+ * av_hub_detach() or a failed write; only one client at a time. With
+ * container the records go out as stream_frame.h frames. */
+esp_err_t av_hub_attach(stream_socket_t *out, bool container);
+void av_hub_detach(void);
+bool av_hub_attached(void);
+
+/* Write one record to the attached client, serialized with the audio sources.
+ * Video is sliced (AV_RECORD_FLAG_MORE) and every slice waits for the video
+ * shaper; client_lock is only held per slice. */
+esp_err_t av_hub_write(av_record_type_t type, uint8_t source, uint32_t seq, int64_t timestamp_us,
+                       const void *payload, size_t len);
+
+void av_hub_get_stats(av_hub_source_stats_t stats[AV_HUB_MAX_SOURCES]);
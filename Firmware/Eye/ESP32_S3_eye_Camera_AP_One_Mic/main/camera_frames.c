@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "camera_frames.h"
+
+static const char *TAG = "camera_frames";
+
+#define CAPTURE_TASK_STACK      4096
+#define CAPTURE_TASK_PRIORITY   (tskIDLE_PRIORITY + 6)  // above the video senders, the work per frame is tiny
+#define CAPTURE_RETRY_MS        100
+// Every driver buffer in use, plus the one just being converted
+#define FRAME_SLOTS             (CAMERA_FRAMES_FB_COUNT + 1)
+
+struct camera_frames_sub {
+    TaskHandle_t task;      // NULL: the slot is free
+    uint32_t last_seq;
+    bool first;
+};
+
+// Frame slots, subscribers and the latest frame are guarded by frames_lock
+static portMUX_TYPE frames_lock = portMUX_INITIALIZER_UNLOCKED;
+static camera_frame_t slots[FRAME_SLOTS];
+static camera_frames_sub_t subs[CAMERA_FRAMES_MAX_SUBSCRIBERS];
+static camera_frame_t *latest = NULL;
+static camera_frames_stats_t stats;
+static TaskHandle_t capture_task = NULL;
+
+static void frame_free(camera_frame_t *frame) {
+    if (frame->fb != NULL) {
+        esp_camera_fb_return(frame->fb);
+    } else {
+        free((void *)frame->jpg);
+    }
+    // Under the lock, slot_take() must not see the slot free before both are cleared
+    taskENTER_CRITICAL(&frames_lock);
+    frame->fb = NULL;
+    frame->jpg = NULL;
+    taskEXIT_CRITICAL(&frames_lock);
+}
+
+// Call with frames_lock held
+static void age_add(camera_frames_age_t *age, int64_t timestamp_us, int64_t now_us) {
+    uint32_t age_us = now_us > timestamp_us ? (uint32_t)(now_us - timestamp_us) : 0;
+    age->frames++;
+    age->last_us = age_us;
+    age->total_us += age_us;
+    if (age_us > age->max_us) {
+        age->max_us = age_us;
+    }
+}
+
+static void frame_unref(camera_frame_t *frame, bool sent) {
+    int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&frames_lock);
+    if (sent) {
+        age_add(&stats.sent_age, frame->timestamp_us, now_us);
+    }
+    bool last = --frame->refs == 0;
+    taskEXIT_CRITICAL(&frames_lock);
+    if (last) {
+        // The slot is only reused once refs is 0, and nobody else can reach it now
+        frame_free(frame);
+    }
+}
+
+void camera_frames_release(camera_frame_t *frame) {
+    frame_unref(frame, true);
+}
+
+void camera_frames_release_unsent(camera_frame_t *frame) {
+    frame_unref(frame, false);
+}
+
+// Replace the latest frame with frame (or none), the old one loses the reference latest held
+static void publish(camera_frame_t *frame) {
+    taskENTER_CRITICAL(&frames_lock);
+    camera_frame_t *old = latest;
+    latest = frame;
+    taskEXIT_CRITICAL(&frames_lock);
+    if (old != NULL) {
+        frame_unref(old, false);
+    }
+}
+
+static camera_frame_t *slot_take(void) {
+    camera_frame_t *frame = NULL;
+    taskENTER_CRITICAL(&frames_lock);
+    for (int i = 0; i < FRAME_SLOTS; i++) {
+        // A slot still holding a buffer has refs 0 only between its release and frame_free()
+        if (slots[i].refs == 0 && slots[i].jpg == NULL) {
+            frame = &slots[i];
+            frame->refs = 1;    // the latest frame's reference
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&frames_lock);
+    return frame;
+}
+
+// Take one frame from the driver and publish it, false if there was none
+static bool capture_one(void) {
+    camera_fb_t *fb = esp_camera_fb_get();
+    int64_t got_us = esp_timer_get_time();
+    camera_frame_t *frame = fb ? slot_take() : NULL;
+    if (frame == NULL) {
+        if (fb) {
+            ESP_LOGE(TAG, "No free frame slot");
+            esp_camera_fb_return(fb);
+        }
+        taskENTER_CRITICAL(&frames_lock);
+        stats.failures++;
+        taskEXIT_CRITICAL(&frames_lock);
+        return false;
+    }
+    frame->timestamp_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    if (fb->format == PIXFORMAT_JPEG) {
+        frame->fb = fb;
+        frame->jpg = fb->buf;
+        frame->len = fb->len;
+    } else {
+        // Not a JPEG sensor mode: convert once here instead of in every client
+        uint8_t *jpg = NULL;
+        size_t len = 0;
+        bool converted = frame2jpg(fb, 80, &jpg, &len);
+        esp_camera_fb_return(fb);
+        frame->fb = NULL;
+        frame->jpg = jpg;
+        frame->len = len;
+        if (!converted) {
+            ESP_LOGE(TAG, "JPEG compression failed");
+            taskENTER_CRITICAL(&frames_lock);
+            frame->jpg = NULL;
+            frame->refs = 0;
+            stats.failures++;
+            taskEXIT_CRITICAL(&frames_lock);
+            return false;
+        }
+    }
+
+    TaskHandle_t wake[CAMERA_FRAMES_MAX_SUBSCRIBERS];
+    int wake_count = 0;
+    taskENTER_CRITICAL(&frames_lock);
+    frame->seq = stats.captured++;
+    stats.last_capture_us = frame->timestamp_us;
+    // A frame that sat in the driver's queue shows up here, GRAB_LATEST keeps it short
+    age_add(&stats.capture_age, frame->timestamp_us, got_us);
+    for (int i = 0; i < CAMERA_FRAMES_MAX_SUBSCRIBERS; i++) {
+        if (subs[i].task != NULL) {
+            wake[wake_count++] = subs[i].task;
+        }
+    }
+    taskEXIT_CRITICAL(&frames_lock);
+    publish(frame);
+    for (int i = 0; i < wake_count; i++) {
+        xTaskNotifyGive(wake[i]);
+    }
+    return true;
+}
+
+static void camera_frames_task(void *arg) {
+    while (true) {
+        taskENTER_CRITICAL(&frames_lock);
+        bool idle = stats.subscribers == 0;
+        taskEXIT_CRITICAL(&frames_lock);
+        if (idle) {
+            // Give the buffer back, and a new subscriber must not start with a stale frame
+            publish(NULL);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (!capture_one()) {
+            vTaskDelay(pdMS_TO_TICKS(CAPTURE_RETRY_MS));
+        }
+    }
+}
+
+esp_err_t camera_frames_start(void) {
+    if (xTaskCreate(camera_frames_task, "camera_frames", CAPTURE_TASK_STACK, NULL, CAPTURE_TASK_PRIORITY,
+                    &capture_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the capture task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+camera_frames_sub_t *camera_frames_subscribe(void) {
+    camera_frames_sub_t *sub = NULL;
+    taskENTER_CRITICAL(&frames_lock);
+    for (int i = 0; i < CAMERA_FRAMES_MAX_SUBSCRIBERS; i++) {
+        if (subs[i].task == NULL) {
+            sub = &subs[i];
+            sub->task = xTaskGetCurrentTaskHandle();
+            sub->first = true;
+            stats.subscribers++;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&frames_lock);
+    if (sub != NULL && capture_task != NULL) {
+        xTaskNotifyGive(capture_task);
+    }
+    return sub;
+}
+
+void camera_frames_unsubscribe(camera_frames_sub_t *sub) {
+    taskENTER_CRITICAL(&frames_lock);
+    sub->task = NULL;
+    stats.subscribers--;
+    taskEXIT_CRITICAL(&frames_lock);
+}
+
+camera_frame_t *camera_frames_get(camera_frames_sub_t *sub, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        camera_frame_t *frame = NULL;
+        taskENTER_CRITICAL(&frames_lock);
+        if (latest != NULL && (sub->first || latest->seq != sub->last_seq)) {
+            frame = latest;
+            frame->refs++;
+            if (!sub->first) {
+                stats.skipped += frame->seq - sub->last_seq - 1;
+            }
+            stats.delivered++;
+            sub->first = false;
+            sub->last_seq = frame->seq;
+        }
+        taskEXIT_CRITICAL(&frames_lock);
+        if (frame != NULL) {
+            return frame;
+        }
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout) {
+            return NULL;
+        }
+        // Woken by the capture task for every frame
+        ulTaskNotifyTake(pdTRUE, timeout - waited);
+    }
+}
+
+void camera_frames_get_stats(camera_frames_stats_t *out) {
+    taskENTER_CRITICAL(&frames_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&frames_lock);
+}
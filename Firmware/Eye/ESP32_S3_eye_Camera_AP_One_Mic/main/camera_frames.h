@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_camera.h"
+
+/* One camera capture task for all video clients
+ *
+ * esp_camera_fb_get() hands every frame out once, so two clients calling it
+ * side by side get every other frame each, and a client holds a driver buffer
+ * for as long as it takes to send it. Here one task takes every frame from
+ * the driver and publishes it as the latest frame. Subscribers (the /stream
+ * and /av clients) take a reference to the latest frame, send it and release
+ * it; the driver buffer goes back when the last reference is dropped. The
+ * face detector (face_detect.h) is a subscriber too.
+ *
+ * Every subscriber has its own "latest frame wins" cursor: a subscriber that
+ * is slower than the camera skips straight to the newest frame when it is
+ * done with the previous one, and the frames it missed show up as a jump in
+ * seq. The capture never waits for a subscriber as long as there is a free
+ * driver buffer: one per subscriber (each holds at most one frame), one for
+ * the latest frame and one to capture into, CAMERA_FRAMES_FB_COUNT_MIN. With
+ * fewer (CONFIG_CAMERA_FB_COUNT) a slow subscriber holds up the capture.
+ *
+ * The capture task only runs while somebody is subscribed. */
+
+#define CAMERA_FRAMES_MAX_SUBSCRIBERS   3       // the two video clients and the face detector
+#define CAMERA_FRAMES_FB_COUNT_MIN      (CAMERA_FRAMES_MAX_SUBSCRIBERS + 2)
+#define CAMERA_FRAMES_FB_COUNT          CONFIG_CAMERA_FB_COUNT
+#define CAMERA_FRAMES_TIMEOUT_MS        1000    // camera_frames_get() gives up, the camera has stopped
+
+typedef struct {
+    const uint8_t *jpg;     // JPEG, the driver's buffer or a conversion of it
+    size_t len;
+    int64_t timestamp_us;   // esp_timer time of the frame's VSYNC
+    uint32_t seq;           // counts every captured frame, gaps are frames this subscriber skipped
+    // Owned by camera_frames.c
+    camera_fb_t *fb;        // NULL once a non-JPEG frame was converted
+    int refs;
+} camera_frame_t;
+
+// Age of frames at some point: the time since their VSYNC
+typedef struct {
+    uint32_t frames;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} camera_frames_age_t;
+
+typedef struct {
+    uint32_t captured;
+    uint32_t failures;      // esp_camera_fb_get() or the JPEG conversion failed
+    uint8_t subscribers;
+    uint32_t delivered;     // frames handed to subscribers, all together
+    uint32_t skipped;       // frames a subscriber missed because it was still sending
+    int64_t last_capture_us;
+    camera_frames_age_t capture_age;    // when the capture task got the frame from the driver
+    camera_frames_age_t sent_age;       // when a subscriber released it, done sending
+} camera_frames_stats_t;
+
+typedef struct camera_frames_sub camera_frames_sub_t;
+
+/* Start the capture task, after esp_camera_init() */
+esp_err_t camera_frames_start(void);
+
+/* Subscribe the calling task, it is woken for every new frame. NULL when
+ * CAMERA_FRAMES_MAX_SUBSCRIBERS are subscribed already. */
+camera_frames_sub_t *camera_frames_subscribe(void);
+void camera_frames_unsubscribe(camera_frames_sub_t *sub);
+
+/* The latest frame, once it is newer than the last one this subscriber got,
+ * with a reference held for the caller. NULL after timeout. */
+camera_frame_t *camera_frames_get(camera_frames_sub_t *sub, TickType_t timeout);
+/* Done with a frame from camera_frames_get(), its age now counts as sent_age */
+void camera_frames_release(camera_frame_t *frame);
+/* The same for a subscriber that does not send frames */
+void camera_frames_release_unsent(camera_frame_t *frame);
+
+void camera_frames_get_stats(camera_frames_stats_t *stats);
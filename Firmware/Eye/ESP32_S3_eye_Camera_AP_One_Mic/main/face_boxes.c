@@ -0,0 +1,134 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "face_boxes.h"
+
+size_t face_image_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+    face_image_t *image = arg;
+    if (index >= image->jpg_len) {
+        return 0;
+    }
+    if (len > image->jpg_len - index) {
+        len = image->jpg_len - index;
+    }
+    // No buffer: the decoder skips len bytes
+    if (buf != NULL) {
+        memcpy(buf, image->jpg + index, len);
+    }
+    return len;
+}
+
+bool face_image_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    face_image_t *image = arg;
+    if (data == NULL) {
+        // Without data at 0,0 the decoder announces the image size, anywhere else its end
+        if (x == 0 && y == 0) {
+            image->width = w;
+            image->height = h;
+            image->overflow = (size_t)w * h * 3 > image->capacity;
+        }
+        return true;
+    }
+    if (image->overflow || x >= image->width || y >= image->height) {
+        return true;
+    }
+    // Blocks of RGB888 rows, the last ones of a row or column may stick out
+    uint16_t copy_w = w < image->width - x ? w : image->width - x;
+    uint16_t copy_h = h < image->height - y ? h : image->height - y;
+    for (uint16_t row = 0; row < copy_h; row++) {
+        memcpy(image->rgb + ((size_t)(y + row) * image->width + x) * 3, data + (size_t)row * w * 3,
+               (size_t)copy_w * 3);
+    }
+    return true;
+}
+
+bool face_jpeg_size(const uint8_t *jpg, size_t len, uint16_t *width, uint16_t *height) {
+    if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) {
+        return false;
+    }
+    // Segments after SOI: FF, marker, big endian length including itself
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (jpg[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = jpg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;      // fill byte
+            continue;
+        }
+        size_t segment = (size_t)jpg[pos + 2] << 8 | jpg[pos + 3];
+        // SOF0 to SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (segment < 7 || pos + 2 + segment > len) {
+                return false;
+            }
+            *height = (uint16_t)(jpg[pos + 5] << 8 | jpg[pos + 6]);
+            *width = (uint16_t)(jpg[pos + 7] << 8 | jpg[pos + 8]);
+            return *width > 0 && *height > 0;
+        }
+        if (marker == 0xDA || segment < 2) {
+            return false;   // the scan started without a frame header
+        }
+        pos += 2 + segment;
+    }
+    return false;
+}
+
+int face_decode_shift(uint16_t width, uint16_t height) {
+    int shift = 0;
+    while (shift < 3 && ((width >> shift) > FACE_DETECT_INPUT_WIDTH || (height >> shift) > FACE_DETECT_INPUT_HEIGHT)) {
+        shift++;
+    }
+    return shift;
+}
+
+static int clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+void face_boxes_finish(face_result_t *result, const face_raw_t *raw, int n, int shift) {
+    face_box_t boxes[FACE_DETECT_MAX_FACES];
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        int x1 = clamp(raw[i].x1 << shift, 0, result->width);
+        int y1 = clamp(raw[i].y1 << shift, 0, result->height);
+        int x2 = clamp(raw[i].x2 << shift, 0, result->width);
+        int y2 = clamp(raw[i].y2 << shift, 0, result->height);
+        if (x2 <= x1 || y2 <= y1) {
+            continue;
+        }
+        face_box_t box = { .x = x1, .y = y1, .w = x2 - x1, .h = y2 - y1, .score = raw[i].score };
+        // Insert by score, a full list drops its lowest
+        int at = count;
+        while (at > 0 && boxes[at - 1].score < box.score) {
+            at--;
+        }
+        if (at == FACE_DETECT_MAX_FACES) {
+            continue;
+        }
+        if (count < FACE_DETECT_MAX_FACES) {
+            count++;
+        }
+        memmove(&boxes[at + 1], &boxes[at], (count - 1 - at) * sizeof(boxes[0]));
+        boxes[at] = box;
+    }
+    memcpy(result->faces, boxes, count * sizeof(boxes[0]));
+    result->count = count;
+}
+
+int face_result_format(const face_result_t *result, char *out, size_t size) {
+    int len = snprintf(out, size,
+                       "{\"seq\":%" PRIu32 ",\"timestamp_us\":%" PRId64 ",\"width\":%u,\"height\":%u,"
+                       "\"detect_us\":%" PRIu32 ",\"faces\":[",
+                       result->seq, result->timestamp_us, result->width, result->height, result->detect_us);
+    for (int i = 0; i < result->count && len < (int)size; i++) {
+        const face_box_t *box = &result->faces[i];
+        len += snprintf(out + len, size - len, "%s{\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"score\":%.3f}",
+                        i ? "," : "", box->x, box->y, box->w, box->h, box->score);
+    }
+    if (len < (int)size) {
+        len += snprintf(out + len, size - len, "]}");
+    }
+    return len;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The parts of the face detection that do not need the ESP32: decoding a
+ * camera JPEG into the detector's RGB input, mapping the detector's boxes
+ * back onto the camera frame, and the JSON of a result. Builds on the host
+ * too, Software/Streaming/faces.py selftest checks it there. */
+
+#define FACE_DETECT_INPUT_WIDTH     320     // frames are decoded at 1/2, 1/4 or 1/8 to at most this width
+#define FACE_DETECT_INPUT_HEIGHT    240
+#define FACE_DETECT_MAX_FACES       8
+
+// A face as the detector reports it, in pixels of its input image
+typedef struct {
+    int x1, y1, x2, y2;
+    float score;
+} face_raw_t;
+
+// A face in pixels of the camera frame
+typedef struct {
+    int16_t x, y;
+    int16_t w, h;
+    float score;
+} face_box_t;
+
+typedef struct {
+    uint32_t seq;               // camera frame seq (camera_frames.h) the faces were found in
+    int64_t timestamp_us;       // its capture time, on the Eye's clock
+    uint16_t width, height;     // camera frame size
+    uint32_t detect_us;         // decoding and inference
+    uint8_t count;
+    face_box_t faces[FACE_DETECT_MAX_FACES];    // highest score first
+} face_result_t;
+
+/* RGB888 image the JPEG decoder writes into, the arg of face_image_read() and
+ * face_image_write(), which are esp_jpg_decode()'s reader and writer */
+typedef struct {
+    const uint8_t *jpg;
+    size_t jpg_len;
+    uint8_t *rgb;               // capacity bytes, set by the caller
+    size_t capacity;
+    uint16_t width, height;     // of the decoded image, set by the decoder
+    bool overflow;              // the image did not fit, rgb is incomplete
+} face_image_t;
+
+size_t face_image_read(void *arg, size_t index, uint8_t *buf, size_t len);
+bool face_image_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
+
+/* Frame size from the JPEG's SOF marker, false if there is none */
+bool face_jpeg_size(const uint8_t *jpg, size_t len, uint16_t *width, uint16_t *height);
+
+/* How far to scale a frame of this size down, as a power of two (0..3, the
+ * jpg_scale_t of esp_jpg_decode()), to fit FACE_DETECT_INPUT_WIDTH x _HEIGHT */
+int face_decode_shift(uint16_t width, uint16_t height);
+
+/* Fill result's faces from n raw detections on an input scaled down by shift:
+ * scaled up to the frame, clipped to result->width x height, empty boxes
+ * dropped, sorted by score and cut to FACE_DETECT_MAX_FACES. */
+void face_boxes_finish(face_result_t *result, const face_raw_t *raw, int n, int shift);
+
+/* One JSON object, without a newline, as /faces sends it. The length, or
+ * at least size when it did not fit. */
+int face_result_format(const face_result_t *result, char *out, size_t size);
@@ -0,0 +1,211 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_jpg_decode.h"
+#include "camera_frames.h"
+#include "face_model.h"
+#include "face_detect.h"
+
+static const char *TAG = "face_detect";
+
+#define FACE_TASK_PRIORITY  (tskIDLE_PRIORITY + 3)  // below the streams, a late box matters less than a late frame
+#define FACE_TASK_CORE      1                       // core 0 has WiFi and lwIP
+#define FACE_INPUT_BYTES    (FACE_DETECT_INPUT_WIDTH * FACE_DETECT_INPUT_HEIGHT * 3)
+
+struct face_detect_client {
+    TaskHandle_t task;      // NULL: the slot is free
+    uint32_t last_run;
+};
+
+// Clients, the latest result and the stats are guarded by faces_lock
+static portMUX_TYPE faces_lock = portMUX_INITIALIZER_UNLOCKED;
+static face_detect_client_t clients[FACE_DETECT_MAX_CLIENTS];
+static face_result_t latest;
+static uint32_t latest_run = 0;     // stats.runs when latest was found, 0: none yet
+static face_detect_stats_t stats;
+static TaskHandle_t detect_task = NULL;
+// The model and its input image, for the task and face_detect_jpeg() one at a time
+static SemaphoreHandle_t model_lock;
+static uint8_t *input_rgb;
+
+esp_err_t face_detect_jpeg(const uint8_t *jpg, size_t len, face_result_t *result) {
+    uint16_t width, height;
+    if (!face_jpeg_size(jpg, len, &width, &height)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int shift = face_decode_shift(width, height);
+    face_image_t image = { .jpg = jpg, .jpg_len = len, .capacity = FACE_INPUT_BYTES };
+    face_raw_t raw[FACE_DETECT_MAX_FACES * 2];
+    int n = 0;
+
+    int64_t start_us = esp_timer_get_time();
+    xSemaphoreTake(model_lock, portMAX_DELAY);
+    image.rgb = input_rgb;
+    esp_err_t err = esp_jpg_decode(len, (jpg_scale_t)shift, face_image_read, face_image_write, &image);
+    if (err == ESP_OK && image.overflow) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK) {
+        n = face_model_run(input_rgb, image.width, image.height, raw, sizeof(raw) / sizeof(raw[0]));
+    }
+    xSemaphoreGive(model_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    result->width = width;
+    result->height = height;
+    result->detect_us = (uint32_t)(esp_timer_get_time() - start_us);
+    face_boxes_finish(result, raw, n, shift);
+    return ESP_OK;
+}
+
+static void face_detect_task(void *arg) {
+    camera_frames_sub_t *sub = NULL;
+    while (true) {
+        taskENTER_CRITICAL(&faces_lock);
+        bool idle = stats.clients == 0;
+        taskEXIT_CRITICAL(&faces_lock);
+        if (idle) {
+            // Leave the camera frame to the video while nobody wants faces
+            if (sub != NULL) {
+                camera_frames_unsubscribe(sub);
+                sub = NULL;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (sub == NULL && (sub = camera_frames_subscribe()) == NULL) {
+            ESP_LOGE(TAG, "No camera subscription left");
+            vTaskDelay(pdMS_TO_TICKS(CAMERA_FRAMES_TIMEOUT_MS));
+            continue;
+        }
+
+        camera_frame_t *frame = camera_frames_get(sub, pdMS_TO_TICKS(CAMERA_FRAMES_TIMEOUT_MS));
+        if (frame == NULL) {
+            taskENTER_CRITICAL(&faces_lock);
+            stats.failures++;
+            taskEXIT_CRITICAL(&faces_lock);
+            continue;
+        }
+        int64_t start_us = esp_timer_get_time();
+        face_result_t result = { .seq = frame->seq, .timestamp_us = frame->timestamp_us };
+        esp_err_t err = face_detect_jpeg(frame->jpg, frame->len, &result);
+        // Not sent anywhere, so it does not count towards the video's sent_age
+        camera_frames_release_unsent(frame);
+
+        TaskHandle_t wake[FACE_DETECT_MAX_CLIENTS];
+        int wake_count = 0;
+        taskENTER_CRITICAL(&faces_lock);
+        if (err == ESP_OK) {
+            stats.runs++;
+            stats.with_faces += result.count > 0;
+            stats.last_us = result.detect_us;
+            stats.total_us += result.detect_us;
+            if (result.detect_us > stats.max_us) {
+                stats.max_us = result.detect_us;
+            }
+            latest = result;
+            latest_run = stats.runs;
+            for (int i = 0; i < FACE_DETECT_MAX_CLIENTS; i++) {
+                if (clients[i].task != NULL) {
+                    wake[wake_count++] = clients[i].task;
+                }
+            }
+        } else {
+            stats.failures++;
+        }
+        taskEXIT_CRITICAL(&faces_lock);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Frame %lu not decoded: %s", (unsigned long)result.seq, esp_err_to_name(err));
+        }
+        for (int i = 0; i < wake_count; i++) {
+            xTaskNotifyGive(wake[i]);
+        }
+
+        // Leave the rest of the interval to the streams
+        int64_t rest_ms = CONFIG_FACE_DETECT_INTERVAL_MS - (esp_timer_get_time() - start_us) / 1000;
+        if (rest_ms > 0) {
+            vTaskDelay(pdMS_TO_TICKS(rest_ms));
+        }
+    }
+}
+
+esp_err_t face_detect_start(void) {
+    model_lock = xSemaphoreCreateMutex();
+    input_rgb = heap_caps_malloc(FACE_INPUT_BYTES, MALLOC_CAP_SPIRAM);
+    if (model_lock == NULL || input_rgb == NULL) {
+        ESP_LOGE(TAG, "No memory for the detector input");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = face_model_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xTaskCreatePinnedToCore(face_detect_task, "face_detect", FACE_DETECT_STACK, NULL, FACE_TASK_PRIORITY,
+                                &detect_task, FACE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the detection task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+face_detect_client_t *face_detect_subscribe(void) {
+    face_detect_client_t *client = NULL;
+    taskENTER_CRITICAL(&faces_lock);
+    for (int i = 0; i < FACE_DETECT_MAX_CLIENTS; i++) {
+        if (clients[i].task == NULL) {
+            client = &clients[i];
+            client->task = xTaskGetCurrentTaskHandle();
+            // Results from before are stale, wait for the next run
+            client->last_run = latest_run;
+            stats.clients++;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&faces_lock);
+    if (client != NULL && detect_task != NULL) {
+        xTaskNotifyGive(detect_task);
+    }
+    return client;
+}
+
+void face_detect_unsubscribe(face_detect_client_t *client) {
+    taskENTER_CRITICAL(&faces_lock);
+    client->task = NULL;
+    stats.clients--;
+    taskEXIT_CRITICAL(&faces_lock);
+}
+
+bool face_detect_get(face_detect_client_t *client, face_result_t *result, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        bool found = false;
+        taskENTER_CRITICAL(&faces_lock);
+        if (latest_run != client->last_run) {
+            *result = latest;
+            client->last_run = latest_run;
+            found = true;
+        }
+        taskEXIT_CRITICAL(&faces_lock);
+        if (found) {
+            return true;
+        }
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout) {
+            return false;
+        }
+        // Woken by the task for every result
+        ulTaskNotifyTake(pdTRUE, timeout - waited);
+    }
+}
+
+void face_detect_get_stats(face_detect_stats_t *out) {
+    taskENTER_CRITICAL(&faces_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&faces_lock);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "face_boxes.h"
+
+/* Face detection on the Eye
+ *
+ * The host used to decode every VGA JPEG and run an SSD on it just to find the
+ * faces. Here a task subscribes to the camera (camera_frames.h) like a video
+ * client, decodes the latest frame at 1/2 scale into RGB888 (QVGA for a VGA
+ * frame), runs the esp-dl face detector on it (face_model.h) and publishes
+ * the boxes in pixels of the camera frame, with the frame's seq and capture
+ * time, so a client can match them to the video. /faces streams them.
+ *
+ * The task only runs while a /faces or /roi client is connected, at most
+ * once per CONFIG_FACE_DETECT_INTERVAL_MS and below the video priority. Each
+ * client gets the newest result whenever it is done with the previous one;
+ * /roi crops around the faces of the newest result it has. */
+
+#define FACE_DETECT_MAX_CLIENTS     4       // two /faces and two /roi clients
+#define FACE_DETECT_STACK           10240   // for a task calling face_detect_jpeg(): the JPEG decoder and the model
+
+typedef struct {
+    uint8_t clients;
+    uint32_t runs;              // frames the detector ran on
+    uint32_t with_faces;        // runs that found at least one face
+    uint32_t failures;          // no frame from the camera, or one that did not decode
+    uint32_t last_us;           // decoding and inference of a frame
+    uint32_t max_us;
+    uint64_t total_us;
+} face_detect_stats_t;
+
+typedef struct face_detect_client face_detect_client_t;
+
+/* Load the model and start the task, after camera_frames_start() */
+esp_err_t face_detect_start(void);
+
+/* Subscribe the calling task, NULL when FACE_DETECT_MAX_CLIENTS are subscribed */
+face_detect_client_t *face_detect_subscribe(void);
+void face_detect_unsubscribe(face_detect_client_t *client);
+
+/* The newest result once there is one this client has not had, false after timeout */
+bool face_detect_get(face_detect_client_t *client, face_result_t *result, TickType_t timeout);
+
+/* Detect the faces in any JPEG, for evaluating the detector on stored images.
+ * Shares the model with the task, so it waits for a run in progress. seq and
+ * timestamp_us of result are left to the caller. */
+esp_err_t face_detect_jpeg(const uint8_t *jpg, size_t len, face_result_t *result);
+
+void face_detect_get_stats(face_detect_stats_t *stats);
@@ -0,0 +1,36 @@
+#include <new>
+#include "esp_log.h"
+#include "human_face_detect.hpp"
+#include "face_model.h"
+
+static const char *TAG = "face_model";
+
+static HumanFaceDetect *detector = nullptr;
+
+esp_err_t face_model_init(void) {
+    // Loads both stages, from flash into PSRAM
+    detector = new (std::nothrow) HumanFaceDetect();
+    if (detector == nullptr) {
+        ESP_LOGE(TAG, "No memory for the face detector");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int face_model_run(uint8_t *rgb, uint16_t width, uint16_t height, face_raw_t *out, int max) {
+    dl::image::img_t image;
+    image.data = rgb;
+    image.width = width;
+    image.height = height;
+    image.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    std::list<dl::detect::result_t> &results = detector->run(image);
+    int n = 0;
+    for (const dl::detect::result_t &result : results) {
+        if (n == max) {
+            break;
+        }
+        // box is x1, y1, x2, y2
+        out[n++] = { result.box[0], result.box[1], result.box[2], result.box[3], result.score };
+    }
+    return n;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "face_boxes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The esp-dl human face detector (espressif/human_face_detect), the two stage
+ * MSR+MNP model of esp-who, behind a C interface. Not thread safe. */
+
+esp_err_t face_model_init(void);
+
+/* Faces in a width x height RGB888 image, at most max of them into out */
+int face_model_run(uint8_t *rgb, uint16_t width, uint16_t height, face_raw_t *out, int max);
+
+#ifdef __cplusplus
+}
+#endif
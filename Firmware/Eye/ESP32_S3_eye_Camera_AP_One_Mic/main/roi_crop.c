@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stream_frame.h"
+#include "roi_crop.h"
+
+int roi_parse(const char *spec, roi_region_t *out, int max) {
+    int n = 0;
+    const char *p = spec;
+    while (*p != '\0') {
+        if (n == max) {
+            return -1;
+        }
+        long value[4];
+        for (int i = 0; i < 4; i++) {
+            char *end;
+            value[i] = strtol(p, &end, 10);
+            if (end == p || value[i] < 0 || value[i] > UINT16_MAX) {
+                return -1;
+            }
+            // Commas between the numbers, a semicolon or the end after the last
+            if (i < 3 ? *end != ',' : *end != ';' && *end != '\0') {
+                return -1;
+            }
+            p = *end != '\0' ? end + 1 : end;
+        }
+        if (value[2] == 0 || value[3] == 0) {
+            return -1;
+        }
+        out[n++] = (roi_region_t){ .x = value[0], .y = value[1], .w = value[2], .h = value[3],
+                                   .kind = STREAM_FRAME_ROI_REQUESTED };
+    }
+    return n > 0 ? n : -1;
+}
+
+int roi_from_faces(const face_result_t *faces, bool mouth, int pad_percent, roi_region_t *out, int max) {
+    int n = 0;
+    for (int i = 0; i < faces->count && n < max; i++) {
+        const face_box_t *face = &faces->faces[i];
+        int x = face->x, y = face->y, w = face->w, h = face->h;
+        if (mouth) {
+            y += h / 2;
+            h -= h / 2;
+        }
+        int pad_w = w * pad_percent / 100;
+        int pad_h = h * pad_percent / 100;
+        out[n++] = (roi_region_t){ .x = x - pad_w, .y = y - pad_h, .w = w + 2 * pad_w, .h = h + 2 * pad_h,
+                                   .kind = mouth ? STREAM_FRAME_ROI_MOUTH : STREAM_FRAME_ROI_FACE };
+    }
+    return n;
+}
+
+bool roi_fit(roi_region_t *region, uint16_t width, uint16_t height) {
+    if (region->w > ROI_MAX_CROP_WIDTH) {
+        region->x += (region->w - ROI_MAX_CROP_WIDTH) / 2;
+        region->w = ROI_MAX_CROP_WIDTH;
+    }
+    if (region->h > ROI_MAX_CROP_HEIGHT) {
+        region->y += (region->h - ROI_MAX_CROP_HEIGHT) / 2;
+        region->h = ROI_MAX_CROP_HEIGHT;
+    }
+    int x1 = region->x < 0 ? 0 : region->x;
+    int y1 = region->y < 0 ? 0 : region->y;
+    int x2 = region->x + region->w > width ? width : region->x + region->w;
+    int y2 = region->y + region->h > height ? height : region->y + region->h;
+    region->x = x1;
+    region->y = y1;
+    region->w = x2 > x1 ? x2 - x1 : 0;
+    region->h = y2 > y1 ? y2 - y1 : 0;
+    return region->w >= ROI_MIN_SIZE && region->h >= ROI_MIN_SIZE;
+}
+
+void roi_image_begin(roi_image_t *image) {
+    size_t pixels = (size_t)(image->width >> image->shift) * (image->height >> image->shift);
+    memset(image->sums, 0, pixels * 3 * sizeof(image->sums[0]));
+    image->mismatch = false;
+}
+
+size_t roi_image_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+    roi_image_t *image = arg;
+    if (index >= image->jpg_len) {
+        return 0;
+    }
+    if (len > image->jpg_len - index) {
+        len = image->jpg_len - index;
+    }
+    // No buffer: the decoder skips len bytes
+    if (buf != NULL) {
+        memcpy(buf, image->jpg + index, len);
+    }
+    return len;
+}
+
+bool roi_image_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    roi_image_t *image = arg;
+    if (data == NULL) {
+        // Without data at 0,0 the decoder announces the image size, anywhere else its end
+        if (x == 0 && y == 0 && (w != image->width || h != image->height)) {
+            image->mismatch = true;
+        }
+        return true;
+    }
+    if (image->mismatch || x >= image->width || y >= image->height) {
+        return true;
+    }
+    // Blocks of RGB888 rows, the last ones of a row or column may stick out
+    int block_w = w < image->width - x ? w : image->width - x;
+    int block_h = h < image->height - y ? h : image->height - y;
+    int context_w = image->width >> image->shift;
+    int context_h = image->height >> image->shift;
+    for (int row = 0; row < block_h; row++) {
+        int frame_y = y + row;
+        const uint8_t *src = data + (size_t)row * w * 3;
+        for (int i = 0; i < image->count; i++) {
+            const roi_region_t *region = &image->regions[i];
+            if (frame_y < region->y || frame_y >= region->y + region->h) {
+                continue;
+            }
+            int from = x > region->x ? x : region->x;
+            int to = x + block_w < region->x + region->w ? x + block_w : region->x + region->w;
+            uint8_t *dst = image->crops[i] + ((size_t)(frame_y - region->y) * region->w + (from - region->x)) * 3;
+            for (const uint8_t *p = src + (size_t)(from - x) * 3; from < to; from++, p += 3, dst += 3) {
+                dst[0] = p[2];
+                dst[1] = p[1];
+                dst[2] = p[0];
+            }
+        }
+        // Edge pixels of a frame that is not a multiple of the scale are left out
+        int context_y = frame_y >> image->shift;
+        if (context_y >= context_h) {
+            continue;
+        }
+        uint16_t *sums = image->sums + (size_t)context_y * context_w * 3;
+        for (int col = 0; col < block_w; col++) {
+            int context_x = (x + col) >> image->shift;
+            if (context_x >= context_w) {
+                break;
+            }
+            const uint8_t *p = src + (size_t)col * 3;
+            uint16_t *sum = sums + (size_t)context_x * 3;
+            sum[0] += p[2];
+            sum[1] += p[1];
+            sum[2] += p[0];
+        }
+    }
+    return true;
+}
+
+uint8_t *roi_context_finish(roi_image_t *image) {
+    size_t values = (size_t)(image->width >> image->shift) * (image->height >> image->shift) * 3;
+    int bits = 2 * image->shift;
+    // Byte i only overwrites sums before i, which are done
+    uint8_t *out = (uint8_t *)image->sums;
+    for (size_t i = 0; i < values; i++) {
+        out[i] = (uint8_t)((image->sums[i] + (1 << (bits - 1))) >> bits);
+    }
+    return out;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "face_boxes.h"
+
+/* The parts of region of interest streaming (/roi) that do not need the
+ * ESP32: where the regions are, and splitting one decoded camera frame into a
+ * scaled down context image and full resolution crops of the regions. Builds
+ * on the host too, Software/Streaming/roi_stream.py selftest checks it there.
+ *
+ * Pixels are 3 bytes in the order fmt2jpg() takes for PIXFORMAT_RGB888, which
+ * is the camera's: blue first. */
+
+#define ROI_MAX_REGIONS         4
+#define ROI_MAX_CROP_WIDTH      320     // a larger region keeps its center and loses its edges
+#define ROI_MAX_CROP_HEIGHT     240
+#define ROI_MIN_SIZE            16      // smaller regions are dropped
+#define ROI_CROP_BYTES          (ROI_MAX_CROP_WIDTH * ROI_MAX_CROP_HEIGHT * 3)
+
+typedef struct {
+    int x, y, w, h;             // in pixels of the camera frame
+    uint8_t kind;               // stream_frame_roi_kind_t
+} roi_region_t;
+
+/* Regions from a query value "x,y,w,h;x,y,w,h", the number parsed or -1 if
+ * it is malformed or has more than max. Still to be fitted to the frame. */
+int roi_parse(const char *spec, roi_region_t *out, int max);
+
+/* A region per face of a detector result, highest score first, up to max:
+ * the face, or with mouth the lower half of it as lip reading needs, grown
+ * by pad_percent of its size on every side. Still to be fitted. */
+int roi_from_faces(const face_result_t *faces, bool mouth, int pad_percent, roi_region_t *out, int max);
+
+/* Clip a region to a width x height frame and cut it to ROI_MAX_CROP_WIDTH x
+ * _HEIGHT around its center. False if less than ROI_MIN_SIZE is left. */
+bool roi_fit(roi_region_t *region, uint16_t width, uint16_t height);
+
+/* A decoded camera frame split up, the arg of roi_image_read() and
+ * roi_image_write(), which are esp_jpg_decode()'s reader and writer. The
+ * decoder hands over the frame in blocks; each is copied into the crops it
+ * touches and summed into the context, one pixel per 2^shift square. */
+typedef struct {
+    const uint8_t *jpg;
+    size_t jpg_len;
+    uint16_t width, height;             // expected frame size, set by the caller
+    const roi_region_t *regions;        // fitted to width x height
+    int count;
+    uint8_t *crops[ROI_MAX_REGIONS];    // ROI_CROP_BYTES each, region w x h
+    uint16_t *sums;                     // context sums, (width >> shift) x (height >> shift) x 3
+    int shift;                          // 1..3
+    bool mismatch;                      // the decoder found another size, the images are incomplete
+} roi_image_t;
+
+/* Clear the context sums, before every decode */
+void roi_image_begin(roi_image_t *image);
+
+size_t roi_image_read(void *arg, size_t index, uint8_t *buf, size_t len);
+bool roi_image_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
+
+/* Average the sums into the context image, in place in the sums' memory,
+ * which it returns. (width >> shift) x (height >> shift) pixels. */
+uint8_t *roi_context_finish(roi_image_t *image);
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+#include "roi_encoder.h"
+
+static const char *TAG = "roi_encoder";
+
+struct roi_encoder {
+    roi_image_t image;
+    roi_region_t regions[ROI_MAX_REGIONS];
+    const uint8_t *context;     // after a decode, in image.sums
+    uint8_t *out;               // stream_frame_roi_t and up to ROI_JPEG_MAX of JPEG
+    size_t out_len;
+    bool overflow;
+};
+
+roi_encoder_t *roi_encoder_create(uint16_t max_width, uint16_t max_height, int shift) {
+    roi_encoder_t *encoder = calloc(1, sizeof(*encoder));
+    if (encoder == NULL) {
+        return NULL;
+    }
+    size_t context_pixels = (size_t)(max_width >> shift) * (max_height >> shift);
+    encoder->image.shift = shift;
+    encoder->image.regions = encoder->regions;
+    encoder->image.sums = heap_caps_malloc(context_pixels * 3 * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    encoder->out = heap_caps_malloc(sizeof(stream_frame_roi_t) + ROI_JPEG_MAX, MALLOC_CAP_SPIRAM);
+    bool ok = encoder->image.sums != NULL && encoder->out != NULL;
+    for (int i = 0; i < ROI_MAX_REGIONS && ok; i++) {
+        encoder->image.crops[i] = heap_caps_malloc(ROI_CROP_BYTES, MALLOC_CAP_SPIRAM);
+        ok = encoder->image.crops[i] != NULL;
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "No memory for the images");
+        roi_encoder_free(encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+void roi_encoder_free(roi_encoder_t *encoder) {
+    if (encoder == NULL) {
+        return;
+    }
+    for (int i = 0; i < ROI_MAX_REGIONS; i++) {
+        free(encoder->image.crops[i]);
+    }
+    free(encoder->image.sums);
+    free(encoder->out);
+    free(encoder);
+}
+
+esp_err_t roi_encoder_decode(roi_encoder_t *encoder, const uint8_t *jpg, size_t len, uint16_t width,
+                             uint16_t height, const roi_region_t *regions, int count) {
+    roi_image_t *image = &encoder->image;
+    memcpy(encoder->regions, regions, count * sizeof(regions[0]));
+    image->jpg = jpg;
+    image->jpg_len = len;
+    image->width = width;
+    image->height = height;
+    image->count = count;
+    encoder->context = NULL;
+    roi_image_begin(image);
+    esp_err_t err = esp_jpg_decode(len, JPG_SCALE_NONE, roi_image_read, roi_image_write, image);
+    if (err == ESP_OK && image->mismatch) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK) {
+        encoder->context = roi_context_finish(image);
+    }
+    return err;
+}
+
+static size_t jpeg_write(void *arg, size_t index, const void *data, size_t len) {
+    roi_encoder_t *encoder = arg;
+    if (index + len > ROI_JPEG_MAX) {
+        encoder->overflow = true;
+        return 0;
+    }
+    memcpy(encoder->out + sizeof(stream_frame_roi_t) + index, data, len);
+    if (index + len > encoder->out_len) {
+        encoder->out_len = index + len;
+    }
+    return len;
+}
+
+esp_err_t roi_encoder_encode(roi_encoder_t *encoder, int index, int quality, const uint8_t **payload,
+                             size_t *len) {
+    roi_image_t *image = &encoder->image;
+    if (encoder->context == NULL || index > image->count) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    stream_frame_roi_t roi = {
+        .frame_width = image->width,
+        .frame_height = image->height,
+        .index = index,
+    };
+    uint8_t *pixels;
+    uint16_t width, height;
+    if (index == 0) {
+        pixels = (uint8_t *)encoder->context;
+        width = image->width >> image->shift;
+        height = image->height >> image->shift;
+        roi.w = image->width;
+        roi.h = image->height;
+        roi.kind = STREAM_FRAME_ROI_CONTEXT;
+    } else {
+        const roi_region_t *region = &encoder->regions[index - 1];
+        pixels = image->crops[index - 1];
+        width = region->w;
+        height = region->h;
+        roi.x = region->x;
+        roi.y = region->y;
+        roi.w = region->w;
+        roi.h = region->h;
+        roi.kind = region->kind;
+    }
+    memcpy(encoder->out, &roi, sizeof(roi));
+    encoder->out_len = 0;
+    encoder->overflow = false;
+    if (!fmt2jpg_cb(pixels, (size_t)width * height * 3, width, height, PIXFORMAT_RGB888, quality, jpeg_write,
+                    encoder)) {
+        return encoder->overflow ? ESP_ERR_INVALID_SIZE : ESP_FAIL;
+    }
+    *payload = encoder->out;
+    *len = sizeof(roi) + encoder->out_len;
+    return ESP_OK;
+}
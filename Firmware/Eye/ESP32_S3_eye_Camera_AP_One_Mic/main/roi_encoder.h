@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "stream_frame.h"
+#include "roi_crop.h"
+
+/* Region of interest streaming on the Eye, /roi
+ *
+ * A VGA frame at the camera's quality spends most of its bytes on the
+ * background, while the lip movement detection on the host needs a sharp
+ * mouth. Instead of the camera's JPEG, /roi sends a scaled down context image
+ * of the whole frame at a low quality, and crops of the regions that matter
+ * (the mouths or faces the detector found, or regions the client asks for)
+ * at full resolution and a high quality, each as a STREAM_CODEC_JPEG_ROI
+ * frame with its coordinates (stream_frame.h).
+ *
+ * An encoder decodes a camera frame once, at full size, straight into the
+ * context and the crops (roi_crop.h), then encodes them one after the other
+ * into one output buffer. Everything is in PSRAM, about 1.2 MB for VGA. The
+ * crops cannot be sharper than the camera's JPEG they are cut from: lower
+ * CAMERA_JPEG_QUALITY (/camera?quality=) for more detail in them. */
+
+#define ROI_JPEG_MAX    (96 * 1024)     // output of one image, a larger one is dropped
+
+typedef struct roi_encoder roi_encoder_t;
+
+/* For frames of up to max_width x max_height, with a context of 1/2^shift of
+ * their size. NULL without the memory. */
+roi_encoder_t *roi_encoder_create(uint16_t max_width, uint16_t max_height, int shift);
+void roi_encoder_free(roi_encoder_t *encoder);
+
+/* Decode a camera frame of width x height into the context and the crops of
+ * count regions, fitted to that size (roi_fit()). The JPEG is not needed
+ * after this. */
+esp_err_t roi_encoder_decode(roi_encoder_t *encoder, const uint8_t *jpg, size_t len, uint16_t width,
+                             uint16_t height, const roi_region_t *regions, int count);
+
+/* Encode image index of the last decode, 0 the context and 1 to count the
+ * regions, at quality 1..100 of fmt2jpg(). *payload is a STREAM_CODEC_JPEG_ROI
+ * payload, its stream_frame_roi_t and the JPEG, valid until the next call. */
+esp_err_t roi_encoder_encode(roi_encoder_t *encoder, int index, int quality, const uint8_t **payload,
+                             size_t *len);
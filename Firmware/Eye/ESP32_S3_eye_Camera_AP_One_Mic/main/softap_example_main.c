@@ -1,6 +1,10 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_mac.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -11,6 +15,20 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 #include "driver/spi_master.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "stream_socket.h"
+#include "cpu_load.h"
+#include "av_hub.h"
+#include "time_sync_net.h"
+#include "net_bench.h"
+#include "stream_frame.h"
+#include "video_shaper.h"
+#include "camera_frames.h"
+#include "face_detect.h"
+#include "roi_encoder.h"
+#include "video_rate.h"
 
 /* WiFi configuration */
 #define EXAMPLE_ESP_WIFI_SSID      CONFIG_ESP_WIFI_SSID
@@ -37,6 +55,39 @@ static const char *TAG = "wifi softAP";
 #define CAMERA_PIN_VSYNC 6
 #define CAMERA_PIN_HREF 7
 #define CAMERA_PIN_PCLK 13
+#define CAMERA_SCCB_I2C_PORT 1  /* the driver's own SCCB port, only used when CAMERA_PIN_SIOD is -1 */
+
+#if CONFIG_CAMERA_FRAME_SIZE_QVGA
+#define CAMERA_FRAME_SIZE FRAMESIZE_QVGA
+#define CAMERA_VIDEO_SIZE VIDEO_SIZE_QVGA
+#elif CONFIG_CAMERA_FRAME_SIZE_SVGA
+#define CAMERA_FRAME_SIZE FRAMESIZE_SVGA
+#define CAMERA_VIDEO_SIZE VIDEO_SIZE_SVGA
+#elif CONFIG_CAMERA_FRAME_SIZE_HD
+#define CAMERA_FRAME_SIZE FRAMESIZE_HD
+#define CAMERA_VIDEO_SIZE VIDEO_SIZE_HD
+#else
+#define CAMERA_FRAME_SIZE FRAMESIZE_VGA
+#define CAMERA_VIDEO_SIZE VIDEO_SIZE_VGA
+#endif
+
+#if CONFIG_SPIRAM
+#define CAMERA_FB_LOCATION CAMERA_FB_IN_PSRAM
+#else
+#define CAMERA_FB_LOCATION CAMERA_FB_IN_DRAM
+#endif
+
+/* Frame sizes /camera and the video rate controller switch between, smallest
+ * first like framesize_t, indexed by video_size_t */
+static const struct {
+    const char *name;
+    framesize_t size;
+} camera_sizes[] = {
+    [VIDEO_SIZE_QVGA] = { "qvga", FRAMESIZE_QVGA },
+    [VIDEO_SIZE_VGA] = { "vga", FRAMESIZE_VGA },
+    [VIDEO_SIZE_SVGA] = { "svga", FRAMESIZE_SVGA },
+    [VIDEO_SIZE_HD] = { "hd", FRAMESIZE_HD },
+};
 
 #define SPI_SCLK_OUT 21     /* SPI shared SCLK @ GPIO 21 */
 #define SPI_SDO2     43     /* Serial Data Out 1 @ GPIO0 */
@@ -45,6 +96,25 @@ static const char *TAG = "wifi softAP";
 #define SPI_SDI3     46     /* Serial Data In 2 @ GPIO46 */
 #define SPI_CS       -1     /* Chip select is not being used, peripheral device's CS is pulled down to 0*/
 
+/* Streaming workers. Every /stream and /ach1 client gets its own task, so the
+ * httpd task only accepts requests and the endpoints are served in parallel.
+ * Audio runs above video, a late audio chunk is audible, a late frame is not. */
+#define VIDEO_TASK_STACK     4096
+#define VIDEO_TASK_PRIORITY  (tskIDLE_PRIORITY + 5)
+#define AUDIO_TASK_STACK     4096
+#define AUDIO_TASK_PRIORITY  (tskIDLE_PRIORITY + 6)
+#define MAX_VIDEO_CLIENTS    2      /* each holds one camera frame while sending, see camera_frames.h */
+#define MAX_FACES_CLIENTS    2      /* the face detector's other clients are /roi streams */
+#define FACES_TASK_STACK     4096
+#define FACES_IMAGE_MAX      (256 * 1024)   /* largest JPEG POST /faces takes */
+#define ROI_TASK_STACK       10240  /* esp_jpg_decode() and fmt2jpg_cb() keep their work areas on the stack */
+#define ROI_CONTEXT_QUALITY  30     /* fmt2jpg() quality, 1..100 and higher is better unlike the camera's */
+#define ROI_CROP_QUALITY     90
+#define ROI_PAD_PERCENT      20     /* around a face or mouth, of its size */
+#define ROI_FACES_MAX_AGE_MS 500    /* older boxes are not cropped, the face may have moved */
+
+#define MJPEG_BOUNDARY       "123456789000000000000987654321"
+
 // Function definitions
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 void wifi_init_softap(void);
@@ -53,11 +123,44 @@ esp_err_t stream_handler(httpd_req_t *req);
 static void start_camera_server();
 void init_spi_controllers();
 esp_err_t ach1_handler(httpd_req_t *req);
+esp_err_t status_handler(httpd_req_t *req);
+esp_err_t av_handler(httpd_req_t *req);
+esp_err_t camera_handler(httpd_req_t *req);
+esp_err_t faces_handler(httpd_req_t *req);
+esp_err_t faces_image_handler(httpd_req_t *req);
+esp_err_t roi_handler(httpd_req_t *req);
 
 // Global variables
 spi_device_handle_t spi_device_2;
 spi_device_handle_t spi_device_3;
 
+// Streaming worker bookkeeping, shared between the httpd task and the workers
+static portMUX_TYPE clients_lock = portMUX_INITIALIZER_UNLOCKED;
+static int video_clients = 0;
+static bool audio_active = false;   // the SPI link to the arm board serves one reader at a time
+static bool av_active = false;      // one /av client, it also takes a video slot
+static int faces_clients = 0;
+static int roi_clients = 0;         // they take a video slot too
+static uint32_t frames_sent = 0;
+static uint32_t audio_chunks_sent = 0;
+typedef struct {
+    uint32_t frames;            // camera frames sent as context and crops
+    uint32_t crops;
+    uint32_t failures;          // frames that did not decode, images that did not encode
+    uint64_t source_bytes;      // the camera's JPEGs of those frames
+    uint64_t context_bytes;
+    uint64_t crop_bytes;
+    uint32_t last_us;           // decoding and encoding of a frame
+    uint32_t max_us;
+    uint64_t total_us;
+} roi_stats_t;
+static roi_stats_t roi_stats;
+// The operating point of the adaptive /stream clients, see video_rate.h. The
+// mutex also covers the sensor settings it makes, they go over SCCB.
+static SemaphoreHandle_t video_rate_lock;
+static video_rate_t video_rate;
+static int adapt_clients = 0;
+
 static httpd_uri_t stream_uri = {
     .uri = "/stream",          // URI endpoint for video stream
     .method = HTTP_GET,         // HTTP GET method
@@ -72,6 +175,48 @@ static httpd_uri_t ach1_uri = {
     .user_ctx = NULL            // Optional user context
 };
 
+static httpd_uri_t av_uri = {
+    .uri = "/av",               // URI endpoint for the merged camera and arm board stream
+    .method = HTTP_GET,
+    .handler = av_handler,
+    .user_ctx = NULL
+};
+
+static httpd_uri_t camera_uri = {
+    .uri = "/camera",           // URI endpoint for the camera settings
+    .method = HTTP_GET,
+    .handler = camera_handler,
+    .user_ctx = NULL
+};
+
+static httpd_uri_t faces_uri = {
+    .uri = "/faces",            // URI endpoint for the face boxes
+    .method = HTTP_GET,
+    .handler = faces_handler,
+    .user_ctx = NULL
+};
+
+static httpd_uri_t faces_image_uri = {
+    .uri = "/faces",            // faces in a posted JPEG, for evaluating the detector
+    .method = HTTP_POST,
+    .handler = faces_image_handler,
+    .user_ctx = NULL
+};
+
+static httpd_uri_t roi_uri = {
+    .uri = "/roi",              // URI endpoint for the context image and region crops
+    .method = HTTP_GET,
+    .handler = roi_handler,
+    .user_ctx = NULL
+};
+
+static httpd_uri_t status_uri = {
+    .uri = "/status",           // URI endpoint for the server status
+    .method = HTTP_GET,         // HTTP GET method
+    .handler = status_handler,  // Handler function
+    .user_ctx = NULL            // Optional user context
+};
+
 // In app_main, add after each major step:
 void app_main(void) {
     ESP_LOGI(TAG, "Starting application...");
@@ -89,10 +234,31 @@ void app_main(void) {
     
     ESP_LOGI(TAG, "Initializing camera");
     init_camera();
+    if (camera_frames_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Camera capture task failed to start");
+    }
+    ESP_LOGI(TAG, "Loading the face detector");
+    if (face_detect_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Face detection failed to start");
+    }
     
+    // Before the server, every video sender goes through it
+    video_shaper_init(CONFIG_VIDEO_SHAPER_KBPS, CONFIG_VIDEO_SHAPER_BURST_KB * 1024);
+    video_rate_lock = xSemaphoreCreateMutex();
+
     ESP_LOGI(TAG, "Starting camera server");
     start_camera_server();
 
+    // The arm boards and the host synchronize their clocks with this one
+    if (time_sync_master_start(TIME_SYNC_PORT) != ESP_OK) {
+        ESP_LOGE(TAG, "Time sync master failed to start");
+    }
+
+    ESP_LOGI(TAG, "Starting A/V hub");
+    if (av_hub_start() != ESP_OK) {
+        ESP_LOGE(TAG, "A/V hub failed to start");
+    }
+
     ESP_LOGI(TAG, "Initializing SPI controllers");
     init_spi_controllers();
     
@@ -152,32 +318,45 @@ void wifi_init_softap(void) {
              EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS, EXAMPLE_ESP_WIFI_CHANNEL);
 }
 
-/* Initialize the Camera */
+/* Initialize the Camera. Every field is set here, the driver's buffer
+ * placement and queueing depend on fields that used to be left undefined. */
 void init_camera() {
-    camera_config_t config;
-    config.ledc_channel = LEDC_CHANNEL_0;
-    config.ledc_timer = LEDC_TIMER_0;
-    config.pin_d0 = CAMERA_PIN_D0;
-    config.pin_d1 = CAMERA_PIN_D1;
-    config.pin_d2 = CAMERA_PIN_D2;
-    config.pin_d3 = CAMERA_PIN_D3;
-    config.pin_d4 = CAMERA_PIN_D4;
-    config.pin_d5 = CAMERA_PIN_D5;
-    config.pin_d6 = CAMERA_PIN_D6;
-    config.pin_d7 = CAMERA_PIN_D7;
-    config.pin_xclk = CAMERA_PIN_XCLK;
-    config.pin_pclk = CAMERA_PIN_PCLK;
-    config.pin_vsync = CAMERA_PIN_VSYNC;
-    config.pin_href = CAMERA_PIN_HREF;
-    config.pin_sccb_sda = CAMERA_PIN_SIOD;
-    config.pin_sccb_scl = CAMERA_PIN_SIOC;
-    config.pin_pwdn = CAMERA_PIN_PWDN;
-    config.pin_reset = CAMERA_PIN_RESET;
-    config.xclk_freq_hz = 20000000;
-    config.pixel_format = PIXFORMAT_JPEG;
-    config.frame_size = FRAMESIZE_VGA;
-    config.jpeg_quality = 12;
-    config.fb_count = 2;
+    camera_config_t config = {
+        .pin_pwdn = CAMERA_PIN_PWDN,
+        .pin_reset = CAMERA_PIN_RESET,
+        .pin_xclk = CAMERA_PIN_XCLK,
+        .pin_sccb_sda = CAMERA_PIN_SIOD,
+        .pin_sccb_scl = CAMERA_PIN_SIOC,
+        .pin_d7 = CAMERA_PIN_D7,
+        .pin_d6 = CAMERA_PIN_D6,
+        .pin_d5 = CAMERA_PIN_D5,
+        .pin_d4 = CAMERA_PIN_D4,
+        .pin_d3 = CAMERA_PIN_D3,
+        .pin_d2 = CAMERA_PIN_D2,
+        .pin_d1 = CAMERA_PIN_D1,
+        .pin_d0 = CAMERA_PIN_D0,
+        .pin_vsync = CAMERA_PIN_VSYNC,
+        .pin_href = CAMERA_PIN_HREF,
+        .pin_pclk = CAMERA_PIN_PCLK,
+        .xclk_freq_hz = 20000000,
+        .ledc_timer = LEDC_TIMER_0,
+        .ledc_channel = LEDC_CHANNEL_0,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = CAMERA_FRAME_SIZE,    // the buffers are sized for it, /camera can only go smaller
+        .jpeg_quality = CONFIG_CAMERA_JPEG_QUALITY,
+        // Frames are shared by reference (camera_frames.h): one buffer per client, the latest and one to fill
+        .fb_count = CAMERA_FRAMES_FB_COUNT,
+        .fb_location = CAMERA_FB_LOCATION,
+        // The driver drops queued frames for the newest one, so a frame is never older than one period
+        .grab_mode = CAMERA_GRAB_LATEST,
+        .sccb_i2c_port = CAMERA_SCCB_I2C_PORT,
+    };
+#if !CONFIG_SPIRAM
+    ESP_LOGW(TAG, "No PSRAM, %d camera frame buffers in internal RAM", (int)config.fb_count);
+#endif
+#if CAMERA_FRAMES_FB_COUNT < CAMERA_FRAMES_FB_COUNT_MIN
+    ESP_LOGW(TAG, "%d camera frame buffers, a slow video client holds up the others", CAMERA_FRAMES_FB_COUNT);
+#endif
 
     // Camera init
     esp_err_t err = esp_camera_init(&config);
@@ -186,79 +365,426 @@ void init_camera() {
     }
 }
 
-/* Stream handler for HTTP */
-esp_err_t stream_handler(httpd_req_t *req) {
-    camera_fb_t *fb = NULL;
-    esp_err_t res = ESP_OK;
-    size_t _jpg_buf_len = 0;
-    uint8_t *_jpg_buf = NULL;
-    char *part_buf[64];
+static const char *camera_size_name(framesize_t size) {
+    for (size_t i = 0; i < sizeof(camera_sizes) / sizeof(camera_sizes[0]); i++) {
+        if (camera_sizes[i].size == size) {
+            return camera_sizes[i].name;
+        }
+    }
+    return "other";
+}
 
-    // Set MIME type for MJPEG stream
-    res = httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=123456789000000000000987654321");
+/* ?framesize= and ?quality= of /camera, NULL when applied or the error for code */
+static const char *camera_set(sensor_t *sensor, const char *query, httpd_err_code_t *code) {
+    char value[8];
+    *code = HTTPD_400_BAD_REQUEST;
+    if (httpd_query_key_value(query, "framesize", value, sizeof(value)) == ESP_OK) {
+        int found = -1;
+        for (size_t i = 0; i < sizeof(camera_sizes) / sizeof(camera_sizes[0]); i++) {
+            if (strcmp(value, camera_sizes[i].name) == 0) {
+                found = i;
+            }
+        }
+        if (found < 0 || camera_sizes[found].size > CAMERA_FRAME_SIZE) {
+            return "framesize must be qvga, vga, svga or hd, at most the boot size";
+        }
+        if (sensor->set_framesize(sensor, camera_sizes[found].size) != 0) {
+            *code = HTTPD_500_INTERNAL_SERVER_ERROR;
+            return "set_framesize failed";
+        }
+    }
+    if (httpd_query_key_value(query, "quality", value, sizeof(value)) == ESP_OK) {
+        int quality = atoi(value);
+        if (quality < 4 || quality > 63) {
+            return "quality must be 4 to 63";
+        }
+        if (sensor->set_quality(sensor, quality) != 0) {
+            *code = HTTPD_500_INTERNAL_SERVER_ERROR;
+            return "set_quality failed";
+        }
+    }
+    return NULL;
+}
+
+/* Camera settings as JSON. ?framesize=qvga|vga|svga|hd and ?quality=4..63
+ * change them while the streams run, up to the frame size of the boot config
+ * (CONFIG_CAMERA_FRAME_SIZE), which the frame buffers were allocated for.
+ * While an adaptive /stream runs the settings are the controller's, and
+ * changing them is refused. */
+esp_err_t camera_handler(httpd_req_t *req) {
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (sensor == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "camera not initialized");
+    }
+    char query[64];
+    const char *error = NULL;
+    httpd_err_code_t code = HTTPD_400_BAD_REQUEST;
+    bool refused = false;
+    xSemaphoreTake(video_rate_lock, portMAX_DELAY);
+    int adapt = adapt_clients;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[8];
+        bool change = httpd_query_key_value(query, "framesize", value, sizeof(value)) == ESP_OK ||
+                      httpd_query_key_value(query, "quality", value, sizeof(value)) == ESP_OK;
+        if (change && adapt > 0) {
+            refused = true;
+        } else if (change) {
+            error = camera_set(sensor, query, &code);
+        }
+    }
+    xSemaphoreGive(video_rate_lock);
+    if (refused) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, "An adaptive /stream sets the camera");
+    }
+    if (error != NULL) {
+        return httpd_resp_send_err(req, code, error);
+    }
+
+    char json[224];
+    int len = snprintf(json, sizeof(json),
+                       "{\"framesize\":\"%s\",\"quality\":%d,\"max_framesize\":\"%s\",\"fb_count\":%d,"
+                       "\"fb_in_psram\":%s,\"grab_latest\":true,\"adapt_clients\":%d}",
+                       camera_size_name(sensor->status.framesize), sensor->status.quality,
+                       camera_size_name(CAMERA_FRAME_SIZE), CAMERA_FRAMES_FB_COUNT,
+                       CAMERA_FB_LOCATION == CAMERA_FB_IN_PSRAM ? "true" : "false", adapt);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+/* Hand a long-lived request over to its own task, the httpd task is free again
+ * as soon as this returns. The task gets the async copy of the request and has
+ * to call httpd_req_async_handler_complete() on it when done. */
+static esp_err_t start_stream_worker(httpd_req_t *req, TaskFunction_t worker, const char *name,
+                                     uint32_t stack_size, UBaseType_t priority) {
+    httpd_req_t *async_req = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &async_req);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to detach %s request: %s", name, esp_err_to_name(err));
+        return err;
+    }
+    if (xTaskCreate(worker, name, stack_size, async_req, priority, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create %s worker", name);
+        httpd_req_async_handler_complete(async_req);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* True if the query string has key=1, ex: ?raw=1 */
+static bool query_flag(httpd_req_t *req, const char *key) {
+    char query[64];
+    char value[8];
+    return httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+           httpd_query_key_value(query, key, value, sizeof(value)) == ESP_OK && value[0] == '1';
+}
+
+/* Sets the camera to point, with video_rate_lock held */
+static void video_rate_apply(const video_rate_point_t *point) {
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (sensor == NULL) {
+        return;
+    }
+    if (sensor->status.framesize != camera_sizes[point->size].size &&
+        sensor->set_framesize(sensor, camera_sizes[point->size].size) != 0) {
+        ESP_LOGW(TAG, "Video rate: set_framesize failed");
+    }
+    if (sensor->status.quality != point->quality && sensor->set_quality(sensor, point->quality) != 0) {
+        ESP_LOGW(TAG, "Video rate: set_quality failed");
+    }
+}
+
+/* The first adaptive stream starts the controller at the boot point, the last
+ * one leaves the camera at it */
+static void video_rate_join(video_rate_point_t *point) {
+    xSemaphoreTake(video_rate_lock, portMAX_DELAY);
+    if (adapt_clients++ == 0) {
+        video_rate_init(&video_rate, CAMERA_VIDEO_SIZE, CONFIG_CAMERA_JPEG_QUALITY, CONFIG_VIDEO_RATE_TARGET_MS,
+                        esp_timer_get_time());
+        video_rate_apply(video_rate_point(&video_rate));
+    }
+    *point = *video_rate_point(&video_rate);
+    xSemaphoreGive(video_rate_lock);
+}
+
+static void video_rate_leave(void) {
+    xSemaphoreTake(video_rate_lock, portMAX_DELAY);
+    if (--adapt_clients == 0) {
+        video_rate_apply(&video_rate.points[0]);
+    }
+    xSemaphoreGive(video_rate_lock);
+}
+
+/* One frame an adaptive stream sent, point becomes the one to send the next at */
+static void video_rate_feed(uint32_t send_us, uint32_t latency_us, video_rate_point_t *point) {
+    xSemaphoreTake(video_rate_lock, portMAX_DELAY);
+    if (video_rate_update(&video_rate, send_us, latency_us, esp_timer_get_time())) {
+        const video_rate_point_t *next = video_rate_point(&video_rate);
+        ESP_LOGI(TAG, "Video rate: %s quality %d at %d fps, latency %lu ms, send %lu ms",
+                 camera_sizes[next->size].name, next->quality, next->fps,
+                 (unsigned long)(video_rate.latency_us / 1000), (unsigned long)(video_rate.send_us / 1000));
+        video_rate_apply(next);
+    }
+    *point = *video_rate_point(&video_rate);
+    xSemaphoreGive(video_rate_lock);
+}
+
+/* A JPEG in VIDEO_SHAPER_SLICE pieces, each let through by the shaper, so
+ * audio never queues behind a whole frame. The first piece goes out together
+ * with the part or frame header head in front of it. The time spent waiting
+ * for the shaper is added to *shaped_us if given. */
+static esp_err_t jpeg_send_shaped(httpd_req_t *req, stream_socket_t *out, bool raw, const void *head,
+                                  size_t head_len, const uint8_t *jpg, size_t jpg_len, int64_t *shaped_us) {
+    size_t sent = 0;
+    do {
+        size_t slice = jpg_len - sent < VIDEO_SHAPER_SLICE ? jpg_len - sent : VIDEO_SHAPER_SLICE;
+        int64_t waited_us = video_shaper_wait(head_len + slice);
+        if (shaped_us != NULL) {
+            *shaped_us += waited_us;
+        }
+        esp_err_t res = ESP_OK;
+        if (raw) {
+            struct iovec iov[2] = {
+                { .iov_base = (void *)head, .iov_len = head_len },
+                { .iov_base = (void *)(jpg + sent), .iov_len = slice },
+            };
+            res = stream_socket_writev(out, iov, 2);
+        } else {
+            if (head_len > 0) {
+                res = httpd_resp_send_chunk(req, head, head_len);
+            }
+            if (res == ESP_OK) {
+                res = httpd_resp_send_chunk(req, (const char *)jpg + sent, slice);
+            }
+        }
+        if (res != ESP_OK) {
+            return res;
+        }
+        head_len = 0;
+        sent += slice;
+    } while (sent < jpg_len);
+    return ESP_OK;
+}
+
+/* What an MJPEG part says about its frame besides the length */
+typedef struct {
+    uint32_t seq;           // the capture's frame number, skipped frames show as a gap
+    int64_t timestamp_us;   // VSYNC on the synchronized clock, the Eye's
+    uint32_t delay_us;      // VSYNC to the part header being sent
+    const char *framesize;  // the camera's settings when the frame was sent, a change takes a frame or two
+    int quality;
+    int fps;                // the stream's frame rate cap, 0 when it sends every frame it can
+} mjpeg_part_info_t;
+
+/* The part header from the value of Content-Length to the blank line */
+static int mjpeg_part_fields(char *out, size_t size, size_t jpg_len, const mjpeg_part_info_t *info) {
+    return snprintf(out, size,
+                    "%u\r\nX-Frame-Seq: %lu\r\nX-Timestamp: %lld\r\nX-Capture-Delay-Us: %lu\r\n"
+                    "X-Framesize: %s\r\nX-Quality: %d\r\nX-Fps: %d\r\n\r\n",
+                    (unsigned)jpg_len, (unsigned long)info->seq, (long long)info->timestamp_us,
+                    (unsigned long)info->delay_us, info->framesize, info->quality, info->fps);
+}
+
+/* The camera settings of two parts differ */
+static bool mjpeg_part_settings_changed(const mjpeg_part_info_t *a, const mjpeg_part_info_t *b) {
+    return a->framesize == NULL || b->framesize == NULL || strcmp(a->framesize, b->framesize) != 0 ||
+           a->quality != b->quality || a->fps != b->fps;
+}
+
+/* One MJPEG part through httpd: every piece is its own chunk */
+static esp_err_t mjpeg_send_part_chunked(httpd_req_t *req, const mjpeg_part_info_t *info,
+                                         const uint8_t *jpg, size_t jpg_len, int64_t *shaped_us) {
+    static const char boundary[] = "\r\n--" MJPEG_BOUNDARY "\r\n";
+    static const char jpeg_header[] = "Content-Type: image/jpeg\r\nContent-Length: ";
+    // Send multipart header
+    esp_err_t res = httpd_resp_send_chunk(req, boundary, sizeof(boundary) - 1);
+    if (res != ESP_OK) {
+        return res;
+    }
+    // Send JPEG header
+    res = httpd_resp_send_chunk(req, jpeg_header, sizeof(jpeg_header) - 1);
     if (res != ESP_OK) {
         return res;
     }
+    // Send length and the frame's settings
+    char fields[224];
+    int fields_len = mjpeg_part_fields(fields, sizeof(fields), jpg_len, info);
+    res = httpd_resp_send_chunk(req, fields, fields_len);
+    if (res != ESP_OK) {
+        return res;
+    }
+    // Send JPEG data
+    return jpeg_send_shaped(req, NULL, false, NULL, 0, jpg, jpg_len, shaped_us);
+}
+
+/* One MJPEG part straight to the socket: the part header goes out in one writev with the first slice */
+static esp_err_t mjpeg_send_part_raw(stream_socket_t *out, const mjpeg_part_info_t *info,
+                                     const uint8_t *jpg, size_t jpg_len, int64_t *shaped_us) {
+    char part_header[288];
+    int header_len = snprintf(part_header, sizeof(part_header),
+                              "\r\n--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: ");
+    header_len += mjpeg_part_fields(part_header + header_len, sizeof(part_header) - header_len, jpg_len, info);
+    return jpeg_send_shaped(NULL, out, true, part_header, header_len, jpg, jpg_len, shaped_us);
+}
+
+/* One JPEG as a stream_frame.h frame, ?container=1 */
+static esp_err_t jpeg_send_frame(httpd_req_t *req, stream_socket_t *out, bool raw, uint32_t seq,
+                                 int64_t timestamp_us, const uint8_t *jpg, size_t jpg_len, int64_t *shaped_us) {
+    stream_frame_header_t frame;
+    // The Eye's clock is the one the others synchronize to
+    stream_frame_encode(&frame, 0, STREAM_CODEC_JPEG, seq, timestamp_us, 0, STREAM_FRAME_FLAG_SYNCED, jpg, jpg_len);
+    return jpeg_send_shaped(req, out, raw, &frame, sizeof(frame), jpg, jpg_len, shaped_us);
+}
+
+/* The part info as a JSON frame ahead of the first JPEG it applies to, ?container=1 */
+static esp_err_t jpeg_send_info(httpd_req_t *req, stream_socket_t *out, bool raw, uint32_t seq,
+                                int64_t timestamp_us, const mjpeg_part_info_t *info) {
+    char json[80];
+    int len = snprintf(json, sizeof(json), "{\"framesize\":\"%s\",\"quality\":%d,\"fps\":%d}",
+                       info->framesize, info->quality, info->fps);
+    stream_frame_header_t frame;
+    stream_frame_encode(&frame, 0, STREAM_CODEC_JSON, seq, timestamp_us, 0, STREAM_FRAME_FLAG_SYNCED, json, len);
+    if (raw) {
+        struct iovec iov[] = {
+            { .iov_base = &frame, .iov_len = sizeof(frame) },
+            { .iov_base = json, .iov_len = len },
+        };
+        return stream_socket_writev(out, iov, 2);
+    }
+    esp_err_t res = httpd_resp_send_chunk(req, (const char *)&frame, sizeof(frame));
+    return res == ESP_OK ? httpd_resp_send_chunk(req, json, len) : res;
+}
 
-    while (true) {
-        // Get frame
-        fb = esp_camera_fb_get();
-        if (!fb) {
+/* MJPEG stream, runs on a video worker until the client goes away. It sends
+ * the latest frame of the capture task whenever it is done with the previous
+ * one, so a slow client gets fewer frames and the others are not held up.
+ * With ?raw=1 the parts are written straight to the socket instead of as four
+ * chunked httpd sends per frame. Every multipart part carries the frame's seq,
+ * its capture time and the delay until it was sent besides the camera
+ * settings, so the host can line it up with the audio. With ?container=1
+ * every JPEG goes out as a stream_frame.h frame, with its capture time,
+ * instead of a multipart part, and a JSON frame with the camera settings goes
+ * ahead of the first JPEG and whenever they change. With ?adapt=1 the stream
+ * feeds the video rate controller (video_rate.h) and keeps to the frame rate
+ * of its point. */
+static esp_err_t mjpeg_stream(httpd_req_t *req) {
+    esp_err_t res = ESP_OK;
+    bool raw = query_flag(req, "raw");
+    bool container = query_flag(req, "container");
+    bool adapt = query_flag(req, "adapt");
+    sensor_t *sensor = esp_camera_sensor_get();
+    mjpeg_part_info_t info = { 0 };
+    video_rate_point_t point = { 0 };
+    int64_t next_send_us = 0;
+    const char *type = container ? "application/octet-stream" : "multipart/x-mixed-replace;boundary=" MJPEG_BOUNDARY;
+    const stream_socket_header_t frame_headers[] = {
+        { STREAM_FRAME_HTTP_HEADER, "1" },
+    };
+    stream_socket_t out = { 0 };
+    camera_frames_sub_t *sub = camera_frames_subscribe();
+    if (sub == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (adapt) {
+        video_rate_join(&point);
+    }
+
+    // Set MIME type for MJPEG stream
+    if (raw) {
+        res = stream_socket_begin(&out, req, type, frame_headers, container ? 1 : 0);
+    } else {
+        res = httpd_resp_set_type(req, type);
+        if (res == ESP_OK && container) {
+            res = httpd_resp_set_hdr(req, STREAM_FRAME_HTTP_HEADER, "1");
+        }
+    }
+    while (res == ESP_OK) {
+        // Frames that come in meanwhile are skipped, the next one is the newest
+        int64_t wait_us = next_send_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS((wait_us + 999) / 1000));
+        }
+        camera_frame_t *frame = camera_frames_get(sub, pdMS_TO_TICKS(CAMERA_FRAMES_TIMEOUT_MS));
+        if (frame == NULL) {
             ESP_LOGE(TAG, "Camera capture failed");
             res = ESP_FAIL;
             break;
         }
-        if (fb->format != PIXFORMAT_JPEG) {
-            bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-            esp_camera_fb_return(fb);
-            fb = NULL;
-            if (!jpeg_converted) {
-                ESP_LOGE(TAG, "JPEG compression failed");
-                res = ESP_FAIL;
-                break;
+        int64_t send_start_us = esp_timer_get_time();
+        int64_t shaped_us = 0;      // waited for the shaper, not for the link
+        mjpeg_part_info_t now = {
+            .seq = frame->seq,
+            .timestamp_us = time_sync_to_master(frame->timestamp_us),
+            .delay_us = send_start_us > frame->timestamp_us ? (uint32_t)(send_start_us - frame->timestamp_us) : 0,
+            .framesize = camera_size_name(sensor->status.framesize),
+            .quality = sensor->status.quality,
+            .fps = adapt ? point.fps : 0,
+        };
+        if (container) {
+            if (mjpeg_part_settings_changed(&now, &info)) {
+                res = jpeg_send_info(req, &out, raw, now.seq, now.timestamp_us, &now);
+            }
+            if (res == ESP_OK) {
+                res = jpeg_send_frame(req, &out, raw, now.seq, now.timestamp_us, frame->jpg, frame->len, &shaped_us);
             }
+        } else if (raw) {
+            res = mjpeg_send_part_raw(&out, &now, frame->jpg, frame->len, &shaped_us);
         } else {
-            _jpg_buf_len = fb->len;
-            _jpg_buf = fb->buf;
+            res = mjpeg_send_part_chunked(req, &now, frame->jpg, frame->len, &shaped_us);
         }
-        // Send multipart header
-        res = httpd_resp_send_chunk(req, "\r\n--123456789000000000000987654321\r\n", 37);
-        if (res != ESP_OK) {
-            break;
-        }
-        // Send JPEG header
-        res = httpd_resp_send_chunk(req, "Content-Type: image/jpeg\r\nContent-Length: ", 43);
-        if (res != ESP_OK) {
-            break;
+        info = now;
+        if (adapt && res == ESP_OK) {
+            int64_t sent_us = esp_timer_get_time();
+            // The shaper holds every stream to the configured rate, only the
+            // rest is the link being slow. The latency includes both.
+            video_rate_feed(sent_us - send_start_us - shaped_us, sent_us - frame->timestamp_us, &point);
+            next_send_us = send_start_us + video_rate_interval_us(&point);
         }
-        // Send length
-        char len_str[16];
-        size_t len_len = snprintf(len_str, 16, "%u\r\n\r\n", _jpg_buf_len);
-        res = httpd_resp_send_chunk(req, len_str, len_len);
-        if (res != ESP_OK) {
-            break;
-        }
-        // Send JPEG data
-        res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-        if (res != ESP_OK) {
-            break;
-        }
-        // Free up the buffers
-        if (fb) {
-            esp_camera_fb_return(fb);
-            fb = NULL;
-            _jpg_buf = NULL;
-        } else if (_jpg_buf) {
-            free(_jpg_buf);
-            _jpg_buf = NULL;
+        camera_frames_release(frame);
+        if (res == ESP_OK) {
+            taskENTER_CRITICAL(&clients_lock);
+            frames_sent++;
+            taskEXIT_CRITICAL(&clients_lock);
         }
     }
-    // Clean up
-    if (fb) {
-        esp_camera_fb_return(fb);
+    if (adapt) {
+        video_rate_leave();
+    }
+    camera_frames_unsubscribe(sub);
+    stream_socket_end(&out);
+    return res;
+}
+
+static void video_worker(void *arg) {
+    httpd_req_t *req = (httpd_req_t *)arg;
+    esp_err_t res = mjpeg_stream(req);
+    ESP_LOGI(TAG, "Video stream ended: %s", esp_err_to_name(res));
+    httpd_req_async_handler_complete(req);
+    taskENTER_CRITICAL(&clients_lock);
+    video_clients--;
+    taskEXIT_CRITICAL(&clients_lock);
+    vTaskDelete(NULL);
+}
+
+/* Stream handler for HTTP */
+esp_err_t stream_handler(httpd_req_t *req) {
+    bool accepted = false;
+    taskENTER_CRITICAL(&clients_lock);
+    if (video_clients < MAX_VIDEO_CLIENTS) {
+        video_clients++;
+        accepted = true;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+    if (!accepted) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many video clients");
     }
-    if (_jpg_buf) {
-        free(_jpg_buf);
+
+    esp_err_t res = start_stream_worker(req, video_worker, "video_stream", VIDEO_TASK_STACK, VIDEO_TASK_PRIORITY);
+    if (res != ESP_OK) {
+        taskENTER_CRITICAL(&clients_lock);
+        video_clients--;
+        taskEXIT_CRITICAL(&clients_lock);
     }
     return res;
 }
@@ -272,6 +798,7 @@ static void start_camera_server()
 
     // Server configuration
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 12;   // the default 8 are taken
     ESP_LOGI(TAG, "Server config created with port: %d", config.server_port);
 
     // Start the server
@@ -294,6 +821,57 @@ static void start_camera_server()
         } else {
             ESP_LOGI(TAG, "Audio handler registered at URI: %s", ach1_uri.uri);
         }
+
+        // Register merged A/V handler
+        err = httpd_register_uri_handler(server, &av_uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register A/V handler: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "A/V handler registered at URI: %s", av_uri.uri);
+        }
+
+        // Register camera settings handler
+        err = httpd_register_uri_handler(server, &camera_uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register camera handler: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Camera handler registered at URI: %s", camera_uri.uri);
+        }
+
+        // Register face detection handlers
+        err = httpd_register_uri_handler(server, &faces_uri);
+        if (err == ESP_OK) {
+            err = httpd_register_uri_handler(server, &faces_image_uri);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register faces handler: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Faces handler registered at URI: %s", faces_uri.uri);
+        }
+
+        // Register region of interest handler
+        err = httpd_register_uri_handler(server, &roi_uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register ROI handler: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "ROI handler registered at URI: %s", roi_uri.uri);
+        }
+
+        // Register status handler
+        err = httpd_register_uri_handler(server, &status_uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register status handler: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Status handler registered at URI: %s", status_uri.uri);
+        }
+
+        // Register the network benchmark, competing with the video like another stream
+        err = net_bench_register(server, VIDEO_TASK_PRIORITY);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register bench handler: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Bench handler registered at URI: /bench");
+        }
     } else {
         ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(err));
     }
@@ -338,11 +916,14 @@ void init_spi_controllers()
     return;
 }
 
-esp_err_t ach1_handler(httpd_req_t *req) {
+/* Audio stream from the arm board over SPI, runs on the audio worker until the client goes away */
+static esp_err_t ach1_stream(httpd_req_t *req) {
     ESP_LOGI(TAG, "Audio handler started");
     esp_err_t res = ESP_OK;
     uint8_t *audio_buffer = NULL;
     uint8_t *ch1_buffer = NULL;
+    bool raw = query_flag(req, "raw");     // ?raw=1: write to the socket, no chunked encoding
+    stream_socket_t out = { 0 };
     
     // Reduced buffer sizes
     #define SAMPLES_PER_READ 512  // Reduced from 2048
@@ -367,18 +948,30 @@ esp_err_t ach1_handler(httpd_req_t *req) {
 
     // Set response type and headers
     ESP_LOGI(TAG, "Setting response headers");
-    if ((res = httpd_resp_set_type(req, "audio/raw")) != ESP_OK) {
+    if (raw) {
+        const stream_socket_header_t headers[] = {
+            { "X-Audio-Sample-Rate", "24000" },
+            { "X-Audio-Bits-Per-Sample", "16" },
+            { "X-Audio-Channels", "1" },
+        };
+        if ((res = stream_socket_begin(&out, req, "audio/raw", headers, 3)) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start raw stream: %s", esp_err_to_name(res));
+            goto cleanup;
+        }
+    } else if ((res = httpd_resp_set_type(req, "audio/raw")) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set response type: %s", esp_err_to_name(res));
         goto cleanup;
     }
     
-    if ((res = httpd_resp_set_hdr(req, "X-Audio-Sample-Rate", "24000")) != ESP_OK ||
+    if (!raw && ((res = httpd_resp_set_hdr(req, "X-Audio-Sample-Rate", "24000")) != ESP_OK ||
         (res = httpd_resp_set_hdr(req, "X-Audio-Bits-Per-Sample", "16")) != ESP_OK ||
-        (res = httpd_resp_set_hdr(req, "X-Audio-Channels", "1")) != ESP_OK) {
+        (res = httpd_resp_set_hdr(req, "X-Audio-Channels", "1")) != ESP_OK)) {
         ESP_LOGE(TAG, "Failed to set audio headers: %s", esp_err_to_name(res));
         goto cleanup;
     }
     ESP_LOGI(TAG, "Headers set successfully");
+    // WMM voice, and the video senders hold back while a chunk is being sent
+    stream_socket_set_tos(httpd_req_to_sockfd(req), STREAM_SOCKET_TOS_VOICE);
 
     // Main transaction configuration
     spi_transaction_t trans = {
@@ -414,11 +1007,20 @@ esp_err_t ach1_handler(httpd_req_t *req) {
         }
 
         ESP_LOGD(TAG, "Sending audio chunk");
-        res = httpd_resp_send_chunk(req, (char*)ch1_buffer, SAMPLES_PER_READ * BYTES_PER_SAMPLE);
+        video_shaper_audio_begin();
+        if (raw) {
+            res = stream_socket_write(&out, ch1_buffer, SAMPLES_PER_READ * BYTES_PER_SAMPLE);
+        } else {
+            res = httpd_resp_send_chunk(req, (char*)ch1_buffer, SAMPLES_PER_READ * BYTES_PER_SAMPLE);
+        }
+        video_shaper_audio_end();
         if (res != ESP_OK) {
             ESP_LOGE(TAG, "Failed to send chunk: %s", esp_err_to_name(res));
             goto cleanup;
         }
+        taskENTER_CRITICAL(&clients_lock);
+        audio_chunks_sent++;
+        taskEXIT_CRITICAL(&clients_lock);
 
         // Small delay to prevent watchdog timeout
         vTaskDelay(1);
@@ -435,11 +1037,620 @@ cleanup:
         ch1_buffer = NULL;
     }
     
-    if (res != ESP_OK) {
+    if (res != ESP_OK && !raw) {
         ESP_LOGI(TAG, "Sending error response");
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Stream failed");
     }
     
+    stream_socket_end(&out);
     ESP_LOGI(TAG, "Handler complete");
     return res;
 }
+
+static void audio_worker(void *arg) {
+    httpd_req_t *req = (httpd_req_t *)arg;
+    ach1_stream(req);
+    httpd_req_async_handler_complete(req);
+    taskENTER_CRITICAL(&clients_lock);
+    audio_active = false;
+    taskEXIT_CRITICAL(&clients_lock);
+    vTaskDelete(NULL);
+}
+
+esp_err_t ach1_handler(httpd_req_t *req) {
+    bool accepted = false;
+    taskENTER_CRITICAL(&clients_lock);
+    if (!audio_active) {
+        audio_active = true;
+        accepted = true;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+    if (!accepted) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Audio stream already in use");
+    }
+
+    esp_err_t res = start_stream_worker(req, audio_worker, "audio_stream", AUDIO_TASK_STACK, AUDIO_TASK_PRIORITY);
+    if (res != ESP_OK) {
+        taskENTER_CRITICAL(&clients_lock);
+        audio_active = false;
+        taskEXIT_CRITICAL(&clients_lock);
+    }
+    return res;
+}
+
+/* Merged stream: camera frames from this task, arm board audio from the hub
+ * sources, all as av_record_header_t records (see av_hub.h) on one socket,
+ * or as stream_frame.h frames with ?container=1 */
+static esp_err_t av_stream(httpd_req_t *req) {
+    stream_socket_t out = { 0 };
+    bool container = query_flag(req, "container");
+    const stream_socket_header_t headers[] = {
+        { "X-AV-Format", container ? "irsf1" : "irav1" },
+        { STREAM_FRAME_HTTP_HEADER, "1" },
+    };
+    camera_frames_sub_t *sub = camera_frames_subscribe();
+    if (sub == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t res = stream_socket_begin(&out, req, "application/octet-stream", headers, container ? 2 : 1);
+    if (res == ESP_OK) {
+        res = av_hub_attach(&out, container);
+    }
+    while (res == ESP_OK) {
+        // esp32-camera stamps every frame with esp_timer at VSYNC, the hub maps the audio onto the same clock
+        camera_frame_t *frame = camera_frames_get(sub, pdMS_TO_TICKS(CAMERA_FRAMES_TIMEOUT_MS));
+        if (frame == NULL) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            res = ESP_FAIL;
+            break;
+        }
+        // Sliced, every slice waits for its tokens and lets pending audio go first
+        res = av_hub_write(AV_RECORD_VIDEO, AV_SOURCE_CAMERA, frame->seq, frame->timestamp_us, frame->jpg, frame->len);
+        camera_frames_release(frame);
+        if (res == ESP_OK) {
+            taskENTER_CRITICAL(&clients_lock);
+            frames_sent++;
+            taskEXIT_CRITICAL(&clients_lock);
+        }
+    }
+    av_hub_detach();
+    camera_frames_unsubscribe(sub);
+    stream_socket_end(&out);
+    return res;
+}
+
+static void av_worker(void *arg) {
+    httpd_req_t *req = (httpd_req_t *)arg;
+    esp_err_t res = av_stream(req);
+    ESP_LOGI(TAG, "A/V stream ended: %s", esp_err_to_name(res));
+    httpd_req_async_handler_complete(req);
+    taskENTER_CRITICAL(&clients_lock);
+    video_clients--;
+    av_active = false;
+    taskEXIT_CRITICAL(&clients_lock);
+    vTaskDelete(NULL);
+}
+
+esp_err_t av_handler(httpd_req_t *req) {
+    bool accepted = false;
+    taskENTER_CRITICAL(&clients_lock);
+    if (!av_active && video_clients < MAX_VIDEO_CLIENTS) {
+        av_active = true;
+        video_clients++;
+        accepted = true;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+    if (!accepted) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "A/V stream already in use or no video slot left");
+    }
+
+    esp_err_t res = start_stream_worker(req, av_worker, "av_stream", VIDEO_TASK_STACK, VIDEO_TASK_PRIORITY);
+    if (res != ESP_OK) {
+        taskENTER_CRITICAL(&clients_lock);
+        video_clients--;
+        av_active = false;
+        taskEXIT_CRITICAL(&clients_lock);
+    }
+    return res;
+}
+
+/* Face boxes of the detector, one JSON object per line (face_boxes.h), until
+ * the client goes away. With ?container=1 every result is a stream_frame.h
+ * JSON frame on stream 0 with the seq and capture time of its camera frame,
+ * next to the JPEGs of /stream?container=1 or /av?container=1. */
+static esp_err_t faces_stream(httpd_req_t *req) {
+    stream_socket_t out = { 0 };
+    bool container = query_flag(req, "container");
+    const stream_socket_header_t frame_headers[] = {
+        { STREAM_FRAME_HTTP_HEADER, "1" },
+    };
+    face_detect_client_t *client = face_detect_subscribe();
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t res = stream_socket_begin(&out, req, container ? "application/octet-stream" : "application/x-ndjson",
+                                        frame_headers, container ? 1 : 0);
+    char line[512];
+    while (res == ESP_OK) {
+        face_result_t result;
+        // A run per frame at most, so the camera timeout covers a stopped detector too
+        if (!face_detect_get(client, &result, pdMS_TO_TICKS(CAMERA_FRAMES_TIMEOUT_MS + CONFIG_FACE_DETECT_INTERVAL_MS))) {
+            ESP_LOGE(TAG, "No face detection results");
+            res = ESP_FAIL;
+            break;
+        }
+        int len = face_result_format(&result, line, sizeof(line) - 1);
+        if (len >= (int)sizeof(line) - 1) {
+            continue;   // cannot happen with FACE_DETECT_MAX_FACES boxes
+        }
+        if (container) {
+            stream_frame_header_t frame;
+            stream_frame_encode(&frame, 0, STREAM_CODEC_JSON, result.seq, result.timestamp_us, 0,
+                                STREAM_FRAME_FLAG_SYNCED, line, len);
+            struct iovec iov[] = {
+                { .iov_base = &frame, .iov_len = sizeof(frame) },
+                { .iov_base = line, .iov_len = len },
+            };
+            res = stream_socket_writev(&out, iov, 2);
+        } else {
+            line[len++] = '\n';
+            res = stream_socket_write(&out, line, len);
+        }
+    }
+    face_detect_unsubscribe(client);
+    stream_socket_end(&out);
+    return res;
+}
+
+static void faces_worker(void *arg) {
+    httpd_req_t *req = (httpd_req_t *)arg;
+    esp_err_t res = faces_stream(req);
+    ESP_LOGI(TAG, "Faces stream ended: %s", esp_err_to_name(res));
+    httpd_req_async_handler_complete(req);
+    taskENTER_CRITICAL(&clients_lock);
+    faces_clients--;
+    taskEXIT_CRITICAL(&clients_lock);
+    vTaskDelete(NULL);
+}
+
+esp_err_t faces_handler(httpd_req_t *req) {
+    bool accepted = false;
+    taskENTER_CRITICAL(&clients_lock);
+    if (faces_clients < MAX_FACES_CLIENTS) {
+        faces_clients++;
+        accepted = true;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+    if (!accepted) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many faces clients");
+    }
+
+    esp_err_t res = start_stream_worker(req, faces_worker, "faces_stream", FACES_TASK_STACK, VIDEO_TASK_PRIORITY);
+    if (res != ESP_OK) {
+        taskENTER_CRITICAL(&clients_lock);
+        faces_clients--;
+        taskEXIT_CRITICAL(&clients_lock);
+    }
+    return res;
+}
+
+/* POST /faces with a JPEG body: the faces in it as one JSON object, seq and
+ * timestamp_us 0. Runs the same decoding and model as the live detector, for
+ * Software/Streaming/faces.py eval. On a worker, a run takes too long for the
+ * httpd task. */
+static void faces_image_worker(void *arg) {
+    httpd_req_t *req = (httpd_req_t *)arg;
+    size_t len = req->content_len;
+    uint8_t *jpg = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    esp_err_t res = jpg != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+    for (size_t got = 0; res == ESP_OK && got < len;) {
+        int n = httpd_req_recv(req, (char *)jpg + got, len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (n <= 0) {
+            res = ESP_FAIL;
+        } else {
+            got += n;
+        }
+    }
+    face_result_t result = { 0 };
+    if (res == ESP_OK) {
+        res = face_detect_jpeg(jpg, len, &result);
+        if (res == ESP_OK) {
+            char json[512];
+            int json_len = face_result_format(&result, json, sizeof(json));
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_send(req, json, json_len);
+        } else {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "not a JPEG the detector can decode");
+        }
+    } else if (jpg == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory for the image");
+    }
+    free(jpg);
+    ESP_LOGI(TAG, "Faces image of %u bytes: %s", (unsigned)len, esp_err_to_name(res));
+    httpd_req_async_handler_complete(req);
+    vTaskDelete(NULL);
+}
+
+esp_err_t faces_image_handler(httpd_req_t *req) {
+    if (req->content_len == 0 || req->content_len > FACES_IMAGE_MAX) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "expected a JPEG of up to 256 KB");
+    }
+    return start_stream_worker(req, faces_image_worker, "faces_image", FACE_DETECT_STACK, VIDEO_TASK_PRIORITY);
+}
+
+typedef struct {
+    roi_region_t requested[ROI_MAX_REGIONS];
+    int requested_count;        // 0: around the faces of the detector
+    bool mouth;                 // the mouths of the faces, or the whole faces
+    int pad;
+    int shift;                  // context at 1/2^shift of the frame size
+    int quality;
+    int crop_quality;
+} roi_params_t;
+
+/* /roi's query, NULL or what is wrong with it */
+static const char *roi_params_parse(httpd_req_t *req, roi_params_t *params) {
+    *params = (roi_params_t){
+        .mouth = true,
+        .pad = ROI_PAD_PERCENT,
+        .shift = 2,
+        .quality = ROI_CONTEXT_QUALITY,
+        .crop_quality = ROI_CROP_QUALITY,
+    };
+    char query[160];
+    char value[112];
+    esp_err_t err = httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (err == ESP_ERR_NOT_FOUND) {
+        return NULL;
+    }
+    if (err != ESP_OK) {
+        return "query too long";
+    }
+    if (httpd_query_key_value(query, "roi", value, sizeof(value)) == ESP_OK) {
+        params->requested_count = roi_parse(value, params->requested, ROI_MAX_REGIONS);
+        if (params->requested_count < 0) {
+            return "roi must be x,y,w,h, up to 4 of them separated by ;";
+        }
+    }
+    if (httpd_query_key_value(query, "region", value, sizeof(value)) == ESP_OK) {
+        if (strcmp(value, "face") != 0 && strcmp(value, "mouth") != 0) {
+            return "region must be mouth or face";
+        }
+        params->mouth = strcmp(value, "mouth") == 0;
+    }
+    if (httpd_query_key_value(query, "pad", value, sizeof(value)) == ESP_OK) {
+        params->pad = atoi(value);
+        if (params->pad < 0 || params->pad > 100) {
+            return "pad must be 0 to 100";
+        }
+    }
+    if (httpd_query_key_value(query, "scale", value, sizeof(value)) == ESP_OK) {
+        int scale = atoi(value);
+        if (scale != 2 && scale != 4 && scale != 8) {
+            return "scale must be 2, 4 or 8";
+        }
+        params->shift = scale == 2 ? 1 : scale == 4 ? 2 : 3;
+    }
+    if (httpd_query_key_value(query, "quality", value, sizeof(value)) == ESP_OK) {
+        params->quality = atoi(value);
+    }
+    if (httpd_query_key_value(query, "crop_quality", value, sizeof(value)) == ESP_OK) {
+        params->crop_quality = atoi(value);
+    }
+    if (params->quality < 1 || params->quality > 100 || params->crop_quality < 1 || params->crop_quality > 100) {
+        return "quality and crop_quality must be 1 to 100";
+    }
+    return NULL;
+}
+
+/* Regions of interest, until the client goes away: every camera frame as a
+ * low resolution context image and high quality crops of the regions, each a
+ * stream_frame.h STREAM_CODEC_JPEG_ROI frame with the seq and capture time of
+ * the camera frame (see roi_encoder.h). The regions are the mouths of the
+ * faces the detector found (?region=face: the faces), or ?roi=x,y,w,h;... */
+static esp_err_t roi_stream(httpd_req_t *req) {
+    roi_params_t params;
+    roi_params_parse(req, &params);     // checked by roi_handler()
+    const stream_socket_header_t frame_headers[] = {
+        { STREAM_FRAME_HTTP_HEADER, "1" },
+    };
+    stream_socket_t out = { 0 };
+    face_detect_client_t *client = NULL;
+    camera_frames_sub_t *sub = camera_frames_subscribe();
+    roi_encoder_t *encoder = roi_encoder_create(resolution[CAMERA_FRAME_SIZE].width,
+                                                resolution[CAMERA_FRAME_SIZE].height, params.shift);
+    if (params.requested_count == 0) {
+        client = face_detect_subscribe();
+    }
+    esp_err_t res = ESP_ERR_NO_MEM;
+    if (sub != NULL && encoder != NULL && (params.requested_count > 0 || client != NULL)) {
+        res = stream_socket_begin(&out, req, "application/octet-stream", frame_headers, 1);
+    }
+
+    face_result_t faces = { 0 };
+    while (res == ESP_OK) {
+        camera_frame_t *frame = camera_frames_get(sub, pdMS_TO_TICKS(CAMERA_FRAMES_TIMEOUT_MS));
+        if (frame == NULL) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            res = ESP_FAIL;
+            break;
+        }
+        // Keeps the previous faces until the detector has newer ones
+        if (client != NULL) {
+            face_detect_get(client, &faces, 0);
+        }
+        uint16_t width = 0, height = 0;
+        roi_region_t found[ROI_MAX_REGIONS];
+        roi_region_t regions[ROI_MAX_REGIONS];
+        int found_count = 0, count = 0;
+        if (face_jpeg_size(frame->jpg, frame->len, &width, &height)) {
+            if (client == NULL) {
+                memcpy(found, params.requested, sizeof(found));
+                found_count = params.requested_count;
+            } else if (faces.width == width && faces.height == height &&
+                       frame->timestamp_us - faces.timestamp_us < ROI_FACES_MAX_AGE_MS * 1000LL) {
+                found_count = roi_from_faces(&faces, params.mouth, params.pad, found, ROI_MAX_REGIONS);
+            }
+            for (int i = 0; i < found_count; i++) {
+                if (roi_fit(&found[i], width, height)) {
+                    regions[count++] = found[i];
+                }
+            }
+        }
+        uint32_t seq = frame->seq;
+        int64_t timestamp_us = frame->timestamp_us;
+        size_t source_len = frame->len;
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = width == 0 ? ESP_ERR_INVALID_SIZE
+                                   : roi_encoder_decode(encoder, frame->jpg, frame->len, width, height, regions, count);
+        // The JPEG is not needed past the decode, the buffer goes back before the slow part
+        camera_frames_release_unsent(frame);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Frame %lu not decoded: %s", (unsigned long)seq, esp_err_to_name(err));
+            taskENTER_CRITICAL(&clients_lock);
+            roi_stats.failures++;
+            taskEXIT_CRITICAL(&clients_lock);
+            continue;
+        }
+
+        uint32_t work_us = 0;
+        size_t sent[2] = { 0, 0 };      // context, crops
+        int failures = 0;
+        for (int i = 0; i <= count && res == ESP_OK; i++) {
+            const uint8_t *payload;
+            size_t len;
+            err = roi_encoder_encode(encoder, i, i == 0 ? params.quality : params.crop_quality, &payload, &len);
+            work_us += (uint32_t)(esp_timer_get_time() - start_us);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Image %d of frame %lu dropped: %s", i, (unsigned long)seq, esp_err_to_name(err));
+                failures++;
+            } else {
+                stream_frame_header_t header;
+                // The Eye's clock is the one the others synchronize to
+                stream_frame_encode(&header, 0, STREAM_CODEC_JPEG_ROI, seq, timestamp_us, 0, STREAM_FRAME_FLAG_SYNCED,
+                                    payload, len);
+                res = jpeg_send_shaped(NULL, &out, true, &header, sizeof(header), payload, len, NULL);
+                sent[i > 0] += len;
+            }
+            start_us = esp_timer_get_time();
+        }
+        taskENTER_CRITICAL(&clients_lock);
+        roi_stats.frames++;
+        roi_stats.crops += count;
+        roi_stats.failures += failures;
+        roi_stats.source_bytes += source_len;
+        roi_stats.context_bytes += sent[0];
+        roi_stats.crop_bytes += sent[1];
+        roi_stats.last_us = work_us;
+        roi_stats.total_us += work_us;
+        if (work_us > roi_stats.max_us) {
+            roi_stats.max_us = work_us;
+        }
+        taskEXIT_CRITICAL(&clients_lock);
+    }
+    if (client != NULL) {
+        face_detect_unsubscribe(client);
+    }
+    if (sub != NULL) {
+        camera_frames_unsubscribe(sub);
+    }
+    roi_encoder_free(encoder);
+    stream_socket_end(&out);
+    return res;
+}
+
+static void roi_worker(void *arg) {
+    httpd_req_t *req = (httpd_req_t *)arg;
+    esp_err_t res = roi_stream(req);
+    ESP_LOGI(TAG, "ROI stream ended: %s", esp_err_to_name(res));
+    httpd_req_async_handler_complete(req);
+    taskENTER_CRITICAL(&clients_lock);
+    video_clients--;
+    roi_clients--;
+    taskEXIT_CRITICAL(&clients_lock);
+    vTaskDelete(NULL);
+}
+
+esp_err_t roi_handler(httpd_req_t *req) {
+    roi_params_t params;
+    const char *error = roi_params_parse(req, &params);
+    if (error != NULL) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+    }
+    bool accepted = false;
+    taskENTER_CRITICAL(&clients_lock);
+    if (video_clients < MAX_VIDEO_CLIENTS) {
+        video_clients++;
+        roi_clients++;
+        accepted = true;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+    if (!accepted) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many video clients");
+    }
+
+    esp_err_t res = start_stream_worker(req, roi_worker, "roi_stream", ROI_TASK_STACK, VIDEO_TASK_PRIORITY);
+    if (res != ESP_OK) {
+        taskENTER_CRITICAL(&clients_lock);
+        video_clients--;
+        roi_clients--;
+        taskEXIT_CRITICAL(&clients_lock);
+    }
+    return res;
+}
+
+/* Appends to the /status JSON in json[size]. A piece that does not fit leaves
+ * *len past the end and every later append does nothing, so the handler checks
+ * once, at the end. */
+static void json_append(char *json, size_t size, size_t *len, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+static void json_append(char *json, size_t size, size_t *len, const char *format, ...) {
+    if (*len >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(json + *len, size - *len, format, args);
+    va_end(args);
+    *len = n < 0 ? size : *len + n;
+}
+
+// {"last":..,"avg":..,"max":..} of a frame age, for /status
+static void append_age(char *json, size_t size, size_t *len, const camera_frames_age_t *age) {
+    json_append(json, size, len, "{\"last\":%lu,\"avg\":%lu,\"max\":%lu}", (unsigned long)age->last_us,
+                (unsigned long)(age->frames ? age->total_us / age->frames : 0), (unsigned long)age->max_us);
+}
+
+/* Server status, answered straight from the httpd task while the streams run.
+ * cpu_load is per core since the previous /status request, -1 without run time stats. */
+esp_err_t status_handler(httpd_req_t *req) {
+    static cpu_load_snapshot_t last_cpu;
+    static bool have_last_cpu = false;
+    cpu_load_snapshot_t cpu;
+    int cpu_load[2] = { -1, -1 };
+    av_hub_source_stats_t hub[AV_HUB_MAX_SOURCES];
+    time_sync_stats_t sync;
+    video_shaper_stats_t shaper;
+    camera_frames_stats_t camera;
+    face_detect_stats_t faces;
+    video_rate_t rate;
+    // Only ever used by the httpd task, and too big for its stack
+    static char json[4096];
+    taskENTER_CRITICAL(&clients_lock);
+    int video = video_clients;
+    bool audio = audio_active;
+    bool av = av_active;
+    uint32_t frames = frames_sent;
+    uint32_t chunks = audio_chunks_sent;
+    int roi = roi_clients;
+    roi_stats_t roi_now = roi_stats;
+    taskEXIT_CRITICAL(&clients_lock);
+    if (cpu_load_snapshot(&cpu)) {
+        if (have_last_cpu) {
+            cpu_load[0] = cpu_load_percent(&last_cpu, &cpu, 0);
+            cpu_load[1] = cpu_load_percent(&last_cpu, &cpu, 1);
+        }
+        last_cpu = cpu;
+        have_last_cpu = true;
+    }
+    av_hub_get_stats(hub);
+    time_sync_get_stats(&sync);
+    video_shaper_get_stats(&shaper);
+    camera_frames_get_stats(&camera);
+    face_detect_get_stats(&faces);
+    xSemaphoreTake(video_rate_lock, portMAX_DELAY);
+    int adapt = adapt_clients;
+    rate = video_rate;
+    xSemaphoreGive(video_rate_lock);
+    const video_rate_point_t *point = video_rate_point(&rate);
+
+    size_t len = 0;
+    json_append(json, sizeof(json), &len,
+                "{\"uptime_us\":%lld,\"cpu_load\":[%d,%d],\"video_clients\":%d,\"audio_active\":%s,"
+                "\"av_active\":%s,\"frames_sent\":%lu,\"audio_chunks_sent\":%lu,\"free_heap\":%lu,"
+                "\"time_sync\":{\"master\":true,\"exchanges\":%lu},\"hub\":[",
+                (long long)esp_timer_get_time(), cpu_load[0], cpu_load[1], video, audio ? "true" : "false",
+                av ? "true" : "false", (unsigned long)frames, (unsigned long)chunks,
+                (unsigned long)esp_get_free_heap_size(), (unsigned long)sync.exchanges);
+    for (int i = 0, n = 0; i < AV_HUB_MAX_SOURCES; i++) {
+        if (hub[i].host[0] == '\0') {
+            continue;
+        }
+        json_append(json, sizeof(json), &len,
+                    "%s{\"source\":%d,\"host\":\"%s\",\"connected\":%s,\"connects\":%lu,\"chunks\":%lu,"
+                    "\"dropped_blocks\":%lu,\"synced\":%s,\"offset_us\":%lld,\"latency_us\":%lu",
+                    n++ ? "," : "", i + 1, hub[i].host, hub[i].connected ? "true" : "false",
+                    (unsigned long)hub[i].connects, (unsigned long)hub[i].chunks,
+                    (unsigned long)hub[i].dropped_blocks, hub[i].synced ? "true" : "false", (long long)hub[i].offset_us,
+                    (unsigned long)hub[i].latency_us);
+        if (hub[i].espnow) {
+            json_append(json, sizeof(json), &len,
+                        ",\"espnow\":{\"packets\":%lu,\"partial\":%lu,\"lost\":%lu,\"skipped\":%lu,\"late\":%lu,"
+                        "\"duplicates\":%lu,\"queue_drops\":%lu,\"concealed_blocks\":%lu}",
+                        (unsigned long)hub[i].link.packets, (unsigned long)hub[i].link.partial,
+                        (unsigned long)hub[i].link.lost, (unsigned long)hub[i].link.skipped,
+                        (unsigned long)hub[i].link.late, (unsigned long)hub[i].link.duplicates,
+                        (unsigned long)hub[i].queue_drops, (unsigned long)hub[i].concealed_blocks);
+        }
+        json_append(json, sizeof(json), &len, "}");
+    }
+    json_append(json, sizeof(json), &len,
+                "],\"shaper\":{\"kbps\":%lu,\"burst\":%lu,\"bytes\":%llu,\"slices\":%lu,\"deferred\":%lu,"
+                "\"deferred_bytes\":%llu,\"deferred_ms\":%llu,\"audio_yields\":%lu,\"audio_wait_ms\":%llu,"
+                "\"audio_timeouts\":%lu},\"camera\":",
+                (unsigned long)shaper.kbps, (unsigned long)shaper.burst_bytes, (unsigned long long)shaper.bytes,
+                (unsigned long)shaper.slices, (unsigned long)shaper.deferred,
+                (unsigned long long)shaper.deferred_bytes, (unsigned long long)(shaper.deferred_us / 1000),
+                (unsigned long)shaper.audio_yields, (unsigned long long)(shaper.audio_wait_us / 1000),
+                (unsigned long)shaper.audio_timeouts);
+    json_append(json, sizeof(json), &len,
+                "{\"captured\":%lu,\"failures\":%lu,\"subscribers\":%u,\"delivered\":%lu,\"skipped\":%lu,"
+                "\"capture_age_us\":",
+                (unsigned long)camera.captured, (unsigned long)camera.failures, camera.subscribers,
+                (unsigned long)camera.delivered, (unsigned long)camera.skipped);
+    append_age(json, sizeof(json), &len, &camera.capture_age);
+    json_append(json, sizeof(json), &len, ",\"sent_age_us\":");
+    append_age(json, sizeof(json), &len, &camera.sent_age);
+    json_append(json, sizeof(json), &len,
+                "},\"faces\":{\"clients\":%u,\"runs\":%lu,\"with_faces\":%lu,\"failures\":%lu,"
+                "\"detect_us\":{\"last\":%lu,\"avg\":%lu,\"max\":%lu}},\"roi\":",
+                faces.clients, (unsigned long)faces.runs, (unsigned long)faces.with_faces,
+                (unsigned long)faces.failures, (unsigned long)faces.last_us,
+                (unsigned long)(faces.runs ? faces.total_us / faces.runs : 0), (unsigned long)faces.max_us);
+    json_append(json, sizeof(json), &len,
+                "{\"clients\":%d,\"frames\":%lu,\"crops\":%lu,\"failures\":%lu,\"source_bytes\":%llu,"
+                "\"context_bytes\":%llu,\"crop_bytes\":%llu,\"encode_us\":{\"last\":%lu,\"avg\":%lu,\"max\":%lu}},",
+                roi, (unsigned long)roi_now.frames, (unsigned long)roi_now.crops, (unsigned long)roi_now.failures,
+                (unsigned long long)roi_now.source_bytes, (unsigned long long)roi_now.context_bytes,
+                (unsigned long long)roi_now.crop_bytes, (unsigned long)roi_now.last_us,
+                (unsigned long)(roi_now.frames ? roi_now.total_us / roi_now.frames : 0),
+                (unsigned long)roi_now.max_us);
+    json_append(json, sizeof(json), &len,
+                "\"video_rate\":{\"clients\":%d,\"target_ms\":%d,\"framesize\":\"%s\",\"quality\":%d,"
+                "\"fps\":%d,\"point\":%u,\"points\":%u,\"latency_us\":%lu,\"send_us\":%lu,"
+                "\"steps_down\":%lu,\"steps_up\":%lu},\"bench\":",
+                adapt, CONFIG_VIDEO_RATE_TARGET_MS, adapt ? camera_sizes[point->size].name : "",
+                adapt ? point->quality : 0, adapt ? point->fps : 0, rate.point, rate.count,
+                (unsigned long)rate.latency_us, (unsigned long)rate.send_us,
+                (unsigned long)rate.steps_down, (unsigned long)rate.steps_up);
+    if (len < sizeof(json)) {
+        int n = net_bench_format_status(json + len, sizeof(json) - len);
+        len = n < 0 ? sizeof(json) : len + n;
+    }
+    json_append(json, sizeof(json), &len, "}");
+    if (len >= sizeof(json)) {
+        ESP_LOGE(TAG, "/status does not fit in %u bytes", (unsigned)sizeof(json));
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Status too long");
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
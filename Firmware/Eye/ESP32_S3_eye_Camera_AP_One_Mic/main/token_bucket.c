@@ -0,0 +1,28 @@
+#include "token_bucket.h"
+
+void token_bucket_init(token_bucket_t *bucket, uint32_t kbps, uint32_t burst_bytes, int64_t now_us) {
+    bucket->kbps = kbps;
+    bucket->burst_bytes = burst_bytes;
+    bucket->tokens = (int64_t)burst_bytes * TOKEN_BUCKET_SCALE;
+    bucket->refilled_us = now_us;
+}
+
+int64_t token_bucket_take(token_bucket_t *bucket, size_t len, int64_t now_us) {
+    if (bucket->kbps == 0) {
+        return 0;
+    }
+    int64_t full = (int64_t)bucket->burst_bytes * TOKEN_BUCKET_SCALE;
+    bucket->tokens += (now_us - bucket->refilled_us) * bucket->kbps;
+    bucket->refilled_us = now_us;
+    if (bucket->tokens > full) {
+        bucket->tokens = full;
+    }
+    // More than the bucket holds only has to wait for a full bucket
+    int64_t cost = (int64_t)len * TOKEN_BUCKET_SCALE;
+    int64_t needed = cost < full ? cost : full;
+    if (bucket->tokens < needed) {
+        return (needed - bucket->tokens + bucket->kbps - 1) / bucket->kbps;
+    }
+    bucket->tokens -= cost;
+    return 0;
+}
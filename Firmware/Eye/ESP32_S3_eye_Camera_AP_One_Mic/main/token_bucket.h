@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Token bucket of the video shaper (video_shaper.h)
+ *
+ * Fills at kbps up to burst_bytes. Taking len bytes either succeeds now or
+ * says how long until it will; a take larger than the bucket waits for a
+ * full bucket and leaves it in debt, so whole JPEGs can be passed too. Time
+ * comes from the caller. Plain C without ESP-IDF dependencies, `python
+ * mjpeg_stream.py selftest` in Software/Streaming runs it on a virtual clock. */
+
+// Tokens are bytes scaled by 8000, so that refilling is elapsed_us * kbps
+#define TOKEN_BUCKET_SCALE  8000
+
+typedef struct {
+    uint32_t kbps;          // 0: no limit, every take succeeds
+    uint32_t burst_bytes;
+    int64_t tokens;         // bytes * TOKEN_BUCKET_SCALE, below 0 after a take larger than the bucket
+    int64_t refilled_us;
+} token_bucket_t;
+
+/* Starts full */
+void token_bucket_init(token_bucket_t *bucket, uint32_t kbps, uint32_t burst_bytes, int64_t now_us);
+
+/* Microseconds until len bytes may go, 0 if now (and then they are taken) */
+int64_t token_bucket_take(token_bucket_t *bucket, size_t len, int64_t now_us);
@@ -0,0 +1,101 @@
+#include <stddef.h>
+#include "video_rate.h"
+
+// The points below the boot point, most expensive first, see video_rate.h
+static const video_rate_point_t ladder[] = {
+    { VIDEO_SIZE_SVGA, 12, 20 },
+    { VIDEO_SIZE_VGA, 12, 25 },
+    { VIDEO_SIZE_VGA, 18, 20 },
+    { VIDEO_SIZE_VGA, 25, 15 },
+    { VIDEO_SIZE_QVGA, 15, 15 },
+    { VIDEO_SIZE_QVGA, 25, 10 },
+    { VIDEO_SIZE_QVGA, 40, 5 },
+};
+
+static uint32_t smooth(uint32_t average, uint32_t sample) {
+    return (uint32_t)(((uint64_t)average * (VIDEO_RATE_SMOOTHING - 1) + sample) / VIDEO_RATE_SMOOTHING);
+}
+
+void video_rate_init(video_rate_t *rate, video_size_t boot_size, uint8_t boot_quality, uint32_t target_ms,
+                     int64_t now_us) {
+    *rate = (video_rate_t){
+        .target_us = target_ms * 1000,
+        .changed_us = now_us,
+        .calm_since_us = now_us,
+        .stepped_down_us = now_us - VIDEO_RATE_HOLD_MS * 1000LL,
+        .up_hold_ms = VIDEO_RATE_UP_HOLD_MS,
+    };
+    rate->points[rate->count++] = (video_rate_point_t){ boot_size, boot_quality, VIDEO_RATE_MAX_FPS };
+    for (size_t i = 0; i < sizeof(ladder) / sizeof(ladder[0]) && rate->count < VIDEO_RATE_MAX_POINTS; i++) {
+        if (ladder[i].size < boot_size || (ladder[i].size == boot_size && ladder[i].quality > boot_quality)) {
+            rate->points[rate->count++] = ladder[i];
+        }
+    }
+}
+
+bool video_rate_update(video_rate_t *rate, uint32_t send_us, uint32_t latency_us, int64_t now_us) {
+    if (rate->measured) {
+        rate->latency_us = smooth(rate->latency_us, latency_us);
+        rate->send_us = smooth(rate->send_us, send_us);
+    } else {
+        rate->latency_us = latency_us;
+        rate->send_us = send_us;
+        rate->measured = true;
+    }
+    uint32_t interval_us = video_rate_interval_us(&rate->points[rate->point]);
+    bool over = rate->latency_us > rate->target_us || rate->send_us > interval_us;
+    bool calm = rate->latency_us < (uint64_t)rate->target_us * VIDEO_RATE_UP_PERCENT / 100 &&
+                rate->send_us < interval_us / 2;
+    if (!calm) {
+        rate->calm_since_us = now_us;
+    }
+    if (rate->stepped_up_us && now_us - rate->stepped_up_us >= VIDEO_RATE_PROBE_MS * 1000LL) {
+        // The step up held, the next one may come as early as ever
+        rate->stepped_up_us = 0;
+        rate->up_hold_ms = VIDEO_RATE_UP_HOLD_MS;
+    }
+
+    uint8_t next = rate->point;
+    if (over) {
+        // The frames of the new point take a while to arrive, unless the latency keeps growing
+        if (rate->point + 1 < rate->count &&
+            (now_us - rate->stepped_down_us >= VIDEO_RATE_HOLD_MS * 1000LL ||
+             rate->latency_us >= rate->stepped_down_latency + rate->target_us)) {
+            next = rate->point + 1;
+        }
+        if (next != rate->point && rate->stepped_up_us) {
+            rate->stepped_up_us = 0;
+            rate->up_hold_ms *= 2;
+            if (rate->up_hold_ms > VIDEO_RATE_MAX_UP_HOLD_MS) {
+                rate->up_hold_ms = VIDEO_RATE_MAX_UP_HOLD_MS;
+            }
+        }
+    } else if (rate->point > 0 && now_us - rate->calm_since_us >= rate->up_hold_ms * 1000LL &&
+               now_us - rate->changed_us >= rate->up_hold_ms * 1000LL) {
+        next = rate->point - 1;
+        rate->stepped_up_us = now_us;
+    }
+    if (next == rate->point) {
+        return false;
+    }
+    if (next > rate->point) {
+        rate->steps_down++;
+        rate->stepped_down_us = now_us;
+        rate->stepped_down_latency = rate->latency_us;
+    } else {
+        rate->steps_up++;
+    }
+    rate->point = next;
+    rate->measured = false;
+    rate->changed_us = now_us;
+    rate->calm_since_us = now_us;
+    return true;
+}
+
+const video_rate_point_t *video_rate_point(const video_rate_t *rate) {
+    return &rate->points[rate->point];
+}
+
+uint32_t video_rate_interval_us(const video_rate_point_t *point) {
+    return 1000000 / point->fps;
+}
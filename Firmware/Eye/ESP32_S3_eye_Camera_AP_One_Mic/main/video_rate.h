@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Operating point controller for /stream?adapt=1, holds the video latency
+ *
+ * The camera makes frames of one size and quality whatever the link carries.
+ * On a congested access point every frame takes longer to hand to the socket
+ * than the camera takes to make the next, and the frames queued in lwIP and
+ * the WiFi driver add up to seconds of latency. With the controller the
+ * adaptive streams measure, for every frame they send, how long the send took
+ * and its latency on the Eye (VSYNC to the last byte handed to the socket),
+ * and the controller walks a ladder of operating points to keep that latency
+ * below a target:
+ *
+ *   point                size   quality  fps
+ *   boot                 CONFIG_CAMERA_FRAME_SIZE, CONFIG_CAMERA_JPEG_QUALITY, VIDEO_RATE_MAX_FPS
+ *                        SVGA   12       20
+ *                        VGA    12       25
+ *                        VGA    18       20
+ *                        VGA    25       15
+ *                        QVGA   15       15
+ *                        QVGA   25       10
+ *                        QVGA   40        5
+ *
+ * Only the points cheaper than the boot point are used: a smaller frame, or
+ * the same frame at a worse quality (a higher number). The frame buffers are
+ * sized for the boot frame size, so there is no going above it.
+ *
+ * Both measurements are smoothed over a few frames. The stream steps down a
+ * point when the latency is above the target, or when a send takes longer
+ * than a frame period, so the frames cannot leave as fast as the point asks
+ * for. The next step down waits VIDEO_RATE_HOLD_MS, for the frames of the new
+ * point to arrive and the queues to drain, unless the latency grows by
+ * another target meanwhile. It steps up after the latency stayed below
+ * VIDEO_RATE_UP_PERCENT of the target and the sends below half a frame period
+ * for up_hold_ms. A step up undone within VIDEO_RATE_PROBE_MS doubles
+ * up_hold_ms up to VIDEO_RATE_MAX_UP_HOLD_MS, as on the arm board's audio
+ * ladder (audio_ladder.h), so a link that cannot carry the better point is not
+ * probed every few seconds.
+ *
+ * The camera is shared, so there is one controller for all adaptive streams
+ * and the point applies to every video client. Plain C without ESP-IDF
+ * dependencies, `python mjpeg_stream.py selftest` in Software/Streaming checks
+ * it against a simulated link. */
+
+#define VIDEO_RATE_MAX_POINTS       8
+#define VIDEO_RATE_MAX_FPS          30      // the boot point takes every frame the camera makes
+#define VIDEO_RATE_SMOOTHING        4       // weight of the new frame is 1 / VIDEO_RATE_SMOOTHING
+#define VIDEO_RATE_UP_PERCENT       50
+#define VIDEO_RATE_HOLD_MS          1000
+#define VIDEO_RATE_UP_HOLD_MS       5000
+#define VIDEO_RATE_MAX_UP_HOLD_MS   80000
+#define VIDEO_RATE_PROBE_MS         10000
+
+/* Frame sizes of the points, smallest first */
+typedef enum {
+    VIDEO_SIZE_QVGA,
+    VIDEO_SIZE_VGA,
+    VIDEO_SIZE_SVGA,
+    VIDEO_SIZE_HD,
+    VIDEO_SIZE_COUNT,
+} video_size_t;
+
+typedef struct {
+    uint8_t size;           // video_size_t
+    uint8_t quality;        // the camera's JPEG quality, lower is better
+    uint8_t fps;            // frames a stream sends per second at most
+} video_rate_point_t;
+
+typedef struct {
+    video_rate_point_t points[VIDEO_RATE_MAX_POINTS];   // the boot point first
+    uint8_t count;
+    uint8_t point;          // index into points, higher is cheaper
+    uint32_t target_us;
+    uint32_t latency_us;    // smoothed, VSYNC to sent
+    uint32_t send_us;       // smoothed, time to hand a frame to the socket
+    bool measured;          // latency_us and send_us hold a frame of the current point
+    int64_t changed_us;
+    int64_t calm_since_us;  // last frame that was not calm enough to step up
+    int64_t stepped_up_us;  // last step up, 0 once it held for VIDEO_RATE_PROBE_MS
+    int64_t stepped_down_us;
+    uint32_t stepped_down_latency;
+    uint32_t up_hold_ms;
+    uint32_t steps_down;
+    uint32_t steps_up;
+} video_rate_t;
+
+/* Starts at the boot point, size and quality of the camera's boot config */
+void video_rate_init(video_rate_t *rate, video_size_t boot_size, uint8_t boot_quality, uint32_t target_ms,
+                     int64_t now_us);
+
+/* Feed every frame an adaptive stream sent. Returns true when the point changed. */
+bool video_rate_update(video_rate_t *rate, uint32_t send_us, uint32_t latency_us, int64_t now_us);
+
+const video_rate_point_t *video_rate_point(const video_rate_t *rate);
+
+/* Shortest time between two frames of a stream at point */
+uint32_t video_rate_interval_us(const video_rate_point_t *point);
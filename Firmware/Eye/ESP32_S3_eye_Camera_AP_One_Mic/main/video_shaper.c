@@ -0,0 +1,104 @@
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "token_bucket.h"
+#include "video_shaper.h"
+
+#define AUDIO_IDLE_BIT  BIT0
+
+static portMUX_TYPE shaper_lock = portMUX_INITIALIZER_UNLOCKED;
+static video_shaper_stats_t stats;     // guarded by shaper_lock
+static token_bucket_t bucket;          // guarded by shaper_lock
+static int audio_pending;
+// Set while no audio is pending, so video wakes up the moment the last audio send is done
+static EventGroupHandle_t audio_idle;
+
+void video_shaper_init(uint32_t kbps, uint32_t burst_bytes) {
+    if (audio_idle == NULL) {
+        audio_idle = xEventGroupCreate();
+    }
+    xEventGroupSetBits(audio_idle, AUDIO_IDLE_BIT);
+    taskENTER_CRITICAL(&shaper_lock);
+    stats = (video_shaper_stats_t){ .kbps = kbps, .burst_bytes = burst_bytes };
+    token_bucket_init(&bucket, kbps, burst_bytes, esp_timer_get_time());
+    audio_pending = 0;
+    taskEXIT_CRITICAL(&shaper_lock);
+}
+
+void video_shaper_audio_begin(void) {
+    taskENTER_CRITICAL(&shaper_lock);
+    audio_pending++;
+    taskEXIT_CRITICAL(&shaper_lock);
+    xEventGroupClearBits(audio_idle, AUDIO_IDLE_BIT);
+}
+
+void video_shaper_audio_end(void) {
+    taskENTER_CRITICAL(&shaper_lock);
+    bool idle = --audio_pending == 0;
+    taskEXIT_CRITICAL(&shaper_lock);
+    if (idle) {
+        xEventGroupSetBits(audio_idle, AUDIO_IDLE_BIT);
+    }
+}
+
+int64_t video_shaper_wait(size_t len) {
+    int64_t start_us = esp_timer_get_time();
+    int64_t audio_us = 0;
+    bool yielded = false;
+    bool slept = false;
+    bool timed_out = false;
+    while (true) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t wait_us = 0;
+        bool audio = false;
+        taskENTER_CRITICAL(&shaper_lock);
+        if (audio_pending > 0 && now_us - start_us < VIDEO_SHAPER_MAX_DEFER_MS * 1000) {
+            audio = true;
+        } else {
+            timed_out |= audio_pending > 0;
+            wait_us = token_bucket_take(&bucket, len, now_us);
+        }
+        taskEXIT_CRITICAL(&shaper_lock);
+        if (!audio && wait_us == 0) {
+            break;
+        }
+        if (audio) {
+            // Returns when the audio is done. The counter is checked again
+            // after at most a tick, begin and end are not atomic with the bit.
+            xEventGroupWaitBits(audio_idle, AUDIO_IDLE_BIT, pdFALSE, pdTRUE, 1);
+            yielded = true;
+            audio_us += esp_timer_get_time() - now_us;
+        } else {
+            TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+            vTaskDelay(ticks > 0 ? ticks : 1);
+        }
+        slept = true;
+    }
+    int64_t waited_us = esp_timer_get_time() - start_us;
+
+    taskENTER_CRITICAL(&shaper_lock);
+    stats.bytes += len;
+    stats.slices++;
+    if (slept) {
+        stats.deferred++;
+        stats.deferred_bytes += len;
+        stats.deferred_us += waited_us;
+    }
+    if (yielded) {
+        stats.audio_yields++;
+        stats.audio_wait_us += audio_us;
+    }
+    if (timed_out) {
+        stats.audio_timeouts++;
+    }
+    taskEXIT_CRITICAL(&shaper_lock);
+    return slept ? waited_us : 0;
+}
+
+void video_shaper_get_stats(video_shaper_stats_t *out) {
+    taskENTER_CRITICAL(&shaper_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&shaper_lock);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Token bucket for the video leaving the Eye
+ *
+ * The Eye's radio carries its MJPEG output and the audio of the arm boards.
+ * A VGA JPEG handed to the socket in one piece is tens of KB queued in lwIP
+ * and the WiFi driver at once, and the audio sent meanwhile waits behind it.
+ * All video senders (/stream and the frames of /av) take their bytes from one
+ * bucket instead: it fills at CONFIG_VIDEO_SHAPER_KBPS up to
+ * CONFIG_VIDEO_SHAPER_BURST_KB, and /stream and /av hand each JPEG over in
+ * slices of VIDEO_SHAPER_SLICE bytes, so at most about a burst of video is
+ * queued ahead of any audio packet.
+ *
+ * Audio senders on the Eye (/ach1, the hub relaying arm board chunks to /av)
+ * bracket their sends with video_shaper_audio_begin() / _end(). While any is
+ * pending, video waits, for at most VIDEO_SHAPER_MAX_DEFER_MS per slice so a
+ * stuck audio client cannot stall the video. The audio sockets are also
+ * tagged for the WMM voice category (STREAM_SOCKET_TOS_VOICE), which covers
+ * the queues below lwIP.
+ *
+ * A rate of 0 turns the bucket off; video still yields to pending audio. */
+
+#define VIDEO_SHAPER_SLICE          4096    // about three TCP segments
+#define VIDEO_SHAPER_MAX_DEFER_MS   20      // longest wait for audio per slice
+
+typedef struct {
+    uint32_t kbps;              // 0: no rate limit
+    uint32_t burst_bytes;
+    uint64_t bytes;             // video bytes through the shaper
+    uint32_t slices;
+    uint32_t deferred;          // slices that had to wait, for tokens or audio
+    uint64_t deferred_bytes;
+    uint64_t deferred_us;       // time video spent waiting, all senders together
+    uint32_t audio_yields;      // slices that waited for pending audio
+    uint64_t audio_wait_us;     // part of deferred_us spent waiting for audio
+    uint32_t audio_timeouts;    // gave up waiting for audio after VIDEO_SHAPER_MAX_DEFER_MS
+} video_shaper_stats_t;
+
+void video_shaper_init(uint32_t kbps, uint32_t burst_bytes);
+
+/* Blocks until len bytes of video may go out: no audio pending and enough
+ * tokens. A slice larger than the bucket goes out once the bucket is full and
+ * leaves it in debt, so whole JPEGs can be passed too. Returns the time it
+ * blocked in us, which is not time the link took. */
+int64_t video_shaper_wait(size_t len);
+
+void video_shaper_audio_begin(void);
+void video_shaper_audio_end(void);
+
+void video_shaper_get_stats(video_shaper_stats_t *stats);
@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/task.h"
+#include "cpu_load.h"
+
+bool cpu_load_snapshot(cpu_load_snapshot_t *snap) {
+    memset(snap, 0, sizeof(*snap));
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // Room for tasks created while the list is being read
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(capacity * sizeof(TaskStatus_t));
+    if (tasks == NULL) {
+        return false;
+    }
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, capacity, &total);
+    if (count == 0) {
+        free(tasks);
+        return false;
+    }
+    snap->total = total;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+        for (UBaseType_t i = 0; i < count; i++) {
+            if (tasks[i].xHandle == idle) {
+                snap->idle[core] = tasks[i].ulRunTimeCounter;
+                break;
+            }
+        }
+    }
+    free(tasks);
+    return true;
+#else
+    return false;
+#endif
+}
+
+int cpu_load_percent(const cpu_load_snapshot_t *from, const cpu_load_snapshot_t *to, int core) {
+    uint32_t total = to->total - from->total;
+    uint32_t idle = to->idle[core] - from->idle[core];
+    if (total == 0) {
+        return -1;
+    }
+    if (idle > total) {
+        idle = total;
+    }
+    return 100 - (int)((uint64_t)idle * 100 / total);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// Per-core CPU load from the FreeRTOS run time counters
+//
+// Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (see sdkconfig.defaults). Load is
+// the share of time the core's idle task did not run between two snapshots.
+
+typedef struct {
+    uint32_t total;                         // run time counter, wraps
+    uint32_t idle[portNUM_PROCESSORS];
+} cpu_load_snapshot_t;
+
+// False when run time stats are disabled or the task list could not be read
+bool cpu_load_snapshot(cpu_load_snapshot_t *snap);
+
+// Load of a core in percent between two snapshots, -1 if no time passed
+int cpu_load_percent(const cpu_load_snapshot_t *from, const cpu_load_snapshot_t *to, int core);
@@ -0,0 +1,263 @@
+#include <string.h>
+#include "espnow_audio.h"
+
+_Static_assert(sizeof(espnow_audio_header_t) == 23, "header layout is part of the link format");
+_Static_assert(ESPNOW_AUDIO_MAX_FRAGMENTS <= 8, "received_mask is 8 bits");
+
+uint16_t espnow_audio_fragment_frames(uint8_t channels) {
+    if (channels == 0 || channels > ESPNOW_AUDIO_MAX_CHANNELS) {
+        return 0;
+    }
+    // Whole frames only, so a lost fragment leaves a gap of whole frames
+    return ESPNOW_AUDIO_MAX_FRAGMENT_BYTES / (channels * sizeof(int16_t));
+}
+
+uint8_t espnow_audio_fragment_count(uint16_t frames, uint8_t channels) {
+    uint16_t per_fragment = espnow_audio_fragment_frames(channels);
+    if (per_fragment == 0 || frames == 0 || frames > ESPNOW_AUDIO_MAX_FRAMES) {
+        return 0;
+    }
+    uint16_t count = (frames + per_fragment - 1) / per_fragment;
+    return count <= ESPNOW_AUDIO_MAX_FRAGMENTS ? count : 0;
+}
+
+size_t espnow_audio_build(uint8_t *packet, uint32_t block_seq, uint8_t frag_index, int64_t timestamp_us,
+                          const int16_t *samples, uint16_t frames, uint8_t channels, uint8_t channel_mask,
+                          uint8_t flags) {
+    uint8_t count = espnow_audio_fragment_count(frames, channels);
+    if (frag_index >= count) {
+        return 0;
+    }
+    uint16_t per_fragment = espnow_audio_fragment_frames(channels);
+    uint16_t offset = frag_index * per_fragment;
+    uint16_t n = frames - offset < per_fragment ? frames - offset : per_fragment;
+
+    espnow_audio_header_t header = {
+        .magic = ESPNOW_AUDIO_MAGIC,
+        .version = ESPNOW_AUDIO_VERSION,
+        .frag_index = frag_index,
+        .frag_count = count,
+        .block_seq = block_seq,
+        .timestamp_us = timestamp_us,
+        .frames = frames,
+        .frame_offset = offset,
+        .channels = channels,
+        .channel_mask = channel_mask,
+        .flags = flags,
+    };
+    size_t bytes = (size_t)n * channels * sizeof(int16_t);
+    memcpy(packet, &header, sizeof(header));
+    memcpy(packet + sizeof(header), samples + (size_t)offset * channels, bytes);
+    return sizeof(header) + bytes;
+}
+
+void espnow_audio_reassembler_init(espnow_audio_reassembler_t *r, uint32_t sample_rate, int64_t max_wait_us) {
+    memset(r, 0, sizeof(*r));
+    r->sample_rate = sample_rate;
+    r->max_wait_us = max_wait_us;
+}
+
+bool espnow_audio_reassembler_push(espnow_audio_reassembler_t *r, const uint8_t *packet, size_t len, int64_t now_us) {
+    espnow_audio_header_t h;
+    r->stats.packets++;
+    if (len < sizeof(h)) {
+        r->stats.invalid++;
+        return false;
+    }
+    memcpy(&h, packet, sizeof(h));
+    uint8_t count = espnow_audio_fragment_count(h.frames, h.channels);
+    uint16_t per_fragment = espnow_audio_fragment_frames(h.channels);
+    if (h.magic != ESPNOW_AUDIO_MAGIC || h.version != ESPNOW_AUDIO_VERSION || count == 0 ||
+        h.frag_count != count || h.frag_index >= count || h.frame_offset != h.frag_index * per_fragment) {
+        r->stats.invalid++;
+        return false;
+    }
+    uint16_t n = h.frames - h.frame_offset < per_fragment ? h.frames - h.frame_offset : per_fragment;
+    size_t bytes = (size_t)n * h.channels * sizeof(int16_t);
+    if (len != sizeof(h) + bytes) {
+        r->stats.invalid++;
+        return false;
+    }
+
+    if (!r->started) {
+        r->started = true;
+        r->next_seq = h.block_seq;
+    }
+    int32_t ahead = (int32_t)(h.block_seq - r->next_seq);
+    if (ahead < 0) {
+        r->stats.late++;
+        return true;
+    }
+    if (ahead >= ESPNOW_AUDIO_REORDER_BLOCKS) {
+        // Too far ahead to wait for the blocks in between. Give them up and
+        // restart the window so that this block is its last one.
+        uint32_t first = h.block_seq - (ESPNOW_AUDIO_REORDER_BLOCKS - 1);
+        for (uint32_t seq = r->next_seq; seq != first; seq++) {
+            espnow_audio_slot_t *old = &r->slots[seq % ESPNOW_AUDIO_REORDER_BLOCKS];
+            if (old->used && old->seq == seq) {
+                old->used = false;
+            }
+            r->stats.skipped++;
+        }
+        r->next_seq = first;
+        r->loss_run = ESPNOW_AUDIO_FADE_BLOCKS;     // nothing sensible to repeat after a long gap
+    }
+
+    espnow_audio_slot_t *slot = &r->slots[h.block_seq % ESPNOW_AUDIO_REORDER_BLOCKS];
+    if (!slot->used || slot->seq != h.block_seq) {
+        slot->used = true;
+        slot->seq = h.block_seq;
+        slot->frag_count = count;
+        slot->received = 0;
+        slot->received_mask = 0;
+        slot->first_rx_us = now_us;
+        slot->timestamp_us = h.timestamp_us;
+        slot->frames = h.frames;
+        slot->channels = h.channels;
+        slot->channel_mask = h.channel_mask;
+        slot->flags = h.flags;
+        slot->frag_frames = per_fragment;
+    } else if (slot->frames != h.frames || slot->channels != h.channels) {
+        r->stats.invalid++;
+        return false;
+    }
+    if (slot->received_mask & (1u << h.frag_index)) {
+        r->stats.duplicates++;
+        return true;
+    }
+    memcpy(slot->samples + (size_t)h.frame_offset * h.channels, packet + sizeof(h), bytes);
+    slot->received_mask |= 1u << h.frag_index;
+    slot->received++;
+    return true;
+}
+
+// Last received block halved, and halved again for every further lost block in
+// a row; silence once the fade is over or when the layout changed
+static void conceal(const espnow_audio_reassembler_t *r, int16_t *dst, size_t first, size_t count, uint8_t channels) {
+    if (!r->have_last || r->last_channels != channels || r->loss_run >= ESPNOW_AUDIO_FADE_BLOCKS) {
+        memset(dst + first, 0, count * sizeof(int16_t));
+        return;
+    }
+    size_t available = (size_t)r->last_frames * channels;
+    int shift = r->loss_run + 1;
+    for (size_t i = first; i < first + count; i++) {
+        dst[i] = i < available ? r->last[i] >> shift : 0;
+    }
+}
+
+static void remember(espnow_audio_reassembler_t *r, const espnow_audio_block_t *block) {
+    r->have_last = true;
+    r->last_timestamp_us = block->timestamp_us;
+    r->last_frames = block->frames;
+    r->last_channels = block->channels;
+    r->last_channel_mask = block->channel_mask;
+    r->last_flags = block->flags;
+    memcpy(r->last, block->samples, (size_t)block->frames * block->channels * sizeof(int16_t));
+}
+
+// A missing block is given up once a later one has waited long enough, its
+// own fragments would have arrived by then
+static bool later_block_waited(const espnow_audio_reassembler_t *r, int64_t now_us) {
+    for (int i = 0; i < ESPNOW_AUDIO_REORDER_BLOCKS; i++) {
+        const espnow_audio_slot_t *s = &r->slots[i];
+        if (s->used && (int32_t)(s->seq - r->next_seq) > 0 && now_us - s->first_rx_us >= r->max_wait_us) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Capture time of a lost block, counted back from the next block that arrived
+static int64_t lost_timestamp(const espnow_audio_reassembler_t *r) {
+    const espnow_audio_slot_t *next = NULL;
+    for (int i = 0; i < ESPNOW_AUDIO_REORDER_BLOCKS; i++) {
+        const espnow_audio_slot_t *s = &r->slots[i];
+        if (s->used && (int32_t)(s->seq - r->next_seq) > 0 && (next == NULL || (int32_t)(s->seq - next->seq) < 0)) {
+            next = s;
+        }
+    }
+    if (next == NULL) {
+        return r->last_timestamp_us + (int64_t)r->last_frames * 1000000 / r->sample_rate;
+    }
+    return next->timestamp_us - (int64_t)(next->seq - r->next_seq) * next->frames * 1000000 / r->sample_rate;
+}
+
+bool espnow_audio_reassembler_pop(espnow_audio_reassembler_t *r, int64_t now_us, espnow_audio_block_t *out) {
+    if (!r->started) {
+        return false;
+    }
+    espnow_audio_slot_t *slot = &r->slots[r->next_seq % ESPNOW_AUDIO_REORDER_BLOCKS];
+    bool present = slot->used && slot->seq == r->next_seq;
+
+    if (present && slot->received < slot->frag_count && now_us - slot->first_rx_us < r->max_wait_us) {
+        return false;
+    }
+    if (!present) {
+        if (!later_block_waited(r, now_us)) {
+            return false;
+        }
+        // Without any block before it there is nothing to conceal with
+        while (!r->have_last && !(slot->used && slot->seq == r->next_seq)) {
+            r->stats.skipped++;
+            r->next_seq++;
+            slot = &r->slots[r->next_seq % ESPNOW_AUDIO_REORDER_BLOCKS];
+        }
+        present = slot->used && slot->seq == r->next_seq;
+        if (present && slot->received < slot->frag_count && now_us - slot->first_rx_us < r->max_wait_us) {
+            return false;
+        }
+    }
+
+    out->seq = r->next_seq;
+    if (present) {
+        out->timestamp_us = slot->timestamp_us;
+        out->frames = slot->frames;
+        out->channels = slot->channels;
+        out->channel_mask = slot->channel_mask;
+        out->flags = slot->flags;
+        out->missing_fragments = slot->frag_count - slot->received;
+        out->lost = false;
+        size_t total = (size_t)slot->frames * slot->channels;
+        memcpy(out->samples, slot->samples, total * sizeof(int16_t));
+        for (uint8_t i = 0; i < slot->frag_count; i++) {
+            if (slot->received_mask & (1u << i)) {
+                continue;
+            }
+            size_t first = (size_t)i * slot->frag_frames * slot->channels;
+            size_t count = (size_t)slot->frag_frames * slot->channels;
+            if (first + count > total) {
+                count = total - first;
+            }
+            conceal(r, out->samples, first, count, slot->channels);
+        }
+        slot->used = false;
+    } else {
+        // Same layout as the previous block
+        out->frames = r->last_frames;
+        out->channels = r->last_channels;
+        out->channel_mask = r->last_channel_mask;
+        out->flags = r->last_flags;
+        out->timestamp_us = lost_timestamp(r);
+        out->missing_fragments = espnow_audio_fragment_count(out->frames, out->channels);
+        out->lost = true;
+        conceal(r, out->samples, 0, (size_t)out->frames * out->channels, out->channels);
+    }
+
+    r->stats.blocks++;
+    if (out->lost) {
+        // Keep concealing from the last block that arrived, only move on in time
+        r->stats.lost++;
+        r->last_timestamp_us = out->timestamp_us;
+        if (r->loss_run < UINT8_MAX) {
+            r->loss_run++;
+        }
+    } else {
+        if (out->missing_fragments > 0) {
+            r->stats.partial++;
+        }
+        remember(r, out);
+        r->loss_run = 0;
+    }
+    r->next_seq++;
+    return true;
+}
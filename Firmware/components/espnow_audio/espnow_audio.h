@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Audio over ESP-NOW, shared by the arm board (sender) and the Eye (receiver)
+//
+// A capture block is split into fragments that fit one ESP-NOW frame. Every
+// fragment carries the block number, its position in the block and the
+// capture time, so it can be placed without the others. Nothing is ever
+// retransmitted. The receiver holds a few blocks for late or reordered
+// fragments. It then releases every block in order and conceals what is
+// missing: a lost fragment with the same samples of the previous block,
+// faded, and a lost block with the whole previous block, fading to silence.
+// Gaps longer than the reorder window are skipped, and the block numbers jump.
+//
+// Plain C without ESP-IDF dependencies, so it also builds on a host:
+// `python av_stream.py selftest` in Software/Streaming checks it on a simulated link.
+
+#define ESPNOW_AUDIO_MAX_PACKET     250     // ESP_NOW_MAX_DATA_LEN
+#define ESPNOW_AUDIO_MAGIC          0xA5
+#define ESPNOW_AUDIO_VERSION        2       // 2: flags
+#define ESPNOW_AUDIO_MAX_FRAMES     120     // one 5 ms capture block at 24 kHz
+#define ESPNOW_AUDIO_MAX_CHANNELS   4
+#define ESPNOW_AUDIO_MAX_FRAGMENTS  8
+#define ESPNOW_AUDIO_REORDER_BLOCKS 4       // blocks held back for late fragments
+#define ESPNOW_AUDIO_DEFAULT_WAIT_US 10000  // how long a block may wait for its missing fragments
+#define ESPNOW_AUDIO_FADE_BLOCKS    3       // concealment fades to silence over this many lost blocks
+#define ESPNOW_AUDIO_FLAG_SYNCED    0x01    // timestamp_us is on the Eye's clock, see time_sync.h
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;          // ESPNOW_AUDIO_MAGIC
+    uint8_t version;        // ESPNOW_AUDIO_VERSION
+    uint8_t frag_index;
+    uint8_t frag_count;
+    uint32_t block_seq;     // capture block number on the sender
+    int64_t timestamp_us;   // sender time of the block's first frame
+    uint16_t frames;        // frames in the whole block
+    uint16_t frame_offset;  // first frame carried by this fragment
+    uint8_t channels;
+    uint8_t channel_mask;   // microphones in the payload, as in /ach1?ch=
+    uint8_t flags;          // ESPNOW_AUDIO_FLAG_*
+} espnow_audio_header_t;
+
+#define ESPNOW_AUDIO_MAX_FRAGMENT_BYTES (ESPNOW_AUDIO_MAX_PACKET - sizeof(espnow_audio_header_t))
+
+typedef struct {
+    uint32_t seq;
+    int64_t timestamp_us;
+    uint16_t frames;
+    uint8_t channels;
+    uint8_t channel_mask;
+    uint8_t flags;                  // from the header, a lost block has those of the previous one
+    uint8_t missing_fragments;      // 0 for a complete block
+    bool lost;                      // nothing of this block arrived, all samples are concealment
+    int16_t samples[ESPNOW_AUDIO_MAX_FRAMES * ESPNOW_AUDIO_MAX_CHANNELS];
+} espnow_audio_block_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t invalid;               // malformed or from another stream layout
+    uint32_t duplicates;
+    uint32_t late;                  // arrived after their block was released
+    uint32_t blocks;                // released in total
+    uint32_t partial;               // released with missing fragments
+    uint32_t lost;                  // released fully concealed
+    uint32_t skipped;               // never released, gap longer than the reorder window
+} espnow_audio_stats_t;
+
+typedef struct {
+    bool used;
+    uint32_t seq;
+    uint8_t frag_count;
+    uint8_t received;
+    uint8_t received_mask;
+    int64_t first_rx_us;
+    int64_t timestamp_us;
+    uint16_t frames;
+    uint8_t channels;
+    uint8_t channel_mask;
+    uint8_t flags;
+    uint16_t frag_frames;           // frames per fragment, the last one may carry fewer
+    int16_t samples[ESPNOW_AUDIO_MAX_FRAMES * ESPNOW_AUDIO_MAX_CHANNELS];
+} espnow_audio_slot_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    int64_t max_wait_us;
+    bool started;
+    uint32_t next_seq;              // next block to release
+    espnow_audio_slot_t slots[ESPNOW_AUDIO_REORDER_BLOCKS];
+    // Last released block, the source for concealment
+    bool have_last;
+    int64_t last_timestamp_us;
+    uint16_t last_frames;
+    uint8_t last_channels;
+    uint8_t last_channel_mask;
+    uint8_t last_flags;
+    uint8_t loss_run;               // consecutive lost blocks
+    int16_t last[ESPNOW_AUDIO_MAX_FRAMES * ESPNOW_AUDIO_MAX_CHANNELS];
+    espnow_audio_stats_t stats;
+} espnow_audio_reassembler_t;
+
+// Sender side. Frames carried by every fragment of a block with this many
+// channels, and the number of fragments of a block.
+uint16_t espnow_audio_fragment_frames(uint8_t channels);
+uint8_t espnow_audio_fragment_count(uint16_t frames, uint8_t channels);
+
+// Write fragment frag_index of a block of interleaved samples to packet, which
+// must hold ESPNOW_AUDIO_MAX_PACKET bytes. Returns the packet length, 0 if the
+// block does not fit the limits above.
+size_t espnow_audio_build(uint8_t *packet, uint32_t block_seq, uint8_t frag_index, int64_t timestamp_us,
+                          const int16_t *samples, uint16_t frames, uint8_t channels, uint8_t channel_mask,
+                          uint8_t flags);
+
+// Receiver side
+void espnow_audio_reassembler_init(espnow_audio_reassembler_t *r, uint32_t sample_rate, int64_t max_wait_us);
+
+// Store one received packet. Returns false for packets that are not valid
+// fragments. now_us is any monotonic clock, the same one as for pop.
+bool espnow_audio_reassembler_push(espnow_audio_reassembler_t *r, const uint8_t *packet, size_t len, int64_t now_us);
+
+// Release the next block in order if it is complete, or if waiting longer
+// cannot help anymore; missing parts are concealed. Call until it returns
+// false, after every push and now and then in between.
+bool espnow_audio_reassembler_pop(espnow_audio_reassembler_t *r, int64_t now_us, espnow_audio_block_t *out);
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "stream_socket.h"
+#include "time_sync_net.h"
+#include "net_bench.h"
+
+static const char *TAG = "net_bench";
+
+#define NET_BENCH_TASK_STACK    4096
+#define NET_BENCH_MAX_BACKOFF_MS 16     // longest wait after failed UDP sends in a row
+
+_Static_assert(sizeof(net_bench_block_t) == 24, "block header layout is part of the format");
+
+typedef struct {
+    net_bench_transport_t transport;
+    uint16_t block;
+    uint32_t kbps;
+    uint32_t ms;
+    bool nodelay;
+    httpd_req_t *req;           // async copy, TCP transports
+    struct sockaddr_in dest;    // udp
+} bench_run_t;
+
+static UBaseType_t task_priority;
+static bench_run_t run;         // owned by the running task while stats.active
+static volatile bool stop_requested;
+
+// Guards stats
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static net_bench_stats_t stats;
+
+static const char *transport_names[] = { "chunked", "raw", "udp" };
+
+static uint32_t peer_addr(httpd_req_t *req) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&addr, &addr_len) != 0) {
+        return 0;
+    }
+    if (addr.ss_family == AF_INET) {
+        return ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+    }
+    // IPv4 clients of an IPv6 listening socket are v4-mapped
+    uint32_t v4;
+    memcpy(&v4, &((struct sockaddr_in6 *)&addr)->sin6_addr.s6_addr[12], sizeof(v4));
+    return v4;
+}
+
+static esp_err_t send_block(int udp, stream_socket_t *out, const uint8_t *buf, size_t len) {
+    switch (run.transport) {
+    case NET_BENCH_CHUNKED:
+        return httpd_resp_send_chunk(run.req, (const char *)buf, len);
+    case NET_BENCH_RAW:
+        return stream_socket_write(out, buf, len);
+    default:
+        // A full TX queue is a lost datagram, the receiver counts it
+        return sendto(udp, buf, len, 0, (struct sockaddr *)&run.dest, sizeof(run.dest)) == (int)len ? ESP_OK : ESP_FAIL;
+    }
+}
+
+static esp_err_t begin_response(stream_socket_t *out) {
+    char block[8];
+    snprintf(block, sizeof(block), "%u", run.block);
+    if (run.nodelay) {
+        int one = 1;
+        setsockopt(httpd_req_to_sockfd(run.req), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (run.transport == NET_BENCH_RAW) {
+        const stream_socket_header_t headers[] = { { "X-Bench-Block", block } };
+        return stream_socket_begin(out, run.req, "application/octet-stream", headers, 1);
+    }
+    httpd_resp_set_type(run.req, "application/octet-stream");
+    httpd_resp_set_hdr(run.req, "X-Bench-Block", block);
+    return ESP_OK;
+}
+
+static void bench_task(void *arg) {
+    stream_socket_t out = { 0 };
+    int udp = -1;
+    uint8_t *buf = malloc(run.block);
+    esp_err_t res = buf != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+    if (res == ESP_OK && run.transport == NET_BENCH_UDP) {
+        udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        res = udp >= 0 ? ESP_OK : ESP_FAIL;
+    } else if (res == ESP_OK) {
+        res = begin_response(&out);
+    }
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Run not started: %s", esp_err_to_name(res));
+    } else {
+        ESP_LOGI(TAG, "%s run, %u byte blocks, %lu kbps for %lu ms", transport_names[run.transport], run.block,
+                 (unsigned long)run.kbps, (unsigned long)run.ms);
+    }
+
+    net_bench_block_t *header = (net_bench_block_t *)buf;
+    if (buf != NULL) {
+        // The payload never changes, the benchmark should not cost CPU of its own
+        for (size_t i = sizeof(*header); i < run.block; i++) {
+            buf[i] = NET_BENCH_PATTERN(i - sizeof(*header));
+        }
+        memcpy(header->magic, NET_BENCH_MAGIC, 4);
+        header->length = run.block;
+        header->transport = run.transport;
+        header->reserved = 0;
+    }
+    // Block interval in us: block * 8 bits at kbps * 1000 bits per s
+    int64_t interval_us = run.kbps ? (int64_t)run.block * 8000 / run.kbps : 0;
+    int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + run.ms * 1000LL;
+    int64_t next_us = start_us;
+    uint32_t seq = 0;
+    TickType_t backoff = 0;
+
+    while (res == ESP_OK && !stop_requested) {
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= end_us) {
+            break;
+        }
+        if (interval_us > 0) {
+            if (next_us - now_us >= tick_us) {
+                vTaskDelay((next_us - now_us) / tick_us);
+                continue;
+            }
+            if (now_us - next_us > NET_BENCH_MAX_LAG_MS * 1000LL) {
+                next_us = now_us;
+                taskENTER_CRITICAL(&lock);
+                stats.late++;
+                taskEXIT_CRITICAL(&lock);
+            }
+            next_us += interval_us;
+        }
+
+        bool synced = time_sync_synced();
+        header->seq = seq;
+        header->flags = synced ? NET_BENCH_FLAG_SYNCED : 0;
+        header->sent_us = synced ? time_sync_to_master(now_us) : now_us;
+        esp_err_t sent = send_block(udp, &out, buf, run.block);
+        uint32_t send_us = (uint32_t)(esp_timer_get_time() - now_us);
+        if (sent != ESP_OK && run.transport != NET_BENCH_UDP) {
+            res = sent;     // the client went away
+        }
+        seq++;
+        // A full TX queue fails sendto at once, unpaced that would spin without
+        // ever blocking. Give the queue a tick to drain, longer while it stays full.
+        if (sent != ESP_OK && run.transport == NET_BENCH_UDP) {
+            backoff = backoff ? backoff * 2 : 1;
+            if (backoff > pdMS_TO_TICKS(NET_BENCH_MAX_BACKOFF_MS)) {
+                backoff = pdMS_TO_TICKS(NET_BENCH_MAX_BACKOFF_MS);
+            }
+            vTaskDelay(backoff ? backoff : 1);
+        } else {
+            backoff = 0;
+        }
+
+        taskENTER_CRITICAL(&lock);
+        if (sent == ESP_OK) {
+            stats.blocks++;
+            stats.bytes += run.block;
+        } else {
+            stats.send_errors++;
+        }
+        if (send_us > stats.max_send_us) {
+            stats.max_send_us = send_us;
+        }
+        stats.elapsed_ms = (uint32_t)((now_us - start_us) / 1000);
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    if (udp >= 0) {
+        // End marker, a few times over in case one is lost
+        header->seq = seq;
+        header->flags |= NET_BENCH_FLAG_LAST;
+        for (int i = 0; i < 3; i++) {
+            sendto(udp, buf, sizeof(*header), 0, (struct sockaddr *)&run.dest, sizeof(run.dest));
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+        close(udp);
+    } else if (run.transport == NET_BENCH_RAW) {
+        stream_socket_end(&out);
+    } else if (res == ESP_OK) {
+        httpd_resp_send_chunk(run.req, NULL, 0);
+    }
+    if (run.req != NULL) {
+        httpd_req_async_handler_complete(run.req);
+    }
+    free(buf);
+
+    taskENTER_CRITICAL(&lock);
+    stats.elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    stats.active = false;
+    taskEXIT_CRITICAL(&lock);
+    ESP_LOGI(TAG, "Run done: %lu blocks, %lu send errors, longest send %lu us", (unsigned long)stats.blocks,
+             (unsigned long)stats.send_errors, (unsigned long)stats.max_send_us);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t bench_handler(httpd_req_t *req) {
+    char query[128];
+    char value[16];
+    bench_run_t next = {
+        .transport = NET_BENCH_CHUNKED,
+        .block = NET_BENCH_DEFAULT_BLOCK,
+        .ms = NET_BENCH_DEFAULT_MS,
+    };
+    long udp_port = NET_BENCH_DEFAULT_UDP_PORT;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "stop", value, sizeof(value)) == ESP_OK && value[0] == '1') {
+            stop_requested = true;
+            return httpd_resp_sendstr(req, "Benchmark stopped");
+        }
+        if (httpd_query_key_value(query, "transport", value, sizeof(value)) == ESP_OK) {
+            int t = 0;
+            while (t < 3 && strcmp(value, transport_names[t]) != 0) {
+                t++;
+            }
+            if (t == 3) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "transport must be chunked, raw or udp");
+            }
+            next.transport = (net_bench_transport_t)t;
+        }
+        if (httpd_query_key_value(query, "block", value, sizeof(value)) == ESP_OK) {
+            long v = strtol(value, NULL, 10);
+            if (v < (long)sizeof(net_bench_block_t) || v > NET_BENCH_MAX_BLOCK) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "block must be 24-16384");
+            }
+            next.block = (uint16_t)v;
+        }
+        if (httpd_query_key_value(query, "kbps", value, sizeof(value)) == ESP_OK) {
+            long v = strtol(value, NULL, 10);
+            if (v < 0 || v > 100000) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "kbps must be 0-100000");
+            }
+            next.kbps = (uint32_t)v;
+        }
+        if (httpd_query_key_value(query, "ms", value, sizeof(value)) == ESP_OK) {
+            long v = strtol(value, NULL, 10);
+            if (v < 100 || v > NET_BENCH_MAX_MS) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ms must be 100-120000");
+            }
+            next.ms = (uint32_t)v;
+        }
+        if (httpd_query_key_value(query, "port", value, sizeof(value)) == ESP_OK) {
+            udp_port = strtol(value, NULL, 10);
+            if (udp_port <= 0 || udp_port > 65535) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "port must be 1-65535");
+            }
+        }
+        if (httpd_query_key_value(query, "nodelay", value, sizeof(value)) == ESP_OK) {
+            next.nodelay = (value[0] == '1');
+        }
+    }
+    if (next.transport == NET_BENCH_UDP) {
+        if (next.block > NET_BENCH_MAX_UDP_BLOCK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "block must be at most 1472 for udp");
+        }
+        next.dest.sin_family = AF_INET;
+        next.dest.sin_port = htons((uint16_t)udp_port);
+        next.dest.sin_addr.s_addr = peer_addr(req);
+        if (next.dest.sin_addr.s_addr == 0) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Unknown client address");
+        }
+    }
+
+    bool claimed = false;
+    taskENTER_CRITICAL(&lock);
+    if (!stats.active) {
+        stats = (net_bench_stats_t){
+            .active = true,
+            .transport = next.transport,
+            .block = next.block,
+            .kbps = next.kbps,
+        };
+        claimed = true;
+    }
+    taskEXIT_CRITICAL(&lock);
+    if (!claimed) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Benchmark already running");
+    }
+
+    run = next;
+    stop_requested = false;
+    esp_err_t res = ESP_OK;
+    if (run.transport != NET_BENCH_UDP) {
+        res = httpd_req_async_handler_begin(req, &run.req);
+    }
+    if (res == ESP_OK &&
+        xTaskCreate(bench_task, "net_bench", NET_BENCH_TASK_STACK, NULL, task_priority, NULL) != pdPASS) {
+        if (run.req != NULL) {
+            httpd_req_async_handler_complete(run.req);
+        }
+        res = ESP_ERR_NO_MEM;
+    }
+    if (res != ESP_OK) {
+        taskENTER_CRITICAL(&lock);
+        stats.active = false;
+        taskEXIT_CRITICAL(&lock);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start the benchmark");
+    }
+    if (run.transport != NET_BENCH_UDP) {
+        return ESP_OK;      // the task sends the response
+    }
+
+    char json[160];
+    int len = snprintf(json, sizeof(json),
+                       "{\"transport\":\"udp\",\"port\":%ld,\"block\":%u,\"kbps\":%lu,\"ms\":%lu,\"header_bytes\":%u}",
+                       udp_port, run.block, (unsigned long)run.kbps, (unsigned long)run.ms,
+                       (unsigned)sizeof(net_bench_block_t));
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+esp_err_t net_bench_register(httpd_handle_t server, UBaseType_t priority) {
+    static const httpd_uri_t bench_uri = {
+        .uri = "/bench",
+        .method = HTTP_GET,
+        .handler = bench_handler,
+        .user_ctx = NULL,
+    };
+    task_priority = priority;
+    return httpd_register_uri_handler(server, &bench_uri);
+}
+
+void net_bench_get_stats(net_bench_stats_t *out) {
+    taskENTER_CRITICAL(&lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&lock);
+}
+
+int net_bench_format_status(char *out, size_t size) {
+    net_bench_stats_t s;
+    net_bench_get_stats(&s);
+    return snprintf(out, size,
+                    "{\"active\":%s,\"transport\":\"%s\",\"block\":%u,\"kbps\":%lu,\"blocks\":%lu,\"bytes\":%llu,"
+                    "\"send_errors\":%lu,\"max_send_us\":%lu,\"late\":%lu,\"elapsed_ms\":%lu}",
+                    s.active ? "true" : "false", transport_names[s.transport], s.block, (unsigned long)s.kbps,
+                    (unsigned long)s.blocks, (unsigned long long)s.bytes, (unsigned long)s.send_errors,
+                    (unsigned long)s.max_send_us, (unsigned long)s.late, (unsigned long)s.elapsed_ms);
+}
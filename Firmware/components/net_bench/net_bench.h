@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+
+// Synthetic throughput benchmark, /bench on the arm board and the Eye
+//
+// Streams generated blocks instead of audio or video, so the network and the
+// send path can be measured on their own while the capture tasks keep
+// running. When a run loses goodput or stalls while the capture counters in
+// /status stay clean, the cause is WiFi airtime or the socket, not the
+// microphones or the CPU. Software/Streaming/net_bench.py is the client.
+//
+//   GET /bench?transport=raw&block=1024&kbps=800&ms=10000
+//     transport  chunked  blocks as httpd chunks of the response (default)
+//                raw      blocks written straight to the socket, stream_socket.h
+//                udp      one block per datagram to the requester, ?port= (default
+//                         NET_BENCH_DEFAULT_UDP_PORT). The response is a JSON
+//                         description, the run continues in the background.
+//     block      bytes per block including the header, up to NET_BENCH_MAX_BLOCK
+//                (NET_BENCH_MAX_UDP_BLOCK for udp)
+//     kbps       paced rate, 0 (default) sends as fast as the socket takes it
+//     ms         duration of the run
+//     nodelay=1  TCP_NODELAY for the TCP transports
+//   GET /bench?stop=1 ends the current run.
+//
+// Every block starts with a net_bench_block_t and the rest is filled with
+// NET_BENCH_PATTERN, so the receiver can check the payload and count the
+// blocks lost (UDP) from the sequence numbers. Pacing sleeps whole FreeRTOS
+// ticks, so blocks leave in bursts of up to one tick at the right average
+// rate. One run at a time.
+
+#define NET_BENCH_MAGIC             "IRBN"
+#define NET_BENCH_DEFAULT_BLOCK     1024
+#define NET_BENCH_MAX_BLOCK         16384
+#define NET_BENCH_MAX_UDP_BLOCK     1472    // one datagram in a 1500-byte MTU, no IP fragments
+#define NET_BENCH_DEFAULT_MS        10000
+#define NET_BENCH_MAX_MS            120000
+#define NET_BENCH_DEFAULT_UDP_PORT  5010
+#define NET_BENCH_MAX_LAG_MS        100     // pacing this far behind restarts from now instead of bursting
+#define NET_BENCH_PATTERN(i)        ((uint8_t)((i) % 251))  // payload byte i after the header
+#define NET_BENCH_FLAG_LAST         0x01    // udp: end of the run, seq is the number of blocks sent
+#define NET_BENCH_FLAG_SYNCED       0x02    // sent_us is on the Eye's clock (time_sync)
+
+typedef enum {
+    NET_BENCH_CHUNKED = 0,
+    NET_BENCH_RAW = 1,
+    NET_BENCH_UDP = 2,
+} net_bench_transport_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];          // NET_BENCH_MAGIC
+    uint32_t seq;           // from 0 in every run
+    int64_t sent_us;        // when the block was handed to the socket
+    uint32_t length;        // whole block, this header included
+    uint8_t flags;          // NET_BENCH_FLAG_*
+    uint8_t transport;      // net_bench_transport_t
+    uint16_t reserved;
+} net_bench_block_t;
+
+typedef struct {
+    bool active;
+    net_bench_transport_t transport;
+    uint16_t block;
+    uint32_t kbps;          // requested, 0: unpaced
+    uint32_t blocks;        // of the current or the last run
+    uint64_t bytes;
+    uint32_t send_errors;   // udp: datagrams the stack refused, ex: WiFi TX queue full
+    uint32_t max_send_us;   // longest single send, the socket pushing back
+    uint32_t late;          // times pacing fell NET_BENCH_MAX_LAG_MS behind and gave up catching up
+    uint32_t elapsed_ms;
+} net_bench_stats_t;
+
+// Register /bench. Runs get their own task at priority, which should be below
+// the capture tasks so that the benchmark competes like a real stream.
+esp_err_t net_bench_register(httpd_handle_t server, UBaseType_t priority);
+
+void net_bench_get_stats(net_bench_stats_t *stats);
+
+// The stats as a JSON object for /status, snprintf-style return value
+int net_bench_format_status(char *out, size_t size);
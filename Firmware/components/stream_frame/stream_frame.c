@@ -0,0 +1,119 @@
+#include <string.h>
+#include "stream_frame.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+_Static_assert(sizeof(stream_frame_header_t) == STREAM_FRAME_HEADER_V1, "header layout is part of the format");
+_Static_assert(sizeof(stream_frame_levels_t) == 28, "levels layout is part of the format");
+
+#define CRC_OFFSET          offsetof(stream_frame_header_t, crc)
+#define HEADER_CRC_OFFSET   offsetof(stream_frame_header_t, header_crc)
+
+#ifndef ESP_PLATFORM
+static uint32_t crc_table[256];
+
+static void crc_table_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+#endif
+
+uint32_t stream_frame_crc32(uint32_t crc, const void *data, size_t len) {
+#ifdef ESP_PLATFORM
+    return esp_rom_crc32_le(crc, data, len);
+#else
+    if (crc_table[1] == 0) {
+        crc_table_init();
+    }
+    const uint8_t *p = data;
+    crc = ~crc;
+    while (len--) {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+#endif
+}
+
+void stream_frame_encode(stream_frame_header_t *header, uint8_t stream, uint8_t codec, uint32_t seq,
+                         int64_t timestamp_us, uint8_t channel_mask, uint8_t flags, const void *payload, size_t len) {
+    *header = (stream_frame_header_t){
+        .magic = STREAM_FRAME_MAGIC,
+        .version = STREAM_FRAME_VERSION,
+        .header_len = sizeof(*header),
+        .stream = stream,
+        .codec = codec,
+        .seq = seq,
+        .timestamp_us = timestamp_us,
+        .channel_mask = channel_mask,
+        .flags = flags,
+        .length = len,
+    };
+    header->header_crc = (uint16_t)stream_frame_crc32(0, header, HEADER_CRC_OFFSET);
+    uint32_t crc = stream_frame_crc32(0, header, CRC_OFFSET);
+    header->crc = stream_frame_crc32(crc, payload, len);
+}
+
+stream_frame_result_t stream_frame_decode(const uint8_t *buf, size_t len, stream_frame_header_t *header,
+                                          const uint8_t **payload, size_t *frame_len) {
+    *frame_len = 0;
+    if (len < 6) {
+        return memcmp(buf, STREAM_FRAME_MAGIC, len < 4 ? len : 4) == 0 ? STREAM_FRAME_SHORT : STREAM_FRAME_BAD_MAGIC;
+    }
+    if (memcmp(buf, STREAM_FRAME_MAGIC, 4) != 0) {
+        return STREAM_FRAME_BAD_MAGIC;
+    }
+    uint8_t header_len = buf[5];
+    if (buf[4] == 0 || header_len < STREAM_FRAME_HEADER_V1) {
+        return STREAM_FRAME_BAD_HEADER;
+    }
+    if (len < header_len) {
+        return STREAM_FRAME_SHORT;
+    }
+    // The fields of version 1, then the crc, which is always last
+    memcpy(header, buf, CRC_OFFSET);
+    memcpy(&header->crc, buf + header_len - sizeof(header->crc), sizeof(header->crc));
+    if (header->header_crc != (uint16_t)stream_frame_crc32(0, buf, HEADER_CRC_OFFSET) ||
+        header->length > STREAM_FRAME_MAX_PAYLOAD) {
+        return STREAM_FRAME_BAD_HEADER;
+    }
+    *frame_len = (size_t)header_len + header->length;
+    if (len < *frame_len) {
+        return STREAM_FRAME_SHORT;
+    }
+    uint32_t crc = stream_frame_crc32(0, buf, header_len - sizeof(header->crc));
+    if (stream_frame_crc32(crc, buf + header_len, header->length) != header->crc) {
+        return STREAM_FRAME_BAD_CRC;
+    }
+    *payload = buf + header_len;
+    return STREAM_FRAME_OK;
+}
+
+size_t stream_frame_resync(const uint8_t *buf, size_t len) {
+    for (size_t i = 1; i + 4 <= len; i++) {
+        if (memcmp(buf + i, STREAM_FRAME_MAGIC, 4) == 0) {
+            return i;
+        }
+    }
+    // Keep a tail that may be the start of a magic
+    return len > 4 ? len - 3 : 1;
+}
+
+const char *stream_frame_codec_name(uint8_t codec) {
+    switch (codec) {
+    case STREAM_CODEC_PCM16_24K: return "pcm16_24k";
+    case STREAM_CODEC_PCM16_16K: return "pcm16_16k";
+    case STREAM_CODEC_MULAW_16K: return "mulaw_16k";
+    case STREAM_CODEC_JPEG: return "jpeg";
+    case STREAM_CODEC_JPEG_ROI: return "jpeg_roi";
+    case STREAM_CODEC_LEVELS: return "levels";
+    case STREAM_CODEC_JSON: return "json";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary stream container, ?container=1 on /ach1 (arm board), /stream and /av (Eye)
+//
+// Every frame is a stream_frame_header_t followed by length payload bytes.
+// The header says everything a reader needs to skip or decode the payload,
+// so a reader takes one header read and one payload read per frame instead of
+// hunting for JPEG markers or relying on HTTP headers sent once.
+//
+// stream is the source on the connection (0: the board serving it, on /av the
+// AV_SOURCE_* numbers) and codec the kind of payload, so audio, video and
+// metadata about them (levels, faces) share one
+// connection. A metadata frame carries the seq and timestamp of the frame it
+// describes.
+//
+// The CRC-32 (zlib's) covers the header up to the crc field and the payload.
+// header_crc, the low 16 bits of the CRC-32 of the header bytes before it,
+// lets a reader reject a corrupted length before waiting for that many bytes.
+// A reader that finds a bad magic, header or CRC scans forward for the next
+// magic. Newer versions may only append header fields before crc and say so
+// in header_len. A version 1 reader takes any version whose header_len is at
+// least STREAM_FRAME_HEADER_V1, reads the fields it knows and skips the rest.
+//
+// Plain C without ESP-IDF dependencies, so it also builds on a host; on the
+// boards the CRC runs from ROM. Software/Streaming/stream_frame.py is the
+// Python reader, `python stream_frame.py selftest` checks it against this code.
+
+#define STREAM_FRAME_MAGIC          "IRSF"
+#define STREAM_FRAME_VERSION        1
+#define STREAM_FRAME_HEADER_V1      32
+#define STREAM_FRAME_MAX_PAYLOAD    (1u << 24)  // a reader treats longer frames as corrupt
+#define STREAM_FRAME_HTTP_HEADER    "X-Stream-Frame-Version"    // set by endpoints that send frames
+
+typedef enum {
+    STREAM_CODEC_PCM16_24K = 1,     // interleaved 16-bit little endian, one column per channel_mask bit
+    STREAM_CODEC_PCM16_16K = 2,
+    STREAM_CODEC_MULAW_16K = 3,     // G.711 mu-law, 8-bit
+    STREAM_CODEC_JPEG = 16,
+    STREAM_CODEC_JPEG_ROI = 17,     // stream_frame_roi_t, then a JPEG of that region of the frame
+    STREAM_CODEC_LEVELS = 32,       // stream_frame_levels_t of the audio frame with the same stream and seq
+    STREAM_CODEC_JSON = 33,         // other metadata
+} stream_frame_codec_t;
+
+#define STREAM_FRAME_FLAG_SYNCED    0x01    // timestamp_us is on the Eye's clock (time_sync)
+#define STREAM_FRAME_FLAG_CONCEALED 0x02    // samples were lost on the way and concealed
+#define STREAM_FRAME_FLAG_BEAM      0x04    // one audio column, the mix of the channel_mask microphones
+#define STREAM_FRAME_FLAG_MORE      0x08    // the payload continues in the next frame of this stream, same
+                                            // codec and seq (/av slices its JPEGs); frames of other
+                                            // streams may come in between
+
+typedef struct __attribute__((packed)) {
+    char magic[4];          // STREAM_FRAME_MAGIC
+    uint8_t version;
+    uint8_t header_len;     // bytes up to and including crc
+    uint8_t stream;
+    uint8_t codec;          // stream_frame_codec_t
+    uint32_t seq;           // per stream: capture block number for audio, frame number for video
+    int64_t timestamp_us;   // capture of the first sample or of the frame
+    uint32_t length;        // payload bytes that follow the header
+    uint8_t channel_mask;   // audio: bit n set, microphone n is in the payload
+    uint8_t flags;          // STREAM_FRAME_FLAG_*
+    uint16_t header_crc;    // CRC-32 of the bytes before it, low 16 bits
+    // Fields of later versions go here
+    uint32_t crc;
+} stream_frame_header_t;
+
+// STREAM_CODEC_LEVELS payload, the per-microphone levels of an audio frame
+// (see audio_levels.h on the arm board), little endian
+typedef struct __attribute__((packed)) {
+    struct {
+        uint16_t peak;
+        uint16_t rms;
+        uint16_t clips;
+    } level[4];             // always all four microphones, at the capture rate
+    uint32_t latency_us;    // capture of the first frame to the frame being handed to the socket
+} stream_frame_levels_t;
+
+// STREAM_CODEC_JPEG_ROI payload header, little endian. The JPEG after it shows
+// the region x, y, w, h of a camera frame of frame_width x frame_height; it
+// may be smaller than the region, a low resolution view of it. All images of
+// one camera frame have its seq and timestamp, index counts them from 0.
+typedef enum {
+    STREAM_FRAME_ROI_CONTEXT = 0,   // the whole frame, scaled down
+    STREAM_FRAME_ROI_FACE = 1,      // a face the Eye's detector found
+    STREAM_FRAME_ROI_MOUTH = 2,     // the lower half of such a face
+    STREAM_FRAME_ROI_REQUESTED = 3, // a region the client asked for
+} stream_frame_roi_kind_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t frame_width;
+    uint16_t frame_height;
+    uint16_t x, y;
+    uint16_t w, h;
+    uint8_t index;
+    uint8_t kind;           // stream_frame_roi_kind_t
+} stream_frame_roi_t;
+
+typedef enum {
+    STREAM_FRAME_OK,
+    STREAM_FRAME_SHORT,         // not enough bytes yet, *frame_len says how many when the header was complete
+    STREAM_FRAME_BAD_MAGIC,
+    STREAM_FRAME_BAD_HEADER,    // version, header_len or length out of range, or header_crc wrong
+    STREAM_FRAME_BAD_CRC,
+} stream_frame_result_t;
+
+// zlib compatible, crc = 0 to start, pass the previous result to continue
+uint32_t stream_frame_crc32(uint32_t crc, const void *data, size_t len);
+
+// Fills in the header of a frame with len payload bytes, including the CRC.
+// The payload is not copied: send the header, then the payload.
+void stream_frame_encode(stream_frame_header_t *header, uint8_t stream, uint8_t codec, uint32_t seq,
+                         int64_t timestamp_us, uint8_t channel_mask, uint8_t flags, const void *payload, size_t len);
+
+// Decodes the frame at the start of buf. On STREAM_FRAME_OK header and
+// *payload are set and *frame_len is the frame's size in buf (header_len +
+// length). On STREAM_FRAME_SHORT, *frame_len is the size needed, or 0 while
+// the header itself is incomplete.
+stream_frame_result_t stream_frame_decode(const uint8_t *buf, size_t len, stream_frame_header_t *header,
+                                          const uint8_t **payload, size_t *frame_len);
+
+// After a failed decode: offset of the next possible frame start in buf, at
+// least 1. Bytes before it can be dropped.
+size_t stream_frame_resync(const uint8_t *buf, size_t len);
+
+const char *stream_frame_codec_name(uint8_t codec);
@@ -0,0 +1,83 @@
+#include <errno.h>
+#include <stdio.h>
+#include "esp_log.h"
+#include "stream_socket.h"
+
+static const char *TAG = "stream_socket";
+
+esp_err_t stream_socket_begin(stream_socket_t *stream, httpd_req_t *req, const char *content_type,
+                              const stream_socket_header_t *headers, size_t header_count) {
+    char head[512];
+    stream->req = req;
+    stream->sock = httpd_req_to_sockfd(req);
+    stream->bytes = 0;
+    stream->writes = 0;
+    if (stream->sock < 0) {
+        return ESP_FAIL;
+    }
+
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nCache-Control: no-cache\r\nConnection: close\r\n",
+                       content_type);
+    for (size_t i = 0; i < header_count && len < (int)sizeof(head); i++) {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", headers[i].name, headers[i].value);
+    }
+    len += snprintf(head + len, len < (int)sizeof(head) ? sizeof(head) - len : 0, "\r\n");
+    if (len >= (int)sizeof(head)) {
+        ESP_LOGE(TAG, "Response header does not fit in %u bytes", (unsigned)sizeof(head));
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    struct iovec iov = { .iov_base = head, .iov_len = len };
+    esp_err_t res = stream_socket_writev(stream, &iov, 1);
+    stream->bytes = 0;
+    stream->writes = 0;
+    return res;
+}
+
+esp_err_t stream_socket_writev(stream_socket_t *stream, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t sent = lwip_writev(stream->sock, iov, iovcnt);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGD(TAG, "writev failed: errno %d", errno);
+            return ESP_FAIL;
+        }
+        stream->bytes += sent;
+        stream->writes++;
+        // Skip what went out, the rest is sent by the next writev()
+        while (iovcnt > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t stream_socket_write(stream_socket_t *stream, const void *data, size_t len) {
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    return stream_socket_writev(stream, &iov, 1);
+}
+
+esp_err_t stream_socket_set_tos(int sock, uint8_t tos) {
+    int value = tos;
+    if (setsockopt(sock, IPPROTO_IP, IP_TOS, &value, sizeof(value)) != 0) {
+        ESP_LOGW(TAG, "IP_TOS %02x failed: errno %d", tos, errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void stream_socket_end(stream_socket_t *stream) {
+    if (stream->req != NULL && stream->sock >= 0) {
+        httpd_sess_trigger_close(stream->req->handle, stream->sock);
+        stream->sock = -1;
+    }
+}
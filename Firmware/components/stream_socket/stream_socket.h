@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "lwip/sockets.h"
+
+// Lean streaming responses, shared by the arm board and the Eye
+//
+// httpd_resp_send_chunk() wraps every call in chunked transfer framing (a hex
+// length line before and a CRLF after the payload) and sends each piece
+// through the httpd session. A stream that sends several small pieces per
+// frame pays that per piece. Here the handler writes its HTTP response header
+// once, then the body goes straight to the client socket with writev(), so a
+// part header and its payload leave in one call. The response has no length
+// and says Connection: close; closing the socket ends it.
+//
+// Only for async requests (httpd_req_async_handler_begin()) served from their
+// own task: the socket is written without the httpd task's knowledge.
+
+// IP TOS for audio sockets. The ESP-IDF WiFi driver, like most WiFi stacks,
+// takes the WMM user priority of a packet from the top three bits of the TOS
+// byte (the IP precedence), and 6 and 7 are the voice access category: the
+// shortest wait for the air and its own transmit queue, so audio does not sit
+// behind a burst of video from the same station. Precedence 6 is DSCP CS6 (48).
+// EF (46) is precedence 5, which this mapping puts in the video category.
+#define STREAM_SOCKET_TOS_VOICE     0xC0
+
+typedef struct {
+    const char *name;
+    const char *value;
+} stream_socket_header_t;
+
+typedef struct {
+    httpd_req_t *req;
+    int sock;
+    uint64_t bytes;         // body bytes written
+    uint32_t writes;        // writev() calls, partial writes count again
+} stream_socket_t;
+
+// Write "HTTP/1.1 200 OK", the content type and the extra headers to the request's socket
+esp_err_t stream_socket_begin(stream_socket_t *stream, httpd_req_t *req, const char *content_type,
+                              const stream_socket_header_t *headers, size_t header_count);
+
+// Write all of iov, retrying partial writes. iov is used as scratch and comes back modified.
+// Fails when the client went away or the socket send timeout of httpd ran out.
+esp_err_t stream_socket_writev(stream_socket_t *stream, struct iovec *iov, int iovcnt);
+esp_err_t stream_socket_write(stream_socket_t *stream, const void *data, size_t len);
+
+// Set the IP TOS byte of a TCP or UDP socket's packets, ex: STREAM_SOCKET_TOS_VOICE
+esp_err_t stream_socket_set_tos(int sock, uint8_t tos);
+
+// Have httpd close the connection, which ends the response. Call before
+// httpd_req_async_handler_complete(). Does nothing on a zeroed stream that never began.
+void stream_socket_end(stream_socket_t *stream);
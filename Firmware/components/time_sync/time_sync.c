@@ -0,0 +1,125 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "time_sync.h"
+
+_Static_assert(sizeof(time_sync_packet_t) == 36, "packet layout is part of the protocol");
+
+void time_sync_estimator_init(time_sync_estimator_t *e) {
+    uint32_t jumps = e->jumps;
+    memset(e, 0, sizeof(*e));
+    e->jumps = jumps;
+}
+
+// Round trip of the fit_rounds-th fastest round, slower rounds are left out
+static uint32_t rtt_limit(const time_sync_estimator_t *e, int fit_rounds) {
+    uint32_t rtts[TIME_SYNC_ROUNDS];
+    for (int i = 0; i < e->round_count; i++) {
+        // Insertion sort, 32 rounds at most
+        int j = i;
+        for (; j > 0 && rtts[j - 1] > e->rounds[i].rtt_us; j--) {
+            rtts[j] = rtts[j - 1];
+        }
+        rtts[j] = e->rounds[i].rtt_us;
+    }
+    return rtts[(fit_rounds < e->round_count ? fit_rounds : e->round_count) - 1];
+}
+
+// Least squares line through the fastest rounds, with the newest round as the
+// reference point. A round's offset error is bounded by how much slower than
+// the network's fastest its round trip was, so a few fast rounds beat many
+// slow ones.
+static void refit(time_sync_estimator_t *e) {
+    const time_sync_sample_t *newest = &e->rounds[(e->round_next + TIME_SYNC_ROUNDS - 1) % TIME_SYNC_ROUNDS];
+    uint32_t max_rtt = rtt_limit(e, TIME_SYNC_FIT_ROUNDS);
+    uint32_t min_rtt = rtt_limit(e, 1);
+
+    int n = 0;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    const time_sync_sample_t *latest_used = NULL;
+    for (int k = 0; k < e->round_count; k++) {
+        // Oldest to newest, so latest_used ends up as the newest usable round
+        const time_sync_sample_t *r = &e->rounds[(e->round_next + TIME_SYNC_ROUNDS - e->round_count + k) % TIME_SYNC_ROUNDS];
+        if (r->rtt_us > max_rtt) {
+            continue;
+        }
+        double x = (r->local_us - newest->local_us) / 1e6;
+        double y = (double)(r->offset_us - newest->offset_us);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        n++;
+        latest_used = r;
+    }
+
+    double slope = 0.0;     // us per s
+    double intercept;
+    if (n >= TIME_SYNC_MIN_FIT_ROUNDS && n * sxx - sx * sx > 0) {
+        slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+        intercept = (sy - slope * sx) / n;
+    } else {
+        // Too few rounds for a slope, hold the newest usable offset
+        intercept = (double)(latest_used->offset_us - newest->offset_us);
+    }
+
+    double sum_sq = 0;
+    for (int i = 0; i < e->round_count; i++) {
+        const time_sync_sample_t *r = &e->rounds[i];
+        if (r->rtt_us > max_rtt) {
+            continue;
+        }
+        double x = (r->local_us - newest->local_us) / 1e6;
+        double d = (double)(r->offset_us - newest->offset_us) - (intercept + slope * x);
+        sum_sq += d * d;
+    }
+
+    e->map.valid = true;
+    e->map.ref_local_us = newest->local_us;
+    e->map.offset_us = newest->offset_us + (int64_t)llround(intercept);
+    e->map.drift = slope * 1e-6;
+    e->rtt_us = min_rtt;
+    e->residual_us = (uint32_t)sqrt(sum_sq / n);
+    e->fit_rounds = n;
+}
+
+bool time_sync_estimator_add(time_sync_estimator_t *e, int64_t t1_us, int64_t t2_us, int64_t t3_us, int64_t t4_us) {
+    int64_t rtt = (t4_us - t1_us) - (t3_us - t2_us);
+    if (rtt < 0) {
+        return false;
+    }
+    time_sync_sample_t sample = {
+        .local_us = t1_us + (t4_us - t1_us) / 2,
+        .offset_us = ((t2_us - t1_us) + (t3_us - t4_us)) / 2,
+        .rtt_us = rtt > UINT32_MAX ? UINT32_MAX : (uint32_t)rtt,
+    };
+    // A slow exchange may be off by half its round trip, more than that is another clock
+    if (e->map.valid &&
+        llabs(sample.offset_us - (time_sync_map(&e->map, sample.local_us) - sample.local_us)) >
+            TIME_SYNC_JUMP_US + (int64_t)sample.rtt_us / 2) {
+        time_sync_estimator_init(e);
+        e->jumps++;
+    }
+    if (e->round_exchanges == 0 || sample.rtt_us < e->best.rtt_us) {
+        e->best = sample;
+    }
+    if (++e->round_exchanges < TIME_SYNC_ROUND_EXCHANGES) {
+        return false;
+    }
+
+    e->rounds[e->round_next] = e->best;
+    e->round_next = (e->round_next + 1) % TIME_SYNC_ROUNDS;
+    if (e->round_count < TIME_SYNC_ROUNDS) {
+        e->round_count++;
+    }
+    e->round_exchanges = 0;
+    refit(e);
+    return true;
+}
+
+int64_t time_sync_map(const time_sync_mapping_t *map, int64_t local_us) {
+    if (!map->valid) {
+        return local_us;
+    }
+    return local_us + map->offset_us + (int64_t)llround(map->drift * (double)(local_us - map->ref_local_us));
+}
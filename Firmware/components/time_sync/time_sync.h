@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Two-way time synchronization over UDP, the Eye is the master
+//
+// A client sends a request stamped with its own time t1. The master stamps the
+// arrival t2 and the reply t3 on its clock, and the client stamps the reply's
+// arrival t4. As in PTP, with symmetric paths
+//   offset = ((t2 - t1) + (t3 - t4)) / 2      master minus client
+//   rtt    = (t4 - t1) - (t3 - t2)
+// and an asymmetric delay shifts the offset by at most rtt / 2. The client keeps
+// the fastest exchange out of every TIME_SYNC_ROUND_EXCHANGES, and fits a line
+// through the TIME_SYNC_FIT_ROUNDS fastest of the last TIME_SYNC_ROUNDS for
+// offset and drift.
+// An exchange whose offset is more than TIME_SYNC_JUMP_US (plus half its round
+// trip) off the fitted line means the master restarted or its clock was set.
+// The history then describes another clock, so the estimator starts over.
+//
+// The packet and the estimator are plain C, the boards' tasks are in
+// time_sync_net.h. The host client in Software/Streaming/time_sync.py
+// implements the same.
+
+#define TIME_SYNC_PORT              5007
+#define TIME_SYNC_MAGIC             "IRTS"
+#define TIME_SYNC_VERSION           1
+#define TIME_SYNC_INTERVAL_MS       125     // between two exchanges
+#define TIME_SYNC_ROUND_EXCHANGES   8       // one round per second
+#define TIME_SYNC_ROUNDS            32      // rounds kept for the fit
+#define TIME_SYNC_FIT_ROUNDS        8       // fastest rounds in the fit
+#define TIME_SYNC_MIN_FIT_ROUNDS    4       // fewer rounds: offset of the newest round, no drift
+#define TIME_SYNC_JUMP_US           20000   // offset change that restarts the estimator
+
+typedef enum {
+    TIME_SYNC_REQUEST = 1,
+    TIME_SYNC_RESPONSE = 2,
+} time_sync_type_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];          // TIME_SYNC_MAGIC
+    uint8_t version;
+    uint8_t type;           // time_sync_type_t
+    uint16_t reserved;
+    uint32_t seq;           // chosen by the client, echoed
+    int64_t t1_us;          // client clock, echoed
+    int64_t t2_us;          // master clock, request received
+    int64_t t3_us;          // master clock, response sent
+} time_sync_packet_t;
+
+typedef struct {
+    int64_t local_us;       // client time halfway through the exchange
+    int64_t offset_us;      // master minus client
+    uint32_t rtt_us;        // network round trip, without the time spent on the master
+} time_sync_sample_t;
+
+// master = local + offset_us + drift * (local - ref_local_us)
+typedef struct {
+    bool valid;
+    int64_t ref_local_us;
+    int64_t offset_us;
+    double drift;           // 40e-6: the master clock runs 40 ppm faster
+} time_sync_mapping_t;
+
+typedef struct {
+    time_sync_sample_t best;        // fastest exchange of the current round
+    uint8_t round_exchanges;
+    time_sync_sample_t rounds[TIME_SYNC_ROUNDS];
+    uint8_t round_count;
+    uint8_t round_next;
+    time_sync_mapping_t map;
+    uint32_t rtt_us;        // fastest round trip in the fit, the offset is good to half of it
+    uint32_t residual_us;   // rms distance of the rounds used from the fit
+    uint8_t fit_rounds;     // rounds used, slow ones are left out
+    uint32_t jumps;         // restarts after the offset jumped, kept by time_sync_estimator_init()
+} time_sync_estimator_t;
+
+void time_sync_estimator_init(time_sync_estimator_t *e);
+
+// Add one completed exchange. Returns true when a round completed and the
+// mapping was refitted. An exchange far off the mapping starts the estimator
+// over, with that exchange as the first.
+bool time_sync_estimator_add(time_sync_estimator_t *e, int64_t t1_us, int64_t t2_us, int64_t t3_us, int64_t t4_us);
+
+// Client time to master time, unchanged until the first round completed
+int64_t time_sync_map(const time_sync_mapping_t *map, int64_t local_us);
@@ -0,0 +1,213 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "time_sync_net.h"
+
+static const char *TAG = "time_sync";
+
+#define TIME_SYNC_TASK_STACK        3072
+#define TIME_SYNC_TASK_PRIORITY     (tskIDLE_PRIORITY + 7)  // above the streams, timestamps are taken in this task
+#define TIME_SYNC_RESPONSE_MS       100     // a response later than this is not waited for
+#define TIME_SYNC_RETRY_MS          1000    // socket errors, ex: no network yet
+
+typedef struct {
+    bool master;
+    uint16_t port;
+    struct sockaddr_in master_addr;
+} time_sync_config_t;
+
+static time_sync_config_t config;
+
+// Published mapping and statistics, guarded by lock
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static time_sync_mapping_t mapping;
+static time_sync_stats_t stats;
+
+static int open_socket(uint16_t bind_port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(bind_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool packet_valid(const time_sync_packet_t *packet, int len, time_sync_type_t type) {
+    return len == sizeof(*packet) && memcmp(packet->magic, TIME_SYNC_MAGIC, 4) == 0 &&
+           packet->version == TIME_SYNC_VERSION && packet->type == type;
+}
+
+// Answers every request right away. t2 is taken as soon as recvfrom returns
+// and t3 just before sendto, so the time on the master drops out of the rtt.
+static void master_task(void *arg) {
+    time_sync_packet_t packet;
+    struct sockaddr_in from;
+    socklen_t from_len;
+
+    while (true) {
+        int sock = open_socket(config.port);
+        if (sock < 0) {
+            ESP_LOGE(TAG, "Master: no socket on port %u", config.port);
+            vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_RETRY_MS));
+            continue;
+        }
+        ESP_LOGI(TAG, "Master on UDP port %u", config.port);
+        while (true) {
+            from_len = sizeof(from);
+            int len = recvfrom(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+            int64_t t2_us = esp_timer_get_time();
+            if (len < 0) {
+                break;
+            }
+            if (!packet_valid(&packet, len, TIME_SYNC_REQUEST)) {
+                continue;
+            }
+            packet.type = TIME_SYNC_RESPONSE;
+            packet.t2_us = t2_us;
+            packet.t3_us = esp_timer_get_time();
+            if (sendto(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&from, from_len) == sizeof(packet)) {
+                taskENTER_CRITICAL(&lock);
+                stats.exchanges++;
+                taskEXIT_CRITICAL(&lock);
+            }
+        }
+        ESP_LOGW(TAG, "Master socket failed, reopening");
+        close(sock);
+    }
+}
+
+// One exchange every TIME_SYNC_INTERVAL_MS. Responses to earlier requests
+// that arrive late are recognized by their sequence number and dropped.
+static void client_task(void *arg) {
+    static time_sync_estimator_t estimator;     // the round history is too big for the stack
+    time_sync_packet_t request = {
+        .magic = TIME_SYNC_MAGIC,
+        .version = TIME_SYNC_VERSION,
+        .type = TIME_SYNC_REQUEST,
+    };
+    time_sync_packet_t response;
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = TIME_SYNC_RESPONSE_MS * 1000 };
+    uint32_t seq = 0;
+
+    while (true) {
+        // The socket failed, ex: the link was lost. Start over rather than fit
+        // the new exchanges onto rounds from before.
+        time_sync_estimator_init(&estimator);
+        int sock = open_socket(0);
+        if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+            if (sock >= 0) {
+                close(sock);
+            }
+            vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_RETRY_MS));
+            continue;
+        }
+        TickType_t wake = xTaskGetTickCount();
+        while (true) {
+            request.seq = ++seq;
+            request.t1_us = esp_timer_get_time();
+            if (sendto(sock, &request, sizeof(request), 0, (struct sockaddr *)&config.master_addr,
+                       sizeof(config.master_addr)) != sizeof(request)) {
+                break;
+            }
+            bool answered = false;
+            int64_t t4_us = 0;
+            while (!answered) {
+                int len = recv(sock, &response, sizeof(response), 0);
+                t4_us = esp_timer_get_time();
+                if (len < 0) {
+                    break;
+                }
+                answered = packet_valid(&response, len, TIME_SYNC_RESPONSE) && response.seq == seq &&
+                           response.t1_us == request.t1_us;
+            }
+
+            if (answered) {
+                uint32_t jumps = estimator.jumps;
+                bool fitted = time_sync_estimator_add(&estimator, response.t1_us, response.t2_us, response.t3_us, t4_us);
+                if (estimator.jumps != jumps) {
+                    ESP_LOGW(TAG, "Master clock jumped, synchronizing again");
+                }
+                taskENTER_CRITICAL(&lock);
+                stats.exchanges++;
+                stats.jumps = estimator.jumps;
+                if (fitted) {
+                    mapping = estimator.map;
+                    stats.synced = true;
+                    stats.offset_us = estimator.map.offset_us;
+                    stats.drift_ppm = (float)(estimator.map.drift * 1e6);
+                    stats.rtt_us = estimator.rtt_us;
+                    stats.residual_us = estimator.residual_us;
+                    stats.last_fit_us = estimator.map.ref_local_us;
+                }
+                taskEXIT_CRITICAL(&lock);
+                if (fitted && estimator.round_count == 1) {
+                    ESP_LOGI(TAG, "Synchronized, offset %lld us, rtt %lu us", (long long)estimator.map.offset_us,
+                             (unsigned long)estimator.rtt_us);
+                }
+            } else {
+                taskENTER_CRITICAL(&lock);
+                stats.timeouts++;
+                taskEXIT_CRITICAL(&lock);
+            }
+            vTaskDelayUntil(&wake, pdMS_TO_TICKS(TIME_SYNC_INTERVAL_MS));
+        }
+        close(sock);
+        vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_RETRY_MS));
+    }
+}
+
+esp_err_t time_sync_master_start(uint16_t port) {
+    config.master = true;
+    config.port = port;
+    stats.master = true;
+    stats.synced = true;    // the master's clock is the reference
+    if (xTaskCreate(master_task, "time_sync", TIME_SYNC_TASK_STACK, NULL, TIME_SYNC_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t time_sync_client_start(const char *master_ip, uint16_t port) {
+    config.master = false;
+    config.port = port;
+    config.master_addr.sin_family = AF_INET;
+    config.master_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, master_ip, &config.master_addr.sin_addr) != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xTaskCreate(client_task, "time_sync", TIME_SYNC_TASK_STACK, NULL, TIME_SYNC_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int64_t time_sync_to_master(int64_t local_us) {
+    if (config.master) {
+        return local_us;
+    }
+    taskENTER_CRITICAL(&lock);
+    time_sync_mapping_t map = mapping;
+    taskEXIT_CRITICAL(&lock);
+    return time_sync_map(&map, local_us);
+}
+
+bool time_sync_synced(void) {
+    return stats.synced;
+}
+
+void time_sync_get_stats(time_sync_stats_t *out) {
+    taskENTER_CRITICAL(&lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&lock);
+}
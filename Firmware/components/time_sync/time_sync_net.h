@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "time_sync.h"
+
+// Synchronization tasks of the boards, see time_sync.h for the protocol. The
+// Eye runs the master, the arm boards a client each.
+typedef struct {
+    bool master;
+    bool synced;
+    uint32_t exchanges;     // client: completed, master: answered
+    uint32_t timeouts;      // client: requests without a response in time
+    uint32_t jumps;         // client: restarts after the master's clock jumped
+    int64_t offset_us;      // master minus local at the last fit
+    float drift_ppm;
+    uint32_t rtt_us;
+    uint32_t residual_us;
+    int64_t last_fit_us;    // local time of the last fit
+} time_sync_stats_t;
+
+// Both start a task and return right away
+esp_err_t time_sync_master_start(uint16_t port);
+esp_err_t time_sync_client_start(const char *master_ip, uint16_t port);
+
+// Local esp_timer time to the master's clock, unchanged until synchronized. On
+// the master it is the identity.
+int64_t time_sync_to_master(int64_t local_us);
+bool time_sync_synced(void);
+void time_sync_get_stats(time_sync_stats_t *stats);
@@ -8,6 +8,9 @@ import requests
 import os
 import sys
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Streaming"))
+from audio_blocks import ResumingStream
+
 class AudioProcessor:
     transcription = "" #most recent transcription result
     def __init__(self):
@@ -17,8 +20,10 @@ class AudioProcessor:
         self.CHANNELS = 2
         self.BUFFER_SIZE = self.SAMPLE_RATE * self.BUFFER_DURATION
         
-        # ESP32 settings
-        self.ESP32_URL = "http://192.168.4.1/ach1"
+        # ESP32 settings, only the two left arm microphones are requested from the arm board.
+        # Framed, so that after a dropped connection the board can replay what was missed.
+        self.ESP32_URL = "http://192.168.4.254/ach1?ch=0,1&framed=1"
+        self.stream = None
         
         # Separate buffers for left and right channels
         self.audio_buffer_left = []
@@ -91,58 +96,13 @@ class AudioProcessor:
     def stop(self):
         """Stop audio processing"""
         self.running = False
+        if self.stream:
+            self.stream.close()
         if hasattr(self, 'receiver_thread'):
             self.receiver_thread.join()
         if hasattr(self, 'process_thread'):
             self.process_thread.join()
 
-    def receive_audio(self):
-        """Receive audio data from ESP32 via HTTP"""
-        print(f"Starting to receive audio from {self.ESP32_URL}")
-        
-        while self.running:
-            try:
-                # Stream the audio data
-                response = requests.get(self.ESP32_URL, stream=True)
-                print("Connected to audio stream")
-                
-                for chunk in response.iter_content(chunk_size=4096):
-                    if not self.running:
-                        break
-                        
-                    if chunk:
-                        # Convert bytes to numpy array of 16-bit integers
-                        samples = np.frombuffer(chunk, dtype=np.int16)
-                        
-                        # Debug print first few samples
-                        #if len(samples) > 0:
-                        #    print(f"Received {len(samples)} samples. First few samples: {samples[:10]}")
-                        
-                        # Separate channels (even indices = left, odd indices = right)
-                        left_channel = samples[::2]
-                        right_channel = samples[1::2]
-                        
-                        self.audio_buffer_left.extend(left_channel)
-                        self.audio_buffer_right.extend(right_channel)
-                        
-                        # If buffers are full, queue them for processing
-                        if len(self.audio_buffer_left) >= self.BUFFER_SIZE:
-                            audio_chunk = {
-                                'left': np.array(self.audio_buffer_left[:self.BUFFER_SIZE]),
-                                'right': np.array(self.audio_buffer_right[:self.BUFFER_SIZE])
-                            }
-                            self.audio_queue.put(audio_chunk)
-                            
-                            # Clear processed data from buffers
-                            self.audio_buffer_left = self.audio_buffer_left[self.BUFFER_SIZE:]
-                            self.audio_buffer_right = self.audio_buffer_right[self.BUFFER_SIZE:]
-                            
-            except requests.exceptions.RequestException as e:
-                print(f"Connection error: {e}")
-                print("Attempting to reconnect in 1 second...")
-                time.sleep(1)
-                continue
-
     def process_audio_chunk(self, audio_chunk):
         """Process a chunk of stereo audio with Whisper"""
         # Convert to float32 normalized between -1 and 1
@@ -186,69 +146,35 @@ class AudioProcessor:
             print(f"Test failed: {type(e).__name__} - {str(e)}")
             return False
 
-    def start_streaming(self):
-        """Establish the main streaming connection"""
-        print("Starting audio stream...")
-        try:
-            response = requests.get(self.ESP32_URL, stream=True)
-            print("Connected to audio stream")
-            print("Stream headers:")
-            for header, value in response.headers.items():
-                print(f"  {header}: {value}")
-            return response
-        except Exception as e:
-            print(f"Failed to start stream: {e}")
-            return None
-
     def receive_audio(self):
         """Receive audio data from ESP32 via HTTP"""
         print(f"Starting to receive audio from {self.ESP32_URL}")
+        # Reconnects by itself, and the board replays the audio captured in the meantime,
+        # so a WiFi hiccup does not cut words in half
+        self.stream = ResumingStream(self.ESP32_URL)
+        self.stream.on_reconnect = lambda replay: print(f"Reconnected to audio stream, {replay} blocks replayed")
         
-        while self.running:
-            try:
-                # Establish streaming connection
-                response = self.start_streaming()
-                if not response:
-                    print("Failed to connect, retrying in 1 second...")
-                    time.sleep(1)
-                    continue
-                    
-                for chunk in response.iter_content(chunk_size=4096):
-                    if not self.running:
-                        break
-                        
-                    if chunk:
-                        # Process chunk as before...
-                        samples = np.frombuffer(chunk, dtype=np.int16)
-                        
-                        # Debug print first few samples
-                        #if len(samples) > 0:
-                        #    print(f"Received {len(samples)} samples. First few samples: {samples[:10]}")
-                        
-                        # Separate channels (even indices = left, odd indices = right)
-                        left_channel = samples[::2]
-                        right_channel = samples[1::2]
-                        
-                        self.audio_buffer_left.extend(left_channel)
-                        self.audio_buffer_right.extend(right_channel)
-                        
-                        # If buffers are full, queue them for processing
-                        if len(self.audio_buffer_left) >= self.BUFFER_SIZE:
-                            audio_chunk = {
-                                'left': np.array(self.audio_buffer_left[:self.BUFFER_SIZE]),
-                                'right': np.array(self.audio_buffer_right[:self.BUFFER_SIZE])
-                            }
-                            self.audio_queue.put(audio_chunk)
-                            
-                            # Clear processed data from buffers
-                            self.audio_buffer_left = self.audio_buffer_left[self.BUFFER_SIZE:]
-                            self.audio_buffer_right = self.audio_buffer_right[self.BUFFER_SIZE:]
-                            
-            except requests.exceptions.RequestException as e:
-                print(f"Connection error: {e}")
-                print("Attempting to reconnect in 1 second...")
-                time.sleep(1)
-                continue
+        for block in self.stream:
+            if not self.running:
+                break
+            
+            # Columns are the requested channels (0 = left back, 1 = left front)
+            self.audio_buffer_left.extend(block.samples[:, 0])
+            self.audio_buffer_right.extend(block.samples[:, 1])
+            
+            # If buffers are full, queue them for processing
+            if len(self.audio_buffer_left) >= self.BUFFER_SIZE:
+                audio_chunk = {
+                    'left': np.array(self.audio_buffer_left[:self.BUFFER_SIZE]),
+                    'right': np.array(self.audio_buffer_right[:self.BUFFER_SIZE])
+                }
+                self.audio_queue.put(audio_chunk)
+                
+                # Clear processed data from buffers
+                self.audio_buffer_left = self.audio_buffer_left[self.BUFFER_SIZE:]
+                self.audio_buffer_right = self.audio_buffer_right[self.BUFFER_SIZE:]
+        if self.stream.lost_blocks:
+            print(f"{self.stream.lost_blocks * 5} ms of audio were lost across {self.stream.reconnects} reconnects")
 
 def main():
     print("Initializing AudioProcessor()")
@@ -1,4 +1,5 @@
 import os
+import sys
 import requests
 import cv2
 import AudioCapture
@@ -7,6 +8,10 @@ import numpy as np
 from zipfile import ZipFile
 from urllib.request import urlretrieve
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Streaming"))
+from faces import FaceTracker
+from mjpeg_stream import read_parts
+
 # ========================-Downloading Assets-========================
 def download_and_unzip(url, save_path):
     print(f"Downloading and extracting assets....", end="")
@@ -29,6 +34,9 @@ if not os.path.exists(asset_zip_path):
 # URL of the ESP32-S3-EYE MJPEG stream
 url = 'http://192.168.4.1/stream'  # Replace with your actual MJPEG stream URL
 
+# Take the face boxes from the Eye's detector (/faces) instead of running the SSD on every frame here
+EYE_FACES = True
+
 # Function to display JPEG images from an MJPEG stream
 def display_mjpeg_stream(url):
     # Open a connection to the stream
@@ -38,11 +46,9 @@ def display_mjpeg_stream(url):
         print("Failed to retrieve video stream. Status code:", stream.status_code)
         return
 
-    # Initialize an empty byte array to accumulate JPEG data
-    byte_data = bytes()
-
-    # Load the face detection model
-    net = cv2.dnn.readNetFromCaffe("deploy.prototxt", "res10_300x300_ssd_iter_140000_fp16.caffemodel")
+    # Load the face detection model, or follow the boxes the Eye finds
+    tracker = FaceTracker().start() if EYE_FACES else None
+    net = None if EYE_FACES else cv2.dnn.readNetFromCaffe("deploy.prototxt", "res10_300x300_ssd_iter_140000_fp16.caffemodel")
     # Model parameters
     in_width = 300
     in_height = 300
@@ -61,140 +67,147 @@ def display_mjpeg_stream(url):
     win_name = "Camera Preview"
     cv2.namedWindow(win_name, cv2.WINDOW_NORMAL)
 
-    # Process the stream to display frames
-    for chunk in stream.iter_content(chunk_size=1024):
-        byte_data += chunk
-        #print(f"Received chunk of size: {len(chunk)} bytes")  # Debugging line
-
-        # Look for JPEG frame boundaries in the stream
-        a = byte_data.find(b'\xff\xd8')  # Start of JPEG
-        b = byte_data.find(b'\xff\xd9')  # End of JPEG
-
-        if a != -1 and b != -1:
-            # Extract the JPEG image data from the byte stream
-            jpg_data = byte_data[a:b + 2]
-            byte_data = byte_data[b + 2:]
-
-            # Check if the extracted JPEG data is valid (non-empty)
-            if len(jpg_data) > 0:
-                # Decode the JPEG image into an OpenCV-compatible format
-                img_array = np.frombuffer(jpg_data, dtype=np.uint8)
-                frame = cv2.imdecode(img_array, cv2.IMREAD_COLOR)
-
-                # Perform face detection
-                if frame is not None:
-                    frame = cv2.flip(frame, 1)
-                    frame_height = frame.shape[0]
-                    frame_width = frame.shape[1]
-
+    # Process the stream part by part, every part says which camera frame it carries
+    for part in read_parts(stream.raw):
+        jpg_data = part.jpeg
+
+        # Check if the extracted JPEG data is valid (non-empty)
+        if len(jpg_data) > 0:
+            # Decode the JPEG image into an OpenCV-compatible format
+            img_array = np.frombuffer(jpg_data, dtype=np.uint8)
+            frame = cv2.imdecode(img_array, cv2.IMREAD_COLOR)
+
+            # Perform face detection
+            if frame is not None:
+                frame = cv2.flip(frame, 1)
+                frame_height = frame.shape[0]
+                frame_width = frame.shape[1]
+
+                faces = []  # (confidence, left, top, right, bottom) in the mirrored frame
+                if EYE_FACES:
+                    # The boxes the Eye had for this frame, not newer ones
+                    result = tracker.at(part.seq)
+                    if result is not None:
+                        sx = frame_width / result["width"]
+                        sy = frame_height / result["height"]
+                        for face in result["faces"]:
+                            # The Eye's boxes are on the camera frame, this one is mirrored
+                            left = frame_width - int((face["x"] + face["w"]) * sx)
+                            faces.append((face["score"], left, int(face["y"] * sy),
+                                          left + int(face["w"] * sx), int((face["y"] + face["h"]) * sy)))
+                else:
                     # Create a 4D blob from a frame
                     blob = cv2.dnn.blobFromImage(frame, 1.0, (in_width, in_height), mean, swapRB=False, crop=False)
                     net.setInput(blob)
                     detections = net.forward()
-
-                    face_detected = False  # Variable to check if a face is detected
-
-                    # Process face detection
                     for i in range(detections.shape[2]):
                         confidence = detections[0, 0, i, 2]
                         if confidence > conf_threshold:
-                            face_detected = True  # Mark that a face is detected
-                            x_left_bottom = int(detections[0, 0, i, 3] * frame_width)
-                            y_left_bottom = int(detections[0, 0, i, 4] * frame_height)
-                            x_right_top = int(detections[0, 0, i, 5] * frame_width)
-                            y_right_top = int(detections[0, 0, i, 6] * frame_height)
-
-                            cv2.rectangle(frame, (x_left_bottom, y_left_bottom), (x_right_top, y_right_top), (0, 255, 0))
-                            label = "Confidence: %.4f" % confidence
-                            label_size, base_line = cv2.getTextSize(label, cv2.FONT_HERSHEY_SIMPLEX, 0.5, 1)
-
-                            cv2.rectangle(
-                                frame,
-                                (x_left_bottom, y_left_bottom - label_size[1]),
-                                (x_left_bottom + label_size[0], y_left_bottom + base_line),
-                                (255, 255, 255),
-                                cv2.FILLED,
-                            )
-                            cv2.putText(frame, label, (x_left_bottom, y_left_bottom), cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 0, 0))
-
-                            # Perform lip detection
-                            face_region = frame[y_left_bottom:y_right_top, x_left_bottom:x_right_top]
-                            if face_region.size > 0:
-                                gray_face = cv2.cvtColor(face_region, cv2.COLOR_BGR2GRAY)
-                                lip_region = gray_face[int(face_region.shape[0] * 0.5):, :]  # Focus on lower half of the face
-                                lips = lip_cascade.detectMultiScale(lip_region, scaleFactor=1.3, minNeighbors=5, minSize=(20, 10))
-
-                                for (lx, ly, lw, lh) in lips:
-                                    if lh > 10:  # Ensure lip height is above a threshold
-                                        cv2.rectangle(frame,
-                                                      (x_left_bottom + lx, y_left_bottom + ly + int(face_region.shape[0] * 0.5)),
-                                                      (x_left_bottom + lx + lw, y_left_bottom + ly + int(face_region.shape[0] * 0.5) + lh),
-                                                      (255, 0, 0), 2)
-
-                                        upper_lip_y = y_left_bottom + ly + int(face_region.shape[0] * 0.5)
-                                        lower_lip_y = upper_lip_y + lh
-
-                                        # Detect lip movement
-                                        if prev_upper_lip_y is not None and prev_lower_lip_y is not None:
-                                            lip_movement = abs(upper_lip_y - prev_upper_lip_y) + abs(lower_lip_y - prev_lower_lip_y)
-
-                                            if lip_movement > lip_movement_threshold and lip_movement < 10:
-                                                movement_count += 1
-                                                print(f"Lips Moving (possible speech) - Count: {movement_count}")
-
-                                        prev_upper_lip_y = upper_lip_y
-                                        prev_lower_lip_y = lower_lip_y
-
-                            # Draw the rectangle below the face
-                            offset_x = int((x_right_top - x_left_bottom) * 0.15)
-                            offset_y = int((y_right_top - y_left_bottom) * 0.1)
-                            rect_width = int((x_right_top - x_left_bottom) * 0.8)
-                            rect_height = int((y_right_top - y_left_bottom) * 0.2)
-
-                            rect_top_left = (x_left_bottom + offset_x, y_right_top + offset_y)
-                            rect_bottom_right = (rect_top_left[0] + rect_width, rect_top_left[1] + rect_height)
-
-                            cv2.rectangle(frame, rect_top_left, rect_bottom_right, (0, 0, 255), 2)
-
-
-                    if not face_detected:
-                        # Rectangle parameters at the bottom of the screen
-                        rect_width = int(frame_width * 0.8)  # Width relative to screen width
-                        rect_height = int(frame_height * 0.1)  # Height relative to screen height
-                        rect_top_left = (int(frame_width * 0.1), frame_height - rect_height - 10)  # 10px margin from the bottom
-                        rect_bottom_right = (rect_top_left[0] + rect_width, frame_height - 10)
-
-                        # Draw the rectangle at the bottom
-                        cv2.rectangle(frame, rect_top_left, rect_bottom_right, (0, 0, 255), 2)
-
-                        # Optional: You can also add text inside the rectangle
-                        
-                        if AudioCapture.AudioProcessor.transcription.strip():
-                            text = AudioCapture.AudioProcessor.transcription
-                        else:
-                            text = "No face no transcribed audio"
-                        
-                        text_size, _ = cv2.getTextSize(text, cv2.FONT_HERSHEY_SIMPLEX, 0.7, 2)
-                        text_x = rect_top_left[0] + (rect_width - text_size[0]) // 2  # Center the text
-                        text_y = rect_top_left[1] + (rect_height + text_size[1]) // 2  # Center vertically
-                        cv2.putText(frame, text, (text_x, text_y), cv2.FONT_HERSHEY_SIMPLEX, 0.7, (255, 255, 255), 2)
-                                
-
-                    # Display inference time
+                            faces.append((confidence,
+                                          int(detections[0, 0, i, 3] * frame_width),
+                                          int(detections[0, 0, i, 4] * frame_height),
+                                          int(detections[0, 0, i, 5] * frame_width),
+                                          int(detections[0, 0, i, 6] * frame_height)))
+
+                face_detected = False  # Variable to check if a face is detected
+
+                # Process face detection
+                for confidence, x_left_bottom, y_left_bottom, x_right_top, y_right_top in faces:
+                    face_detected = True  # Mark that a face is detected
+
+                    cv2.rectangle(frame, (x_left_bottom, y_left_bottom), (x_right_top, y_right_top), (0, 255, 0))
+                    label = "Confidence: %.4f" % confidence
+                    label_size, base_line = cv2.getTextSize(label, cv2.FONT_HERSHEY_SIMPLEX, 0.5, 1)
+
+                    cv2.rectangle(
+                        frame,
+                        (x_left_bottom, y_left_bottom - label_size[1]),
+                        (x_left_bottom + label_size[0], y_left_bottom + base_line),
+                        (255, 255, 255),
+                        cv2.FILLED,
+                    )
+                    cv2.putText(frame, label, (x_left_bottom, y_left_bottom), cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 0, 0))
+
+                    # Perform lip detection
+                    face_region = frame[y_left_bottom:y_right_top, x_left_bottom:x_right_top]
+                    if face_region.size > 0:
+                        gray_face = cv2.cvtColor(face_region, cv2.COLOR_BGR2GRAY)
+                        lip_region = gray_face[int(face_region.shape[0] * 0.5):, :]  # Focus on lower half of the face
+                        lips = lip_cascade.detectMultiScale(lip_region, scaleFactor=1.3, minNeighbors=5, minSize=(20, 10))
+
+                        for (lx, ly, lw, lh) in lips:
+                            if lh > 10:  # Ensure lip height is above a threshold
+                                cv2.rectangle(frame,
+                                              (x_left_bottom + lx, y_left_bottom + ly + int(face_region.shape[0] * 0.5)),
+                                              (x_left_bottom + lx + lw, y_left_bottom + ly + int(face_region.shape[0] * 0.5) + lh),
+                                              (255, 0, 0), 2)
+
+                                upper_lip_y = y_left_bottom + ly + int(face_region.shape[0] * 0.5)
+                                lower_lip_y = upper_lip_y + lh
+
+                                # Detect lip movement
+                                if prev_upper_lip_y is not None and prev_lower_lip_y is not None:
+                                    lip_movement = abs(upper_lip_y - prev_upper_lip_y) + abs(lower_lip_y - prev_lower_lip_y)
+
+                                    if lip_movement > lip_movement_threshold and lip_movement < 10:
+                                        movement_count += 1
+                                        print(f"Lips Moving (possible speech) - Count: {movement_count}")
+
+                                prev_upper_lip_y = upper_lip_y
+                                prev_lower_lip_y = lower_lip_y
+
+                    # Draw the rectangle below the face
+                    offset_x = int((x_right_top - x_left_bottom) * 0.15)
+                    offset_y = int((y_right_top - y_left_bottom) * 0.1)
+                    rect_width = int((x_right_top - x_left_bottom) * 0.8)
+                    rect_height = int((y_right_top - y_left_bottom) * 0.2)
+
+                    rect_top_left = (x_left_bottom + offset_x, y_right_top + offset_y)
+                    rect_bottom_right = (rect_top_left[0] + rect_width, rect_top_left[1] + rect_height)
+
+                    cv2.rectangle(frame, rect_top_left, rect_bottom_right, (0, 0, 255), 2)
+
+
+                if not face_detected:
+                    # Rectangle parameters at the bottom of the screen
+                    rect_width = int(frame_width * 0.8)  # Width relative to screen width
+                    rect_height = int(frame_height * 0.1)  # Height relative to screen height
+                    rect_top_left = (int(frame_width * 0.1), frame_height - rect_height - 10)  # 10px margin from the bottom
+                    rect_bottom_right = (rect_top_left[0] + rect_width, frame_height - 10)
+
+                    # Draw the rectangle at the bottom
+                    cv2.rectangle(frame, rect_top_left, rect_bottom_right, (0, 0, 255), 2)
+
+                    # Optional: You can also add text inside the rectangle
+                    
+                    if AudioCapture.AudioProcessor.transcription.strip():
+                        text = AudioCapture.AudioProcessor.transcription
+                    else:
+                        text = "No face no transcribed audio"
+                    
+                    text_size, _ = cv2.getTextSize(text, cv2.FONT_HERSHEY_SIMPLEX, 0.7, 2)
+                    text_x = rect_top_left[0] + (rect_width - text_size[0]) // 2  # Center the text
+                    text_y = rect_top_left[1] + (rect_height + text_size[1]) // 2  # Center vertically
+                    cv2.putText(frame, text, (text_x, text_y), cv2.FONT_HERSHEY_SIMPLEX, 0.7, (255, 255, 255), 2)
+                            
+
+                # Display inference time
+                if EYE_FACES:
+                    detect_ms = tracker.latest["detect_us"] / 1000 if tracker.latest else 0
+                    label = "Inference time on the Eye: %.0f ms" % detect_ms
+                else:
                     t, _ = net.getPerfProfile()
                     label = "Inference time: %.2f ms" % (t * 1000.0 / cv2.getTickFrequency())
-                    cv2.putText(frame, label, (0, 15), cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 255, 0))
+                cv2.putText(frame, label, (0, 15), cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 255, 0))
 
-                    # Show the frame
-                    cv2.imshow(win_name, frame)
+                # Show the frame
+                cv2.imshow(win_name, frame)
 
-                    # Press 'q' to exit the display loop
-                    if cv2.waitKey(1) & 0xFF == ord('q'):
-                        break
-            #else:
-                #print("Failed to decode frame")
+                # Press 'q' to exit the display loop
+                if cv2.waitKey(1) & 0xFF == ord('q'):
+                    break
         #else:
-            #print("Incomplete JPEG frame")
+            #print("Failed to decode frame")
 
     # Close the OpenCV display window
     cv2.destroyAllWindows()
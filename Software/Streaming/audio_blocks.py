@@ -0,0 +1,1071 @@
+# Reader for the framed arm board audio stream, /ach1?framed=1
+#
+# Every chunk starts with a 50-byte block header (audio_block_header_t in
+# main/audio_levels.h) carrying the block sequence number, the capture time and
+# per-channel peak / RMS / clip counts and the capture-to-socket latency the
+# board measured for the chunk, followed by the interleaved samples.
+# With /ach1?ch=... only the requested microphones are in the samples (see
+# channel_map); the levels always cover all four.
+# The sequence number counts 5 ms capture blocks (BLOCK_FRAMES frames), so a
+# chunk whose seq is not the previous seq plus its frames / BLOCK_FRAMES
+# follows audio the board skipped for a slow client.
+# The levels let the host gate silent channels and spot dead or saturated
+# microphones without touching the samples.
+# With /ach1?adapt=1 the board lowers the format while the host falls behind
+# (main/audio_ladder.h): 16 kHz, two channels, one beamformed channel, then
+# 8-bit mu-law. Every chunk's flags and channel fields say its format, and
+# AudioBlock decodes it, so block.samples is always int16 at block.rate.
+# The board keeps the last seconds of audio in PSRAM. ResumingStream
+# reconnects after a dropped connection with /ach1?from_seq= and the board
+# replays what was missed, so a short WiFi outage loses nothing. When the
+# board restarted in between it says so with a new X-Audio-Boot-Id and the
+# stream starts over.
+#
+# `python audio_blocks.py` prints the levels of every block as they arrive.
+# `python audio_blocks.py selftest` compiles the board's audio ring
+# (main/audio_ring.c) with the host C compiler, with threads standing in for
+# the FreeRTOS tasks, and runs a producer against four subscribers, then
+# resumes from the replay ring. ResumingStream runs against a local fake board
+# that cuts and stalls its connections and restarts. It also
+# builds the quality ladder (main/audio_ladder.c) and checks its resampler,
+# rung changes and mu-law, and the chunks of every rung as read here, and
+# runs its controller against a link that drops and recovers.
+
+import argparse
+import http.server
+import io
+import math
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+from pathlib import Path
+
+import numpy as np
+import requests
+import urllib3
+
+ESP32_IP = "192.168.4.254"  # IP address of the ESP32 (4-mic array)
+
+SOFTWARE = Path(__file__).resolve().parents[1]
+FIRMWARE_MAIN = SOFTWARE.parent / "Firmware" / "Arm Board" / "ESP32_Arm_Boards_Station" / "main"
+BLOCK_FRAMES = 120  # AUDIO_RING_BLOCK_FRAMES in main/audio_ring.h
+FLAG_CONCEALED = 0x01   # set by the Eye's /av when samples lost over ESP-NOW were filled in
+FLAG_SYNCED = 0x02      # timestamp_us is on the Eye's clock (time_sync.py), else on the arm board's
+FLAG_16K = 0x04         # 16 kHz, 80 frames per capture block
+FLAG_BEAM = 0x08        # one channel, the mix of the channel_map microphones
+FLAG_MULAW = 0x10       # 8-bit G.711 mu-law
+RATE = 24000
+
+HEADER = struct.Struct("<4sIqHBBBB" + "HHH" * 4 + "I")
+MAGIC = b"IRLA"
+
+
+def _mulaw_table():
+    u = ~np.arange(256) & 0xFF
+    magnitude = (((u & 0x0F) << 3) + 0x84 << ((u >> 4) & 7)) - 0x84
+    return np.where(u & 0x80, -magnitude, magnitude).astype(np.int16)
+
+
+MULAW = _mulaw_table()    # G.711 code -> int16
+
+
+class AudioBlock:
+    def __init__(self, fields, samples):
+        magic, self.seq, self.timestamp_us, self.frames, self.channels, self.bits, mask, self.flags = fields[:8]
+        # Microphone index of each column in samples
+        self.channel_map = [ch for ch in range(4) if mask & (1 << ch)]
+        levels = fields[8:20]
+        self.latency_us = fields[20]    # first frame captured -> chunk handed to the socket
+        self.peak = levels[0::3]
+        self.rms = levels[1::3]
+        self.clips = levels[2::3]
+        self.samples = samples
+
+    @property
+    def concealed(self):
+        return bool(self.flags & FLAG_CONCEALED)
+
+    @property
+    def synced(self):
+        return bool(self.flags & FLAG_SYNCED)
+
+    @property
+    def rate(self):
+        return 16000 if self.flags & FLAG_16K else RATE
+
+    @property
+    def blocks(self):
+        """Capture blocks in the chunk, what seq advances by."""
+        return self.frames * RATE // (self.rate * BLOCK_FRAMES)
+
+    @property
+    def format(self):
+        """Ex: "16 kHz beam of 0,1,2,3 mu-law", changes show when an adaptive stream steps."""
+        mics = ",".join(str(ch) for ch in self.channel_map)
+        layout = f"beam of {mics}" if self.flags & FLAG_BEAM else f"ch {mics}"
+        return f"{self.rate // 1000} kHz {layout}{' mu-law' if self.flags & FLAG_MULAW else ''}"
+
+    def dbfs(self, value):
+        return 20 * math.log10(value / 32768) if value else -math.inf
+
+    def is_silent(self, channel, threshold_dbfs=-60.0):
+        return self.dbfs(self.rms[channel]) < threshold_dbfs
+
+
+def read_blocks(raw):
+    """Yield AudioBlock objects from a file-like stream of framed audio."""
+    while True:
+        head = raw.read(HEADER.size)
+        if len(head) < HEADER.size:
+            return
+        fields = HEADER.unpack(head)
+        if fields[0] != MAGIC:
+            raise ValueError(f"Lost block framing (got {fields[0]!r})")
+        frames, channels, bits = fields[3], fields[4], fields[5]
+        size = frames * channels * bits // 8
+        payload = raw.read(size)
+        if len(payload) < size:
+            return
+        if fields[7] & FLAG_MULAW:
+            samples = MULAW[np.frombuffer(payload, dtype=np.uint8)].reshape(frames, channels)
+        else:
+            samples = np.frombuffer(payload, dtype=np.int16).reshape(frames, channels)
+        yield AudioBlock(fields, samples)
+
+
+class ResumingStream:
+    """Iterate the AudioBlocks of a framed /ach1 URL across reconnects.
+
+    When the connection fails or stalls for `timeout` seconds it connects again
+    with &from_seq= set to the next block expected, and the board replays the
+    blocks missed in between, faster than real time. Blocks the board no
+    longer had show up as a seq jump and in `lost_blocks`.
+    Block numbers restart when the board does. The board's X-Audio-Boot-Id
+    goes back with every reconnect, and when it changed the stream starts
+    over: `expected` and `lost_blocks` are reset and `board_restarts` counts it.
+    """
+
+    def __init__(self, url, timeout=1.0, retry_s=0.2):
+        self.url = url
+        self.timeout = timeout
+        self.retry_s = retry_s
+        self.expected = None        # seq of the next block
+        self.boot_id = None         # X-Audio-Boot-Id the seqs are counted in
+        self.board_restarts = 0
+        self.reconnects = 0
+        self.replayed_blocks = 0    # X-Audio-Replay summed over the reconnects
+        self.lost_blocks = 0
+        self.on_reconnect = None    # called with the X-Audio-Replay value after every reconnect
+        self.response = None
+        self.closed = False
+
+    def _connect(self):
+        url = self.url
+        if self.expected is not None:
+            url += f"&from_seq={self.expected}"
+            if self.boot_id is not None:
+                url += f"&boot_id={self.boot_id}"
+        response = requests.get(url, stream=True, timeout=(self.timeout, self.timeout))
+        if response.status_code != 200:
+            # 503 while the board still counts the dead connection as a client
+            response.close()
+            raise requests.exceptions.HTTPError(f"{response.status_code} {response.text}")
+        response.raw.decode_content = True
+        if self.expected is not None:
+            replay = int(response.headers.get("X-Audio-Replay", 0))
+            self.reconnects += 1
+            self.replayed_blocks += replay
+            if self.on_reconnect:
+                self.on_reconnect(replay)
+        boot_id = response.headers.get("X-Audio-Boot-Id")
+        if self.boot_id is not None and boot_id != self.boot_id:
+            # The board restarted and streams live, its seqs have nothing to do with ours
+            self.expected = None
+            self.lost_blocks = 0
+            self.board_restarts += 1
+        self.boot_id = boot_id
+        return response
+
+    def __iter__(self):
+        while not self.closed:
+            try:
+                self.response = self._connect()
+                for block in read_blocks(self.response.raw):
+                    if self.expected is not None and block.seq != self.expected:
+                        self.lost_blocks += (block.seq - self.expected) % 2**32
+                    self.expected = (block.seq + block.blocks) % 2**32
+                    yield block
+            except (requests.exceptions.RequestException, urllib3.exceptions.HTTPError, OSError):
+                pass
+            finally:
+                if self.response is not None:
+                    self.response.close()
+            if not self.closed:
+                time.sleep(self.retry_s)
+
+    def close(self):
+        """Stops the iteration, also from another thread."""
+        self.closed = True
+        if self.response is not None:
+            self.response.close()
+
+
+
+# ---------------------------------------------------------------------------
+# selftest
+
+# ESP-IDF headers for audio_ring.c on the host. Tasks are threads, a tick is a
+# millisecond, and the stubs count the times the ring's lock is taken twice
+# or a FreeRTOS call is made while it is held.
+RING_STUBS = {
+    "esp_err.h": r"""#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_TIMEOUT 0x107
+""",
+    "esp_log.h": r"""#pragma once
+void stub_log(const char *tag, const char *format, ...);
+#define ESP_LOGE(tag, format, ...) stub_log(tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) stub_log(tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) stub_log(tag, format, ##__VA_ARGS__)
+""",
+    "esp_random.h": "#pragma once\n#include <stdint.h>\nuint32_t esp_random(void);\n",
+    "esp_heap_caps.h": r"""#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+""",
+    "freertos/FreeRTOS.h": r"""#pragma once
+#include <pthread.h>
+#include <stdint.h>
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef struct stub_task *TaskHandle_t;
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY UINT32_MAX
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+void stub_enter(portMUX_TYPE *lock);
+void stub_exit(portMUX_TYPE *lock);
+#define taskENTER_CRITICAL(lock) stub_enter(lock)
+#define taskEXIT_CRITICAL(lock) stub_exit(lock)
+""",
+    "freertos/task.h": r"""#pragma once
+#include "freertos/FreeRTOS.h"
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+""",
+}
+
+# The ring with its statics in reach. Reads commands from stdin:
+#   init psram|nopsram  -> "init", audio_ring_init() with or without the PSRAM replay ring
+#   stress BLOCKS       -> a producer writing BLOCKS blocks, every 8 a short sleep, against four subscriber
+#                          threads: fast, lapped now and then, always behind and lapped in the middle
+#                          of its copies, and one with AUDIO_RING_SLOW_DISCONNECT. A line
+#                          "read torn gaps dropped disconnected" per subscriber, then "violations N"
+#   write N             -> "head", N more blocks from this thread
+#   boot                -> audio_ring_boot_id() in hex
+#   from BOOT_ID SEQ    -> "lag replaying dropped", audio_ring_subscribe_from() from this thread
+#   read N              -> "read first last torn gaps replaying dropped", up to N blocks without waiting
+#   unsub               -> "unsub"
+RING_SELFTEST_C = r"""
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// A subscriber can be made to stop halfway through copying a block, long enough for the producer to lap it
+void *stub_memcpy(void *dst, const void *src, size_t n);
+#define memcpy(dst, src, n) stub_memcpy(dst, src, n)
+#include "audio_ring.c"
+#undef memcpy
+
+struct stub_task {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t notified;
+};
+
+static _Thread_local struct stub_task *current_task;
+static _Thread_local int in_critical;
+static _Thread_local long copy_pause_us;
+static int violations;
+static bool no_psram;
+
+void stub_log(const char *tag, const char *format, ...) { (void)tag; (void)format; }
+uint32_t esp_random(void) { return 0x5eed0001; }
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return no_psram && (caps & MALLOC_CAP_SPIRAM) ? NULL : calloc(n, size);
+}
+
+void stub_enter(portMUX_TYPE *lock) {
+    if (in_critical++) {
+        __atomic_add_fetch(&violations, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(lock);
+}
+
+void stub_exit(portMUX_TYPE *lock) {
+    in_critical--;
+    pthread_mutex_unlock(lock);
+}
+
+static void outside_lock(void) {
+    if (in_critical) {
+        __atomic_add_fetch(&violations, 1, __ATOMIC_RELAXED);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == NULL) {
+        current_task = calloc(1, sizeof(*current_task));
+        pthread_mutex_init(&current_task->mutex, NULL);
+        pthread_cond_init(&current_task->cond, NULL);
+    }
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    outside_lock();
+    pthread_mutex_lock(&task->mutex);
+    task->notified++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->mutex);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    outside_lock();
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&task->mutex);
+    while (task->notified == 0) {
+        int err = ticks == portMAX_DELAY ? pthread_cond_wait(&task->cond, &task->mutex)
+                                         : pthread_cond_timedwait(&task->cond, &task->mutex, &deadline);
+        if (err == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notified;
+    task->notified = clear ? 0 : value - (value > 0);
+    pthread_mutex_unlock(&task->mutex);
+    return value;
+}
+
+static void sleep_us(long us) {
+    struct timespec t = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&t, NULL);
+}
+
+// What the producer writes into block seq, a reader that copied a torn block sees a mix
+static void fill(audio_ring_block_t *block, uint32_t seq) {
+    block->timestamp_us = seq;
+    for (int i = 0; i < AUDIO_RING_BLOCK_FRAMES * AUDIO_RING_CHANNELS; i++) {
+        block->samples[i] = (int16_t)(seq * 31 + i);
+    }
+}
+
+static bool intact(const audio_ring_block_t *block) {
+    if (block->timestamp_us != block->seq) {
+        return false;
+    }
+    for (int i = 0; i < AUDIO_RING_BLOCK_FRAMES * AUDIO_RING_CHANNELS; i++) {
+        if (block->samples[i] != (int16_t)(block->seq * 31 + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void *stub_memcpy(void *dst, const void *src, size_t n) {
+    memcpy(dst, src, n / 2);
+    if (copy_pause_us) {
+        sleep_us(copy_pause_us);
+    }
+    memcpy((char *)dst + n / 2, (const char *)src + n / 2, n - n / 2);
+    return dst;
+}
+
+static void produce(uint32_t blocks) {
+    for (uint32_t n = 0; n < blocks; n++) {
+        audio_ring_block_t *block = audio_ring_write_begin();
+        fill(block, write_seq);
+        audio_ring_write_commit();
+        if (n % 8 == 7) {
+            sleep_us(20);
+        }
+    }
+}
+
+typedef struct {
+    pthread_t thread;
+    audio_ring_slow_policy_t policy;
+    uint32_t pause_every;       // blocks between pauses, 0: never
+    long pause_us;
+    long copy_pause_us;         // inside every copy of a block
+    uint32_t read, torn, gaps, dropped;
+    bool disconnected;
+} stress_sub_t;
+
+static int stress_ready;
+static bool stress_done;
+
+static void *stress_reader(void *arg) {
+    stress_sub_t *s = arg;
+    copy_pause_us = s->copy_pause_us;
+    audio_ring_subscriber_t *sub = audio_ring_subscribe(s->policy);
+    uint32_t expected = sub->cursor;
+    __atomic_add_fetch(&stress_ready, 1, __ATOMIC_RELEASE);
+    audio_ring_block_t block;
+    while (true) {
+        esp_err_t err = audio_ring_read(sub, &block, pdMS_TO_TICKS(50));
+        if (err == ESP_ERR_INVALID_STATE) {
+            s->disconnected = true;
+            break;
+        }
+        if (err == ESP_ERR_TIMEOUT) {
+            if (__atomic_load_n(&stress_done, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            continue;
+        }
+        s->read++;
+        s->torn += !intact(&block);
+        s->gaps += block.seq - expected;
+        expected = block.seq + 1;
+        if (s->pause_every && s->read % s->pause_every == 0) {
+            sleep_us(s->pause_us);
+        }
+    }
+    s->dropped = sub->dropped_blocks;
+    audio_ring_unsubscribe(sub);
+    return NULL;
+}
+
+static void stress(uint32_t blocks) {
+    stress_sub_t subs[AUDIO_RING_MAX_SUBSCRIBERS] = {
+        { .policy = AUDIO_RING_SLOW_DROP },
+        { .policy = AUDIO_RING_SLOW_DROP, .pause_every = 500, .pause_us = 2000 },
+        { .policy = AUDIO_RING_SLOW_DROP, .copy_pause_us = 300 },
+        { .policy = AUDIO_RING_SLOW_DISCONNECT, .pause_every = 200, .pause_us = 5000 },
+    };
+    stress_ready = 0;
+    stress_done = false;
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        pthread_create(&subs[i].thread, NULL, stress_reader, &subs[i]);
+    }
+    while (__atomic_load_n(&stress_ready, __ATOMIC_ACQUIRE) < AUDIO_RING_MAX_SUBSCRIBERS) {
+        sleep_us(100);
+    }
+    produce(blocks);
+    __atomic_store_n(&stress_done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < AUDIO_RING_MAX_SUBSCRIBERS; i++) {
+        pthread_join(subs[i].thread, NULL);
+        printf("%u %u %u %u %d\n", subs[i].read, subs[i].torn, subs[i].gaps, subs[i].dropped,
+               subs[i].disconnected);
+    }
+    printf("violations %d\n", violations);
+}
+
+// The subscriber of the from / read commands
+static audio_ring_subscriber_t *resumed;
+static uint32_t resumed_expected;
+
+static void read_resumed(unsigned n) {
+    audio_ring_block_t block;
+    uint32_t read = 0, first = 0, last = 0, torn = 0, gaps = 0;
+    while (read < n && audio_ring_read(resumed, &block, 0) == ESP_OK) {
+        first = read++ == 0 ? block.seq : first;
+        last = block.seq;
+        torn += !intact(&block);
+        gaps += block.seq - resumed_expected;
+        resumed_expected = block.seq + 1;
+    }
+    printf("%u %u %u %u %u %d %u\n", read, first, last, torn, gaps, audio_ring_replaying(resumed),
+           resumed->dropped_blocks);
+}
+
+int main(void) {
+    char line[64];
+    unsigned n, boot, seq;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (strncmp(line, "init ", 5) == 0) {
+            no_psram = strncmp(line + 5, "nopsram", 7) == 0;
+            printf("%s\n", audio_ring_init() == ESP_OK ? "init" : "failed");
+        } else if (sscanf(line, "stress %u", &n) == 1) {
+            stress(n);
+        } else if (sscanf(line, "write %u", &n) == 1) {
+            produce(n);
+            printf("%u\n", write_seq);
+        } else if (strncmp(line, "boot", 4) == 0) {
+            printf("%x\n", audio_ring_boot_id());
+        } else if (sscanf(line, "from %x %u", &boot, &seq) == 2) {
+            resumed = audio_ring_subscribe_from(AUDIO_RING_SLOW_DROP, boot, seq);
+            resumed_expected = resumed->cursor;
+            printf("%u %d %u\n", audio_ring_lag(resumed), audio_ring_replaying(resumed), resumed->dropped_blocks);
+        } else if (sscanf(line, "read %u", &n) == 1) {
+            read_resumed(n);
+        } else if (strncmp(line, "unsub", 5) == 0) {
+            audio_ring_unsubscribe(resumed);
+            printf("unsub\n");
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+"""
+
+
+# Built against audio_ladder.c by the selftest. Reads commands from stdin:
+#   init MASK LOWEST NOW_US     -> "init", audio_ladder_init()
+#   set QUALITY                 -> "set", moves the ladder to a rung without the controller
+#   update LAG NOW_US           -> "changed quality steps_down steps_up up_hold_ms"
+#   chunk SEQ BLOCKS, followed by BLOCKS ring blocks of int16 samples
+#                               -> a line with the chunk's length, then the framed chunk as ach1_send_chunk()
+#                                  writes it: audio_block_header_t and the converted blocks
+LADDER_SELFTEST_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include "audio_ladder.h"
+
+#define MAX_BLOCKS 34
+
+int main(void) {
+    char line[64];
+    audio_ladder_t ladder;
+    static int16_t samples[AUDIO_RING_BLOCK_FRAMES * AUDIO_RING_CHANNELS];
+    static uint8_t chunk[sizeof(audio_block_header_t) + MAX_BLOCKS * sizeof(samples)];
+    unsigned mask, quality, lag, seq, blocks;
+    long long now_us;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (sscanf(line, "init %u %u %lld", &mask, &quality, &now_us) == 3) {
+            audio_ladder_init(&ladder, (uint8_t)mask, (audio_quality_t)quality, now_us);
+            printf("init\n");
+        } else if (sscanf(line, "set %u", &quality) == 1) {
+            ladder.quality = (audio_quality_t)quality;
+            printf("set\n");
+        } else if (sscanf(line, "update %u %lld", &lag, &now_us) == 2) {
+            bool changed = audio_ladder_update(&ladder, lag, now_us);
+            printf("%d %d %u %u %u\n", changed, ladder.quality, (unsigned)ladder.steps_down,
+                   (unsigned)ladder.steps_up, (unsigned)ladder.up_hold_ms);
+        } else if (sscanf(line, "chunk %u %u", &seq, &blocks) == 2 && blocks <= MAX_BLOCKS) {
+            audio_ladder_format_t format;
+            audio_ladder_get_format(&ladder, &format);
+            audio_block_header_t header = {
+                .magic = AUDIO_BLOCK_MAGIC,
+                .seq = seq,
+                .frames = blocks * format.block_frames,
+                .channels = format.channels,
+                .bits_per_sample = format.bits_per_sample,
+                .channel_mask = format.channel_mask,
+                .flags = format.flags,
+            };
+            size_t len = sizeof(header);
+            for (unsigned b = 0; b < blocks; b++) {
+                if (fread(samples, sizeof(samples), 1, stdin) != 1) {
+                    return 1;
+                }
+                len += audio_ladder_convert(&ladder, samples, chunk + len);
+            }
+            memcpy(chunk, &header, sizeof(header));
+            printf("%zu\n", len);
+            fwrite(chunk, 1, len, stdout);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+"""
+
+# audio_ladder.h
+FULL, Q16K, Q2CH, BEAM, QMULAW = range(5)
+LADDER_DOWN_BLOCKS = 16
+RING_BLOCKS = 64        # AUDIO_RING_BLOCKS
+
+
+class LadderDriver:
+    """audio_ladder.c built for the host, driven over stdin"""
+
+    def __init__(self, binary):
+        self.process = subprocess.Popen([str(binary)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    def ask(self, line):
+        self.process.stdin.write(line.encode() + b"\n")
+        self.process.stdin.flush()
+        return self.process.stdout.readline().decode().strip()
+
+    def chunk(self, seq, samples):
+        """samples: (blocks * BLOCK_FRAMES, 4) int16 of all four microphones, returns the AudioBlock"""
+        blocks = len(samples) // BLOCK_FRAMES
+        self.process.stdin.write(f"chunk {seq} {blocks}\n".encode() + samples.astype("<i2").tobytes())
+        self.process.stdin.flush()
+        length = int(self.process.stdout.readline())
+        return next(read_blocks(io.BytesIO(self.process.stdout.read(length))))
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+
+
+def tone(freq, blocks, amplitude=8000, channels=4, start=0):
+    t = (np.arange(blocks * BLOCK_FRAMES) + start) / RATE
+    wave = np.round(amplitude * np.sin(2 * np.pi * freq * t)).astype(np.int16)
+    return np.repeat(wave[:, None], channels, axis=1)
+
+
+def link_simulation(ladder, mask, kbytes_per_s, seconds, state):
+    """A client reading the ring as fast as a link of the given rate carries the
+    chunks, one 5 ms capture block at a time. Returns the largest lag."""
+    channels = bin(mask).count("1")
+    block_bytes = {FULL: BLOCK_FRAMES * 2 * channels, Q16K: 80 * 2 * channels,
+                   Q2CH: 80 * 2 * min(channels, 2), BEAM: 80 * 2, QMULAW: 80}
+    header_per_block = HEADER.size / 8          # 40 ms chunks
+    max_lag = 0
+    for _ in range(seconds * 200):
+        state["now_us"] += 5000
+        state["produced"] += 1
+        state["budget"] = min(state["budget"] + kbytes_per_s * 5, 8192)     # what the socket buffer takes
+        while state["read"] < state["produced"]:
+            cost = block_bytes[state["quality"]] + header_per_block
+            if state["budget"] < cost:
+                break
+            state["budget"] -= cost
+            state["read"] += 1
+            lag = state["produced"] - state["read"]
+            state["quality"] = int(ladder.ask(f"update {lag} {state['now_us']}").split()[1])
+        max_lag = max(max_lag, state["produced"] - state["read"])
+    return max_lag
+
+
+class FakeBoard:
+    """/ach1?framed=1 of an arm board for ResumingStream: one microphone,
+    8-block chunks, a block every block_s seconds and the last REPLAY_BLOCKS
+    kept. Every fault_every-th chunk is cut off halfway or, alternating, the
+    connection stalls for stall_s. restart() reboots it."""
+
+    REPLAY_BLOCKS = 1000    # AUDIO_RING_REPLAY_BLOCKS
+
+    def __init__(self, block_s, fault_every, stall_s):
+        self.block_s = block_s
+        self.fault_every = fault_every
+        self.stall_s = stall_s
+        self.chunks = 0
+        self.faults = 0
+        self.boot_id = "00000001"
+        self.booted = time.monotonic()
+        self.lock = threading.Lock()
+        self.stopped = False
+
+    def head(self):
+        return int((time.monotonic() - self.booted) / self.block_s)
+
+    def restart(self):
+        with self.lock:
+            self.boot_id = f"{int(self.boot_id, 16) + 1:08x}"
+            self.booted = time.monotonic()
+
+    @staticmethod
+    def samples(seq, blocks):
+        return (np.arange(seq * BLOCK_FRAMES, (seq + blocks) * BLOCK_FRAMES) * 7 % 65536 - 32768).astype("<i2")
+
+    def chunk(self, seq):
+        samples = self.samples(seq, 8)
+        return HEADER.pack(MAGIC, seq, seq * 5000, len(samples), 1, 16, 1, 0, *([0] * 12), 0) + samples.tobytes()
+
+    def serve(self, handler, query):
+        with self.lock:
+            boot_id, head = self.boot_id, self.head()
+        seq = head
+        if "from_seq" in query and query.get("boot_id") == boot_id:
+            seq = min(max(int(query["from_seq"]), head - self.REPLAY_BLOCKS), head)
+        handler.send_response(200)
+        handler.send_header("X-Audio-Replay", str(head - seq))
+        handler.send_header("X-Audio-Boot-Id", boot_id)
+        handler.end_headers()
+        while not self.stopped and self.boot_id == boot_id:
+            if self.head() < seq + 8:
+                time.sleep(self.block_s)
+                continue
+            chunk = self.chunk(seq)
+            with self.lock:
+                self.chunks += 1
+                fault = self.chunks % self.fault_every == 0
+                self.faults += fault
+                stall = fault and self.faults % 2 == 0
+            if stall:
+                time.sleep(self.stall_s)
+                return
+            handler.wfile.write(chunk[:len(chunk) // 2] if fault else chunk)
+            if fault:
+                return
+            seq += 8
+
+    def start(self):
+        board = self
+
+        class Handler(http.server.BaseHTTPRequestHandler):
+            def do_GET(self):
+                query = dict(urllib.parse.parse_qsl(urllib.parse.urlsplit(self.path).query))
+                try:
+                    board.serve(self, query)
+                except OSError:
+                    pass
+
+            def log_message(self, *args):
+                pass
+
+        self.server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+        self.server.daemon_threads = True
+        threading.Thread(target=self.server.serve_forever, daemon=True).start()
+        return f"http://127.0.0.1:{self.server.server_address[1]}/ach1?framed=1&ch=0"
+
+    def stop(self):
+        self.stopped = True
+        self.server.shutdown()
+        self.server.server_close()
+
+
+class RingDriver:
+    """One host build of audio_ring.c, driven over stdin"""
+
+    def __init__(self, binary, psram=True):
+        self.process = subprocess.Popen([str(binary)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+        self.ask("init psram" if psram else "init nopsram")
+
+    def send(self, line):
+        self.process.stdin.write(line.encode() + b"\n")
+        self.process.stdin.flush()
+
+    def answer(self):
+        return self.process.stdout.readline().decode().strip()
+
+    def ask(self, line):
+        self.send(line)
+        return self.answer()
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+
+
+def selftest(args):
+    failures = []
+
+    def check(name, ok, detail=""):
+        print(f"{'ok  ' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        if not ok:
+            failures.append(name)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        stubs = Path(tmp) / "stubs"
+        for name, text in RING_STUBS.items():
+            (stubs / name).parent.mkdir(parents=True, exist_ok=True)
+            (stubs / name).write_text(text)
+        source = Path(tmp) / "ring_selftest.c"
+        source.write_text(RING_SELFTEST_C)
+        binary = Path(tmp) / "ring_selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", "-pthread", "-D_POSIX_C_SOURCE=200809L",
+                        f"-I{stubs}", f"-I{FIRMWARE_MAIN}", str(source), "-o", str(binary)], check=True)
+
+        # One producer and four subscriber threads
+        ring = RingDriver(binary)
+        ring.send(f"stress {args.blocks}")
+        subs = [tuple(map(int, ring.answer().split())) for _ in range(4)]
+        violations = int(ring.answer().split()[1])
+        ring.close()
+        check(f"stress: no torn blocks over {args.blocks} blocks", all(s[1] == 0 for s in subs), f"{subs}")
+        check("stress: the dropped counts match the seq gaps the subscribers saw",
+              all(s[2] == s[3] for s in subs), f"{subs}")
+        check("stress: every block is read or counted as dropped",
+              all(s[0] + s[2] == args.blocks for s in subs[:3]), f"{subs}")
+        check("stress: a subscriber always behind drops blocks", subs[2][2] > 0, f"{subs}")
+        check("stress: a slow AUDIO_RING_SLOW_DISCONNECT subscriber is disconnected",
+              subs[3][4] == 1 and subs[3][2] == 0, f"{subs}")
+        check("stress: no FreeRTOS call under the ring lock, and the lock is never nested",
+              violations == 0, f"{violations}")
+
+        # Resuming from the PSRAM replay ring, one thread writing and reading in turn
+        replay = FakeBoard.REPLAY_BLOCKS
+        ring = RingDriver(binary)
+        boot = ring.ask("boot")
+
+        def resume(boot_id, seq):
+            return tuple(map(int, ring.ask(f"from {boot_id} {seq}").split()))
+
+        def read(n):
+            return tuple(map(int, ring.ask(f"read {n}").split()))
+
+        ring.ask("write 600")
+        start = resume(boot, 100)
+        got = read(1000)
+        check("resume: within the replay window the missed blocks are replayed, then it goes live",
+              start == (500, 1, 0) and got == (500, 100, 599, 0, 0, 0, 0), f"{start}, {got}")
+        ring.ask("unsub")
+        head = int(ring.ask("write 1900"))
+        start = resume(boot, 100)
+        got = read(5000)
+        check("resume: beyond the window it starts with the oldest block kept and counts the rest as dropped",
+              start == (replay, 1, head - replay - 100) and got[:3] == (replay, head - replay, head - 1),
+              f"{start}, {got}")
+        ring.ask("unsub")
+        check("resume: a seq the board has not reached yet starts live", resume(boot, head + 50) == (0, 0, 0))
+        ring.ask("unsub")
+        other = f"{int(boot, 16) ^ 1:x}"
+        check("resume: a seq from another boot starts live", resume(other, head - 10) == (0, 0, 0))
+        ring.ask("unsub")
+
+        # Replays that go twice as fast as the capture catch up, half as fast get overrun and go live
+        head = int(ring.ask(f"write {replay}"))
+        resume(boot, head - replay + 1)
+        got = (0,) * 7
+        for _ in range(replay):
+            ring.ask("write 1")
+            got = read(2)
+            if not got[5]:
+                break
+        check("resume: a 2x replay catches up without a gap", got[5] == 0 and got[4] == 0, f"{got}")
+        ring.ask("unsub")
+        head = int(ring.ask(f"write {replay}"))
+        resume(boot, head - replay + 1)
+        gaps = 0
+        for _ in range(2 * replay):
+            ring.ask("write 2")
+            got = read(1)
+            gaps += got[4]
+            if not got[5]:
+                break
+        check("resume: a replay slower than the capture is overrun and goes live, counting the gap",
+              got[5] == 0 and gaps > 0 and gaps == got[6] and got[3] == 0, f"{got}, {gaps} blocks skipped")
+        ring.ask("unsub")
+        ring.close()
+
+        # Without PSRAM the stream still works, resuming does not
+        ring = RingDriver(binary, psram=False)
+        ring.ask("write 200")
+        start = resume(ring.ask("boot"), 100)
+        ring.ask("write 5")
+        got = read(100)
+        check("resume: without PSRAM the missed blocks are counted as dropped and the stream goes live",
+              start == (0, 0, 100) and got[:5] == (5, 200, 204, 0, 0), f"{start}, {got}")
+        ring.close()
+
+        # ResumingStream against a board that cuts its chunks off and stalls, then restarts
+        board = FakeBoard(block_s=0.0005, fault_every=100, stall_s=0.6)
+        stream = ResumingStream(board.start(), timeout=0.3, retry_s=0.05)
+        expected, received, gaps, corrupt, restarted = None, 0, 0, 0, None
+        for block in stream:
+            if stream.board_restarts and restarted is None:
+                restarted, expected = received, None
+            if expected is not None:
+                gaps += (block.seq - expected) % 2**32
+            expected = block.seq + block.blocks
+            corrupt += not np.array_equal(block.samples[:, 0], FakeBoard.samples(block.seq, block.blocks))
+            received += block.blocks
+            if received == 8000:
+                board.restart()
+            if received >= 12000:
+                break
+        stream.close()
+        board.stop()
+        check("ResumingStream: cut and stalled connections lose no audio",
+              stream.reconnects >= board.faults >= 5 and gaps == 0 and corrupt == 0,
+              f"{stream.reconnects} reconnects for {board.faults} faults, {gaps} blocks missing, {corrupt} corrupt")
+        check("ResumingStream: a board restart starts the count over",
+              stream.board_restarts == 1 and restarted is not None and stream.lost_blocks == 0,
+              f"{stream.board_restarts} restarts, {stream.lost_blocks} lost")
+
+        source = Path(tmp) / "ladder_selftest.c"
+        source.write_text(LADDER_SELFTEST_C)
+        binary = Path(tmp) / "ladder_selftest"
+        # M_PI, which newlib has without asking
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", "-D_DEFAULT_SOURCE", f"-I{stubs}",
+                        f"-I{FIRMWARE_MAIN}", str(source), str(FIRMWARE_MAIN / "audio_ladder.c"), "-lm",
+                        "-o", str(binary)], check=True)
+        ladder = LadderDriver(binary)
+
+        # The 24 -> 16 kHz resampler: a tone's level at 16 kHz, its alias above 8 kHz
+        def gain_db(freq):
+            ladder.ask(f"init 1 {QMULAW} 0")
+            ladder.ask(f"set {Q16K}")
+            out = np.concatenate([ladder.chunk(n * 8, tone(freq, 8, start=n * 8 * BLOCK_FRAMES)).samples[:, 0]
+                                  for n in range(4)])[320:].astype(float)
+            return 20 * math.log10(max(np.sqrt(np.mean(out ** 2)), 1e-3) / (8000 / math.sqrt(2)))
+
+        passband = {f: gain_db(f) for f in (100, 1000, 3000, 5000, 5800)}
+        stopband = {f: gain_db(f) for f in (8200, 9000, 10000, 11000, 11900)}
+        check("ladder: the 16 kHz resampler is flat to 5.8 kHz",
+              all(abs(g) < 1 for g in passband.values()), f"{passband}")
+        check("ladder: and at least 42 dB down above 8 kHz",
+              all(g <= -42 for g in stopband.values()), f"{stopband}")
+
+        # Rung changes every block on a tone all microphones hear alike: every 16 kHz rung
+        # continues the same signal, as if the stream had stayed at 16k
+        rng = np.random.default_rng(args.seed)
+        signal = tone(440, 60)
+        ladder.ask(f"init 15 {QMULAW} 0")
+        ladder.ask(f"set {Q16K}")
+        steady = [ladder.chunk(n, signal[n * BLOCK_FRAMES:(n + 1) * BLOCK_FRAMES]) for n in range(60)]
+        ladder.ask(f"init 15 {QMULAW} 0")
+        seamless, rungs = True, []
+        for n in range(60):
+            rung = int(rng.integers(FULL, QMULAW + 1))
+            rungs.append(rung)
+            ladder.ask(f"set {rung}")
+            block = ladder.chunk(n, signal[n * BLOCK_FRAMES:(n + 1) * BLOCK_FRAMES])
+            if rung == FULL:
+                seamless &= np.array_equal(block.samples, signal[n * BLOCK_FRAMES:(n + 1) * BLOCK_FRAMES])
+            elif rung == QMULAW:
+                seamless &= bool(np.all(np.abs(block.samples[:, 0].astype(int) - steady[n].samples[:, 0]) <= 512))
+            else:
+                seamless &= np.array_equal(block.samples[:, 0], steady[n].samples[:, 0])
+        check("ladder: rung changes continue the signal without a seam", seamless, f"rungs {rungs}")
+
+        # Every rung's chunk as audio_blocks.py reads it
+        ladder.ask(f"init 15 {QMULAW} 0")
+        noise = rng.integers(-20000, 20000, size=(8 * BLOCK_FRAMES, 4)).astype(np.int16)
+        formats = []
+        for rung in range(FULL, QMULAW + 1):
+            ladder.ask(f"set {rung}")
+            block = ladder.chunk(1000 + rung * 8, noise)
+            formats.append((block.format, block.rate, block.blocks, block.samples.shape, str(block.samples.dtype)))
+        check("ladder: every rung's chunk reads back with its format",
+              formats == [("24 kHz ch 0,1,2,3", 24000, 8, (960, 4), "int16"),
+                          ("16 kHz ch 0,1,2,3", 16000, 8, (640, 4), "int16"),
+                          ("16 kHz ch 0,3", 16000, 8, (640, 2), "int16"),
+                          ("16 kHz beam of 0,1,2,3", 16000, 8, (640, 1), "int16"),
+                          ("16 kHz beam of 0,1,2,3 mu-law", 16000, 8, (640, 1), "int16")], f"{formats}")
+
+        # mu-law against the reference encoder, on the same 16 kHz signal
+        ladder.ask(f"init 1 {QMULAW} 0")
+        ladder.ask(f"set {Q16K}")
+        pcm = ladder.chunk(0, noise).samples[:, 0]
+        ladder.ask(f"init 1 {QMULAW} 0")
+        ladder.ask(f"set {QMULAW}")
+        decoded = ladder.chunk(0, noise).samples[:, 0]
+        try:
+            import warnings
+            with warnings.catch_warnings():
+                warnings.simplefilter("ignore", DeprecationWarning)
+                import audioop
+            reference = MULAW[np.frombuffer(audioop.lin2ulaw(pcm.astype("<i2").tobytes(), 2), dtype=np.uint8)]
+            # audioop drops the two low bits before taking the magnitude, so a negative sample
+            # right at a step can end up one step further out than with the 16-bit magnitude
+            levels = np.unique(MULAW)
+            off = decoded != reference
+            adjacent = np.abs(np.searchsorted(levels, decoded) - np.searchsorted(levels, reference)) == 1
+            check("ladder: mu-law matches audioop, up to the rounding of negative samples",
+                  bool(np.all(adjacent[off] & (pcm[off] < 0))) and off.sum() < len(pcm) // 20,
+                  f"{off.sum()} of {len(pcm)} samples differ")
+        except ImportError:
+            step = np.maximum(np.abs(pcm.astype(int)) // 16, 8)
+            check("ladder: mu-law within a step of the signal",
+                  bool(np.all(np.abs(decoded.astype(int) - pcm) <= step)))
+
+        # The controller on a link that drops and recovers
+        for mask, slow_kbytes in ((0xF, 48), (0x3, 24), (0x1, 20)):
+            ladder.ask(f"init {mask} {QMULAW} 0")
+            state = {"now_us": 0, "produced": 0, "read": 0, "budget": 0, "quality": FULL}
+            link_simulation(ladder, mask, 400, 10, state)
+            fast = state["quality"]
+            max_lag = link_simulation(ladder, mask, slow_kbytes, 60, state)
+            slow = state["quality"]
+            link_simulation(ladder, mask, 400, 120, state)
+            check(f"ladder: channels {mask:#x} at {slow_kbytes} KB/s step down without a ring overrun, and back up",
+                  fast == FULL and slow > FULL and max_lag < RING_BLOCKS and state["quality"] == FULL,
+                  f"rung {fast} -> {slow} -> {state['quality']}, lag up to {max_lag} blocks")
+        ladder.close()
+
+    if failures:
+        sys.exit(1)
+
+def listen(args):
+    url = f"http://{args.ip}/ach1?framed=1&ch={args.ch}"
+    if args.low_latency:
+        url += "&profile=low_latency"
+    if args.block_ms:
+        url += f"&block_ms={args.block_ms}"
+    if args.adapt:
+        url += f"&adapt={args.adapt}"
+    if args.resume:
+        blocks = ResumingStream(url)
+        blocks.on_reconnect = lambda replay: print(f"-- reconnected, {replay} blocks replayed")
+    else:
+        response = requests.get(url, stream=True)
+        if response.status_code != 200:
+            print(f"Failed to connect: {response.status_code} {response.text}")
+            return
+        response.raw.decode_content = True
+        blocks = read_blocks(response.raw)
+    expected = None
+    restarts = 0
+    fmt = None
+    try:
+        for block in blocks:
+            if args.resume and blocks.board_restarts != restarts:
+                print("-- the board restarted, block numbers start over")
+                restarts = blocks.board_restarts
+                expected = None
+            if expected is not None and block.seq != expected:
+                print(f"-- {(block.seq - expected) % 2**32} blocks skipped")
+            if block.format != fmt:
+                print(f"-- {block.format}")
+                fmt = block.format
+            expected = (block.seq + block.blocks) % 2**32
+            levels = "  ".join(f"ch{c}: {block.dbfs(block.rms[c]):6.1f} dBFS"
+                               f"{' CLIP ' + str(block.clips[c]) if block.clips[c] else ''}"
+                               for c in range(len(block.rms)))
+            clock = "eye" if block.synced else "arm"
+            print(f"#{block.seq:<6} {block.timestamp_us / 1e6:9.3f}s {clock} {block.latency_us / 1000:6.1f}ms  {levels}")
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Print per-block levels of the arm board stream")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--ch", default="0,1,2,3", help="microphones to stream, ex: 0,2")
+    parser.add_argument("--block-ms", type=int, help="chunk length on the board, 5 to 170 ms")
+    parser.add_argument("--low-latency", action="store_true",
+                        help="5 ms chunks written to the socket with TCP_NODELAY")
+    parser.add_argument("--adapt", nargs="?", const="1",
+                        help="let the board lower the format while this client falls behind, "
+                             "optionally down to 16k, 2ch, beam or mulaw only")
+    parser.add_argument("--resume", action="store_true",
+                        help="reconnect after errors and have the board replay the missed audio")
+    parser.set_defaults(func=listen)
+
+    p = sub.add_parser("selftest", help="run the board's audio ring and quality ladder on the host")
+    p.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    p.add_argument("--blocks", type=int, default=200000, help="blocks the stress test produces")
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
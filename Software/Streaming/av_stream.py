@@ -0,0 +1,582 @@
+# Reader for the Eye's merged A/V stream, /av
+#
+# The Eye relays the framed audio of the arm boards together with its own
+# camera frames on one connection. Every record is a 24-byte header
+# (av_record_header_t in the Eye's main/av_hub.h) followed by its payload:
+#   video  a JPEG
+#   audio  an arm board chunk as sent on /ach1?framed=1, see audio_blocks.py;
+#          over ESP-NOW the Eye flags chunks with concealed samples
+# All timestamps are on the Eye's clock, so audio and video line up without
+# any alignment on the host. A JPEG comes in 4 KB records flagged MORE up to
+# the last one, with audio records in between, so audio never waits for a
+# whole frame; read_records() joins them.
+#
+# `python av_stream.py` prints the video frame rate, the audio chunks per
+# arm board and the A/V offset once a second. Each arm board's audio also runs
+# through a drift.py StreamLock on the Eye's clock, which reports the board's
+# sample clock error; `--wav PREFIX` records the locked audio, one WAV per arm
+# board, that stays aligned with the frame timestamps. `python av_stream.py selftest`
+# builds the ESP-NOW framing and reassembly (Firmware/components/espnow_audio)
+# with the host C compiler and runs it against a simulated lossy link.
+
+import argparse
+import io
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import wave
+from array import array
+from collections import namedtuple
+from pathlib import Path
+
+import requests
+
+import numpy as np
+
+from audio_blocks import BLOCK_FRAMES, HEADER as BLOCK_HEADER, MAGIC as BLOCK_MAGIC, RATE, read_blocks
+from drift import TIMESTAMPED, StreamLock
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+
+RECORD = struct.Struct("<4sBBHIqI")
+MAGIC = b"IRAV"
+VIDEO = 1
+AUDIO = 2
+CAMERA = 0
+FLAG_MORE = 0x0001      # the payload continues in the next record of the source
+LOCK_MAX_GAP_BLOCKS = 200   # 1 s, a longer gap starts the arm board's StreamLock over
+
+
+class AvRecord:
+    def __init__(self, kind, source, seq, timestamp_us, payload):
+        self.kind = kind
+        self.source = source            # 0 camera, 1 and 2 the arm boards
+        self.seq = seq
+        self.timestamp_us = timestamp_us
+        self.payload = payload
+        self.block = None
+        if kind == AUDIO:
+            # The arm board chunk. Its own timestamp is on the Eye's clock too once
+            # the arm board is synchronized (block.synced), else on the arm board's
+            self.block = next(read_blocks(io.BytesIO(payload)))
+
+    @property
+    def end_us(self):
+        """Time just after the last sample (audio) or the frame time (video)."""
+        if self.block is None:
+            return self.timestamp_us
+        return self.timestamp_us + self.block.frames * 1_000_000 // self.block.rate
+
+
+def read_records(raw):
+    """Yield AvRecord objects from a file-like /av stream, sliced ones joined."""
+    pieces = {}     # source -> payload so far of a record flagged MORE
+    while True:
+        head = raw.read(RECORD.size)
+        if len(head) < RECORD.size:
+            return
+        magic, kind, source, flags, seq, timestamp_us, length = RECORD.unpack(head)
+        if magic != MAGIC:
+            raise ValueError(f"Lost record framing (got {magic!r})")
+        payload = raw.read(length)
+        if len(payload) < length:
+            return
+        if source in pieces:
+            payload = pieces.pop(source) + payload
+        if flags & FLAG_MORE:
+            pieces[source] = payload
+            continue
+        yield AvRecord(kind, source, seq, timestamp_us, payload)
+
+
+def listen(args):
+    response = requests.get(f"http://{args.ip}/av", stream=True)
+    if response.status_code != 200:
+        print(f"Failed to connect: {response.status_code} {response.text}")
+        return
+    response.raw.decode_content = True
+
+    frames = 0
+    chunks = {}
+    concealed = {}
+    gaps = {}
+    next_seq = {}
+    last_video_us = None
+    last_audio_end = {}
+    # Arm board audio resampled onto the Eye's clock. Fed only synchronized
+    # chunks, their timestamps are capture times and TIMESTAMPED applies.
+    origin = None           # shared, so both boards start on the same timebase
+    locks = {}
+    wavs = {}
+    report = time.monotonic() + 1.0
+    try:
+        for record in read_records(response.raw):
+            if record.kind == VIDEO:
+                frames += 1
+                last_video_us = record.timestamp_us
+            elif record.kind == AUDIO:
+                src = record.source
+                chunks[src] = chunks.get(src, 0) + 1
+                if record.block.concealed:
+                    concealed[src] = concealed.get(src, 0) + 1
+                expected = next_seq.get(src)
+                lost = 0
+                if expected is not None and record.seq != expected:
+                    lost = (record.seq - expected) % 2**32
+                    gaps[src] = gaps.get(src, 0) + lost
+                next_seq[src] = (record.seq + record.block.blocks) % 2**32
+                last_audio_end[src] = record.end_us
+                if record.block.synced:
+                    if origin is None:
+                        origin = record.timestamp_us / 1e6
+                    lock_audio(args, locks, wavs, src, record, lost, origin)
+
+            now = time.monotonic()
+            if now >= report:
+                parts = [f"video {frames:3d} fps"]
+                for src in sorted(chunks):
+                    skew = ""
+                    if last_video_us is not None:
+                        # Positive: the audio already covers time after the latest frame
+                        skew = f", audio-video {(last_audio_end[src] - last_video_us) / 1000:+6.1f} ms"
+                    lock = locks.get(src)
+                    if lock is None:
+                        drift = ", not synced"
+                    elif lock.estimator.ready:
+                        drift = f", clock {lock.ppm:+6.1f} ppm"
+                    else:
+                        drift = ", clock locking"
+                    parts.append(f"arm {src}: {chunks[src]:3d} chunks, {concealed.get(src, 0)} concealed, "
+                                 f"{gaps.get(src, 0)} blocks lost{skew}{drift}")
+                print("  |  ".join(parts))
+                frames = 0
+                chunks = {src: 0 for src in chunks}
+                concealed = {}
+                report = now + 1.0
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for out in wavs.values():
+            out.close()
+
+
+def lock_audio(args, locks, wavs, src, record, lost, origin):
+    """Runs one synchronized chunk of arm board src through its StreamLock."""
+    block = record.block
+    lock = locks.get(src)
+    rate, channels = (lock.rate, lock.channels) if lock is not None else (block.rate, block.channels)
+    if lock is not None and lost > LOCK_MAX_GAP_BLOCKS:
+        # Ex: the board restarted. Start over where the output had got to, the
+        # new lock fills the time in between with silence.
+        origin = lock.origin + lock.samples_out / lock.rate
+        lock = None
+    if lock is None:
+        locks[src] = lock = StreamLock(rate, channels, origin=origin, **TIMESTAMPED)
+        if args.wav and src not in wavs:
+            wavs[src] = wave.open(f"{args.wav}-arm{src}.wav", "wb")
+            wavs[src].setnchannels(channels)
+            wavs[src].setsampwidth(2)
+            wavs[src].setframerate(rate)
+    if (block.rate, block.channels) != (lock.rate, lock.channels):
+        return      # the lock and the WAV keep the format of the first chunk
+    # Lost blocks become silence, so the sample count keeps following the clock
+    missing = lost * BLOCK_FRAMES * block.rate // RATE
+    samples = np.concatenate([np.zeros((missing, block.channels)), block.samples])
+    out = lock.process(record.end_us / 1e6, samples)
+    if src in wavs:
+        wavs[src].writeframes(np.clip(np.round(out), -32768, 32767).astype("<i2").tobytes())
+
+
+# ---------------------------------------------------------------------------
+# selftest
+
+# Built against espnow_audio.c by the selftest. Reads commands from stdin,
+# packets and samples in hex:
+#   build SEQ FRAG TIMESTAMP FRAMES CHANNELS MASK FLAGS SAMPLES -> "packet HEX", "packet -" if it does not fit
+#   init SAMPLE_RATE MAX_WAIT_US
+#   push NOW_US PACKET
+#   pop NOW_US    -> "block seq timestamp frames channels mask flags missing lost SAMPLES" per released block
+#   stats         -> "stats packets invalid duplicates late blocks partial lost skipped"
+SELFTEST_C = r"""
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "espnow_audio.h"
+
+static size_t unhex(const char *s, uint8_t *out, size_t max) {
+    size_t n = 0;
+    unsigned byte;
+    while (n < max && sscanf(s + 2 * n, "%2x", &byte) == 1) {
+        out[n++] = (uint8_t)byte;
+    }
+    return n;
+}
+
+static void hex(const void *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        printf("%02x", ((const uint8_t *)data)[i]);
+    }
+}
+
+int main(void) {
+    static char line[8192];
+    static uint8_t bytes[4096];
+    static int16_t samples[ESPNOW_AUDIO_MAX_FRAMES * ESPNOW_AUDIO_MAX_CHANNELS];
+    static espnow_audio_reassembler_t r;
+    static espnow_audio_block_t block;
+    uint8_t packet[ESPNOW_AUDIO_MAX_PACKET];
+    long long now_us;
+    int n;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (strncmp(line, "build ", 6) == 0) {
+            unsigned seq, frag, frames, channels, mask, flags;
+            long long timestamp_us;
+            sscanf(line + 6, "%u %u %lld %u %u %u %u %n", &seq, &frag, &timestamp_us, &frames, &channels, &mask,
+                   &flags, &n);
+            memset(samples, 0, sizeof(samples));
+            unhex(line + 6 + n, (uint8_t *)samples, sizeof(samples));
+            size_t len = espnow_audio_build(packet, seq, frag, timestamp_us, samples, frames, channels, mask, flags);
+            printf("packet ");
+            if (len == 0) {
+                printf("-");
+            }
+            hex(packet, len);
+            printf("\n");
+        } else if (strncmp(line, "init ", 5) == 0) {
+            unsigned rate;
+            long long wait_us;
+            sscanf(line + 5, "%u %lld", &rate, &wait_us);
+            espnow_audio_reassembler_init(&r, rate, wait_us);
+        } else if (strncmp(line, "push ", 5) == 0) {
+            sscanf(line + 5, "%lld %n", &now_us, &n);
+            size_t len = unhex(line + 5 + n, bytes, sizeof(bytes));
+            espnow_audio_reassembler_push(&r, bytes, len, now_us);
+        } else if (strncmp(line, "pop ", 4) == 0) {
+            sscanf(line + 4, "%lld", &now_us);
+            while (espnow_audio_reassembler_pop(&r, now_us, &block)) {
+                printf("block %" PRIu32 " %" PRId64 " %u %u %u %u %u %d ", block.seq, block.timestamp_us,
+                       block.frames, block.channels, block.channel_mask, block.flags, block.missing_fragments,
+                       block.lost);
+                hex(block.samples, (size_t)block.frames * block.channels * sizeof(int16_t));
+                printf("\n");
+            }
+        } else if (strncmp(line, "stats", 5) == 0) {
+            const espnow_audio_stats_t *s = &r.stats;
+            printf("stats %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32
+                   " %" PRIu32 "\n", s->packets, s->invalid, s->duplicates, s->late, s->blocks, s->partial,
+                   s->lost, s->skipped);
+        }
+    }
+    return 0;
+}
+"""
+
+# espnow_audio.h
+ESPNOW_HEADER = struct.Struct("<BBBBIqHHBBB")
+ESPNOW_MAGIC = 0xA5
+ESPNOW_VERSION = 2
+ESPNOW_MAX_PACKET = 250
+ESPNOW_MAX_FRAMES = 120
+ESPNOW_MAX_FRAGMENTS = 8
+ESPNOW_REORDER_BLOCKS = 4
+ESPNOW_FADE_BLOCKS = 3
+ESPNOW_FLAG_SYNCED = 0x01
+
+ESPNOW_RATE = 24000
+ESPNOW_FRAMES = 120             # one 5 ms capture block
+ESPNOW_BLOCK_US = ESPNOW_FRAMES * 1_000_000 // ESPNOW_RATE
+ESPNOW_FRAGMENT_GAP_US = 100    # between the fragments of a block on air
+
+EspnowBlock = namedtuple("EspnowBlock", "seq timestamp_us frames channels mask flags missing lost samples")
+EspnowStats = namedtuple("EspnowStats", "packets invalid duplicates late blocks partial lost skipped")
+
+
+def espnow_fragment_frames(channels):
+    return (ESPNOW_MAX_PACKET - ESPNOW_HEADER.size) // (channels * 2)
+
+
+def espnow_fragment_count(frames, channels):
+    count = -(-frames // espnow_fragment_frames(channels))
+    return count if 0 < frames <= ESPNOW_MAX_FRAMES and count <= ESPNOW_MAX_FRAGMENTS else 0
+
+
+def espnow_build(seq, frag, timestamp_us, samples, frames, channels, mask, flags=0):
+    """Fragment frag of a block of little-endian int16 samples, as espnow_audio_build()"""
+    per = espnow_fragment_frames(channels)
+    offset = frag * per
+    n = min(per, frames - offset)
+    header = ESPNOW_HEADER.pack(ESPNOW_MAGIC, ESPNOW_VERSION, frag, espnow_fragment_count(frames, channels),
+                                seq % 2**32, timestamp_us, frames, offset, channels, mask, flags)
+    return header + samples[offset * channels * 2:(offset + n) * channels * 2]
+
+
+def espnow_run(binary, commands):
+    """Blocks released and the final stats of a run of the C reassembler"""
+    out = subprocess.run([str(binary)], input="\n".join(commands) + "\nstats\n", capture_output=True, text=True,
+                         check=True).stdout
+    blocks, stats = [], None
+    for line in out.splitlines():
+        kind, *fields = line.split()
+        if kind == "block":
+            blocks.append(EspnowBlock(*map(int, fields[:6]), int(fields[6]), fields[7] == "1",
+                                      bytes.fromhex(fields[8])))
+        elif kind == "stats":
+            stats = EspnowStats(*map(int, fields))
+    return blocks, stats
+
+
+class EspnowLink:
+    """Sends blocks of random samples over a simulated ESP-NOW link and checks what the reassembler releases"""
+
+    def __init__(self, rng, first_seq, blocks, channels, loss=0.0, duplicates=0.0, jitter_us=0, drop=(),
+                 wait_us=10000):
+        self.channels = channels
+        self.wait_us = wait_us
+        self.sent = {}                  # seq -> (timestamp_us, samples)
+        self.delivered = {}             # (seq, frag) -> first arrival, us
+        self.pushed = self.duplicated = 0
+        count = espnow_fragment_count(ESPNOW_FRAMES, channels)
+        arrivals = []
+        for i in range(blocks):
+            seq = (first_seq + i) % 2**32
+            timestamp_us = 1_700_000_000_000_000 + i * ESPNOW_BLOCK_US
+            samples = rng.randbytes(ESPNOW_FRAMES * channels * 2)
+            self.sent[seq] = (timestamp_us, samples)
+            for frag in range(count):
+                if i in drop or rng.random() < loss:
+                    continue
+                packet = espnow_build(seq, frag, timestamp_us, samples, ESPNOW_FRAMES, channels, 0x0F >> (4 - channels))
+                copies = 2 if rng.random() < duplicates else 1
+                self.duplicated += copies - 1
+                for _ in range(copies):
+                    at = i * ESPNOW_BLOCK_US + frag * ESPNOW_FRAGMENT_GAP_US + rng.randrange(jitter_us + 1)
+                    arrivals.append((at, packet))
+                    self.delivered[(seq, frag)] = min(at, self.delivered.get((seq, frag), at))
+        arrivals.sort(key=lambda a: a[0])
+
+        # Every packet is pushed and popped right away, and the receiver polls every ms in between
+        self.commands = [f"init {ESPNOW_RATE} {wait_us}"]
+        end_us = blocks * ESPNOW_BLOCK_US + jitter_us + 2 * wait_us
+        k = 0
+        for tick in range(0, end_us, 1000):
+            while k < len(arrivals) and arrivals[k][0] <= tick:
+                at, packet = arrivals[k]
+                self.commands += [f"push {at} {packet.hex()}", f"pop {at}"]
+                self.pushed += 1
+                k += 1
+            self.commands.append(f"pop {tick}")
+
+    def run(self, binary):
+        self.blocks, self.stats = espnow_run(binary, self.commands)
+        return self.blocks, self.stats
+
+    def check(self):
+        """Problems found in the released blocks, modelled on the concealment described in espnow_audio.h"""
+        problems = []
+        per = espnow_fragment_frames(self.channels) * self.channels * 2
+        count = espnow_fragment_count(ESPNOW_FRAMES, self.channels)
+        self.skipped = self.concealed_delivered = 0
+        last, loss_run, prev = None, 0, None
+
+        def conceal(lo, hi):
+            if last is None or loss_run >= ESPNOW_FADE_BLOCKS:
+                return bytes(hi - lo)
+            return array("h", (x >> (loss_run + 1) for x in array("h", last[lo:hi]))).tobytes()
+
+        for b in self.blocks:
+            if prev is not None and b.seq != (prev + 1) % 2**32:
+                gap = (b.seq - prev - 1) % 2**32
+                if gap >= 2**31 or gap >= len(self.sent):
+                    problems.append(f"block {b.seq} released after {prev}")
+                    break
+                # Skipped blocks leave nothing to repeat
+                self.skipped += gap
+                loss_run = ESPNOW_FADE_BLOCKS
+            prev = b.seq
+            timestamp_us, original = self.sent[b.seq]
+            if b.timestamp_us != timestamp_us:
+                problems.append(f"block {b.seq} timestamp {b.timestamp_us}, sent {timestamp_us}")
+            if b.lost:
+                if b.missing != count or b.samples != conceal(0, len(original)):
+                    problems.append(f"lost block {b.seq} not concealed from the last block, {loss_run} lost before it")
+                loss_run += 1
+                continue
+            missing = 0
+            for frag in range(count):
+                lo, hi = frag * per, min((frag + 1) * per, len(original))
+                if b.samples[lo:hi] == original[lo:hi] and (b.seq, frag) in self.delivered:
+                    continue
+                if b.samples[lo:hi] != conceal(lo, hi):
+                    problems.append(f"block {b.seq} fragment {frag} is neither received nor concealed")
+                missing += 1
+                if (b.seq, frag) in self.delivered:
+                    self.concealed_delivered += 1
+            if missing != b.missing:
+                problems.append(f"block {b.seq} says {b.missing} fragments missing, {missing} concealed")
+            last, loss_run = b.samples, 0
+
+        s = self.stats
+        released = len(self.blocks)
+        lost = sum(b.lost for b in self.blocks)
+        partial = sum(b.missing > 0 and not b.lost for b in self.blocks)
+        if (s.packets, s.invalid, s.blocks, s.lost, s.partial, s.skipped) != \
+                (self.pushed, 0, released, lost, partial, self.skipped):
+            problems.append(f"stats {s} do not add up: {self.pushed} packets pushed, {released} blocks released, "
+                            f"{lost} lost, {partial} partial, {self.skipped} skipped")
+        return problems
+
+
+def selftest(args):
+    component = Path(__file__).resolve().parents[2] / "Firmware" / "components" / "espnow_audio"
+    failures = []
+
+    def check(name, ok, detail=""):
+        print(f"{'ok  ' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        if not ok:
+            failures.append(name)
+
+    rng = random.Random(args.seed)
+    # Every run crosses the wrap of the 32-bit block number
+    first_seq = 2**32 - args.blocks // 2
+
+    with tempfile.TemporaryDirectory() as tmp:
+        source = Path(tmp) / "selftest.c"
+        source.write_text(SELFTEST_C)
+        binary = Path(tmp) / "selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", f"-I{component}", str(source),
+                        str(component / "espnow_audio.c"), "-o", str(binary)], check=True)
+
+        # Framing: the C sender and this model build the same bytes
+        commands, expected = [], []
+        for channels in range(1, 5):
+            for frames in (1, 37, ESPNOW_FRAMES):
+                samples = rng.randbytes(frames * channels * 2)
+                seq, timestamp_us = rng.randrange(2**32), rng.randrange(-2**63, 2**63)
+                for frag in range(espnow_fragment_count(frames, channels) + 1):
+                    commands.append(f"build {seq} {frag} {timestamp_us} {frames} {channels} 5 "
+                                    f"{ESPNOW_FLAG_SYNCED} {samples.hex()}")
+                    # One past the last fragment does not fit
+                    packet = espnow_build(seq, frag, timestamp_us, samples, frames, channels, 5, ESPNOW_FLAG_SYNCED)
+                    expected.append("packet " + (packet.hex() if frag < espnow_fragment_count(frames, channels)
+                                                 else "-"))
+        commands.append(f"build 0 0 0 {ESPNOW_MAX_FRAMES + 1} 4 15 0 00")
+        expected.append("packet -")
+        out = subprocess.run([str(binary)], input="\n".join(commands) + "\n", capture_output=True, text=True,
+                             check=True).stdout.splitlines()
+        check("C and Python build the same fragments", out == expected)
+        check("5 fragments per 5 ms block for four channels, 3 for two",
+              [espnow_fragment_count(ESPNOW_FRAMES, c) for c in (4, 2)] == [5, 3])
+
+        # Malformed packets are counted and change nothing
+        samples = rng.randbytes(ESPNOW_FRAMES * 4 * 2)
+        good = espnow_build(7, 1, 0, samples, ESPNOW_FRAMES, 4, 15)
+        bad = [bytes([0]) + good[1:], good[:1] + bytes([ESPNOW_VERSION + 1]) + good[2:], good[:ESPNOW_HEADER.size - 1],
+               good[:-2], good[:16] + struct.pack("<H", 1) + good[18:],  # frame_offset of another fragment
+               good[:3] + bytes([9]) + good[4:]]                          # frag_count
+        blocks, stats = espnow_run(binary, [f"init {ESPNOW_RATE} 10000"] +
+                                   [f"push 0 {packet.hex()}" for packet in bad] + ["pop 1000000"])
+        check("malformed packets are rejected", not blocks and stats.invalid == len(bad) == stats.packets,
+              f"{stats}")
+
+        # A clean link releases every block bit-exact
+        link = EspnowLink(rng, first_seq, args.blocks, 4)
+        blocks, stats = link.run(binary)
+        problems = link.check()
+        check("clean link: every block in order and bit-exact",
+              not problems and len(blocks) == args.blocks and not any(b.missing for b in blocks)
+              and stats.duplicates == stats.late == 0, "; ".join(problems[:3]) or f"{stats}")
+
+        # Random loss with jitter below the wait: only what never arrived is concealed
+        link = EspnowLink(rng, first_seq, args.blocks, 2, loss=args.loss, jitter_us=3000)
+        blocks, stats = link.run(binary)
+        problems = link.check()
+        print(f"{args.loss:.0%} loss: {stats}")
+        check(f"{args.loss:.0%} loss: every received fragment kept, the others concealed",
+              not problems and link.concealed_delivered == 0 and stats.late == 0 and stats.partial > 0,
+              "; ".join(problems[:3]) or f"{stats}, {link.concealed_delivered} concealed after arriving")
+
+        # Duplicates and reordering beyond the wait, some fragments come too late
+        link = EspnowLink(rng, first_seq, args.blocks, 4, loss=args.loss, duplicates=0.1, jitter_us=20000)
+        blocks, stats = link.run(binary)
+        problems = link.check()
+        print(f"duplicates, 20 ms reordering: {stats}")
+        check("duplicates and 20 ms reordering: in order, timestamps exact",
+              not problems and stats.duplicates > 0 and stats.late > 0, "; ".join(problems[:3]) or f"{stats}")
+
+        # Half of everything lost, with long gaps that get skipped
+        link = EspnowLink(rng, first_seq, args.blocks, 1, loss=0.5, duplicates=0.05, jitter_us=5000)
+        blocks, stats = link.run(binary)
+        problems = link.check()
+        print(f"50% loss: {stats}")
+        check("50% loss: in order, concealed, counters add up", not problems, "; ".join(problems[:3]))
+
+        # Fading: a lost block repeats the last one at half level, then a quarter
+        # and an eighth, then silence; gaps past the reorder window are skipped
+        drop = {10, 20, 21, 22, 40, 41, 42, 43, 44}
+        link = EspnowLink(rng, 2**32 - 30, 60, 4, drop=drop, wait_us=2000)
+        blocks, stats = link.run(binary)
+        problems = link.check()
+        by_index = {(b.seq - (2**32 - 30)) % 2**32: b for b in blocks}
+
+        def faded(i, shift):
+            return array("h", (x >> shift for x in array("h", by_index[i].samples))).tobytes()
+
+        check("fade over lost blocks, skip past the reorder window",
+              not problems and sorted(i for i, b in by_index.items() if b.lost) == [10, 20, 21, 22, 42, 43, 44]
+              and stats.skipped == 2 and by_index[10].samples == faded(9, 1)
+              and [by_index[i].samples for i in (20, 21, 22)] == [faded(19, 1), faded(19, 2), faded(19, 3)]
+              and all(not any(by_index[i].samples) for i in (42, 43, 44)),
+              "; ".join(problems[:3]) or f"{stats}")
+
+    # Records: the Eye slices every JPEG into 4 KB records (AV_RECORD_FLAG_MORE)
+    # and writes arm board chunks in between
+    stream = bytearray()
+    jpegs, chunks = [], []
+    for i in range(40):
+        jpeg = rng.randbytes(rng.choice((0, 1, 4096, rng.randrange(1, 60000))))
+        jpegs.append(jpeg)
+        slices = [jpeg[k:k + 4096] for k in range(0, len(jpeg), 4096)] or [b""]
+        for n, piece in enumerate(slices):
+            more = FLAG_MORE if n < len(slices) - 1 else 0
+            stream += RECORD.pack(MAGIC, VIDEO, CAMERA, more, i, i * 33333, len(piece)) + piece
+            for _ in range(rng.randrange(3)):
+                seq = len(chunks) * 8
+                chunk = BLOCK_HEADER.pack(BLOCK_MAGIC, seq, seq * 5000, 960, 1, 16, 1, 0, *[0] * 12, 0)
+                chunk += rng.randbytes(960 * 2)
+                chunks.append((1 + len(chunks) % 2, seq, chunk))
+                stream += RECORD.pack(MAGIC, AUDIO, chunks[-1][0], 0, seq, seq * 5000, len(chunk)) + chunk
+    records = list(read_records(io.BytesIO(bytes(stream))))
+    check("sliced video records are joined, audio in between kept",
+          [r.payload for r in records if r.kind == VIDEO] == jpegs
+          and [(r.source, r.seq, r.payload) for r in records if r.kind == AUDIO] == chunks
+          and [r.seq for r in records if r.kind == VIDEO] == list(range(40)))
+
+    if failures:
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Print statistics of the Eye's merged A/V stream")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--wav", metavar="PREFIX", help="record each arm board's audio on the Eye's clock "
+                                                        "to PREFIX-arm<N>.wav")
+    parser.set_defaults(func=listen)
+
+    p = sub.add_parser("selftest", help="check the ESP-NOW framing and reassembly on a simulated link")
+    p.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    p.add_argument("--blocks", type=int, default=4000, help="5 ms blocks per simulated run")
+    p.add_argument("--loss", type=float, default=0.05, help="fragment loss of the lossy runs")
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,246 @@
+# Sample-rate drift compensation for the board audio streams.
+#
+# Every board samples audio off its own crystal, so a nominal 24 kHz stream is
+# really 24000 * (1 + e) Hz with e in the tens of ppm. Over a long session the
+# streams slide against each other and against the video. StreamLock estimates
+# each stream's true rate against one reference clock (host arrival time, or
+# board timestamps once they are mapped to a shared clock) and resamples it so
+# that output sample k always corresponds to reference time origin + k / rate.
+#
+#   lock = StreamLock(24000, channels=4, origin=session_start)
+#   for chunk in stream:                       # chunk: (n, channels) int16
+#       out = lock.process(time.monotonic(), chunk)
+#
+# How fast the estimate settles depends on how noisy the reference times are.
+# Host arrival times carry the network jitter, so the defaults collect minima
+# over 5 s buckets and need about 5 minutes to get within 1 ppm at 20 ms of
+# jitter and 4096-sample chunks (about 140 s with 20 ms chunks). Board
+# timestamps on the Eye's clock are only off by the sync error, a fraction of
+# a millisecond; StreamLock(..., **TIMESTAMPED) is within 1 ppm after 10 s.
+# av_stream.py locks the arm boards' audio that way.
+#
+# `python drift.py simulate` runs the estimator and resampler against a
+# synthetic drifting stream with network jitter and reports the convergence,
+# `--timestamps` with the TIMESTAMPED settings.
+
+import argparse
+import collections
+
+import numpy as np
+
+# Estimator settings for reference times that are capture timestamps on a shared
+# clock instead of host arrival times
+TIMESTAMPED = dict(bucket_s=1.0, min_buckets=10)
+
+
+class DriftEstimator:
+    """Estimates a stream's sample clock against the reference clock.
+
+    For every chunk the lateness t - n / nominal_rate is computed, where n is
+    the number of samples received up to time t. Network and scheduling delay
+    only ever make chunks late, so the minimum per bucket traces the true clock
+    relation. A line fitted through the bucket minima gives the drift (slope)
+    and the minimum transport delay (intercept).
+    """
+
+    def __init__(self, nominal_rate, bucket_s=5.0, window_s=1800.0, min_buckets=12):
+        self.nominal_rate = nominal_rate
+        self.bucket_s = bucket_s
+        self.min_buckets = min_buckets
+        self.buckets = collections.deque(maxlen=int(window_s / bucket_s))
+        self.current_bucket = None
+        self.slope = 0.0
+        self.intercept = None
+        self.t_base = None
+
+    def update(self, ref_time, sample_count):
+        """Add an observation: sample_count samples had arrived by ref_time."""
+        if self.t_base is None:
+            self.t_base = ref_time
+        t = ref_time - self.t_base
+        lateness = t - sample_count / self.nominal_rate
+        bucket = int(t // self.bucket_s)
+        if self.current_bucket is None or bucket != self.current_bucket[0]:
+            if self.current_bucket is not None:
+                self.buckets.append(self.current_bucket[1:])
+                self._fit()
+            self.current_bucket = [bucket, t, lateness]
+        elif lateness < self.current_bucket[2]:
+            self.current_bucket[1:] = [t, lateness]
+        if self.intercept is None:
+            self.intercept = lateness
+        return self.ppm
+
+    def _fit(self):
+        if len(self.buckets) < self.min_buckets:
+            self.intercept = min(self.intercept, min(b[1] for b in self.buckets))
+            return
+        t, lateness = np.array(self.buckets).T
+        self.slope, self.intercept = np.polyfit(t, lateness, 1)
+
+    @property
+    def ready(self):
+        return len(self.buckets) >= self.min_buckets
+
+    @property
+    def ratio(self):
+        """Actual rate / nominal rate of the stream's clock."""
+        return 1.0 - self.slope
+
+    @property
+    def ppm(self):
+        return -self.slope * 1e6
+
+    def sample_position(self, ref_time):
+        """Input sample index that was captured at ref_time, minus the transport delay."""
+        t = ref_time - self.t_base
+        return self.nominal_rate * ((1.0 - self.slope) * t - self.intercept)
+
+
+class StreamLock:
+    """Resamples one stream onto the reference timebase.
+
+    The read position advances by the estimated ratio per output sample, plus a
+    small correction that pulls it towards where the clock model says it should
+    be, so estimate updates are slewed in instead of causing jumps.
+    """
+
+    def __init__(self, nominal_rate, channels, origin=None, settle_s=10.0, max_slew_ppm=200.0, **estimator_args):
+        self.rate = nominal_rate
+        self.channels = channels
+        self.origin = origin
+        self.gain = 1.0 / (settle_s * nominal_rate)
+        self.max_slew = max_slew_ppm * 1e-6
+        self.estimator = DriftEstimator(nominal_rate, **estimator_args)
+        self.buffer = np.zeros((0, channels))
+        self.buffer_start = 0       # input index of buffer[0]
+        self.samples_in = 0
+        self.samples_out = 0
+        self.position = None        # input position of the next output sample
+        self.step = 1.0
+
+    @property
+    def ppm(self):
+        return self.estimator.ppm
+
+    def timebase_error(self):
+        """How far (in input samples) the read position is from the clock model."""
+        if self.position is None:
+            return 0.0
+        return self._model_position(self.samples_out) - self.position
+
+    def _model_position(self, k):
+        return self.estimator.sample_position(self.origin + k / self.rate)
+
+    def process(self, ref_time, samples):
+        samples = np.asarray(samples, dtype=np.float64).reshape(-1, self.channels)
+        self.samples_in += len(samples)
+        self.estimator.update(ref_time, self.samples_in)
+        self.buffer = np.concatenate([self.buffer, samples])
+        if self.origin is None:
+            self.origin = ref_time
+        if self.position is None:
+            self.position = self._model_position(0)
+
+        error = self._model_position(self.samples_out) - self.position
+        correction = np.clip(error * self.gain, -self.max_slew, self.max_slew)
+        self.step = self.estimator.ratio + correction
+
+        # Cubic interpolation needs one sample behind and two ahead of each position
+        available = self.samples_in - 2
+        count = int(np.floor((available - self.position) / self.step)) + 1
+        if count <= 0:
+            return np.zeros((0, self.channels))
+        positions = self.position + self.step * np.arange(count)
+        out = self._interpolate(positions)
+        self.position += self.step * count
+        self.samples_out += count
+
+        keep_from = max(int(np.floor(self.position)) - 1 - self.buffer_start, 0)
+        self.buffer = self.buffer[keep_from:]
+        self.buffer_start += keep_from
+        return out
+
+    def _interpolate(self, positions):
+        """Catmull-Rom interpolation; positions before the stream started give silence."""
+        out = np.zeros((len(positions), self.channels))
+        valid = positions >= self.buffer_start + 1
+        p = positions[valid] - self.buffer_start
+        i = np.floor(p).astype(int)
+        f = (p - i)[:, None]
+        y0, y1, y2, y3 = self.buffer[i - 1], self.buffer[i], self.buffer[i + 1], self.buffer[i + 2]
+        out[valid] = y1 + 0.5 * f * (y2 - y0 + f * (2 * y0 - 5 * y1 + 4 * y2 - y3 + f * (3 * (y1 - y2) + y3 - y0)))
+        return out
+
+
+def simulate(ppm, minutes, jitter_ms, chunk, rate, seed=0, **estimator_args):
+    """Feed a synthetic drifting stream through StreamLock and report how it locks."""
+    rng = np.random.default_rng(seed)
+    actual_rate = rate * (1 + ppm * 1e-6)
+    lock = StreamLock(rate, channels=1, origin=0.0, **estimator_args)
+    tone_hz = 440.0
+    base_delay = 0.005
+    total_chunks = int(minutes * 60 * actual_rate / chunk)
+    report_every = max(1, total_chunks // 12)
+
+    print(f"Simulating {minutes} min at {ppm:+.1f} ppm, {chunk}-sample chunks, "
+          f"{jitter_ms} ms mean network jitter")
+    print(f"{'time':>8} {'estimate':>12} {'error':>12} {'tone offset':>14}")
+    converged_at = None
+    phase_error_us = 0.0
+    arrival = 0.0
+    for c in range(total_chunks):
+        n = np.arange(c * chunk, (c + 1) * chunk)
+        audio = np.sin(2 * np.pi * tone_hz * n / actual_rate)
+        # The last sample of the chunk is captured at its device time, then delayed
+        # TCP delivers in order, a chunk held up holds up the ones behind it too
+        arrival = max((c + 1) * chunk / actual_rate + base_delay + rng.exponential(jitter_ms / 1000), arrival)
+        out = lock.process(arrival, audio)
+
+        if len(out) and lock.estimator.ready:
+            # Output sample k should be the tone at reference time k / rate (minus the base delay)
+            k = np.arange(lock.samples_out - len(out), lock.samples_out)
+            expected = np.sin(2 * np.pi * tone_hz * (k / rate - base_delay))
+            # Phase difference of the output tone against the expected one, in microseconds
+            ref = expected + 1j * np.cos(2 * np.pi * tone_hz * (k / rate - base_delay))
+            phase = np.angle(np.vdot(ref, out[:, 0] + 0j)) if np.any(out) else 0.0
+            phase_error_us = phase / (2 * np.pi * tone_hz) * 1e6
+
+        err_ppm = lock.ppm - ppm
+        if lock.estimator.ready and abs(err_ppm) < 1.0 and converged_at is None:
+            converged_at = arrival
+        elif abs(err_ppm) >= 1.0:
+            converged_at = None
+        if c % report_every == 0 or c == total_chunks - 1:
+            print(f"{arrival:>7.0f}s {lock.ppm:>+8.2f} ppm {err_ppm:>+8.2f} ppm {phase_error_us:>+11.1f} us")
+
+    print()
+    if converged_at is not None:
+        print(f"Converged to within 1 ppm after {converged_at:.0f} s and stayed there")
+    else:
+        print("Did not converge to within 1 ppm")
+    print(f"Final drift estimate {lock.ppm:+.3f} ppm (true {ppm:+.3f}), "
+          f"output tone {phase_error_us:+.1f} us from the reference timebase")
+    return converged_at is not None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sample-rate drift compensation")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("simulate", help="lock onto a synthetic drifting stream")
+    p.add_argument("--ppm", type=float, default=35.0)
+    p.add_argument("--minutes", type=float, default=30.0)
+    p.add_argument("--jitter-ms", type=float, default=None, help="20 for arrival times, 0.2 with --timestamps")
+    p.add_argument("--chunk", type=int, default=4096, help="samples per received chunk")
+    p.add_argument("--rate", type=int, default=24000)
+    p.add_argument("--timestamps", action="store_true",
+                   help="reference times are board timestamps on a shared clock, use TIMESTAMPED")
+    args = parser.parse_args()
+    jitter_ms = args.jitter_ms if args.jitter_ms is not None else 0.2 if args.timestamps else 20.0
+    ok = simulate(args.ppm, args.minutes, jitter_ms, args.chunk, args.rate,
+                  **(TIMESTAMPED if args.timestamps else {}))
+    raise SystemExit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
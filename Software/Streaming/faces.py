@@ -0,0 +1,523 @@
+# Reader and evaluation harness for the Eye's face detection, /faces
+#
+# The Eye runs the esp-dl face detector on its camera frames and streams the
+# boxes, one JSON object per line:
+#   {"seq":..,"timestamp_us":..,"width":640,"height":480,"detect_us":..,
+#    "faces":[{"x":..,"y":..,"w":..,"h":..,"score":..}]}
+# seq and timestamp_us are those of the camera frame the faces were found in
+# (the frame seq of /stream?container=1 and /av), the boxes are in its pixels,
+# highest score first. /faces?container=1 sends the same as stream_frame JSON
+# frames instead.
+#
+# `python faces.py` prints the results per second. `python faces.py eval DIR`
+# runs stored images through the Eye's detector (POST /faces) and scores it
+# against labelled boxes, or against the res10 SSD the host used until now.
+# esp-dl has no host build, so the model itself runs on the Eye; the rest of
+# the detector's C code builds on the host, `python faces.py selftest`
+# compiles it and checks it against this file.
+
+import argparse
+import collections
+import json
+import os
+import random
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from pathlib import Path
+
+import numpy as np
+import requests
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+
+SOFTWARE = Path(__file__).resolve().parents[1]
+FIRMWARE_MAIN = SOFTWARE.parent / "Firmware" / "Eye" / "ESP32_S3_eye_Camera_AP_One_Mic" / "main"
+
+# face_boxes.h
+INPUT_WIDTH, INPUT_HEIGHT = 320, 240
+MAX_FACES = 8
+
+HISTORY = 32    # /faces results FaceTracker keeps, a few seconds at FACE_DETECT_INTERVAL_MS
+
+
+def read_faces(ip=ESP32_IP, timeout=5):
+    """Yield the /faces results as dicts until the connection ends"""
+    with requests.get(f"http://{ip}/faces", stream=True, timeout=timeout) as response:
+        response.raise_for_status()
+        for line in response.iter_lines():
+            if line:
+                yield json.loads(line)
+
+
+class FaceTracker:
+    """Keeps the newest /faces results, read on a thread. Reconnects when the
+    stream ends, so a display loop can just look at .latest, or at .at(seq)
+    for the boxes of the frame it is showing."""
+
+    def __init__(self, ip=ESP32_IP, keep=HISTORY):
+        self.ip = ip
+        self.latest = None
+        self.history = collections.deque(maxlen=keep)
+        self.received = 0
+        self.running = False
+        self.thread = None
+
+    def at(self, seq):
+        """The newest result from the camera frame seq or an earlier one, the
+        boxes that were on screen when that frame was taken. The latest if
+        seq is None (older firmware) or older than every result kept."""
+        if seq is not None:
+            for result in reversed(self.history):
+                if result["seq"] <= seq:
+                    return result
+        return self.latest
+
+    def start(self):
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+        return self
+
+    def stop(self):
+        self.running = False
+
+    def _run(self):
+        while self.running:
+            try:
+                for result in read_faces(self.ip):
+                    self.history.append(result)
+                    self.latest = result
+                    self.received += 1
+                    if not self.running:
+                        return
+            except (requests.RequestException, ValueError) as e:
+                print(f"/faces: {e}, reconnecting")
+                time.sleep(1)
+
+
+def listen(args):
+    count = faces = 0
+    detect_us = []
+    last_seq = None
+    skipped = 0
+    started = time.monotonic()
+    for result in read_faces(args.ip):
+        count += 1
+        faces += len(result["faces"])
+        detect_us.append(result["detect_us"])
+        if last_seq is not None:
+            skipped += result["seq"] - last_seq - 1
+        last_seq = result["seq"]
+        now = time.monotonic()
+        if now - started >= 1:
+            best = max((f["score"] for f in result["faces"]), default=0)
+            print(f"{count / (now - started):5.1f} results/s, {faces / count:.2f} faces per frame, "
+                  f"detect {statistics.mean(detect_us) / 1000:.0f} ms (max {max(detect_us) / 1000:.0f}), "
+                  f"{skipped} frames between runs, last frame {last_seq}: {len(result['faces'])} faces, "
+                  f"best score {best:.2f}")
+            count = faces = skipped = 0
+            detect_us = []
+            started = now
+
+
+# ---------------------------------------------------------------------------
+# eval
+
+def iou(a, b):
+    ax, ay, aw, ah = a
+    bx, by, bw, bh = b
+    w = min(ax + aw, bx + bw) - max(ax, bx)
+    h = min(ay + ah, by + bh) - max(ay, by)
+    if w <= 0 or h <= 0:
+        return 0.0
+    inter = w * h
+    return inter / (aw * ah + bw * bh - inter)
+
+
+def match(found, reference, threshold):
+    """Greedy one-to-one matching by IoU, best pairs first. Returns the IoU of each match."""
+    pairs = sorted(((iou(f, r), i, j) for i, f in enumerate(found) for j, r in enumerate(reference)), reverse=True)
+    used_found, used_ref, matches = set(), set(), []
+    for value, i, j in pairs:
+        if value < threshold:
+            break
+        if i not in used_found and j not in used_ref:
+            used_found.add(i)
+            used_ref.add(j)
+            matches.append(value)
+    return matches
+
+
+class SsdReference:
+    """The res10 300x300 SSD that FacialDetection3_0.py runs, as the reference when there are no labels"""
+
+    def __init__(self, threshold):
+        import cv2
+        self.cv2 = cv2
+        self.net = cv2.dnn.readNetFromCaffe(str(SOFTWARE / "deploy.prototxt"),
+                                            str(SOFTWARE / "res10_300x300_ssd_iter_140000_fp16.caffemodel"))
+        self.threshold = threshold
+
+    def detect(self, image):
+        height, width = image.shape[:2]
+        blob = self.cv2.dnn.blobFromImage(image, 1.0, (300, 300), [104, 117, 123], swapRB=False, crop=False)
+        self.net.setInput(blob)
+        detections = self.net.forward()
+        boxes = []
+        for i in range(detections.shape[2]):
+            if detections[0, 0, i, 2] > self.threshold:
+                x1, y1, x2, y2 = (detections[0, 0, i, 3:7] * [width, height, width, height]).astype(int)
+                x1, y1, x2, y2 = max(x1, 0), max(y1, 0), min(x2, width), min(y2, height)
+                if x2 > x1 and y2 > y1:
+                    boxes.append((x1, y1, x2 - x1, y2 - y1))
+        return boxes
+
+
+def evaluate(args):
+    import cv2
+
+    paths = sorted(p for p in Path(args.images).iterdir()
+                   if p.suffix.lower() in (".jpg", ".jpeg", ".png", ".bmp"))
+    if not paths:
+        raise SystemExit(f"no images in {args.images}")
+    labels = None
+    if args.labels:
+        # {"image.jpg": [[x, y, w, h], ...], ...}
+        labels = {name: [tuple(box) for box in boxes] for name, boxes in json.loads(Path(args.labels).read_text()).items()}
+    reference = None if labels is not None else SsdReference(args.ssd_threshold)
+
+    found_total = reference_total = 0
+    ious = []
+    eye_ms, round_trip_ms, host_ms = [], [], []
+    failed = 0
+    for path in paths:
+        data = path.read_bytes()
+        image = cv2.imdecode(np.frombuffer(data, np.uint8), cv2.IMREAD_COLOR)
+        if image is None:
+            print(f"{path.name}: not an image")
+            failed += 1
+            continue
+        if path.suffix.lower() not in (".jpg", ".jpeg"):
+            data = cv2.imencode(".jpg", image, [cv2.IMWRITE_JPEG_QUALITY, args.quality])[1].tobytes()
+
+        started = time.monotonic()
+        try:
+            response = requests.post(f"http://{args.ip}/faces", data=data, timeout=10,
+                                     headers={"Content-Type": "image/jpeg"})
+        except requests.RequestException as e:
+            print(f"{path.name}: {e}")
+            failed += 1
+            continue
+        round_trip_ms.append((time.monotonic() - started) * 1000)
+        if response.status_code != 200:
+            print(f"{path.name}: {response.status_code} {response.text.strip()}")
+            failed += 1
+            continue
+        result = response.json()
+        eye_ms.append(result["detect_us"] / 1000)
+        found = [(f["x"], f["y"], f["w"], f["h"]) for f in result["faces"] if f["score"] >= args.min_score]
+
+        if labels is not None:
+            expected = labels.get(path.name, [])
+        else:
+            started = time.monotonic()
+            expected = reference.detect(image)
+            host_ms.append((time.monotonic() - started) * 1000)
+        matches = match(found, expected, args.iou)
+        found_total += len(found)
+        reference_total += len(expected)
+        ious += matches
+        if args.verbose or len(matches) != len(found) or len(matches) != len(expected):
+            print(f"{path.name}: {len(found)} found, {len(expected)} expected, {len(matches)} matched, "
+                  f"detect {result['detect_us'] / 1000:.0f} ms")
+
+    evaluated = len(paths) - failed
+    precision = len(ious) / found_total if found_total else 1.0
+    recall = len(ious) / reference_total if reference_total else 1.0
+    source = "labels" if labels is not None else f"res10 SSD > {args.ssd_threshold}"
+    print(f"\n{evaluated} images ({failed} failed), reference {source}: {reference_total} faces, "
+          f"Eye found {found_total}")
+    print(f"IoU >= {args.iou}: {len(ious)} matched, precision {precision:.3f}, recall {recall:.3f}, "
+          f"mean IoU {statistics.mean(ious) if ious else 0:.3f}")
+    if eye_ms:
+        ordered = sorted(eye_ms)
+        print(f"Eye detection: median {statistics.median(eye_ms):.0f} ms, "
+              f"p95 {ordered[int(0.95 * (len(ordered) - 1))]:.0f} ms, "
+              f"upload and answer median {statistics.median(round_trip_ms):.0f} ms")
+    if host_ms:
+        print(f"Host SSD: median {statistics.median(host_ms):.1f} ms per image")
+    ok = failed == 0 and recall >= args.min_recall and precision >= args.min_precision
+    print("PASS" if ok else "FAIL")
+    raise SystemExit(0 if ok else 1)
+
+
+# ---------------------------------------------------------------------------
+# selftest
+
+SELFTEST_C = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "face_boxes.h"
+
+static uint8_t *read_bytes(size_t n) {
+    uint8_t *buf = malloc(n ? n : 1);
+    if (fread(buf, 1, n, stdin) != n) {
+        exit(2);
+    }
+    return buf;
+}
+
+int main(void) {
+    char cmd[16];
+    while (scanf("%15s", cmd) == 1) {
+        if (strcmp(cmd, "size") == 0) {
+            size_t n;
+            if (scanf("%zu", &n) != 1) return 2;
+            getchar();
+            uint8_t *jpg = read_bytes(n);
+            uint16_t w = 0, h = 0;
+            if (face_jpeg_size(jpg, n, &w, &h)) {
+                printf("%u %u\n", w, h);
+            } else {
+                printf("none\n");
+            }
+            free(jpg);
+        } else if (strcmp(cmd, "shift") == 0) {
+            unsigned w, h;
+            if (scanf("%u %u", &w, &h) != 2) return 2;
+            printf("%d\n", face_decode_shift(w, h));
+        } else if (strcmp(cmd, "image") == 0) {
+            // capacity, size, then blocks as the JPEG decoder writes them
+            size_t capacity, jpg_len;
+            unsigned w, h, blocks;
+            if (scanf("%zu %zu %u %u %u", &capacity, &jpg_len, &w, &h, &blocks) != 5) return 2;
+            getchar();
+            uint8_t *jpg = read_bytes(jpg_len);
+            face_image_t image = { .jpg = jpg, .jpg_len = jpg_len, .rgb = calloc(capacity ? capacity : 1, 1),
+                                   .capacity = capacity };
+            face_image_write(&image, 0, 0, w, h, NULL);
+            for (unsigned i = 0; i < blocks; i++) {
+                unsigned x, y, bw, bh;
+                if (scanf("%u %u %u %u", &x, &y, &bw, &bh) != 4) return 2;
+                getchar();
+                uint8_t *data = read_bytes((size_t)bw * bh * 3);
+                face_image_write(&image, x, y, bw, bh, data);
+                free(data);
+            }
+            face_image_write(&image, w, h, 0, 0, NULL);
+            // The reader as the decoder uses it: skips, reads and past the end
+            uint8_t copy[64];
+            size_t skipped = face_image_read(&image, 0, NULL, 3);
+            size_t got = face_image_read(&image, 3, copy, sizeof(copy));
+            size_t past = face_image_read(&image, jpg_len, copy, 1);
+            int same = memcmp(copy, jpg + 3, got) == 0;
+            printf("%u %u %d %zu %zu %zu %d\n", image.width, image.height, image.overflow, skipped, got, past, same);
+            if (!image.overflow) {
+                fwrite(image.rgb, 1, (size_t)image.width * image.height * 3, stdout);
+            }
+            free(image.rgb);
+            free(jpg);
+        } else if (strcmp(cmd, "boxes") == 0) {
+            face_result_t result = { 0 };
+            unsigned w, h, detect;
+            int shift, n;
+            if (scanf("%u %lld %u %u %u %d %d", &result.seq, (long long *)&result.timestamp_us, &w, &h, &detect,
+                      &shift, &n) != 7) return 2;
+            result.width = w;
+            result.height = h;
+            result.detect_us = detect;
+            face_raw_t *raw = malloc(sizeof(face_raw_t) * (n ? n : 1));
+            for (int i = 0; i < n; i++) {
+                if (scanf("%d %d %d %d %f", &raw[i].x1, &raw[i].y1, &raw[i].x2, &raw[i].y2, &raw[i].score) != 5) return 2;
+            }
+            face_boxes_finish(&result, raw, n, shift);
+            char json[1024];
+            face_result_format(&result, json, sizeof(json));
+            printf("%s\n", json);
+            free(raw);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+"""
+
+
+def jpeg_header(width, height, sof=0xC0, fill=False, extra=()):
+    """A JPEG up to its scan header, enough for face_jpeg_size()"""
+    def segment(marker, body):
+        return bytes((0xFF, marker)) + struct.pack(">H", len(body) + 2) + body
+    data = b"\xff\xd8" + segment(0xE0, b"JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00")
+    for marker, body in extra:
+        data += segment(marker, body)
+    data += segment(0xDB, bytes(65))
+    if fill:
+        data += b"\xff"
+    data += segment(sof, struct.pack(">BHHB", 8, height, width, 3) + bytes(9))
+    data += segment(0xC4, bytes(20)) + segment(0xDA, bytes(10)) + bytes(100) + b"\xff\xd9"
+    return data
+
+
+def finish_reference(raw, width, height, shift):
+    boxes = []
+    for x1, y1, x2, y2, score in raw:
+        x1, x2 = (min(max(v << shift, 0), width) for v in (x1, x2))
+        y1, y2 = (min(max(v << shift, 0), height) for v in (y1, y2))
+        if x2 > x1 and y2 > y1:
+            boxes.append({"x": x1, "y": y1, "w": x2 - x1, "h": y2 - y1, "score": score})
+    return sorted(boxes, key=lambda b: -b["score"])[:MAX_FACES]
+
+
+def selftest(args):
+    failures = []
+
+    def check(name, ok, detail=""):
+        print(f"{'ok  ' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        if not ok:
+            failures.append(name)
+
+    rng = random.Random(args.seed)
+    with tempfile.TemporaryDirectory() as tmp:
+        source = Path(tmp) / "selftest.c"
+        source.write_text(SELFTEST_C)
+        binary = Path(tmp) / "selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", f"-I{FIRMWARE_MAIN}", str(source),
+                        str(FIRMWARE_MAIN / "face_boxes.c"), "-o", str(binary)], check=True)
+        driver = subprocess.Popen([str(binary)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+        def send(line, payload=b""):
+            driver.stdin.write(line.encode() + b"\n" + payload)
+            driver.stdin.flush()
+
+        def answer():
+            return driver.stdout.readline().decode().strip()
+
+        # Frame sizes from the SOF marker
+        cases = [(jpeg_header(640, 480), "640 480"), (jpeg_header(1280, 720, sof=0xC2), "1280 720"),
+                 (jpeg_header(320, 240, fill=True), "320 240"),
+                 (jpeg_header(800, 600, extra=[(0xC4, bytes(30)), (0xFE, b"comment")]), "800 600"),
+                 (jpeg_header(640, 480)[:30], "none"), (b"\x89PNG\r\n\x1a\n" + bytes(40), "none"),
+                 (jpeg_header(0, 480), "none"), (b"\xff\xd8" + bytes(4), "none")]
+        # Without a SOF before the scan there is no size
+        no_sof = jpeg_header(640, 480)
+        sof = no_sof.index(b"\xff\xc0")
+        cases.append((no_sof[:sof] + no_sof[sof + 19:], "none"))
+        results = []
+        for data, _ in cases:
+            send(f"size {len(data)}", data)
+            results.append(answer())
+        check("frame size from the SOF marker", results == [expected for _, expected in cases],
+              f"{results}")
+
+        # Scale to the detector input
+        shifts = {(640, 480): 1, (320, 240): 0, (160, 120): 0, (800, 600): 2, (1280, 720): 2, (1024, 768): 2,
+                  (1600, 1200): 3, (2592, 1944): 3, (352, 288): 1}
+        results = {}
+        for (w, h), _ in shifts.items():
+            send(f"shift {w} {h}")
+            results[(w, h)] = int(answer())
+        check("decode scale keeps the input within 320x240", results == shifts, f"{results}")
+
+        # The image written block by block, in any order, edge blocks sticking out
+        image_ok = True
+        for w, h, block in ((160, 120, 16), (75, 45, 8), (320, 240, 16), (17, 9, 16)):
+            image = np.frombuffer(rng.randbytes(w * h * 3), np.uint8).reshape(h, w, 3)
+            blocks = []
+            for y in range(0, h, block):
+                for x in range(0, w, block):
+                    padded = np.zeros((block, block, 3), np.uint8)
+                    part = image[y:y + block, x:x + block]
+                    padded[:part.shape[0], :part.shape[1]] = part
+                    # The padding is junk in the decoder too
+                    padded[part.shape[0]:, :] = 0xAA
+                    padded[:, part.shape[1]:] = 0x55
+                    blocks.append((x, y, padded))
+            rng.shuffle(blocks)
+            jpg = rng.randbytes(200)
+            send(f"image {w * h * 3} {len(jpg)} {w} {h} {len(blocks)}", jpg)
+            for x, y, data in blocks:
+                send(f"{x} {y} {block} {block}", data.tobytes())
+            fields = answer().split()
+            rgb = driver.stdout.read(w * h * 3)
+            image_ok &= fields == [str(w), str(h), "0", "3", "64", "0", "1"] and rgb == image.tobytes()
+        check("decoder blocks assemble the image, reader skips and reads", image_ok)
+        send(f"image {100 * 100 * 3 - 1} 10 100 100 1", bytes(10))
+        send("0 0 16 16", bytes(16 * 16 * 3))
+        check("an image too large for the buffer is flagged", answer().split()[:3] == ["100", "100", "1"])
+
+        # Boxes back onto the frame: scaled, clipped, sorted and cut
+        boxes_ok = True
+        detail = ""
+        for case in range(args.cases):
+            width, height = rng.choice(((640, 480), (320, 240), (1280, 720), (800, 600)))
+            shift = rng.randrange(4)
+            raw = []
+            for _ in range(rng.choice((0, 1, 3, 8, 12, 20))):
+                x1 = rng.randrange(-40, (width >> shift) + 40)
+                y1 = rng.randrange(-40, (height >> shift) + 40)
+                x2 = x1 + rng.randrange(-5, 120)
+                y2 = y1 + rng.randrange(-5, 120)
+                raw.append((x1, y1, x2, y2, rng.choice((rng.randrange(1000) / 1000, 0.5))))
+            seq, timestamp, detect = rng.randrange(2**32), rng.randrange(-2**40, 2**62), rng.randrange(2**31)
+            send(f"boxes {seq} {timestamp} {width} {height} {detect} {shift} {len(raw)}\n" +
+                 "\n".join(f"{x1} {y1} {x2} {y2} {score}" for x1, y1, x2, y2, score in raw))
+            got = json.loads(answer())
+            expected = finish_reference(raw, width, height, shift)
+            same = (got["seq"], got["timestamp_us"], got["width"], got["height"], got["detect_us"]) == \
+                (seq, timestamp, width, height, detect) and len(got["faces"]) == len(expected) and all(
+                {k: g[k] for k in "xywh"} == {k: e[k] for k in "xywh"} and abs(g["score"] - e["score"]) < 1e-3
+                for g, e in zip(got["faces"], expected))
+            if not same and boxes_ok:
+                detail = f"case {case}: {got} != {expected}"
+            boxes_ok &= same
+        check(f"{args.cases} results match the Python reference", boxes_ok, detail)
+        driver.stdin.close()
+        driver.wait()
+
+    # The matching used by eval
+    check("IoU matching is one to one", match([(0, 0, 10, 10), (1, 1, 10, 10)], [(0, 0, 10, 10)], 0.5) == [1.0])
+    if failures:
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Face boxes from the Eye")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.set_defaults(func=listen)
+
+    p = sub.add_parser("eval", help="score the Eye's detector on stored images")
+    p.add_argument("images", help="directory of .jpg/.png images")
+    p.add_argument("--ip", default=ESP32_IP)
+    p.add_argument("--labels", help='JSON of the true boxes, {"name.jpg": [[x, y, w, h], ...]}; '
+                                    "without it the host's res10 SSD is the reference")
+    p.add_argument("--ssd-threshold", type=float, default=0.7, help="as in FacialDetection3_0.py")
+    p.add_argument("--min-score", type=float, default=0.0, help="ignore the Eye's boxes below this score")
+    p.add_argument("--iou", type=float, default=0.5, help="overlap that counts as the same face")
+    p.add_argument("--quality", type=int, default=90, help="JPEG quality for images that are not JPEGs")
+    p.add_argument("--min-recall", type=float, default=0.0)
+    p.add_argument("--min-precision", type=float, default=0.0)
+    p.add_argument("--verbose", action="store_true", help="a line for every image, not only mismatches")
+    p.set_defaults(func=evaluate)
+
+    p = sub.add_parser("selftest", help="check the firmware's face_boxes.c against this file")
+    p.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    p.add_argument("--cases", type=int, default=500)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
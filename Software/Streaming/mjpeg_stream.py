@@ -0,0 +1,759 @@
+# Reader for the Eye's MJPEG stream, /stream
+#
+# Every multipart part says which camera frame it carries besides its length:
+# X-Frame-Seq (the capture's frame number, as in /stream?container=1, /av and
+# /faces; a gap is frames this client skipped), X-Timestamp (the frame's VSYNC
+# in us on the Eye's clock, the one time_sync.py and the arm boards
+# synchronize to) and X-Capture-Delay-Us (VSYNC to the part being sent). It
+# also carries the camera settings it was sent at: X-Framesize, X-Quality and
+# X-Fps (the stream's frame rate cap, 0 when it takes every frame). With
+# ?adapt=1 the Eye's video rate controller (main/video_rate.h) lowers the
+# frame size, quality and frame rate when the frames take too long to leave,
+# and raises them again when the link has room.
+#
+# `python mjpeg_stream.py --adapt` prints the frame rate, throughput, skipped
+# frames and latency every second, and every change of the settings as it
+# arrives. With --sync the latency is measured up to the host, through the
+# time synchronization with the Eye.
+# `python mjpeg_stream.py selftest` reads parts in the firmware's header
+# format, and compiles the firmware's video_rate.c with the host C compiler
+# and runs it against a simulated link. It also runs the video shaper's token
+# bucket (token_bucket.c) on a virtual clock, and the shared camera capture
+# (camera_frames.c) against a fake camera driver.
+
+import argparse
+import io
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+import requests
+
+import time_sync
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+BOUNDARY = b"123456789000000000000987654321"
+
+SOFTWARE = Path(__file__).resolve().parents[1]
+FIRMWARE = SOFTWARE.parent / "Firmware"
+FIRMWARE_MAIN = FIRMWARE / "Eye" / "ESP32_S3_eye_Camera_AP_One_Mic" / "main"
+
+
+class Part:
+    """One multipart part: its headers (lower case names) and the JPEG"""
+
+    def __init__(self, headers, jpeg):
+        self.headers = headers
+        self.jpeg = jpeg
+        # None from firmware without them
+        self.seq = self._int("x-frame-seq")
+        self.timestamp_us = self._int("x-timestamp")
+        self.delay_us = self._int("x-capture-delay-us")
+
+    def _int(self, name):
+        value = self.headers.get(name)
+        return int(value) if value is not None else None
+
+    def setting(self):
+        """(framesize, quality, fps) the Eye sent the frame at, None from older firmware"""
+        if "x-framesize" not in self.headers:
+            return None
+        return (self.headers["x-framesize"], int(self.headers.get("x-quality", 0)),
+                int(self.headers.get("x-fps", 0)))
+
+
+def read_parts(stream):
+    """Yield the Parts of a multipart/x-mixed-replace body, a file-like object"""
+    while True:
+        line = stream.readline()
+        if not line:
+            return
+        if line.strip() != b"--" + BOUNDARY:
+            continue
+        headers = {}
+        while True:
+            line = stream.readline()
+            if not line:
+                return
+            line = line.strip()
+            if not line:
+                break
+            name, _, value = line.decode("latin-1").partition(":")
+            headers[name.strip().lower()] = value.strip()
+        length = int(headers.get("content-length", 0))
+        jpeg = stream.read(length)
+        if len(jpeg) < length:
+            return
+        yield Part(headers, jpeg)
+
+
+def stream_query(adapt=False, raw=False):
+    params = [key for key, on in (("adapt", adapt), ("raw", raw)) if on]
+    return "?" + "&".join(f"{key}=1" for key in params) if params else ""
+
+
+def listen(args):
+    url = f"http://{args.ip}/stream{stream_query(args.adapt, args.raw)}"
+    sync = time_sync.SyncClient(args.ip).start() if args.sync else None
+    with requests.get(url, stream=True, timeout=5) as response:
+        response.raise_for_status()
+        response.raw.decode_content = True
+        frames = total = skipped = 0
+        delays, latencies = [], []
+        last_seq = None
+        setting = None
+        started = time.monotonic()
+        for part in read_parts(response.raw):
+            frames += 1
+            total += len(part.jpeg)
+            if part.seq is not None:
+                if last_seq is not None and part.seq > last_seq:
+                    skipped += part.seq - last_seq - 1
+                last_seq = part.seq
+            if part.delay_us is not None:
+                delays.append(part.delay_us)
+            if sync is not None and sync.synced and part.timestamp_us is not None:
+                # The whole part is here: VSYNC to the host, on the Eye's clock
+                latencies.append(sync.to_master() - part.timestamp_us)
+            if part.setting() != setting:
+                setting = part.setting()
+                if setting is not None:
+                    print(f"now {setting[0]} quality {setting[1]}, " +
+                          (f"at most {setting[2]} fps" if setting[2] else "every frame"))
+            now = time.monotonic()
+            if now - started >= 1:
+                elapsed = now - started
+                line = (f"{frames / elapsed:5.1f} frames/s, {total * 8 / elapsed / 1000:6.0f} kbit/s, "
+                        f"{total / frames / 1024:5.1f} KB per frame, {skipped} skipped")
+                if delays:
+                    line += f", sent after {sum(delays) / len(delays) / 1000:.0f} ms (max {max(delays) / 1000:.0f})"
+                if latencies:
+                    line += (f", on the host after {sum(latencies) / len(latencies) / 1000:.0f} ms "
+                             f"(max {max(latencies) / 1000:.0f})")
+                elif sync is not None:
+                    line += ", clock not synchronized yet"
+                print(line)
+                frames = total = skipped = 0
+                delays, latencies = [], []
+                started = now
+
+
+# ---------------------------------------------------------------------------
+# selftest
+
+# Built against video_rate.c and token_bucket.c by the selftest. Reads commands from stdin:
+#   init SIZE QUALITY TARGET_MS NOW_US  -> the points, "count size quality fps ..."
+#   update SEND_US LATENCY_US NOW_US    -> "changed point latency_us send_us steps_down steps_up up_hold_ms"
+#   bucket KBPS BURST_BYTES NOW_US      -> "bucket"
+#   take LEN NOW_US                     -> "wait_us tokens"
+SELFTEST_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include "token_bucket.h"
+#include "video_rate.h"
+
+int main(void) {
+    char line[256];
+    video_rate_t rate;
+    token_bucket_t bucket;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (strncmp(line, "init ", 5) == 0) {
+            int size, quality;
+            unsigned target_ms;
+            long long now_us;
+            sscanf(line + 5, "%d %d %u %lld", &size, &quality, &target_ms, &now_us);
+            video_rate_init(&rate, (video_size_t)size, quality, target_ms, now_us);
+            printf("%u", rate.count);
+            for (int i = 0; i < rate.count; i++) {
+                printf(" %u %u %u", rate.points[i].size, rate.points[i].quality, rate.points[i].fps);
+            }
+            printf("\n");
+        } else if (strncmp(line, "update ", 7) == 0) {
+            unsigned send_us, latency_us;
+            long long now_us;
+            sscanf(line + 7, "%u %u %lld", &send_us, &latency_us, &now_us);
+            bool changed = video_rate_update(&rate, send_us, latency_us, now_us);
+            printf("%d %u %u %u %u %u %u\n", changed, rate.point, (unsigned)rate.latency_us,
+                   (unsigned)rate.send_us, (unsigned)rate.steps_down, (unsigned)rate.steps_up,
+                   (unsigned)rate.up_hold_ms);
+        } else if (strncmp(line, "bucket ", 7) == 0) {
+            unsigned kbps, burst;
+            long long now_us;
+            sscanf(line + 7, "%u %u %lld", &kbps, &burst, &now_us);
+            token_bucket_init(&bucket, kbps, burst, now_us);
+            printf("bucket\n");
+        } else if (strncmp(line, "take ", 5) == 0) {
+            size_t len;
+            long long now_us;
+            sscanf(line + 5, "%zu %lld", &len, &now_us);
+            long long wait_us = token_bucket_take(&bucket, len, now_us);
+            printf("%lld %lld\n", wait_us, (long long)bucket.tokens);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+"""
+
+# camera_frames.c against a fake camera driver, built by the selftest with the
+# headers below in place of ESP-IDF's. One thread plays the capture task and
+# every subscriber, the stubs count the times the frame lock is taken twice or
+# a FreeRTOS or driver call is made while it is held. Commands:
+#   sub T / unsub T         -> subscriber slot of task T (-1: none free) / "unsub"
+#   capture                 -> "1 seq", "0" when capture_one() failed
+#   idle                    -> "idle", what the capture task does with nobody subscribed
+#   get T / release T       -> "seq refs" or "none" / "released", T's oldest frame held
+#   mode raw|jpeg|badraw    -> "mode", driver frames that need converting (badraw: and fail to)
+#   clock US                -> "clock", esp_timer time, frames get their VSYNC 5 ms before
+#   state                   -> "driver_out captured failures delivered skipped subscribers violations"
+#   ages                    -> "capture_frames capture_last_us sent_frames sent_last_us"
+#   wakes T                 -> notifications T got since the last "wakes T"
+CAMERA_STUBS = {
+    "sdkconfig.h": "#pragma once\n#define CONFIG_CAMERA_FB_COUNT 5\n",
+    "esp_err.h": "#pragma once\ntypedef int esp_err_t;\n#define ESP_OK 0\n#define ESP_FAIL -1\n",
+    "esp_log.h": "#pragma once\nvoid stub_log(const char *tag, const char *format, ...);\n"
+                 "#define ESP_LOGE(tag, format, ...) stub_log(tag, format, ##__VA_ARGS__)\n",
+    "esp_timer.h": "#pragma once\n#include <stdint.h>\nint64_t esp_timer_get_time(void);\n",
+    "freertos/FreeRTOS.h": r"""#pragma once
+#include <stdint.h>
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef struct stub_task *TaskHandle_t;
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY UINT32_MAX
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+void stub_enter(portMUX_TYPE *lock);
+void stub_exit(portMUX_TYPE *lock);
+#define taskENTER_CRITICAL(lock) stub_enter(lock)
+#define taskEXIT_CRITICAL(lock) stub_exit(lock)
+""",
+    "freertos/task.h": r"""#pragma once
+#include "freertos/FreeRTOS.h"
+BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+""",
+    "esp_camera.h": r"""#pragma once
+#include <stddef.h>
+#include <stdint.h>
+typedef enum { PIXFORMAT_RGB565, PIXFORMAT_JPEG } pixformat_t;
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    pixformat_t format;
+    struct { long tv_sec; long tv_usec; } timestamp;
+} camera_fb_t;
+camera_fb_t *esp_camera_fb_get(void);
+void esp_camera_fb_return(camera_fb_t *fb);
+""",
+    "img_converters.h": r"""#pragma once
+#include <stdbool.h>
+#include "esp_camera.h"
+bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *out_len);
+""",
+}
+
+CAMERA_SELFTEST_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include "camera_frames.c"
+
+#define TASKS 4
+#define HELD 8
+
+struct stub_task { int id; unsigned wakes; };
+static struct stub_task tasks[TASKS];
+static TaskHandle_t current;
+static int lock_depth, violations;
+static int64_t now_us;
+static TickType_t ticks;
+
+void stub_log(const char *tag, const char *format, ...) { (void)tag; (void)format; }
+int64_t esp_timer_get_time(void) { return now_us; }
+
+void stub_enter(portMUX_TYPE *lock) { (void)lock; violations += lock_depth++ != 0; }
+void stub_exit(portMUX_TYPE *lock) { (void)lock; violations += --lock_depth != 0; }
+static void outside_lock(void) { violations += lock_depth != 0; }
+
+BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task) {
+    (void)fn; (void)name; (void)stack; (void)arg; (void)priority; (void)task;
+    return pdPASS;
+}
+void vTaskDelay(TickType_t t) { outside_lock(); ticks += t; }
+TickType_t xTaskGetTickCount(void) { return ticks; }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return current; }
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { outside_lock(); task->wakes++; return pdPASS; }
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t t) { (void)clear; outside_lock(); ticks += t; return 0; }
+
+// The driver: CONFIG_CAMERA_FB_COUNT buffers, NULL once all of them are out
+static camera_fb_t fbs[CONFIG_CAMERA_FB_COUNT];
+static bool fb_out[CONFIG_CAMERA_FB_COUNT];
+static uint8_t fb_data[CONFIG_CAMERA_FB_COUNT][16];
+static pixformat_t format = PIXFORMAT_JPEG;
+static bool convert_fails;
+
+camera_fb_t *esp_camera_fb_get(void) {
+    outside_lock();
+    for (int i = 0; i < CONFIG_CAMERA_FB_COUNT; i++) {
+        if (!fb_out[i]) {
+            fb_out[i] = true;
+            fbs[i] = (camera_fb_t){ .buf = fb_data[i], .len = sizeof(fb_data[i]), .format = format };
+            fbs[i].timestamp.tv_sec = (now_us - 5000) / 1000000;
+            fbs[i].timestamp.tv_usec = (now_us - 5000) % 1000000;
+            return &fbs[i];
+        }
+    }
+    return NULL;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+    outside_lock();
+    violations += !fb_out[fb - fbs];
+    fb_out[fb - fbs] = false;
+}
+
+bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *out_len) {
+    (void)quality;
+    if (convert_fails) {
+        return false;
+    }
+    *out = malloc(fb->len);
+    memcpy(*out, fb->buf, fb->len);
+    *out_len = fb->len;
+    return true;
+}
+
+int main(void) {
+    char line[64];
+    camera_frames_sub_t *sub_of[TASKS] = {0};
+    camera_frame_t *held[TASKS][HELD];
+    int held_count[TASKS] = {0};
+    for (int i = 0; i < TASKS; i++) {
+        tasks[i].id = i;
+    }
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        int t = 0;
+        if (sscanf(line, "sub %d", &t) == 1) {
+            current = &tasks[t];
+            sub_of[t] = camera_frames_subscribe();
+            printf("%d\n", sub_of[t] == NULL ? -1 : (int)(sub_of[t] - subs));
+        } else if (sscanf(line, "unsub %d", &t) == 1) {
+            camera_frames_unsubscribe(sub_of[t]);
+            sub_of[t] = NULL;
+            printf("unsub\n");
+        } else if (strncmp(line, "capture", 7) == 0) {
+            if (capture_one()) {
+                printf("1 %u\n", (unsigned)latest->seq);
+            } else {
+                printf("0\n");
+            }
+        } else if (strncmp(line, "idle", 4) == 0) {
+            publish(NULL);
+            printf("idle\n");
+        } else if (sscanf(line, "get %d", &t) == 1) {
+            current = &tasks[t];
+            camera_frame_t *frame = camera_frames_get(sub_of[t], 0);
+            if (frame == NULL) {
+                printf("none\n");
+            } else {
+                held[t][held_count[t]++] = frame;
+                printf("%u %d\n", (unsigned)frame->seq, frame->refs);
+            }
+        } else if (sscanf(line, "release %d", &t) == 1) {
+            camera_frames_release(held[t][0]);
+            memmove(held[t], held[t] + 1, --held_count[t] * sizeof(held[t][0]));
+            printf("released\n");
+        } else if (strncmp(line, "mode ", 5) == 0) {
+            format = strncmp(line + 5, "jpeg", 4) == 0 ? PIXFORMAT_JPEG : PIXFORMAT_RGB565;
+            convert_fails = strncmp(line + 5, "badraw", 6) == 0;
+            printf("mode\n");
+        } else if (strncmp(line, "clock ", 6) == 0) {
+            long long us;
+            sscanf(line + 6, "%lld", &us);
+            now_us = us;
+            printf("clock\n");
+        } else if (strncmp(line, "state", 5) == 0) {
+            int out = 0;
+            for (int i = 0; i < CONFIG_CAMERA_FB_COUNT; i++) {
+                out += fb_out[i];
+            }
+            camera_frames_stats_t s;
+            camera_frames_get_stats(&s);
+            printf("%d %u %u %u %u %u %d\n", out, (unsigned)s.captured, (unsigned)s.failures,
+                   (unsigned)s.delivered, (unsigned)s.skipped, (unsigned)s.subscribers, violations);
+        } else if (strncmp(line, "ages", 4) == 0) {
+            camera_frames_stats_t s;
+            camera_frames_get_stats(&s);
+            printf("%u %u %u %u\n", (unsigned)s.capture_age.frames, (unsigned)s.capture_age.last_us,
+                   (unsigned)s.sent_age.frames, (unsigned)s.sent_age.last_us);
+        } else if (sscanf(line, "wakes %d", &t) == 1) {
+            printf("%u\n", tasks[t].wakes);
+            tasks[t].wakes = 0;
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+"""
+
+# video_rate.h
+QVGA, VGA, SVGA, HD = range(4)
+SIZES = {QVGA: (320, 240), VGA: (640, 480), SVGA: (800, 600), HD: (1280, 720)}
+MAX_FPS = 30
+LADDER = [(SVGA, 12, 20), (VGA, 12, 25), (VGA, 18, 20), (VGA, 25, 15), (QVGA, 15, 15), (QVGA, 25, 10), (QVGA, 40, 5)]
+MAX_POINTS = 8
+MAX_UP_HOLD_S = 80
+
+CAMERA_FPS = 25         # what the sensor makes at most
+CAPTURE_US = 15000      # VSYNC to the frame being ready to send
+
+
+def firmware_part_format():
+    """The part header of the Eye's mjpeg_send_part_raw() / _chunked() up to
+    the JPEG, from the firmware source, as a Python % format taking the JPEG
+    length, seq, timestamp, delay, frame size, quality and fps"""
+    source = (FIRMWARE_MAIN / "softap_example_main.c").read_text()
+    body = source[source.index("static int mjpeg_part_fields("):]
+    body = body[:body.index(";")]
+    fields = "".join(re.findall(r'"((?:[^"\\]|\\.)*)"', body)).encode().decode("unicode_escape")
+    head = "\r\n--" + BOUNDARY.decode() + "\r\nContent-Type: image/jpeg\r\nContent-Length: "
+    return head + re.sub(r"%l+([ud])", r"%\1", fields)
+
+
+def points_reference(size, quality):
+    points = [(size, quality, MAX_FPS)]
+    for point in LADDER:
+        if len(points) < MAX_POINTS and (point[0] < size or (point[0] == size and point[1] > quality)):
+            points.append(point)
+    return points
+
+
+def frame_bytes(point):
+    """About what the OV2640 makes: 30 KB for VGA at quality 12"""
+    width, height = SIZES[point[0]]
+    return int(width * height * 1.2 / point[1])
+
+
+class Simulation:
+    """One adaptive stream through a link of a given rate. Sending a frame
+    blocks for as long as the link takes to carry it."""
+
+    def __init__(self, send, answer, points, start_us):
+        self.send, self.answer = send, answer
+        self.points = points
+        self.point = 0
+        self.now_us = start_us
+        self.log = []       # (time_us, point, latency_us, changed)
+
+    def run(self, seconds, kbps):
+        end_us = self.now_us + seconds * 1000000
+        while self.now_us < end_us:
+            point = self.points[self.point]
+            send_us = frame_bytes(point) * 8000 // kbps
+            latency_us = CAPTURE_US + send_us
+            self.send(f"update {send_us} {latency_us} {self.now_us + send_us}")
+            fields = list(map(int, self.answer().split()))
+            changed, self.point = fields[0], fields[1]
+            self.log.append((self.now_us, self.point, latency_us, changed))
+            period_us = max(1000000 // point[2], 1000000 // CAMERA_FPS, send_us)
+            self.now_us += period_us
+        return fields
+
+    def window(self, start_s, end_s):
+        return [entry for entry in self.log if start_s * 1000000 <= entry[0] < end_s * 1000000]
+
+
+def camera_selftest(args, check):
+    """camera_frames.c, the Eye's shared capture, against the fake driver"""
+    with tempfile.TemporaryDirectory() as tmp:
+        stubs = Path(tmp) / "stubs"
+        for name, text in CAMERA_STUBS.items():
+            (stubs / name).parent.mkdir(parents=True, exist_ok=True)
+            (stubs / name).write_text(text)
+        source = Path(tmp) / "camera_selftest.c"
+        source.write_text(CAMERA_SELFTEST_C)
+        binary = Path(tmp) / "camera_selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", f"-I{stubs}", f"-I{FIRMWARE_MAIN}",
+                        str(source), "-o", str(binary)], check=True)
+        driver = subprocess.Popen([str(binary)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+        def ask(line):
+            driver.stdin.write(line.encode() + b"\n")
+            driver.stdin.flush()
+            return driver.stdout.readline().decode().strip()
+
+        def state():
+            keys = ("driver_out", "captured", "failures", "delivered", "skipped", "subscribers", "violations")
+            return dict(zip(keys, map(int, ask("state").split())))
+
+        # Two clients share a frame, its driver buffer goes back with the last reference
+        ask("sub 0"), ask("sub 1")
+        ask("capture")
+        first = (ask("get 0"), ask("get 1"))
+        ask("capture")
+        ask("release 0")
+        shared = state()["driver_out"]
+        ask("release 1")
+        check("camera: both clients get the frame, with a reference each", first == ("0 2", "0 3"), f"{first}")
+        check("camera: the driver buffer goes back with the last reference",
+              shared == 2 and state()["driver_out"] == 1, f"{shared} buffers out while one client held it")
+        check("camera: every subscriber is woken once per frame", ask("wakes 0") == ask("wakes 1") == "2")
+
+        # A slow client skips to the newest frame, the gap shows in seq and in skipped
+        ask("get 0"), ask("get 1")
+        for _ in range(5):
+            ask("capture")
+            ask("release 1"), ask("get 1")
+        ask("release 0")
+        got = ask("get 0")
+        check("camera: a slow client gets the latest frame and counts the ones it missed",
+              got == "6 3" and state()["skipped"] == 4 and state()["driver_out"] == 1, f"{got}, {state()}")
+        ask("release 0"), ask("release 1")
+        check("camera: a client gets each frame once", ask("get 0") == "none")
+
+        # Three clients, each holding a frame for a while: the capture never runs out of driver buffers
+        ask("sub 2")
+        check("camera: no more subscribers than CAMERA_FRAMES_MAX_SUBSCRIBERS", ask("sub 3") == "-1")
+        rng = random.Random(args.seed)
+        holding = [False] * 3
+        missed = 0
+        for _ in range(500):
+            missed += ask("capture") == "0"
+            for task in range(3):
+                if holding[task] and rng.random() < 0.3:
+                    ask(f"release {task}")
+                    holding[task] = False
+                if not holding[task] and rng.random() < 0.5:
+                    holding[task] = ask(f"get {task}") != "none"
+        s = state()
+        check("camera: three slow clients never hold up the capture", missed == 0 and s["failures"] == 0, f"{s}")
+        for task in range(3):
+            if holding[task]:
+                ask(f"release {task}")
+            ask(f"unsub {task}")
+        ask("idle")
+        check("camera: every buffer is back once nobody is subscribed", state()["driver_out"] == 0, f"{state()}")
+        ask("sub 0")
+        check("camera: a new subscriber does not start with a stale frame", ask("get 0") == "none")
+
+        # Sensor modes that are not JPEG: the driver buffer goes back right after the conversion
+        ask("mode raw")
+        seq = ask("capture").split()[1]
+        check("camera: converted frames are delivered and free the driver buffer at once",
+              ask("get 0").split()[0] == seq and state()["driver_out"] == 0, f"{state()}")
+        ask("release 0")
+        ask("mode badraw")
+        failed = ask("capture") == "0" and state()["failures"] == 1
+        ask("mode jpeg")
+        check("camera: a failed conversion is counted and frees its slot",
+              failed and all(ask("capture") != "0" for _ in range(10)), f"{state()}")
+
+        # Ages once per frame: capture_age when taken from the driver, sent_age per release
+        ask("clock 1000000")
+        ask("capture")
+        ask("clock 1030000")
+        ask("get 0"), ask("release 0")
+        s = state()
+        capture_frames, capture_last_us, sent_frames, sent_last_us = map(int, ask("ages").split())
+        check("camera: frame ages are recorded once per capture and once per release",
+              capture_frames == s["captured"] and capture_last_us == 5000
+              and sent_frames == s["delivered"] and sent_last_us == 35000,
+              f"{capture_frames} {capture_last_us} {sent_frames} {sent_last_us}, {s}")
+        check("camera: no FreeRTOS or driver call under the frame lock, and the lock is never nested",
+              state()["violations"] == 0, f"{state()}")
+
+        driver.stdin.close()
+        driver.wait()
+
+
+def selftest(args):
+    failures = []
+
+    def check(name, ok, detail=""):
+        print(f"{'ok  ' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        if not ok:
+            failures.append(name)
+
+    # Parts as the firmware writes them, with JPEGs that contain the boundary
+    rng = random.Random(args.seed)
+    part_format = firmware_part_format()
+    sent = []
+    body = b"garbage before the first part"
+    for seq in range(1, 40):
+        if rng.random() < 0.3:
+            continue        # skipped by this client
+        jpeg = b"\xff\xd8" + rng.randbytes(rng.randrange(0, 3000)) + b"\r\n--" + BOUNDARY + b"\r\n\xff\xd9"
+        setting = (rng.choice(("qvga", "vga", "svga", "hd")), rng.randrange(4, 64), rng.choice((0, 5, 20, 30)))
+        timestamp_us, delay_us = rng.randrange(1 << 40), rng.randrange(1 << 20)
+        body += (part_format % ((len(jpeg), seq, timestamp_us, delay_us) + setting)).encode() + jpeg
+        sent.append((seq, timestamp_us, delay_us, setting, jpeg))
+    old = b"\xff\xd8old\xff\xd9"
+    body += b"\r\n--" + BOUNDARY + b"\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n" % len(old) + old
+    parts = list(read_parts(io.BytesIO(body)))
+    got = [(p.seq, p.timestamp_us, p.delay_us, p.setting(), p.jpeg) for p in parts]
+    check("parts carry their frame's seq, capture time, delay and settings", got[:-1] == sent,
+          f"{len(got) - 1} parts read, {len(sent)} sent")
+    check("parts from older firmware read without them", got[-1] == (None, None, None, None, old), f"{got[-1]}")
+
+    with tempfile.TemporaryDirectory() as tmp:
+        source = Path(tmp) / "selftest.c"
+        source.write_text(SELFTEST_C)
+        binary = Path(tmp) / "selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", f"-I{FIRMWARE_MAIN}", str(source),
+                        str(FIRMWARE_MAIN / "video_rate.c"), str(FIRMWARE_MAIN / "token_bucket.c"),
+                        "-o", str(binary)], check=True)
+        driver = subprocess.Popen([str(binary)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+        def send(line):
+            driver.stdin.write(line.encode() + b"\n")
+            driver.stdin.flush()
+
+        def answer():
+            return driver.stdout.readline().decode().strip()
+
+        def init(size, quality, target_ms=args.target_ms):
+            send(f"init {size} {quality} {target_ms} 0")
+            fields = list(map(int, answer().split()))
+            return [tuple(fields[1 + 3 * i:4 + 3 * i]) for i in range(fields[0])]
+
+        # The points below each boot config
+        ladders_ok = True
+        detail = ""
+        for size in SIZES:
+            for quality in (4, 10, 12, 18, 30, 40, 63):
+                got, want = init(size, quality), points_reference(size, quality)
+                if got != want and ladders_ok:
+                    detail = f"{size}/{quality}: {got} != {want}"
+                ladders_ok &= got == want
+        check("only points cheaper than the boot config are used", ladders_ok, detail)
+
+        target_us = args.target_ms * 1000
+        points = init(VGA, 12)
+
+        # A link with room to spare keeps the boot point
+        sim = Simulation(send, answer, points, 0)
+        fields = sim.run(30, 20000)
+        check("a fast link stays at the boot point", sim.point == 0 and fields[4] == 0, f"{fields}")
+
+        # Congestion: the point drops until the latency is back under the target
+        sim.run(30, args.slow_kbps)
+        settled = sim.window(40, 60)
+        late = [entry for entry in settled if entry[2] > target_us]
+        check(f"at {args.slow_kbps} kbit/s the latency settles under {args.target_ms} ms within 10 s",
+              sim.point > 0 and not late, f"point {sim.point}, {len(late)} late frames in the last 20 s")
+        recover = next((entry[0] for entry in sim.window(30, 60) if entry[2] <= target_us), None)
+        check("the latency is back under the target within 2 s",
+              recover is not None and recover < 32 * 1000000, f"latency back at {recover} us")
+
+        # Recovery: back up to the boot point, a step at a time
+        sim.run(120, 20000)
+        check("the boot point comes back once the link recovers", sim.point == 0, f"point {sim.point}")
+
+        # A link with room to spare at QVGA quality 15, 15 fps, but too slow for
+        # VGA quality 25 at the same rate: VGA is probed less and less often
+        sim = Simulation(send, answer, init(VGA, 12), 0)
+        sim.run(600, 1600)
+        ups = [b[0] for a, b in zip(sim.log, sim.log[1:]) if b[1] < a[1]]
+        gaps = [(b - a) / 1000000 for a, b in zip(ups, ups[1:])]
+        check("probing a point the link cannot carry backs off",
+              len(ups) >= 4 and gaps == sorted(gaps) and gaps[-1] >= MAX_UP_HOLD_S,
+              f"steps up at {[round(t / 1000000) for t in ups]} s")
+        late = [entry for entry in sim.log if entry[2] > target_us]
+        check("the probes cost little latency", len(late) < len(sim.log) // 100,
+              f"{len(late)} late frames of {len(sim.log)}")
+
+        # The video shaper's token bucket on a virtual clock, 8000 kbit/s is a byte per us
+        def bucket(kbps, burst, now_us=0):
+            send(f"bucket {kbps} {burst} {now_us}")
+            answer()
+
+        def take(length, now_us):
+            send(f"take {length} {now_us}")
+            return tuple(map(int, answer().split()))
+
+        bucket(8000, 16384)
+        burst = [take(4096, 0)[0] for _ in range(4)]
+        check("bucket: a full burst goes at once, the next slice waits",
+              burst == [0, 0, 0, 0] and take(4096, 0)[0] == 4096, f"{burst}")
+        check("bucket: refilled at the rate, not a us early",
+              take(4096, 4095)[0] == 1 and take(4096, 4096)[0] == 0 and take(1000, 4096 + 999)[0] == 1)
+        bucket(8000, 16384)
+        take(16384, 0)
+        check("bucket: refills to the burst and no further",
+              take(1, 10_000_000) == (0, 16383 * 8000) and take(16384, 10_000_000)[0] == 1)
+        bucket(8000, 16384)
+        take(16384, 0)
+        wait_us = take(60000, 0)[0]
+        debt = take(60000, wait_us)
+        check("bucket: a frame larger than the bucket waits for a full one and leaves it in debt",
+              wait_us == 16384 and debt == (0, (16384 - 60000) * 8000) and take(1, wait_us)[0] == 60000 - 16384 + 1)
+
+        # Sliced sending for 2 s at several rates: burst plus rate times time, to a slice
+        rates_ok, detail = True, ""
+        for kbps in (800, 8000, 20000):
+            bucket(kbps, 16384)
+            now_us = sent = 0
+            while True:
+                wait_us = take(4096, now_us)[0]
+                if wait_us:
+                    now_us += wait_us
+                    continue
+                if now_us > 2_000_000:
+                    break
+                sent += 4096
+            expected = 16384 + kbps * 2_000_000 // 8000
+            if abs(sent - expected) > 4096:
+                rates_ok, detail = False, f"{kbps} kbit/s: {sent} bytes in 2 s, expected {expected}"
+        check("bucket: sliced video holds the rate", rates_ok, detail)
+        bucket(0, 16384)
+        check("bucket: a rate of 0 never waits", take(1_000_000, 0) == (0, 16384 * 8000))
+
+        driver.stdin.close()
+        driver.wait()
+
+    camera_selftest(args, check)
+
+    if failures:
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="MJPEG stream of the Eye with the camera settings of every frame")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--adapt", action="store_true", help="let the Eye adapt the settings to the link")
+    parser.add_argument("--raw", action="store_true", help="?raw=1, parts written straight to the socket")
+    parser.add_argument("--sync", action="store_true", help="synchronize with the Eye's clock for the latency")
+    parser.set_defaults(func=listen)
+
+    p = sub.add_parser("selftest", help="run the firmware's video_rate.c against a simulated link")
+    p.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    p.add_argument("--target-ms", type=int, default=200, help="VIDEO_RATE_TARGET_MS")
+    p.add_argument("--slow-kbps", type=int, default=800, help="rate of the congested link")
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,565 @@
+# Network benchmark against /bench on the arm board or the Eye, see
+# Firmware/components/net_bench.
+#
+# The board streams synthetic blocks instead of audio or video, over httpd
+# chunks, the raw socket or UDP, at a paced rate or as fast as the socket
+# takes them, while its capture tasks keep running. For every run this
+# reports the goodput, the RFC 3550 interarrival jitter, the longest stall,
+# the blocks lost (UDP) or corrupted, and from /status the CPU load and
+# whether the capture lost anything meanwhile (I2S overflows, ring drops).
+# With --eye the host synchronizes with the Eye's clock and the one-way delay
+# of boards that are synchronized too is reported.
+#
+#   python net_bench.py                                        arm board, every transport, 1024 byte blocks
+#   python net_bench.py --ip 192.168.4.1 --blocks 512,1460,8192 --kbps 0,2000
+#   python net_bench.py --transports udp --kbps 4000 --seconds 30 --eye 192.168.4.1
+#   python net_bench.py simulate --loss 0.05
+#
+# `simulate` runs the same client against a local stand-in for the board that
+# drops, duplicates, reorders and corrupts blocks, and exits non-zero when the
+# client's accounting does not match what was injected.
+
+import argparse
+import json
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+import requests
+
+import time_sync
+
+ESP32_IP = "192.168.4.254"  # arm board station address
+UDP_PORT = 5010
+
+HEADER = struct.Struct("<4sIqIBBH")     # net_bench_block_t
+MAGIC = b"IRBN"
+FLAG_LAST = 0x01
+FLAG_SYNCED = 0x02
+TRANSPORTS = ("chunked", "raw", "udp")
+MAX_BLOCK = 16384
+MAX_UDP_BLOCK = 1472
+PATTERN = bytes(i % 251 for i in range(MAX_BLOCK))
+
+
+def now_us():
+    return time.monotonic_ns() // 1000
+
+
+class Run:
+    def __init__(self, transport, block, kbps):
+        self.transport = transport
+        self.block = block
+        self.kbps = kbps
+        self.error = None
+        self.blocks = 0
+        self.bytes = 0
+        self.bad = 0                # wrong magic, length or payload
+        self.lost = 0               # udp
+        self.duplicates = 0
+        self.reordered = 0
+        self.expected = None        # udp: blocks the board sent, from the end marker
+        self.first_us = None
+        self.last_us = None
+        self.max_gap_us = 0
+        self.jitter_us = 0.0
+        self.transit = None
+        self.owd_us = []            # one-way delays, both clocks synchronized
+        self.cpu = []
+        self.capture_before = None
+        self.capture_after = None
+        self.board = {}             # the board's bench stats after the run
+
+    def arrive(self, header, payload, arrival_us, sync):
+        magic, seq, sent_us, length, flags, _, _ = header
+        if magic != MAGIC or length != HEADER.size + len(payload) or payload != PATTERN[:len(payload)]:
+            self.bad += 1
+            return
+        self.blocks += 1
+        self.bytes += length
+        if self.last_us is not None:
+            self.max_gap_us = max(self.max_gap_us, arrival_us - self.last_us)
+        else:
+            self.first_us = arrival_us
+        self.last_us = arrival_us
+        # RFC 3550 interarrival jitter; the clock offset drops out of the difference
+        transit = arrival_us - sent_us
+        if self.transit is not None:
+            self.jitter_us += (abs(transit - self.transit) - self.jitter_us) / 16
+        self.transit = transit
+        if flags & FLAG_SYNCED and sync is not None and sync.synced:
+            self.owd_us.append(sync.to_master(arrival_us) - sent_us)
+
+    @property
+    def seconds(self):
+        return (self.last_us - self.first_us) / 1e6 if self.blocks > 1 else 0.0
+
+    @property
+    def goodput_kbps(self):
+        # Blocks after the first over the time since the first arrived
+        return (self.bytes - self.block) * 8 / 1000 / self.seconds if self.seconds else None
+
+    def cpu_avg(self, core):
+        values = [sample[core] for sample in self.cpu if sample[core] >= 0]
+        return sum(values) / len(values) if values else None
+
+    @property
+    def capture_lost(self):
+        if self.capture_before is None or self.capture_after is None:
+            return None
+        return sum(self.capture_after.values()) - sum(self.capture_before.values())
+
+
+def capture_counters(status):
+    """Counters in /status that grow when the capture or a stream lost audio."""
+    counters = {"i2s_overflows": status.get("i2s_overflows", 0)}
+    counters["ring_dropped"] = sum(c.get("dropped_blocks", 0) for c in status.get("clients", []))
+    counters["hub_dropped"] = sum(h.get("dropped_blocks", 0) for h in status.get("hub", []))
+    return counters
+
+
+def get_status(base):
+    try:
+        return requests.get(base + "/status", timeout=2).json()
+    except (requests.RequestException, ValueError):
+        return None
+
+
+def poll_status(base, run, stop, interval):
+    # The board reports the load since the previous /status request, so the first answer only primes it
+    first = True
+    while not stop.wait(interval):
+        status = get_status(base)
+        if status is None:
+            continue
+        if not first:
+            run.cpu.append(status.get("cpu_load", [-1, -1]))
+        first = False
+
+
+class ChunkDecoder:
+    """Incremental Transfer-Encoding: chunked decoder."""
+
+    def __init__(self):
+        self.buf = b""
+        self.remaining = 0      # payload bytes left in the current chunk
+        self.done = False
+
+    def feed(self, data):
+        self.buf += data
+        out = []
+        while not self.done:
+            if self.remaining:
+                part = self.buf[:self.remaining]
+                out.append(part)
+                self.remaining -= len(part)
+                self.buf = self.buf[len(part):]
+                if self.remaining:
+                    break
+                continue
+            # A size line, after the CRLF that ends the previous chunk
+            if self.buf.startswith(b"\r\n"):
+                self.buf = self.buf[2:]
+            end = self.buf.find(b"\r\n")
+            if end < 0:
+                break
+            size = int(self.buf[:end].split(b";")[0], 16)
+            self.buf = self.buf[end + 2:]
+            if size == 0:
+                self.done = True
+            self.remaining = size
+        return b"".join(out)
+
+
+def read_tcp(host, port, path, run, sync, stop):
+    """Reads the blocks of a chunked or raw /bench response. A plain socket
+    rather than requests, so that every block is stamped when it arrives."""
+    sock = socket.create_connection((host, port), timeout=5)
+    try:
+        sock.sendall(f"GET {path} HTTP/1.1\r\nHost: {host}\r\n\r\n".encode())
+        data = b""
+        while b"\r\n\r\n" not in data:
+            chunk = sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("closed before the response header")
+            data += chunk
+        head, data = data.split(b"\r\n\r\n", 1)
+        lines = head.decode(errors="replace").split("\r\n")
+        status = lines[0].split(" ", 2)
+        if len(status) < 2 or status[1] != "200":
+            run.error = lines[0]
+            return
+        chunked = any(line.lower().startswith("transfer-encoding:") and "chunked" in line.lower()
+                      for line in lines[1:])
+        decoder = ChunkDecoder() if chunked else None
+        body = b""
+        while not stop.is_set():
+            arrival = now_us()
+            body += decoder.feed(data) if decoder else data
+            offset = 0
+            while len(body) - offset >= HEADER.size:
+                header = HEADER.unpack_from(body, offset)
+                length = header[3]
+                if header[0] != MAGIC or not HEADER.size <= length <= MAX_BLOCK:
+                    run.bad += 1
+                    run.error = "lost block framing"
+                    return
+                if len(body) - offset < length:
+                    break
+                run.arrive(header, body[offset + HEADER.size:offset + length], arrival, sync)
+                offset += length
+            body = body[offset:]
+            if decoder and decoder.done:
+                return
+            data = sock.recv(65536)
+            if not data:
+                return
+    finally:
+        sock.close()
+
+
+def read_udp(sock, run, sync, deadline):
+    received = set()
+    highest = -1
+    while time.monotonic() < deadline:
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            continue
+        arrival = now_us()
+        if len(data) < HEADER.size:
+            run.bad += 1
+            continue
+        header = HEADER.unpack_from(data)
+        seq, flags = header[1], header[4]
+        if flags & FLAG_LAST:
+            run.expected = seq
+            break
+        if seq in received:
+            run.duplicates += 1
+            continue
+        received.add(seq)
+        if seq < highest:
+            run.reordered += 1
+        highest = max(highest, seq)
+        run.arrive(header, data[HEADER.size:], arrival, sync)
+    # Without the end marker the blocks after the last one received are not counted
+    total = run.expected if run.expected is not None else highest + 1
+    run.lost = max(0, total - len(received))
+
+
+def measure(host, port, transport, block, kbps, args, sync):
+    run = Run(transport, block, kbps)
+    base = f"http://{host}:{port}"
+    query = f"/bench?transport={transport}&block={block}&kbps={kbps}&ms={int(args.seconds * 1000)}"
+    if args.nodelay:
+        query += "&nodelay=1"
+    status = get_status(base)
+    run.capture_before = capture_counters(status) if status else None
+    stop = threading.Event()
+    poller = threading.Thread(target=poll_status, args=(base, run, stop, args.interval), daemon=True)
+    poller.start()
+    try:
+        if transport == "udp":
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+            sock.bind(("", args.udp_port))
+            sock.settimeout(0.2)
+            try:
+                response = requests.get(base + query + f"&port={args.udp_port}", timeout=5)
+                if response.status_code != 200:
+                    run.error = f"HTTP {response.status_code} {response.text.strip()}"
+                else:
+                    read_udp(sock, run, sync, time.monotonic() + args.seconds + 3.0)
+            finally:
+                sock.close()
+        else:
+            read_tcp(host, port, query, run, sync, stop)
+    except (OSError, requests.RequestException) as e:
+        run.error = str(e)
+    except KeyboardInterrupt:
+        requests.get(base + "/bench?stop=1", timeout=2)
+        raise
+    finally:
+        stop.set()
+        poller.join(timeout=5)
+    time.sleep(0.5)     # the board finishes the run
+    status = get_status(base)
+    if status:
+        run.capture_after = capture_counters(status)
+        run.board = status.get("bench", {})
+    return run
+
+
+def fmt(value, width, digits=1):
+    return f"{'-':>{width}}" if value is None else f"{value:{width}.{digits}f}"
+
+
+def print_runs(runs):
+    print(f"\n{'transport':<10}{'block':>6}{'kbps':>7}{'goodput':>9}{'blocks':>8}{'lost':>6}{'bad':>5}"
+          f"{'jitter ms':>10}{'stall ms':>9}{'owd ms':>8}{'late':>6}{'err':>5}{'send ms':>8}"
+          f"{'core0':>7}{'core1':>7}{'capture':>8}")
+    for run in runs:
+        if run.error and not run.blocks:
+            print(f"{run.transport:<10}{run.block:>6}{run.kbps:>7}   {run.error}")
+            continue
+        owd = sorted(run.owd_us)[len(run.owd_us) // 2] / 1000 if run.owd_us else None
+        capture = run.capture_lost
+        print(f"{run.transport:<10}{run.block:>6}{run.kbps:>7}{fmt(run.goodput_kbps, 9, 0)}{run.blocks:>8}"
+              f"{run.lost:>6}{run.bad:>5}{fmt(run.jitter_us / 1000, 10, 2)}{fmt(run.max_gap_us / 1000, 9)}"
+              f"{fmt(owd, 8, 2)}{run.board.get('late', '-'):>6}{run.board.get('send_errors', '-'):>5}"
+              f"{fmt(run.board.get('max_send_us', 0) / 1000 if run.board else None, 8)}"
+              f"{fmt(run.cpu_avg(0), 7)}{fmt(run.cpu_avg(1), 7)}{'-' if capture is None else capture:>8}"
+              f"{'  ' + run.error if run.error else ''}")
+    print("goodput in kbit/s; capture: I2S overflows and ring/hub drops during the run, should stay 0")
+
+
+def matrix(args):
+    runs = []
+    for transport in args.transports.split(","):
+        for block in (int(b) for b in args.blocks.split(",")):
+            if transport == "udp" and block > MAX_UDP_BLOCK:
+                continue
+            for kbps in (int(k) for k in args.kbps.split(",")):
+                runs.append((transport, block, kbps))
+    return runs
+
+
+def bench(args):
+    sync = time_sync.SyncClient(args.eye).start() if args.eye else None
+    if sync:
+        deadline = time.monotonic() + 10
+        while not sync.synced and time.monotonic() < deadline:
+            time.sleep(0.2)
+        print("synchronized with the Eye" if sync.synced else "not synchronized, no one-way delay")
+    runs = []
+    for transport, block, kbps in matrix(args):
+        print(f"{transport:8} {block:5} B  {kbps or 'unpaced'} kbps  {args.seconds:.0f} s")
+        runs.append(measure(args.ip, args.port, transport, block, kbps, args, sync))
+        time.sleep(1.0)
+    print_runs(runs)
+
+
+class FakeBoard:
+    """Serves /bench and /status like the firmware, with injected faults (simulate)."""
+
+    def __init__(self, loss, duplicate, reorder, corrupt_every, master_clock, seed=1):
+        self.loss = loss
+        self.duplicate = duplicate
+        self.reorder = reorder
+        self.corrupt_every = corrupt_every
+        self.master_clock = master_clock
+        self.rng = random.Random(seed)
+        self.log = []           # per run: dict of what was sent and injected
+        self.stats = {"active": False, "blocks": 0, "send_errors": 0, "late": 0, "max_send_us": 0}
+        board = self
+
+        class Handler(BaseHTTPRequestHandler):
+            protocol_version = "HTTP/1.1"
+
+            def log_message(self, *args):
+                pass
+
+            def do_GET(self):
+                url = urlparse(self.path)
+                if url.path == "/status":
+                    body = json.dumps({"cpu_load": [-1, -1], "i2s_overflows": 0, "bench": board.stats}).encode()
+                    self.send_response(200)
+                    self.send_header("Content-Type", "application/json")
+                    self.send_header("Content-Length", str(len(body)))
+                    self.end_headers()
+                    self.wfile.write(body)
+                    return
+                q = {k: v[0] for k, v in parse_qs(url.query).items()}
+                transport = q.get("transport", "chunked")
+                block, kbps, ms = int(q.get("block", 1024)), int(q.get("kbps", 0)), int(q.get("ms", 10000))
+                if transport == "udp":
+                    dest = (self.client_address[0], int(q.get("port", UDP_PORT)))
+                    body = json.dumps({"transport": "udp", "port": dest[1]}).encode()
+                    self.send_response(200)
+                    self.send_header("Content-Length", str(len(body)))
+                    self.end_headers()
+                    self.wfile.write(body)
+                    threading.Thread(target=board.run_udp, args=(dest, block, kbps, ms), daemon=True).start()
+                    return
+                if q.get("nodelay") == "1":
+                    self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                self.send_response(200)
+                self.send_header("Content-Type", "application/octet-stream")
+                if transport == "chunked":
+                    self.send_header("Transfer-Encoding", "chunked")
+                else:
+                    self.send_header("Connection", "close")
+                    self.close_connection = True
+                self.end_headers()
+
+                def send(data):
+                    if transport == "chunked":
+                        self.wfile.write(b"%x\r\n%s\r\n" % (len(data), data))
+                    else:
+                        self.wfile.write(data)
+                board.run(send, block, kbps, ms, transport)
+                if transport == "chunked":
+                    self.wfile.write(b"0\r\n\r\n")
+
+        self.server = ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+        self.port = self.server.server_address[1]
+        threading.Thread(target=self.server.serve_forever, daemon=True).start()
+
+    def blocks(self, block, kbps, ms, entry):
+        """Yields (seq, data) paced like the firmware, corrupting every corrupt_every-th block."""
+        interval = block * 8 / (kbps * 1000) if kbps else 0
+        start = time.monotonic()
+        next_t = start
+        seq = 0
+        while time.monotonic() - start < ms / 1000:
+            if interval:
+                delay = next_t - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+                next_t += interval
+            sent_us = self.master_clock()
+            data = bytearray(HEADER.pack(MAGIC, seq, sent_us, block, FLAG_SYNCED, 0, 0) + PATTERN[:block - HEADER.size])
+            if self.corrupt_every and seq % self.corrupt_every == self.corrupt_every - 1:
+                data[-1] ^= 0xFF
+                entry["corrupted"] += 1
+            yield seq, bytes(data)
+            seq += 1
+        entry["sent"] = seq
+
+    def run(self, send, block, kbps, ms, transport):
+        entry = {"transport": transport, "sent": 0, "lost": 0, "duplicates": 0, "reordered": 0, "corrupted": 0}
+        self.log.append(entry)
+        self.stats = {"active": True, "blocks": 0, "send_errors": 0, "late": 0, "max_send_us": 0}
+        try:
+            for _, data in self.blocks(block, kbps, ms, entry):
+                send(data)
+                self.stats["blocks"] += 1
+        finally:
+            self.stats["active"] = False
+
+    def run_udp(self, dest, block, kbps, ms):
+        entry = {"transport": "udp", "sent": 0, "lost": 0, "duplicates": 0, "reordered": 0, "corrupted": 0}
+        self.log.append(entry)
+        self.stats = {"active": True, "blocks": 0, "send_errors": 0, "late": 0, "max_send_us": 0}
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        held = None             # a datagram held back to go out after the next one
+        for seq, data in self.blocks(block, kbps, ms, entry):
+            self.stats["blocks"] += 1
+            if self.rng.random() < self.loss:
+                entry["lost"] += 1
+                if self.corrupt_every and seq % self.corrupt_every == self.corrupt_every - 1:
+                    entry["corrupted"] -= 1     # never arrives, so it cannot count as bad
+                continue
+            if held is None and self.rng.random() < self.reorder:
+                held = data
+                continue
+            sock.sendto(data, dest)
+            if self.rng.random() < self.duplicate:
+                sock.sendto(data, dest)
+                entry["duplicates"] += 1
+            if held is not None:
+                sock.sendto(held, dest)
+                entry["reordered"] += 1
+                held = None
+        if held is not None:
+            sock.sendto(held, dest)
+        last = HEADER.pack(MAGIC, entry["sent"], self.master_clock(), HEADER.size, FLAG_LAST, 2, 0)
+        for _ in range(3):
+            sock.sendto(last, dest)
+            time.sleep(0.02)
+        sock.close()
+        self.stats["active"] = False
+
+
+def simulate(args):
+    boot = now_us()
+
+    def master_clock():
+        return 987_654_321 + int((now_us() - boot) * (1 + 30e-6))
+
+    master = time_sync.Master(clock=master_clock)
+    sync = time_sync.SyncClient("127.0.0.1", master.port).start()
+    board = FakeBoard(args.loss, args.duplicate, args.reorder, args.corrupt_every, master_clock)
+    deadline = time.monotonic() + 10
+    while not sync.synced and time.monotonic() < deadline:
+        time.sleep(0.1)
+    print(f"Fake board on port {board.port}: {args.loss * 100:.0f}% loss, {args.duplicate * 100:.0f}% duplicates, "
+          f"{args.reorder * 100:.0f}% reordered (udp), every {args.corrupt_every}th block corrupted")
+
+    runs = []
+    for transport, block, kbps in matrix(args):
+        runs.append(measure("127.0.0.1", board.port, transport, block, kbps, args, sync))
+    sync.stop()
+    print_runs(runs)
+
+    failures = []
+    for run, entry in zip(runs, board.log):
+        name = f"{run.transport} {run.block} B {run.kbps} kbps"
+        expected = {
+            "blocks": entry["sent"] - entry["lost"] - entry["corrupted"],
+            "bad": entry["corrupted"],
+            "lost": entry["lost"],
+            "duplicates": entry["duplicates"],
+            "reordered": entry["reordered"],
+        }
+        for key, value in expected.items():
+            if getattr(run, key) != value:
+                failures.append(f"{name}: {key} {getattr(run, key)}, injected {value}")
+        delivered = run.kbps * expected["blocks"] / max(entry["sent"], 1)
+        if run.kbps and run.goodput_kbps and abs(run.goodput_kbps / delivered - 1) > 0.1:
+            failures.append(f"{name}: goodput {run.goodput_kbps:.0f} kbit/s")
+        owd = sorted(run.owd_us)[len(run.owd_us) // 2] if run.owd_us else None
+        # Without nodelay Nagle holds blocks back for the delayed ACK, tens of ms, which is a real result
+        nagle = run.transport != "udp" and not args.nodelay
+        if owd is None or (abs(owd) > args.owd_tolerance_us and not nagle):
+            failures.append(f"{name}: median one-way delay {owd} us on loopback")
+    for failure in failures:
+        print("FAIL", failure)
+    if failures or len(runs) != len(board.log):
+        sys.exit(1)
+    print(f"{len(runs)} runs match the injected faults")
+
+
+def add_run(parser, blocks, kbps, seconds):
+    parser.add_argument("--transports", default=",".join(TRANSPORTS))
+    parser.add_argument("--blocks", default=blocks, help="block sizes in bytes, comma separated")
+    parser.add_argument("--kbps", default=kbps, help="paced rates, 0 sends as fast as possible")
+    parser.add_argument("--seconds", type=float, default=seconds, help="per run")
+    parser.add_argument("--nodelay", action="store_true", help="TCP_NODELAY on the board")
+    parser.add_argument("--udp-port", type=int, default=UDP_PORT)
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between /status polls")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Network benchmark against /bench")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--eye", help="synchronize with this Eye for one-way delays, ex: 192.168.4.1")
+    add_run(parser, "1024", "0", 10.0)
+    parser.set_defaults(func=bench)
+
+    p = sub.add_parser("simulate", help="check the client against a local fake board")
+    add_run(p, "1024,1460", "2000,8000", 2.0)
+    p.add_argument("--loss", type=float, default=0.05, help="udp datagrams dropped, 0-1")
+    p.add_argument("--duplicate", type=float, default=0.02)
+    p.add_argument("--reorder", type=float, default=0.02)
+    p.add_argument("--corrupt-every", type=int, default=97)
+    p.add_argument("--owd-tolerance-us", type=int, default=5000)
+    p.set_defaults(func=simulate)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
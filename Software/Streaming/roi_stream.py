@@ -0,0 +1,442 @@
+# Reader for the Eye's region of interest stream, /roi
+#
+# Instead of the camera's JPEG, /roi sends every frame as a scaled down
+# context image of the whole frame at a low quality plus high quality full
+# resolution crops of the regions that matter: the mouths (or faces) the
+# Eye's detector found, or regions asked for with ?roi=x,y,w,h;x,y,w,h.
+# Every image is a stream_frame JPEG_ROI frame whose payload starts with the
+# region it shows (stream_frame_roi_t): the camera frame size, x, y, w, h, the
+# index of the image within the frame (0 is the context) and its kind. All
+# images of a camera frame share its seq and capture time.
+#
+# `python roi_stream.py` prints the frame rate, crops and bytes per second and
+# compares them with the camera's JPEGs the Eye started from (/status).
+# --show pastes the crops onto the upscaled context in a window, --save DIR
+# writes every image. `python roi_stream.py selftest` compiles the firmware's
+# roi_crop.c with the host C compiler and checks it against this file.
+
+import argparse
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+import numpy as np
+import requests
+
+from stream_frame import JPEG_ROI, FrameReader
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+
+SOFTWARE = Path(__file__).resolve().parents[1]
+FIRMWARE = SOFTWARE.parent / "Firmware"
+FIRMWARE_MAIN = FIRMWARE / "Eye" / "ESP32_S3_eye_Camera_AP_One_Mic" / "main"
+
+# stream_frame_roi_kind_t
+CONTEXT, FACE, MOUTH, REQUESTED = 0, 1, 2, 3
+KIND_NAMES = {CONTEXT: "context", FACE: "face", MOUTH: "mouth", REQUESTED: "requested"}
+
+# roi_crop.h
+MAX_REGIONS = 4
+MAX_CROP_WIDTH, MAX_CROP_HEIGHT = 320, 240
+MIN_SIZE = 16
+
+
+def roi_query(roi=None, region=None, pad=None, scale=None, quality=None, crop_quality=None):
+    """/roi's query string. Built by hand, requests would escape the , and ; of roi."""
+    params = {"roi": roi, "region": region, "pad": pad, "scale": scale, "quality": quality,
+              "crop_quality": crop_quality}
+    query = "&".join(f"{key}={value}" for key, value in params.items() if value is not None)
+    return "?" + query if query else ""
+
+
+def read_images(ip=ESP32_IP, query="", timeout=5):
+    """Yield (frame, region, jpeg) for every /roi image: the stream_frame Frame,
+    its region as a dict (see Frame.roi()) and the JPEG bytes"""
+    with requests.get(f"http://{ip}/roi{query}", stream=True, timeout=timeout) as response:
+        response.raise_for_status()
+        response.raw.decode_content = True
+        for frame in FrameReader(response.raw):
+            if frame.codec == JPEG_ROI:
+                region, jpeg = frame.roi()
+                yield frame, region, jpeg
+
+
+class RoiView:
+    """The newest context, scaled up to the camera frame, with the crops of the
+    same frame pasted where they belong"""
+
+    def __init__(self):
+        import cv2
+        self.cv2 = cv2
+        self.image = None
+        self.seq = None
+
+    def add(self, frame, region, jpeg):
+        image = self.cv2.imdecode(np.frombuffer(jpeg, np.uint8), self.cv2.IMREAD_COLOR)
+        if image is None:
+            return
+        if region["kind"] == CONTEXT:
+            self.image = self.cv2.resize(image, (region["frame_width"], region["frame_height"]),
+                                         interpolation=self.cv2.INTER_LINEAR)
+            self.seq = frame.seq
+        elif self.image is not None and frame.seq == self.seq:
+            x, y, w, h = region["x"], region["y"], region["w"], region["h"]
+            self.image[y:y + h, x:x + w] = image[:h, :w]
+            self.cv2.rectangle(self.image, (x, y), (x + w - 1, y + h - 1), (0, 255, 0), 1)
+
+
+def eye_status(ip):
+    try:
+        return requests.get(f"http://{ip}/status", timeout=1).json().get("roi")
+    except (requests.RequestException, ValueError):
+        return None
+
+
+def listen(args):
+    query = roi_query(args.roi, args.region, args.pad, args.scale, args.quality, args.crop_quality)
+    view = RoiView() if args.show else None
+    if args.save:
+        os.makedirs(args.save, exist_ok=True)
+    frames = crops = context_bytes = crop_bytes = 0
+    status = eye_status(args.ip)
+    started = time.monotonic()
+    for frame, region, jpeg in read_images(args.ip, query):
+        if region["kind"] == CONTEXT:
+            frames += 1
+            context_bytes += len(jpeg)
+        else:
+            crops += 1
+            crop_bytes += len(jpeg)
+        if args.save:
+            name = f"{frame.seq:08d}_{region['index']}_{KIND_NAMES.get(region['kind'], 'unknown')}.jpg"
+            Path(args.save, name).write_bytes(jpeg)
+        if view is not None:
+            view.add(frame, region, jpeg)
+            if region["kind"] == CONTEXT and view.image is not None:
+                view.cv2.imshow("/roi", view.image)
+                if view.cv2.waitKey(1) & 0xFF == ord("q"):
+                    break
+
+        now = time.monotonic()
+        if now - started >= 1:
+            elapsed = now - started
+            line = (f"{frames / elapsed:5.1f} frames/s, {crops / max(frames, 1):.1f} crops per frame, "
+                    f"context {context_bytes * 8 / elapsed / 1000:6.0f} kbit/s, "
+                    f"crops {crop_bytes * 8 / elapsed / 1000:6.0f} kbit/s")
+            now_status = eye_status(args.ip)
+            if status is not None and now_status is not None:
+                source = now_status["source_bytes"] - status["source_bytes"]
+                sent = (now_status["context_bytes"] - status["context_bytes"] +
+                        now_status["crop_bytes"] - status["crop_bytes"])
+                work = now_status["encode_us"]
+                if source > 0:
+                    line += (f", {100 * sent / source:.0f}% of the camera's JPEGs, "
+                             f"encode {work['avg'] / 1000:.0f} ms (max {work['max'] / 1000:.0f})")
+            status = now_status
+            print(line)
+            frames = crops = context_bytes = crop_bytes = 0
+            started = now
+
+
+# ---------------------------------------------------------------------------
+# selftest
+
+# Built against roi_crop.c by the selftest. Reads commands from stdin:
+#   parse SPEC                  -> the regions, or -1
+#   faces MOUTH PAD N, N lines "x y w h"  -> the regions
+#   fit X Y W H WIDTH HEIGHT    -> "1 x y w h" or "0 ..."
+#   image W H DW DH SHIFT N B, N lines "x y w h", B blocks "x y bw bh" + data
+#                               -> "mismatch", then the crops and the context
+SELFTEST_C = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream_frame.h"
+#include "roi_crop.h"
+
+static void print_regions(const roi_region_t *regions, int n) {
+    printf("%d", n);
+    for (int i = 0; i < n; i++) {
+        printf(" %d %d %d %d %d", regions[i].x, regions[i].y, regions[i].w, regions[i].h, regions[i].kind);
+    }
+    printf("\n");
+}
+
+int main(void) {
+    char line[512];
+    static uint8_t block[64 * 64 * 3];
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        roi_region_t regions[ROI_MAX_REGIONS];
+        if (strncmp(line, "parse ", 6) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            int n = roi_parse(line + 6, regions, ROI_MAX_REGIONS);
+            if (n < 0) {
+                printf("-1\n");
+            } else {
+                print_regions(regions, n);
+            }
+        } else if (strncmp(line, "faces ", 6) == 0) {
+            int mouth, pad, n;
+            sscanf(line + 6, "%d %d %d", &mouth, &pad, &n);
+            face_result_t faces = { .count = n };
+            for (int i = 0; i < n; i++) {
+                int x, y, w, h;
+                if (fgets(line, sizeof(line), stdin) == NULL || sscanf(line, "%d %d %d %d", &x, &y, &w, &h) != 4) {
+                    return 1;
+                }
+                faces.faces[i] = (face_box_t){ .x = x, .y = y, .w = w, .h = h, .score = 1.0f - i * 0.1f };
+            }
+            print_regions(regions, roi_from_faces(&faces, mouth, pad, regions, ROI_MAX_REGIONS));
+        } else if (strncmp(line, "fit ", 4) == 0) {
+            roi_region_t region = { 0 };
+            int width, height;
+            sscanf(line + 4, "%d %d %d %d %d %d", &region.x, &region.y, &region.w, &region.h, &width, &height);
+            bool ok = roi_fit(&region, width, height);
+            printf("%d %d %d %d %d\n", ok, region.x, region.y, region.w, region.h);
+        } else if (strncmp(line, "image ", 6) == 0) {
+            int width, height, decoded_w, decoded_h, shift, n, blocks;
+            sscanf(line + 6, "%d %d %d %d %d %d %d", &width, &height, &decoded_w, &decoded_h, &shift, &n, &blocks);
+            static uint8_t crops[ROI_MAX_REGIONS][ROI_CROP_BYTES];
+            size_t context_bytes = (size_t)(width >> shift) * (height >> shift) * 3;
+            uint16_t *sums = malloc(context_bytes * 2);
+            memset(sums, 0x5A, context_bytes * 2);
+            roi_image_t image = { .width = width, .height = height, .regions = regions, .count = n,
+                                  .sums = sums, .shift = shift };
+            for (int i = 0; i < n; i++) {
+                if (fgets(line, sizeof(line), stdin) == NULL ||
+                    sscanf(line, "%d %d %d %d", &regions[i].x, &regions[i].y, &regions[i].w, &regions[i].h) != 4) {
+                    return 1;
+                }
+                image.crops[i] = crops[i];
+            }
+            roi_image_begin(&image);
+            roi_image_write(&image, 0, 0, decoded_w, decoded_h, NULL);
+            for (int b = 0; b < blocks; b++) {
+                int x, y, w, h;
+                if (fgets(line, sizeof(line), stdin) == NULL || sscanf(line, "%d %d %d %d", &x, &y, &w, &h) != 4 ||
+                    fread(block, 1, (size_t)w * h * 3, stdin) != (size_t)w * h * 3) {
+                    return 1;
+                }
+                roi_image_write(&image, x, y, w, h, block);
+            }
+            roi_image_write(&image, width, height, 0, 0, NULL);
+            uint8_t *context = roi_context_finish(&image);
+            printf("%d\n", image.mismatch);
+            for (int i = 0; i < n; i++) {
+                fwrite(crops[i], 1, (size_t)regions[i].w * regions[i].h * 3, stdout);
+            }
+            fwrite(context, 1, context_bytes, stdout);
+            free(sums);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+"""
+
+
+def parse_reference(spec):
+    groups = spec.split(";")
+    if groups and groups[-1] == "":
+        groups.pop()
+    regions = []
+    for group in groups:
+        if not re.fullmatch(r"\d+,\d+,\d+,\d+", group):
+            return None
+        x, y, w, h = map(int, group.split(","))
+        if max(x, y, w, h) > 65535 or w == 0 or h == 0:
+            return None
+        regions.append((x, y, w, h, REQUESTED))
+    return regions if 0 < len(regions) <= MAX_REGIONS else None
+
+
+def faces_reference(faces, mouth, pad):
+    regions = []
+    for x, y, w, h in faces[:MAX_REGIONS]:
+        if mouth:
+            y, h = y + h // 2, h - h // 2
+        pad_w, pad_h = w * pad // 100, h * pad // 100
+        regions.append((x - pad_w, y - pad_h, w + 2 * pad_w, h + 2 * pad_h, MOUTH if mouth else FACE))
+    return regions
+
+
+def fit_reference(x, y, w, h, width, height):
+    if w > MAX_CROP_WIDTH:
+        x, w = x + (w - MAX_CROP_WIDTH) // 2, MAX_CROP_WIDTH
+    if h > MAX_CROP_HEIGHT:
+        y, h = y + (h - MAX_CROP_HEIGHT) // 2, MAX_CROP_HEIGHT
+    x1, y1 = max(x, 0), max(y, 0)
+    x2, y2 = min(x + w, width), min(y + h, height)
+    w, h = max(x2 - x1, 0), max(y2 - y1, 0)
+    return w >= MIN_SIZE and h >= MIN_SIZE, x1, y1, w, h
+
+
+def context_reference(image, shift):
+    height, width = image.shape[:2]
+    scale = 1 << shift
+    cw, ch = width >> shift, height >> shift
+    sums = image[:ch * scale, :cw * scale].astype(np.uint32).reshape(ch, scale, cw, scale, 3).sum(axis=(1, 3))
+    bits = 2 * shift
+    return ((sums + (1 << (bits - 1))) >> bits).astype(np.uint8)[:, :, ::-1]
+
+
+def random_region(rng, width, height):
+    x, y = rng.randrange(width - MIN_SIZE), rng.randrange(height - MIN_SIZE)
+    w = rng.randrange(MIN_SIZE, min(width - x, MAX_CROP_WIDTH) + 1)
+    h = rng.randrange(MIN_SIZE, min(height - y, MAX_CROP_HEIGHT) + 1)
+    return x, y, w, h
+
+
+def selftest(args):
+    failures = []
+
+    def check(name, ok, detail=""):
+        print(f"{'ok  ' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        if not ok:
+            failures.append(name)
+
+    rng = random.Random(args.seed)
+    with tempfile.TemporaryDirectory() as tmp:
+        source = Path(tmp) / "selftest.c"
+        source.write_text(SELFTEST_C)
+        binary = Path(tmp) / "selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", f"-I{FIRMWARE_MAIN}",
+                        f"-I{FIRMWARE / 'components' / 'stream_frame'}", str(source),
+                        str(FIRMWARE_MAIN / "roi_crop.c"), "-o", str(binary)], check=True)
+        driver = subprocess.Popen([str(binary)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+        def send(line, payload=b""):
+            driver.stdin.write(line.encode() + b"\n" + payload)
+            driver.stdin.flush()
+
+        def answer():
+            return driver.stdout.readline().decode().strip()
+
+        def regions(text):
+            fields = list(map(int, text.split()))
+            if fields[0] < 0:
+                return None
+            return [tuple(fields[1 + 5 * i:6 + 5 * i]) for i in range(fields[0])]
+
+        # ?roi= values
+        specs = ["0,0,640,480", "10,20,30,40;50,60,70,80", "1,2,3,4;", "1,2,3,4;5,6,7,8;9,10,11,12;13,14,15,16",
+                 "1,2,3,4;5,6,7,8;9,10,11,12;13,14,15,16;17,18,19,20", "", ";", "1,2,3", "1,2,3,4,5", "a,1,2,3",
+                 "-1,2,3,4", "1,2,0,4", "1,2,3,0", "70000,1,2,3", "1, 2,3,4", "1,2,3,4;;5,6,7,8", "1,2,3,4x"]
+        results = []
+        for spec in specs:
+            send(f"parse {spec}")
+            results.append(regions(answer()))
+        expected = [parse_reference(spec) for spec in specs]
+        # strtol takes leading blanks, the reference does not
+        expected[specs.index("1, 2,3,4")] = [(1, 2, 3, 4, REQUESTED)]
+        check("roi= is parsed like the reference", results == expected, f"{results} != {expected}")
+
+        # Regions around faces and mouths
+        faces_ok = True
+        detail = ""
+        for case in range(args.cases):
+            faces = [(rng.randrange(-20, 640), rng.randrange(-20, 480), rng.randrange(0, 300), rng.randrange(0, 300))
+                     for _ in range(rng.choice((0, 1, 2, 5, 8)))]
+            mouth, pad = rng.randrange(2), rng.choice((0, 20, 35, 100))
+            send(f"faces {mouth} {pad} {len(faces)}\n" + "\n".join(" ".join(map(str, f)) for f in faces))
+            got = regions(answer())
+            want = faces_reference(faces, mouth, pad)
+            if got != want and faces_ok:
+                detail = f"case {case}: {got} != {want}"
+            faces_ok &= got == want
+        check(f"{args.cases} face and mouth regions match the reference", faces_ok, detail)
+
+        # Fitting to the frame and the crop size
+        fit_ok = True
+        detail = ""
+        for case in range(args.cases):
+            width, height = rng.choice(((640, 480), (320, 240), (1280, 720)))
+            x, y = rng.randrange(-200, width + 50), rng.randrange(-200, height + 50)
+            w, h = rng.randrange(0, 900), rng.randrange(0, 700)
+            send(f"fit {x} {y} {w} {h} {width} {height}")
+            got = tuple(map(int, answer().split()))
+            want = fit_reference(x, y, w, h, width, height)
+            want = (int(want[0]),) + want[1:]
+            if got != want and fit_ok:
+                detail = f"case {case}: {got} != {want}"
+            fit_ok &= got == want
+        check(f"{args.cases} regions fitted like the reference", fit_ok, detail)
+
+        # One decode into crops and context, blocks in any order, edge blocks sticking out
+        image_ok = True
+        detail = ""
+        for width, height, block_w, block_h, shift in ((640, 480, 16, 8, 2), (320, 240, 16, 16, 1),
+                                                       (100, 75, 16, 8, 3), (162, 121, 8, 8, 2),
+                                                       (1280, 720, 16, 8, 1)):
+            image = np.frombuffer(rng.randbytes(width * height * 3), np.uint8).reshape(height, width, 3)
+            crops = [random_region(rng, width, height) for _ in range(rng.randrange(MAX_REGIONS + 1))]
+            blocks = []
+            for y in range(0, height, block_h):
+                for x in range(0, width, block_w):
+                    padded = np.full((block_h, block_w, 3), 0xAA, np.uint8)
+                    part = image[y:y + block_h, x:x + block_w]
+                    padded[:part.shape[0], :part.shape[1]] = part
+                    blocks.append((x, y, padded))
+            rng.shuffle(blocks)
+            send(f"image {width} {height} {width} {height} {shift} {len(crops)} {len(blocks)}\n" +
+                 "\n".join(" ".join(map(str, c)) for c in crops))
+            for x, y, data in blocks:
+                send(f"{x} {y} {block_w} {block_h}", data.tobytes())
+            mismatch = answer()
+            got_crops = [driver.stdout.read(w * h * 3) for _, _, w, h in crops]
+            context = driver.stdout.read((width >> shift) * (height >> shift) * 3)
+            want_crops = [image[y:y + h, x:x + w, ::-1].tobytes() for x, y, w, h in crops]
+            want_context = context_reference(image, shift).tobytes()
+            same = mismatch == "0" and got_crops == want_crops and context == want_context
+            if not same and image_ok:
+                detail = (f"{width}x{height}: mismatch {mismatch}, crops {got_crops == want_crops}, "
+                          f"context {context == want_context}")
+            image_ok &= same
+        check("decoded blocks make the crops and the averaged context", image_ok, detail)
+
+        # A frame of another size than expected is flagged, not written
+        send("image 64 48 128 96 1 1 0\n0 0 16 16")
+        flagged = answer() == "1"
+        driver.stdout.read(16 * 16 * 3 + 32 * 24 * 3)
+        check("a frame of an unexpected size is flagged", flagged)
+        driver.stdin.close()
+        driver.wait()
+
+    if failures:
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Context image and region crops from the Eye")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--roi", help="x,y,w,h;... regions of the camera frame instead of the detector's")
+    parser.add_argument("--region", choices=("mouth", "face"), help="around the detector's faces (default mouth)")
+    parser.add_argument("--pad", type=int, help="percent around a face or mouth (default 20)")
+    parser.add_argument("--scale", type=int, choices=(2, 4, 8), help="context at 1/scale of the frame (default 4)")
+    parser.add_argument("--quality", type=int, help="context JPEG quality, 1..100 (default 30)")
+    parser.add_argument("--crop-quality", type=int, help="crop JPEG quality, 1..100 (default 90)")
+    parser.add_argument("--show", action="store_true", help="show the crops on the context, needs OpenCV")
+    parser.add_argument("--save", help="directory to write every image to")
+    parser.set_defaults(func=listen)
+
+    p = sub.add_parser("selftest", help="check the firmware's roi_crop.c against this file")
+    p.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    p.add_argument("--cases", type=int, default=500)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,528 @@
+# Receiver for the arm board's low-latency RTP audio mode (/rtp)
+#
+# /ach1 streams over TCP, so a single lost segment holds back everything behind
+# it until the retransmission arrives, often for hundreds of ms. In RTP mode the
+# board sends 5 ms L16 packets over UDP instead (main/rtp_audio.c). A packet
+# that is lost or arrives too late is concealed and the stream carries on.
+#
+# JitterBuffer reorders the packets and releases them after an adaptive playout
+# delay that follows the measured jitter. It also keeps loss, jitter and latency
+# statistics. RtpReceiver runs it on a socket, and BoardSession asks the board
+# for the stream and keeps it alive.
+#
+#   receiver = RtpReceiver(port=5004, channels=2).start()
+#   board = BoardSession("192.168.4.254", port=5004, ch="0,1").start()
+#   while True:
+#       audio = receiver.read()         # (n, channels) int16, everything due so far
+#       print(receiver.stats())
+#
+# `python rtp_audio.py listen` streams from the board and prints the statistics
+# every second. `python rtp_audio.py simulate --loss 5` runs the receiver
+# against a local loopback sender that drops, delays, reorders and duplicates
+# packets, then checks the receiver's counts against what was injected.
+
+import argparse
+import heapq
+import socket
+import struct
+import threading
+import time
+
+import numpy as np
+
+import time_sync
+
+ESP32_IP = "192.168.4.254"  # IP address of the ESP32 (4-mic array)
+
+# Keep in sync with main/rtp_audio.h
+DEFAULT_PORT = 5004
+PAYLOAD_TYPE = 96
+SAMPLE_RATE = 24000
+FRAMES_PER_PACKET = 120
+EXT_CAPTURE_ID = 1
+EXT_SYNC_ID = 2         # 1 when capture_us is on the Eye's clock (time_sync)
+
+RTP_HEADER = struct.Struct("!BBHII")
+
+
+class RtpPacket:
+    def __init__(self, seq, timestamp, ssrc, payload_type, marker, capture_us, samples, synced=False):
+        self.seq = seq
+        self.timestamp = timestamp
+        self.ssrc = ssrc
+        self.payload_type = payload_type
+        self.marker = marker
+        self.capture_us = capture_us    # capture time of the first frame, None if absent
+        self.synced = synced            # capture_us is on the Eye's clock, else on the board's esp_timer
+        self.samples = samples          # (frames, channels) int16
+
+
+def parse_packet(data, channels):
+    """Decode one RTP datagram with an L16 payload."""
+    if len(data) < RTP_HEADER.size:
+        raise ValueError("Short RTP packet")
+    b0, b1, seq, timestamp, ssrc = RTP_HEADER.unpack_from(data)
+    if b0 >> 6 != 2:
+        raise ValueError(f"Not an RTP version 2 packet (first byte {b0:#04x})")
+    offset = RTP_HEADER.size + 4 * (b0 & 0x0F)
+    end = len(data) - (data[-1] if b0 & 0x20 else 0)
+    capture_us = None
+    synced = False
+    if b0 & 0x10:
+        profile, words = struct.unpack_from("!HH", data, offset)
+        ext = data[offset + 4:offset + 4 + 4 * words]
+        offset += 4 + 4 * words
+        if profile == 0xBEDE:
+            # One-byte header extension elements (RFC 8285)
+            i = 0
+            while i < len(ext):
+                if ext[i] == 0:
+                    i += 1
+                    continue
+                element_id, length = ext[i] >> 4, (ext[i] & 0x0F) + 1
+                if element_id == 15:
+                    break
+                if element_id == EXT_CAPTURE_ID and length == 8:
+                    capture_us = struct.unpack_from("!q", ext, i + 1)[0]
+                elif element_id == EXT_SYNC_ID and length == 1:
+                    synced = bool(ext[i + 1])
+                i += 1 + length
+    payload = data[offset:end]
+    if len(payload) % (2 * channels):
+        raise ValueError(f"Payload of {len(payload)} bytes is not a whole number of {channels}-channel frames")
+    samples = np.frombuffer(payload, dtype=">i2").astype(np.int16).reshape(-1, channels)
+    return RtpPacket(seq, timestamp, ssrc, b1 & 0x7F, bool(b1 & 0x80), capture_us, samples, synced)
+
+
+def build_packet(seq, timestamp, ssrc, samples, capture_us=None, marker=False, synced=False):
+    """Encode a packet exactly like rtp_audio_send() does."""
+    head = RTP_HEADER.pack(0x80 | (0x10 if capture_us is not None else 0),
+                           (0x80 if marker else 0) | PAYLOAD_TYPE,
+                           seq & 0xFFFF, timestamp & 0xFFFFFFFF, ssrc)
+    if capture_us is not None:
+        head += struct.pack("!HHBqBBx", 0xBEDE, 3, (EXT_CAPTURE_ID << 4) | 7, capture_us, EXT_SYNC_ID << 4, synced)
+    return head + np.asarray(samples, dtype=">i2").tobytes()
+
+
+class JitterBuffer:
+    """Reorders packets and releases them after an adaptive playout delay.
+
+    Packet timestamps are mapped to local time through the fastest packet seen
+    so far: playout(ts) = ts / rate + min(arrival - ts / rate) + delay. The
+    delay starts at min_delay. It grows straight away when a packet misses its
+    playout time, and shrinks slowly towards 3x the RFC 3550 interarrival jitter.
+
+    Statistics:
+      received, duplicates, reordered  packets as they arrived
+      lost                             never arrived: expected (from the sequence numbers) - received
+      late                             arrived after their playout time, dropped
+      concealed                        packet-sized gaps filled in on output (lost + late)
+      jitter_ms                        RFC 3550 interarrival jitter
+      delay_ms                         current playout delay of the buffer
+      latency_ms / latency_max_ms      capture (board clock + clock_offset) to release from read()
+    """
+
+    def __init__(self, rate=SAMPLE_RATE, channels=4, min_delay_ms=10.0, max_delay_ms=300.0,
+                 release_ms_per_s=2.0, clock_offset=None, sync=None):
+        self.rate = rate
+        self.channels = channels
+        self.min_delay = min_delay_ms / 1000
+        self.max_delay = max_delay_ms / 1000
+        self.release = release_ms_per_s / 1000
+        # host time = capture_us / 1e6 + clock_offset. Without a synchronized
+        # clock the offset is estimated from the fastest packet, so the latency
+        # excludes the smallest network delay seen. Packets stamped on the Eye's
+        # clock are measured exactly through sync, a time_sync.SyncClient.
+        self.clock_offset = clock_offset
+        self.estimate_offset = clock_offset is None
+        self.sync = sync
+        self.reset()
+
+    def reset(self):
+        self.ssrc = None
+        self.packets = {}           # extended timestamp -> (samples, capture_us, synced)
+        self.capture_synced = None  # whether the board stamps on the Eye's clock
+        self.seen_seqs = set()
+        self.max_seq = None         # extended sequence numbers
+        self.base_seq = None
+        self.ts_ref = None          # last raw timestamp and its extended value, for unwrapping
+        self.ts_ref_ext = 0
+        self.play_ts = None         # extended timestamp of the next frame to release
+        self.base = None            # min(arrival - ts / rate)
+        self.delay = self.min_delay
+        self.last_transit = None
+        self.last_frames = FRAMES_PER_PACKET
+        self.last_samples = None
+        self.conceal_gain = 1.0
+        self.last_update = None
+        self.received = self.duplicates = self.reordered = self.late = self.concealed = 0
+        self.jitter = 0.0
+        self.latency = None
+        self.latency_max = 0.0
+        if self.estimate_offset:
+            self.clock_offset = None
+
+    def _extend_seq(self, seq):
+        if self.max_seq is None:
+            self.base_seq = self.max_seq = seq
+            return seq
+        delta = (seq - self.max_seq) & 0xFFFF
+        ext = self.max_seq + delta if delta < 0x8000 else self.max_seq - (0x10000 - delta)
+        return ext
+
+    def _extend_ts(self, timestamp):
+        if self.ts_ref is None:
+            self.ts_ref, self.ts_ref_ext = timestamp, timestamp
+        delta = (timestamp - self.ts_ref) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            delta -= 0x100000000
+        ext = self.ts_ref_ext + delta
+        if delta > 0:
+            self.ts_ref, self.ts_ref_ext = timestamp, ext
+        return ext
+
+    def push(self, packet, arrival):
+        """Add a packet that arrived at local time `arrival` (seconds, monotonic)."""
+        if self.ssrc != packet.ssrc:
+            if self.ssrc is not None:
+                self.reset()        # the board restarted the stream
+            self.ssrc = packet.ssrc
+        seq = self._extend_seq(packet.seq)
+        if seq in self.seen_seqs:
+            self.duplicates += 1
+            return
+        self.seen_seqs.add(seq)
+        self.received += 1
+        if seq < self.max_seq:
+            self.reordered += 1
+        self.max_seq = max(self.max_seq, seq)
+        if self.play_ts is None:
+            self.base_seq = min(self.base_seq, seq)
+        if len(self.seen_seqs) > 4096:
+            self.seen_seqs = {s for s in self.seen_seqs if s > self.max_seq - 2048}
+
+        ts = self._extend_ts(packet.timestamp)
+        transit = arrival - ts / self.rate
+        if self.last_transit is not None:
+            self.jitter += (abs(transit - self.last_transit) - self.jitter) / 16
+        self.last_transit = transit
+        if self.base is None or transit < self.base:
+            self.base = transit
+        if self.estimate_offset and packet.capture_us is not None:
+            if packet.synced != self.capture_synced:
+                self.clock_offset = None    # the board's timestamps jumped to the other clock
+                self.capture_synced = packet.synced
+            offset = arrival - packet.capture_us / 1e6
+            self.clock_offset = offset if self.clock_offset is None else min(self.clock_offset, offset)
+
+        self.last_frames = len(packet.samples)
+        if self.play_ts is not None and ts < self.play_ts:
+            # Its slot has already been played (or concealed); make room for the next one
+            self.late += 1
+            self.delay = min(self.delay + self.last_frames / self.rate, self.max_delay)
+            return
+        self.packets[ts] = (packet.samples, packet.capture_us, packet.synced)
+
+    def _adapt(self, now):
+        if self.last_update is not None:
+            need = max(self.min_delay, 3 * self.jitter)
+            if self.delay > need:
+                self.delay = max(need, self.delay - self.release * (now - self.last_update))
+        self.last_update = now
+
+    def read(self, now):
+        """Release every frame whose playout time has come, concealing gaps."""
+        out = []
+        if self.base is None:
+            return np.zeros((0, self.channels), dtype=np.int16)
+        self._adapt(now)
+        due_ts = (now - self.base - self.delay) * self.rate
+        if self.play_ts is None:
+            # Start with the earliest packet once it is due, packets can arrive out of order
+            first = min(self.packets)
+            if first >= due_ts:
+                return np.zeros((0, self.channels), dtype=np.int16)
+            self.play_ts = first
+        while self.play_ts < due_ts:
+            entry = self.packets.pop(self.play_ts, None)
+            if entry is not None:
+                samples, capture_us, synced = entry
+                out.append(samples)
+                self.play_ts += len(samples)
+                self.last_samples = samples
+                self.conceal_gain = 1.0
+                captured = self._capture_time(capture_us, synced)
+                if captured is not None:
+                    latency = now - captured
+                    self.latency = latency if self.latency is None else self.latency + (latency - self.latency) / 16
+                    self.latency_max = max(self.latency_max, latency)
+                continue
+            # Nothing at play_ts: conceal up to the next packet, one packet at a time
+            following = [ts for ts in self.packets if ts > self.play_ts]
+            gap = min(min(following) - self.play_ts, self.last_frames) if following else self.last_frames
+            if self.play_ts + gap > due_ts and not following:
+                break               # the packet may still arrive within its playout time
+            out.append(self._conceal(gap))
+            self.play_ts += gap
+            self.concealed += 1
+        if not out:
+            return np.zeros((0, self.channels), dtype=np.int16)
+        return np.concatenate(out)
+
+    def _capture_time(self, capture_us, synced):
+        """Local time of a packet's capture, None when it cannot be told."""
+        if capture_us is None:
+            return None
+        if synced and self.sync is not None and self.sync.synced:
+            return self.sync.to_local(capture_us) / 1e6
+        if self.clock_offset is None:
+            return None
+        return capture_us / 1e6 + self.clock_offset
+
+    def _conceal(self, frames):
+        """Repeat the last packet, halving it every time, so short losses stay smooth."""
+        if self.last_samples is None or len(self.last_samples) < frames:
+            return np.zeros((frames, self.channels), dtype=np.int16)
+        self.conceal_gain *= 0.5
+        return (self.last_samples[:frames] * self.conceal_gain).astype(np.int16)
+
+    def stats(self):
+        expected = 0 if self.max_seq is None else self.max_seq - self.base_seq + 1
+        return {
+            "received": self.received,
+            "lost": max(expected - self.received, 0),
+            "late": self.late,
+            "duplicates": self.duplicates,
+            "reordered": self.reordered,
+            "concealed": self.concealed,
+            "jitter_ms": self.jitter * 1000,
+            "delay_ms": self.delay * 1000,
+            "latency_ms": None if self.latency is None else self.latency * 1000,
+            "latency_max_ms": self.latency_max * 1000,
+        }
+
+
+class RtpReceiver:
+    """Receives RTP audio on a UDP port into a JitterBuffer, on its own thread."""
+
+    def __init__(self, port=DEFAULT_PORT, channels=4, bind="", **jitter_args):
+        self.channels = channels
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+        self.sock.bind((bind, port))
+        self.sock.settimeout(0.2)
+        self.port = self.sock.getsockname()[1]
+        self.buffer = JitterBuffer(channels=channels, **jitter_args)
+        self.lock = threading.Lock()
+        self.running = False
+        self.errors = 0
+
+    def start(self):
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+        return self
+
+    def stop(self):
+        self.running = False
+        self.thread.join()
+        self.sock.close()
+
+    def _run(self):
+        while self.running:
+            try:
+                data = self.sock.recv(2048)
+            except socket.timeout:
+                continue
+            arrival = time.monotonic()
+            try:
+                packet = parse_packet(data, self.channels)
+            except ValueError:
+                self.errors += 1
+                continue
+            with self.lock:
+                self.buffer.push(packet, arrival)
+
+    def read(self):
+        with self.lock:
+            return self.buffer.read(time.monotonic())
+
+    def stats(self):
+        with self.lock:
+            return self.buffer.stats()
+
+
+class BoardSession:
+    """Asks the arm board for the RTP stream and renews the request until stopped."""
+
+    def __init__(self, ip=ESP32_IP, port=DEFAULT_PORT, ch="0,1,2,3"):
+        self.url = f"http://{ip}/rtp"
+        self.params = {"port": port, "ch": ch}
+        self.running = False
+        self.description = None
+
+    def start(self):
+        import requests
+        response = requests.get(self.url, params=self.params, timeout=5)
+        response.raise_for_status()
+        self.description = response.json()
+        self.running = True
+        self.thread = threading.Thread(target=self._keepalive, daemon=True)
+        self.thread.start()
+        return self
+
+    def _keepalive(self):
+        import requests
+        interval = self.description["keepalive_ms"] / 3000
+        while self.running:
+            time.sleep(interval)
+            try:
+                requests.get(self.url, params=self.params, timeout=5)
+            except requests.RequestException as e:
+                print(f"Keepalive failed: {e}")
+
+    def stop(self):
+        import requests
+        self.running = False
+        try:
+            requests.get(self.url, params={**self.params, "stop": 1}, timeout=5)
+        except requests.RequestException:
+            pass
+
+
+def format_stats(s):
+    latency = "   n/a" if s["latency_ms"] is None else f"{s['latency_ms']:6.1f}"
+    return (f"rx {s['received']:>7}  lost {s['lost']:>5}  late {s['late']:>4}  dup {s['duplicates']:>4}  "
+            f"reord {s['reordered']:>4}  jitter {s['jitter_ms']:5.1f} ms  buffer {s['delay_ms']:5.1f} ms  "
+            f"latency {latency} ms (max {s['latency_max_ms']:.1f})")
+
+
+def listen(args):
+    channels = len(args.ch.split(","))
+    sync = time_sync.SyncClient(args.eye).start()
+    receiver = RtpReceiver(args.port, channels, sync=sync).start()
+    board = BoardSession(args.ip, args.port, args.ch).start()
+    print(f"Streaming {board.description}")
+    print("Until the board and this host are synchronized with the Eye, latency is measured above the fastest "
+          "packet seen")
+    try:
+        while True:
+            time.sleep(1)
+            receiver.read()
+            print(format_stats(receiver.stats()))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        board.stop()
+        receiver.stop()
+        sync.stop()
+
+
+def simulate(seconds, loss, duplicate, jitter_ms, base_ms, channels, seed=0):
+    """Loopback test: a paced sender with injected impairments against RtpReceiver."""
+    rng = np.random.default_rng(seed)
+    receiver = RtpReceiver(0, channels, bind="127.0.0.1", clock_offset=0.0).start()
+    sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    dest = ("127.0.0.1", receiver.port)
+    packet_s = FRAMES_PER_PACKET / SAMPLE_RATE
+    count = int(seconds / packet_s)
+    ts0, seq0, ssrc = int(rng.integers(1 << 32)), int(rng.integers(1 << 16)), int(rng.integers(1 << 32))
+
+    n = np.arange(count * FRAMES_PER_PACKET)
+    tone = (8000 * np.sin(2 * np.pi * 440 * n / SAMPLE_RATE)).astype(np.int16)
+    audio = np.repeat(tone[:, None], channels, axis=1)
+    audio[:, 1:] //= np.arange(2, channels + 1)     # tell the channels apart
+
+    print(f"Sending {count} packets over loopback: {loss}% loss, {duplicate}% duplicates, "
+          f"{base_ms} ms + exp({jitter_ms} ms) delay")
+    dropped = duplicated = 0
+    queue = []
+    output = []
+    start = time.monotonic()
+    next_read = start
+    for i in range(count):
+        capture = start + i * packet_s
+        now = time.monotonic()
+        # Hand out everything whose impaired delivery time has come, then read like a consumer would
+        while queue and queue[0][0] <= now:
+            sender.sendto(heapq.heappop(queue)[2], dest)
+        if now >= next_read:
+            output.append(receiver.read())
+            next_read += 0.02
+        if capture > now:
+            time.sleep(capture - now)
+        data = build_packet(seq0 + i, ts0 + i * FRAMES_PER_PACKET, ssrc,
+                            audio[i * FRAMES_PER_PACKET:(i + 1) * FRAMES_PER_PACKET],
+                            capture_us=int(capture * 1e6), marker=(i == 0))
+        # The first and last packets always get through so the loss count is exact
+        if 0 < i < count - 1 and rng.random() < loss / 100:
+            dropped += 1
+            continue
+        copies = 2 if rng.random() < duplicate / 100 else 1
+        duplicated += copies - 1
+        for _ in range(copies):
+            deliver = capture + packet_s + (base_ms + rng.exponential(jitter_ms)) / 1000
+            heapq.heappush(queue, (deliver, i, data))
+    # Drain the impaired queue, keep reading until the buffer has played everything
+    end = max([q[0] for q in queue] + [time.monotonic()]) + receiver.buffer.max_delay
+    while time.monotonic() < end:
+        while queue and queue[0][0] <= time.monotonic():
+            sender.sendto(heapq.heappop(queue)[2], dest)
+        output.append(receiver.read())
+        time.sleep(0.005)
+    receiver.stop()
+    sender.close()
+
+    out = np.concatenate(output)
+    stats = receiver.buffer.stats()
+    # Every packet-sized block of the output must be the original audio unless it was concealed.
+    # After the last packet the buffer keeps concealing, as it would for a live stream.
+    played = min(len(out) // FRAMES_PER_PACKET, count)
+    tail = len(out) // FRAMES_PER_PACKET - played
+    blocks = out[:played * FRAMES_PER_PACKET].reshape(played, -1)
+    original = audio[:played * FRAMES_PER_PACKET].reshape(played, -1)
+    damaged = int(np.any(blocks != original, axis=1).sum())
+
+    print(format_stats(stats))
+    print(f"Injected: {dropped} dropped, {duplicated} duplicated; "
+          f"output {played} of {count} packets, {damaged} concealed")
+    checks = [
+        ("lost matches dropped", stats["lost"] == dropped),
+        ("duplicates detected", stats["duplicates"] == duplicated),
+        ("concealed = lost + late", stats["concealed"] - tail == stats["lost"] + stats["late"]),
+        ("output differs only where concealed", damaged == stats["concealed"] - tail),
+        ("whole stream played out", played == count),
+    ]
+    for name, ok in checks:
+        print(f"  {'ok  ' if ok else 'FAIL'} {name}")
+    return all(ok for _, ok in checks)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="RTP audio receiver for the arm board")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("listen", help="stream from the board and print statistics")
+    p.add_argument("--ip", default=ESP32_IP)
+    p.add_argument("--port", type=int, default=DEFAULT_PORT)
+    p.add_argument("--ch", default="0,1,2,3", help="microphones to stream, ex: 0,2")
+    p.add_argument("--eye", default=time_sync.ESP32_IP, help="time sync master")
+
+    p = sub.add_parser("simulate", help="loopback test with injected loss and jitter")
+    p.add_argument("--seconds", type=float, default=10.0)
+    p.add_argument("--loss", type=float, default=5.0, help="percent of packets dropped")
+    p.add_argument("--duplicate", type=float, default=1.0, help="percent of packets sent twice")
+    p.add_argument("--jitter-ms", type=float, default=8.0, help="mean of the exponential extra delay")
+    p.add_argument("--base-ms", type=float, default=2.0)
+    p.add_argument("--channels", type=int, default=2)
+
+    args = parser.parse_args()
+    if args.command == "listen":
+        listen(args)
+    else:
+        ok = simulate(args.seconds, args.loss, args.duplicate, args.jitter_ms, args.base_ms, args.channels)
+        raise SystemExit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,151 @@
+# Throughput / CPU benchmark: httpd chunked responses against ?raw=1 streaming
+#
+# Streams the same endpoint twice, once through esp_http_server's chunked path
+# and once with ?raw=1 (response written straight to the socket with writev,
+# see Firmware/components/stream_socket). While each run is going it polls
+# /status for the per-core CPU load, and an idle run with no stream gives the
+# baseline. The board needs run time stats (sdkconfig.defaults) for the CPU
+# columns, otherwise they show "-".
+#
+#   python stream_bench.py                                            Eye MJPEG, 15 s per mode
+#   python stream_bench.py --ip 192.168.4.254 --path "/ach1?framed=1"    arm board audio
+#   python stream_bench.py --path /ach1 --duration 30
+#
+# Audio runs are paced by the capture, so both modes should carry the same
+# bytes per second and the CPU columns are what differs. MJPEG runs can also
+# gain frame rate when the send path was the bottleneck.
+
+import argparse
+import threading
+import time
+
+import requests
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+BOUNDARY = b"--123456789000000000000987654321"
+
+
+def with_query(path, extra):
+    return path + ("&" if "?" in path else "?") + extra
+
+
+class Run:
+    def __init__(self, mode):
+        self.mode = mode
+        self.status = None
+        self.bytes = 0
+        self.frames = 0
+        self.seconds = 0.0
+        self.cpu = []               # [core0, core1] samples from /status
+        self.error = None
+
+    def cpu_avg(self, core):
+        values = [sample[core] for sample in self.cpu if sample[core] >= 0]
+        return sum(values) / len(values) if values else None
+
+
+def stream(url, run, stop):
+    try:
+        response = requests.get(url, stream=True, timeout=5)
+        run.status = response.status_code
+        if response.status_code != 200:
+            response.close()
+            return
+        tail = b""
+        start = None
+        for chunk in response.iter_content(chunk_size=16384):
+            if start is None:
+                start = time.monotonic()    # rate from the first byte, the connection setup is not streaming
+            run.bytes += len(chunk)
+            data = tail + chunk
+            run.frames += data.count(BOUNDARY)
+            tail = data[-(len(BOUNDARY) - 1):]
+            if stop.is_set():
+                break
+        run.seconds = time.monotonic() - start if start else 0.0
+        response.close()
+    except requests.RequestException as e:
+        run.error = str(e)
+
+
+def poll_cpu(url, run, stop, interval):
+    # The board reports the load since the previous /status request, so the first answer only primes it
+    first = True
+    while not stop.wait(interval):
+        try:
+            load = requests.get(url, timeout=2).json().get("cpu_load", [-1, -1])
+        except (requests.RequestException, ValueError):
+            continue
+        if not first:
+            run.cpu.append(load)
+        first = False
+
+
+def measure(base, path, mode, duration, interval):
+    run = Run(mode)
+    stop = threading.Event()
+    threads = [threading.Thread(target=poll_cpu, args=(base + "/status", run, stop, interval), daemon=True)]
+    if path is not None:
+        threads.append(threading.Thread(target=stream, args=(base + path, run, stop), daemon=True))
+    # Prime the CPU counters right before the run
+    try:
+        requests.get(base + "/status", timeout=2)
+    except requests.RequestException:
+        pass
+    for t in threads:
+        t.start()
+    time.sleep(duration)
+    stop.set()
+    for t in threads:
+        t.join(timeout=10)
+    return run
+
+
+def fmt(value, width):
+    return f"{'-':>{width}}" if value is None else f"{value:{width}.1f}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare chunked httpd streaming with ?raw=1")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--path", default="/stream", help="stream to measure, ex: /ach1?framed=1")
+    parser.add_argument("--duration", type=float, default=15.0, help="seconds per mode")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between /status polls")
+    parser.add_argument("--no-idle", action="store_true", help="skip the idle baseline")
+    args = parser.parse_args()
+
+    base = f"http://{args.ip}"
+    modes = [] if args.no_idle else [("idle", None)]
+    modes += [("chunked", args.path), ("raw", with_query(args.path, "raw=1"))]
+    runs = []
+    for mode, path in modes:
+        print(f"{mode:8} {base}{path or '/status'} for {args.duration:.0f} s")
+        runs.append(measure(base, path, mode, args.duration, args.interval))
+        time.sleep(1.0)     # let the board close the previous stream
+
+    print(f"\n{'mode':<9}{'HTTP':>6}{'kB/s':>10}{'fps':>8}{'core0 %':>10}{'core1 %':>10}")
+    for run in runs:
+        streaming = run.mode != "idle"
+        if streaming and run.status != 200:
+            print(f"{run.mode:<9}{run.status or '-':>6}   {run.error or ''}")
+            continue
+        seconds = max(run.seconds, 1e-6)
+        kbps = run.bytes / seconds / 1000 if streaming else None
+        fps = run.frames / seconds if streaming and run.frames else None
+        print(f"{run.mode:<9}{run.status or '-':>6}{fmt(kbps, 10)}{fmt(fps, 8)}"
+              f"{fmt(run.cpu_avg(0), 10)}{fmt(run.cpu_avg(1), 10)}")
+
+    by_mode = {run.mode: run for run in runs}
+    chunked, raw = by_mode.get("chunked"), by_mode.get("raw")
+    if chunked and raw and chunked.status == raw.status == 200:
+        for core in (0, 1):
+            a, b = chunked.cpu_avg(core), raw.cpu_avg(core)
+            if a is not None and b is not None:
+                print(f"core{core}: {a:.1f} % chunked, {b:.1f} % raw")
+        if chunked.bytes and raw.bytes:
+            ratio = (raw.bytes / max(raw.seconds, 1e-6)) / (chunked.bytes / max(chunked.seconds, 1e-6))
+            print(f"throughput raw / chunked: {ratio:.2f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,530 @@
+# Reader for the binary stream container, ?container=1 on /ach1, /stream and /av
+#
+# Every frame is a 32-byte header (stream_frame_header_t in
+# Firmware/components/stream_frame/stream_frame.h) followed by its payload:
+#   magic "IRSF", version, header length, stream, codec, seq, timestamp,
+#   payload length, channel mask, flags, a 16-bit check of the header so far
+#   and a CRC-32 of header and payload.
+# stream tells the sources on one connection apart (on /av the camera is 0 and
+# the arm boards 1 and 2), codec what the payload is: PCM or mu-law audio, a
+# JPEG (of a whole frame, or of a region of one with its coordinates), or
+# metadata about the frame with the same stream and seq, like the levels of an
+# audio frame.
+# A frame whose magic, header or CRC is bad is dropped and the reader scans
+# forward to the next magic, so corruption costs the frames it hits and not
+# the connection. /av sends its JPEGs in slices flagged MORE, with audio
+# frames in between, and the reader yields them joined. Newer versions may append header fields; header_len says
+# how many bytes to skip.
+#
+# `python stream_frame.py` prints frames, bytes and lost blocks per stream
+# once a second. `python stream_frame.py selftest` builds the firmware's C
+# code with the host compiler and checks both against each other.
+
+import argparse
+import io
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+from pathlib import Path
+
+import numpy as np
+import requests
+
+from audio_blocks import MULAW
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+
+HEADER = struct.Struct("<4sBBBBIqIBBHI")
+HEADER_CRC = 26     # offset of header_crc, the low 16 bits of the CRC-32 of the bytes before it
+MAGIC = b"IRSF"
+VERSION = 1
+MAX_PAYLOAD = 1 << 24
+CRC = struct.Struct("<I")
+LEVELS = struct.Struct("<" + "HHH" * 4 + "I")
+ROI = struct.Struct("<HHHHHHBB")     # stream_frame_roi_t
+
+PCM16_24K = 1
+PCM16_16K = 2
+MULAW_16K = 3
+JPEG = 16
+JPEG_ROI = 17
+LEVELS_CODEC = 32
+JSON = 33
+CODEC_NAMES = {PCM16_24K: "pcm16_24k", PCM16_16K: "pcm16_16k", MULAW_16K: "mulaw_16k",
+               JPEG: "jpeg", JPEG_ROI: "jpeg_roi", LEVELS_CODEC: "levels", JSON: "json"}
+AUDIO_CODECS = (PCM16_24K, PCM16_16K, MULAW_16K)
+
+FLAG_SYNCED = 0x01      # timestamp_us is on the Eye's clock
+FLAG_CONCEALED = 0x02   # samples were lost on the way and concealed
+FLAG_BEAM = 0x04        # one column, the mix of the channel_map microphones
+FLAG_MORE = 0x08        # the payload continues in the next frame of the stream, /av's sliced JPEGs
+
+BLOCK_MS = 5            # the arm board's capture block, what audio seq counts
+
+
+class Frame:
+    def __init__(self, version, stream, codec, seq, timestamp_us, channel_mask, flags, payload):
+        self.version = version
+        self.stream = stream
+        self.codec = codec
+        self.seq = seq
+        self.timestamp_us = timestamp_us
+        self.channel_mask = channel_mask
+        self.flags = flags
+        self.payload = payload
+        # Microphone index of each audio column
+        self.channel_map = [ch for ch in range(4) if channel_mask & (1 << ch)]
+
+    @property
+    def codec_name(self):
+        return CODEC_NAMES.get(self.codec, "unknown")
+
+    @property
+    def synced(self):
+        return bool(self.flags & FLAG_SYNCED)
+
+    @property
+    def concealed(self):
+        return bool(self.flags & FLAG_CONCEALED)
+
+    @property
+    def channels(self):
+        return 1 if self.flags & FLAG_BEAM else len(self.channel_map)
+
+    @property
+    def rate(self):
+        return 24000 if self.codec == PCM16_24K else 16000
+
+    @property
+    def frames(self):
+        """Audio frames in the payload."""
+        width = 1 if self.codec == MULAW_16K else 2
+        return len(self.payload) // (width * max(self.channels, 1))
+
+    @property
+    def blocks(self):
+        """Capture blocks covered, what seq advances by."""
+        return self.frames // (self.rate * BLOCK_MS // 1000)
+
+    def samples(self):
+        """Audio as (frames, channels) int16."""
+        if self.codec == MULAW_16K:
+            data = MULAW[np.frombuffer(self.payload, dtype=np.uint8)]
+        elif self.codec in AUDIO_CODECS:
+            data = np.frombuffer(self.payload, dtype="<i2")
+        else:
+            raise ValueError(f"{self.codec_name} frame has no samples")
+        return data.reshape(-1, max(self.channels, 1))
+
+    def levels(self):
+        """Levels frame: (peak, rms, clips) per microphone and the latency in us."""
+        fields = LEVELS.unpack_from(self.payload)
+        return [fields[i:i + 3] for i in range(0, 12, 3)], fields[12]
+
+    def roi(self):
+        """JPEG_ROI frame: the region as a dict (frame_width, frame_height, x, y, w, h, index, kind) and the JPEG."""
+        names = ("frame_width", "frame_height", "x", "y", "w", "h", "index", "kind")
+        return dict(zip(names, ROI.unpack_from(self.payload))), self.payload[ROI.size:]
+
+
+def encode(stream, codec, seq, timestamp_us, payload, channel_mask=0, flags=0):
+    """One frame as bytes, what stream_frame_encode() sends."""
+    head = bytearray(HEADER.pack(MAGIC, VERSION, HEADER.size, stream, codec, seq, timestamp_us,
+                                 len(payload), channel_mask, flags, 0, 0)[:-CRC.size])
+    struct.pack_into("<H", head, HEADER_CRC, zlib.crc32(head[:HEADER_CRC]) & 0xFFFF)
+    return head + CRC.pack(zlib.crc32(payload, zlib.crc32(head))) + payload
+
+
+class FrameReader:
+    """Yields the frames of a file-like stream, skipping corrupted ones.
+
+    Slices flagged FLAG_MORE are joined with the following frames of their
+    stream into one frame. A sliced frame that lost a slice to corruption is
+    dropped and counted in broken_slices; after a corrupted frame, a JPEG
+    slice that does not start with an SOI marker is taken for the rest of one
+    whose first slice was lost. join=False yields every frame as it is."""
+
+    def __init__(self, raw, chunk=4096, join=True):
+        self.raw = raw
+        self.chunk = chunk
+        self.join = join
+        self.broken_slices = 0
+        self.buf = bytearray()
+        self.eof = False
+        self.bad_magic = 0
+        self.bad_header = 0
+        self.crc_errors = 0
+        self.skipped_bytes = 0
+
+    @property
+    def resyncs(self):
+        return self.bad_magic + self.bad_header + self.crc_errors
+
+    def _fill(self, n):
+        while len(self.buf) < n and not self.eof:
+            data = self.raw.read(max(self.chunk, n - len(self.buf)))
+            if not data:
+                self.eof = True
+            self.buf += data
+        return len(self.buf) >= n
+
+    def _resync(self):
+        """Drop bytes up to the next magic after the start of the buffer."""
+        start = 1
+        while True:
+            at = self.buf.find(MAGIC, start)
+            if at >= 0:
+                break
+            # Keep a tail that may be the start of a magic
+            keep = max(len(self.buf) - (len(MAGIC) - 1), 1)
+            self.skipped_bytes += keep
+            del self.buf[:keep]
+            start = 0
+            if not self._fill(len(self.buf) + 1):
+                return
+        self.skipped_bytes += at
+        del self.buf[:at]
+
+    def __iter__(self):
+        if not self.join:
+            yield from self._frames()
+            return
+        pieces = {}     # stream -> (first slice, payload so far)
+        broken = {}     # stream -> (codec, seq) of a sliced frame that lost a slice, its rest is dropped
+        unsure = set()  # streams without a frame since the last resync
+        resyncs = 0
+        for frame in self._frames():
+            if self.resyncs != resyncs:
+                # The lost frame may have been a slice, of any stream
+                resyncs = self.resyncs
+                for stream, (first, _) in pieces.items():
+                    broken[stream] = (first.codec, first.seq)
+                self.broken_slices += len(pieces)
+                pieces.clear()
+                unsure = set(range(256))
+            key = (frame.codec, frame.seq)
+            if frame.stream in unsure:
+                unsure.discard(frame.stream)
+                # Only a JPEG that lost its first slice starts without an SOI marker
+                if frame.codec == JPEG and frame.stream not in pieces and frame.payload[:2] != b"\xff\xd8":
+                    broken[frame.stream] = key
+                    self.broken_slices += 1
+            if frame.stream in broken:
+                if broken[frame.stream] == key:
+                    if not frame.flags & FLAG_MORE:
+                        del broken[frame.stream]
+                    continue
+                del broken[frame.stream]
+            first, payload = pieces.pop(frame.stream, (None, b""))
+            if first is not None and (first.codec, first.seq) != key:
+                self.broken_slices += 1
+                first, payload = None, b""
+            if frame.flags & FLAG_MORE:
+                pieces[frame.stream] = (first or frame, payload + frame.payload)
+                continue
+            if first is not None:
+                frame.payload = payload + frame.payload
+            yield frame
+
+    def _frames(self):
+        while self._fill(6):
+            if self.buf[:4] != MAGIC:
+                self.bad_magic += 1
+                self._resync()
+                continue
+            version, header_len = self.buf[4], self.buf[5]
+            if version == 0 or header_len < HEADER.size:
+                self.bad_header += 1
+                self._resync()
+                continue
+            if not self._fill(header_len):
+                return
+            fields = HEADER.unpack_from(self.buf)
+            length, header_crc = fields[7], fields[10]
+            (crc,) = CRC.unpack_from(self.buf, header_len - CRC.size)
+            if header_crc != zlib.crc32(self.buf[:HEADER_CRC]) & 0xFFFF or length > MAX_PAYLOAD:
+                self.bad_header += 1
+                self._resync()
+                continue
+            if not self._fill(header_len + length):
+                return
+            payload = bytes(self.buf[header_len:header_len + length])
+            if zlib.crc32(payload, zlib.crc32(self.buf[:header_len - CRC.size])) != crc:
+                self.crc_errors += 1
+                self._resync()
+                continue
+            del self.buf[:header_len + length]
+            yield Frame(version, *fields[3:7], *fields[8:10], payload)
+
+
+def listen(args):
+    response = requests.get(f"http://{args.ip}{args.path}", stream=True)
+    if response.status_code != 200:
+        print(f"Failed to connect: {response.status_code} {response.text}")
+        return
+    if "X-Stream-Frame-Version" not in response.headers:
+        print(f"{args.path} does not send frames, add container=1")
+        return
+    response.raw.decode_content = True
+
+    reader = FrameReader(response.raw)
+    counts = {}
+    lost = {}
+    next_seq = {}
+    report = time.monotonic() + 1.0
+    for frame in reader:
+        key = (frame.stream, frame.codec_name)
+        frames, size = counts.get(key, (0, 0))
+        counts[key] = (frames + 1, size + len(frame.payload))
+        if frame.codec in AUDIO_CODECS:
+            expected = next_seq.get(frame.stream)
+            if expected is not None and frame.seq != expected:
+                lost[frame.stream] = lost.get(frame.stream, 0) + (frame.seq - expected) % 2**32
+            next_seq[frame.stream] = (frame.seq + frame.blocks) % 2**32
+
+        now = time.monotonic()
+        if now >= report:
+            parts = []
+            for (stream, name), (frames, size) in sorted(counts.items()):
+                part = f"{stream}/{name}: {frames:3d} frames {size / 1000:7.1f} kB"
+                if stream in lost and name.startswith(("pcm", "mulaw")):
+                    part += f", {lost[stream]} blocks lost"
+                parts.append(part)
+            print("  |  ".join(parts) + f"  |  {reader.resyncs} resyncs, {reader.crc_errors} CRC errors")
+            counts = {}
+            report = now + 1.0
+
+
+# Built against stream_frame.c by the selftest. "encode" writes a fixed
+# sequence of frames, "decode" reads a stream from stdin and prints every frame
+# it decodes and, at the end, the error counts.
+SELFTEST_C = r"""
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stream_frame.h"
+
+static int encode(int count) {
+    static uint8_t payload[70000];
+    for (int i = 0; i < count; i++) {
+        size_t len = (size_t)(i * 7919) % sizeof(payload);
+        if (i % 5 == 0) {
+            len = 0;
+        }
+        for (size_t k = 0; k < len; k++) {
+            payload[k] = (uint8_t)(k * 31 + i);
+        }
+        stream_frame_header_t header;
+        stream_frame_encode(&header, i % 3, 1 + i % 40, 1000u * i, (int64_t)i * -123456789, i & 0xF, i % 8,
+                            payload, len);
+        fwrite(&header, sizeof(header), 1, stdout);
+        fwrite(payload, 1, len, stdout);
+    }
+    return 0;
+}
+
+static int decode(void) {
+    size_t cap = 1 << 20, len = 0, n;
+    uint8_t *buf = malloc(cap);
+    while ((n = fread(buf + len, 1, cap - len, stdin)) > 0) {
+        len += n;
+        if (len == cap) {
+            buf = realloc(buf, cap *= 2);
+        }
+    }
+    unsigned errors[STREAM_FRAME_BAD_CRC + 1] = { 0 };
+    size_t off = 0;
+    while (off < len) {
+        stream_frame_header_t h;
+        const uint8_t *payload;
+        size_t frame_len;
+        stream_frame_result_t r = stream_frame_decode(buf + off, len - off, &h, &payload, &frame_len);
+        if (r == STREAM_FRAME_SHORT) {
+            break;
+        }
+        if (r != STREAM_FRAME_OK) {
+            errors[r]++;
+            off += stream_frame_resync(buf + off, len - off);
+            continue;
+        }
+        printf("frame %u %u %u %" PRIu32 " %" PRId64 " %u %u %" PRIu32 " %08" PRIx32 "\n", h.version, h.stream,
+               h.codec, h.seq, h.timestamp_us, h.channel_mask, h.flags, h.length,
+               stream_frame_crc32(0, payload, h.length));
+        off += frame_len;
+    }
+    printf("errors %u %u %u\n", errors[STREAM_FRAME_BAD_MAGIC], errors[STREAM_FRAME_BAD_HEADER],
+           errors[STREAM_FRAME_BAD_CRC]);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    return argc > 2 ? encode(atoi(argv[2])) : decode();
+}
+"""
+
+
+def frame_line(frame):
+    return (f"frame {frame.version} {frame.stream} {frame.codec} {frame.seq} {frame.timestamp_us} "
+            f"{frame.channel_mask} {frame.flags} {len(frame.payload)} {zlib.crc32(frame.payload):08x}")
+
+
+def expect(frame, payload):
+    fields = HEADER.unpack_from(frame)
+    return frame_line(Frame(fields[1], *fields[3:7], *fields[8:10], payload))
+
+
+def selftest(args):
+    component = Path(__file__).resolve().parents[2] / "Firmware" / "components" / "stream_frame"
+    failures = []
+
+    def check(name, ok, detail=""):
+        print(f"{'ok  ' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        if not ok:
+            failures.append(name)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        source = Path(tmp) / "selftest.c"
+        source.write_text(SELFTEST_C)
+        binary = Path(tmp) / "selftest"
+        subprocess.run([args.cc, "-std=c11", "-Wall", "-Werror", "-O2", f"-I{component}", str(source),
+                        str(component / "stream_frame.c"), "-o", str(binary)], check=True)
+
+        # C encodes, Python decodes
+        count = 200
+        encoded = subprocess.run([str(binary), "encode", str(count)], capture_output=True, check=True).stdout
+        reader = FrameReader(io.BytesIO(encoded), chunk=997, join=False)
+        frames = list(reader)
+        expected = []
+        for i in range(count):
+            size = 0 if i % 5 == 0 else (i * 7919) % 70000
+            payload = bytes((k * 31 + i) & 0xFF for k in range(size))
+            expected.append(frame_line(Frame(VERSION, i % 3, 1 + i % 40, (1000 * i) % 2**32, i * -123456789,
+                                             i & 0xF, i % 8, payload)))
+        check("C encoder -> Python reader", [frame_line(f) for f in frames] == expected and reader.resyncs == 0)
+        check("Python encoder matches C byte for byte",
+              b"".join(encode(i % 3, 1 + i % 40, (1000 * i) % 2**32, i * -123456789, f.payload, i & 0xF, i % 8)
+                       for i, f in enumerate(frames)) == encoded)
+
+        # Python encodes a corrupted stream, both decode it
+        rng = random.Random(args.seed)
+        stream = bytearray()
+        kept = []
+        injected = {"magic": 0, "header": 0, "crc": 0, "garbage": 0}
+        for i in range(args.frames):
+            payload = rng.randbytes(rng.choice((0, 28, 480, 1920, rng.randrange(1, 30000))))
+            frame = bytearray(encode(i % 3, rng.choice((PCM16_24K, JPEG, LEVELS_CODEC)), i,
+                                     rng.randrange(-2**63, 2**63), payload, rng.randrange(16), rng.randrange(8)))
+            what = rng.random() if 0 < i < args.frames - 1 else 1.0
+            if what < 0.05:
+                frame[rng.randrange(4)] ^= 0xFF
+                injected["magic"] += 1
+            elif what < 0.08:
+                # A wrong length with a matching header check, only the range check catches it
+                struct.pack_into("<I", frame, 20, MAX_PAYLOAD + 1 + rng.randrange(2**31))
+                struct.pack_into("<H", frame, HEADER_CRC, zlib.crc32(frame[:HEADER_CRC]) & 0xFFFF)
+                injected["header"] += 1
+            elif what < 0.15:
+                frame[rng.randrange(len(frame))] ^= 1 << rng.randrange(8)
+                injected["crc"] += 1
+            elif what < 0.20 and payload:
+                # A newer version with a longer header: same fields, 8 more bytes before the crc
+                head = bytearray(frame[:HEADER.size - CRC.size]) + rng.randbytes(8)
+                head[4], head[5] = 2, HEADER.size + 8
+                struct.pack_into("<H", head, HEADER_CRC, zlib.crc32(head[:HEADER_CRC]) & 0xFFFF)
+                frame = head + CRC.pack(zlib.crc32(payload, zlib.crc32(head))) + payload
+                kept.append(expect(frame, payload))
+            else:
+                kept.append(expect(frame, payload))
+            stream += frame
+            if rng.random() < 0.05:
+                # Garbage between frames, without a magic in it
+                stream += rng.randbytes(rng.randrange(1, 100)).replace(MAGIC, b"XXXX")
+                injected["garbage"] += 1
+
+        reader = FrameReader(io.BytesIO(bytes(stream)), chunk=1500, join=False)
+        python_lines = [frame_line(f) for f in reader]
+        decoded = subprocess.run([str(binary)], input=bytes(stream), capture_output=True, check=True).stdout
+        c_lines = decoded.decode().splitlines()
+        c_errors = [int(x) for x in c_lines.pop().split()[1:]]
+        python_errors = [reader.bad_magic, reader.bad_header, reader.crc_errors]
+        print(f"{args.frames} frames, {len(stream)} bytes, injected {injected}")
+        print(f"Python reader: {len(python_lines)} frames, errors (magic, header, crc) {python_errors}, "
+              f"{reader.skipped_bytes} bytes skipped")
+        print(f"C decoder:     {len(c_lines)} frames, errors (magic, header, crc) {c_errors}")
+        check("Python reader keeps every intact frame", python_lines == kept,
+              f"{len(python_lines)} frames, expected {len(kept)}")
+        check("C decoder agrees with the Python reader", c_lines == python_lines and c_errors == python_errors)
+
+        # Reading in tiny pieces gives the same result
+        reader = FrameReader(io.BytesIO(bytes(stream)), chunk=1, join=False)
+        check("Python reader with 1-byte reads", [frame_line(f) for f in reader] == kept)
+
+        # /av slices its JPEGs (FLAG_MORE), audio of the arm boards comes in between
+        jpegs, frames, audio = [], [], []
+        for i in range(60):
+            jpeg = b"\xff\xd8" + rng.randbytes(rng.choice((0, 4092, rng.randrange(1, 40000)))) + b"\xff\xd9"
+            jpegs.append(jpeg)
+            slices = [jpeg[k:k + 4096] for k in range(0, len(jpeg), 4096)]
+            for n, piece in enumerate(slices):
+                more = FLAG_MORE if n < len(slices) - 1 else 0
+                frames.append((i, n, bytearray(encode(0, JPEG, i, i * 33333, piece, 0, FLAG_SYNCED | more))))
+                for _ in range(rng.randrange(3)):
+                    pcm = encode(1 + len(audio) % 2, PCM16_24K, len(audio) * 8, 0, rng.randbytes(960), 1, FLAG_SYNCED)
+                    audio.append(pcm)
+                    frames.append((None, 0, bytearray(pcm)))
+        reader = FrameReader(io.BytesIO(b"".join(f for _, _, f in frames)), chunk=1500)
+        joined = list(reader)
+        check("sliced JPEGs joined, audio in between kept",
+              [f.payload for f in joined if f.codec == JPEG] == jpegs
+              and [encode(f.stream, f.codec, f.seq, f.timestamp_us, f.payload, f.channel_mask, f.flags)
+                   for f in joined if f.codec != JPEG] == audio
+              and all(not f.flags & FLAG_MORE for f in joined) and reader.broken_slices == 0)
+
+        # A corrupted first, middle or last slice loses its JPEG and nothing else
+        slice_counts = {}
+        for i, n, _ in frames:
+            if i is not None:
+                slice_counts[i] = n + 1
+        hit = {}
+        for i, n, frame in frames:
+            if i is not None and i % 4 == 1 and n == (0, slice_counts[i] // 2, slice_counts[i] - 1)[i // 4 % 3]:
+                frame[HEADER.size + rng.randrange(len(frame) - HEADER.size)] ^= 0x40
+                hit[i] = n
+        reader = FrameReader(io.BytesIO(b"".join(f for _, _, f in frames)), chunk=1500)
+        joined = list(reader)
+        check("a corrupted slice drops its whole JPEG only",
+              [f.payload for f in joined if f.codec == JPEG] == [j for i, j in enumerate(jpegs) if i not in hit]
+              and sum(f.codec != JPEG for f in joined) == len(audio) and reader.crc_errors == len(hit),
+              f"{len(hit)} slices hit, {reader.broken_slices} broken")
+
+    if failures:
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Read stream_frame container streams")
+    sub = parser.add_subparsers(dest="command")
+    parser.add_argument("--ip", default=ESP32_IP)
+    parser.add_argument("--path", default="/av?container=1", help='ex: "/ach1?container=1" on an arm board')
+    parser.set_defaults(func=listen)
+
+    p = sub.add_parser("selftest", help="check this reader against the firmware's C code")
+    p.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    p.add_argument("--frames", type=int, default=2000)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,397 @@
+# Two-way time synchronization with the Eye, the host side of
+# Firmware/components/time_sync.
+#
+# The Eye is the master clock. Every 125 ms a client sends a request stamped
+# with its own time t1, the Eye stamps the arrival t2 and the reply t3, and the
+# client stamps the reply's arrival t4:
+#   offset = ((t2 - t1) + (t3 - t4)) / 2      Eye minus client
+#   rtt    = (t4 - t1) - (t3 - t2)
+# The fastest of every 8 exchanges is kept, and a line through the 8 fastest of
+# the last 32 of those gives the offset and the drift. Arm boards run the same client and
+# stamp their audio on the Eye's clock once synchronized, so host, arm boards
+# and camera share one time base.
+#
+#   sync = SyncClient("192.168.4.1").start()
+#   eye_us = sync.to_master()             # now, on the Eye's clock
+#   local_us = sync.to_local(block.timestamp_us)    # a synchronized capture time, on time.monotonic()
+#
+# `python time_sync.py listen` synchronizes with the Eye and prints the estimate
+# every second. `python time_sync.py simulate --ppm 40 --delay-ms 2 --jitter-ms 5`
+# runs a simulated master with a skewed clock behind a delaying proxy on this
+# host and reports the error against the known truth; it exits non-zero when
+# the error exceeds --tolerance-us. `python time_sync.py proxy` puts the same
+# delaying proxy in front of a real master.
+
+import argparse
+import heapq
+import math
+import random
+import select
+import socket
+import struct
+import sys
+import threading
+import time
+
+ESP32_IP = "192.168.4.1"  # IP address of the ESP32-S3-EYE access point
+PORT = 5007
+
+PACKET = struct.Struct("<4sBBHIqqq")    # time_sync_packet_t
+MAGIC = b"IRTS"
+VERSION = 1
+REQUEST = 1
+RESPONSE = 2
+
+INTERVAL_S = 0.125
+ROUND_EXCHANGES = 8
+ROUNDS = 32
+FIT_ROUNDS = 8
+MIN_FIT_ROUNDS = 4
+JUMP_US = 20000     # offset change that restarts the estimator
+RESPONSE_TIMEOUT_S = 0.1
+
+
+def now_us():
+    return time.monotonic_ns() // 1000
+
+
+class Estimator:
+    """Offset and drift of the master clock, same as time_sync.c."""
+
+    def __init__(self):
+        self.jumps = 0
+        self.reset()
+
+    def reset(self):
+        self.best = None
+        self.round_exchanges = 0
+        self.rounds = []            # (local_us, offset_us, rtt_us), oldest first
+        self.valid = False
+        self.ref_local_us = 0
+        self.offset_us = 0
+        self.drift = 0.0
+        self.rtt_us = 0
+        self.residual_us = 0
+        self.fit_rounds = 0
+
+    def add(self, t1, t2, t3, t4):
+        """Add one exchange; True when a round completed and the fit was updated."""
+        rtt = (t4 - t1) - (t3 - t2)
+        if rtt < 0:
+            return False
+        sample = (t1 + (t4 - t1) // 2, ((t2 - t1) + (t3 - t4)) // 2, rtt)
+        # A slow exchange may be off by half its round trip, more than that is another clock
+        if self.valid and abs(sample[1] - (self.to_master(sample[0]) - sample[0])) > JUMP_US + rtt // 2:
+            self.reset()
+            self.jumps += 1
+        if self.round_exchanges == 0 or sample[2] < self.best[2]:
+            self.best = sample
+        self.round_exchanges += 1
+        if self.round_exchanges < ROUND_EXCHANGES:
+            return False
+        self.rounds = (self.rounds + [self.best])[-ROUNDS:]
+        self.round_exchanges = 0
+        self._refit()
+        return True
+
+    def _refit(self):
+        ref_local, ref_offset, _ = self.rounds[-1]
+        rtts = sorted(r[2] for r in self.rounds)
+        min_rtt = rtts[0]
+        max_rtt = rtts[min(FIT_ROUNDS, len(rtts)) - 1]
+        used = [r for r in self.rounds if r[2] <= max_rtt]     # the fastest rounds
+        xs = [(r[0] - ref_local) / 1e6 for r in used]
+        ys = [r[1] - ref_offset for r in used]
+        n = len(used)
+        slope = 0.0
+        den = n * sum(x * x for x in xs) - sum(xs) ** 2
+        if n >= MIN_FIT_ROUNDS and den > 0:
+            slope = (n * sum(x * y for x, y in zip(xs, ys)) - sum(xs) * sum(ys)) / den
+            intercept = (sum(ys) - slope * sum(xs)) / n
+        else:
+            intercept = ys[-1]
+        residual = math.sqrt(sum((y - intercept - slope * x) ** 2 for x, y in zip(xs, ys)) / n)
+        self.valid = True
+        self.ref_local_us = ref_local
+        self.offset_us = ref_offset + round(intercept)
+        self.drift = slope * 1e-6
+        self.rtt_us = min_rtt
+        self.residual_us = int(residual)
+        self.fit_rounds = n
+
+    def to_master(self, local_us):
+        if not self.valid:
+            return local_us
+        return local_us + self.offset_us + round(self.drift * (local_us - self.ref_local_us))
+
+    def to_local(self, master_us):
+        if not self.valid:
+            return master_us
+        local_us = master_us - self.offset_us
+        return local_us - round(self.drift * (local_us - self.ref_local_us))
+
+
+class SyncClient:
+    """Keeps an Estimator up to date against a master in a background thread."""
+
+    def __init__(self, ip=ESP32_IP, port=PORT, clock=now_us):
+        self.addr = (ip, port)
+        self.clock = clock
+        self.estimator = Estimator()
+        self.exchanges = 0
+        self.timeouts = 0
+        self.lock = threading.Lock()
+        self.running = False
+        self.thread = None
+
+    def start(self):
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+        return self
+
+    def stop(self):
+        self.running = False
+        if self.thread:
+            self.thread.join()
+
+    @property
+    def synced(self):
+        return self.estimator.valid
+
+    def to_master(self, local_us=None):
+        """Local time (default: now) on the master's clock."""
+        if local_us is None:
+            local_us = self.clock()
+        with self.lock:
+            return self.estimator.to_master(local_us)
+
+    def to_local(self, master_us):
+        """A time on the master's clock, ex: a synchronized capture time, on the local clock."""
+        with self.lock:
+            return self.estimator.to_local(master_us)
+
+    def _run(self):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.settimeout(RESPONSE_TIMEOUT_S)
+        seq = 0
+        wake = time.monotonic()
+        while self.running:
+            seq = (seq + 1) & 0xFFFFFFFF
+            t1 = self.clock()
+            sock.sendto(PACKET.pack(MAGIC, VERSION, REQUEST, 0, seq, t1, 0, 0), self.addr)
+            answer = None
+            while answer is None:
+                try:
+                    data = sock.recv(64)
+                except (socket.timeout, OSError):
+                    break
+                t4 = self.clock()
+                if len(data) != PACKET.size:
+                    continue
+                magic, version, kind, _, rseq, rt1, t2, t3 = PACKET.unpack(data)
+                if magic == MAGIC and version == VERSION and kind == RESPONSE and rseq == seq and rt1 == t1:
+                    answer = (t1, t2, t3, t4)
+            with self.lock:
+                if answer is None:
+                    self.timeouts += 1
+                else:
+                    self.exchanges += 1
+                    self.estimator.add(*answer)
+            wake += INTERVAL_S
+            time.sleep(max(0.0, wake - time.monotonic()))
+        sock.close()
+
+
+class Master:
+    """Answers requests like the Eye, on any clock (for tests)."""
+
+    def __init__(self, port=0, clock=now_us):
+        self.clock = clock
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(("127.0.0.1", port))
+        self.port = self.sock.getsockname()[1]
+        self.exchanges = 0
+        threading.Thread(target=self._run, daemon=True).start()
+
+    def _run(self):
+        while True:
+            data, addr = self.sock.recvfrom(64)
+            t2 = self.clock()
+            if len(data) != PACKET.size:
+                continue
+            magic, version, kind, _, seq, t1, _, _ = PACKET.unpack(data)
+            if magic != MAGIC or version != VERSION or kind != REQUEST:
+                continue
+            self.sock.sendto(PACKET.pack(MAGIC, VERSION, RESPONSE, 0, seq, t1, t2, self.clock()), addr)
+            self.exchanges += 1
+
+
+class DelayProxy:
+    """UDP relay between one client and a master that delays every packet by
+    delay + an exponential jitter (mean jitter), plus asym extra towards the
+    master, and drops a share of them."""
+
+    def __init__(self, master, listen_port=0, delay_ms=2.0, jitter_ms=1.0, asym_ms=0.0, loss=0.0, seed=1):
+        self.master = master
+        self.delay = delay_ms / 1000
+        self.jitter = jitter_ms / 1000
+        self.asym = asym_ms / 1000
+        self.loss = loss
+        self.random = random.Random(seed)
+        self.front = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.front.bind(("0.0.0.0", listen_port))
+        self.port = self.front.getsockname()[1]
+        self.back = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.client = None
+        self.queue = []
+        self.cond = threading.Condition()
+        threading.Thread(target=self._receive, daemon=True).start()
+        threading.Thread(target=self._send, daemon=True).start()
+
+    def _receive(self):
+        while True:
+            ready, _, _ = select.select([self.front, self.back], [], [])
+            for sock in ready:
+                data, addr = sock.recvfrom(2048)
+                if self.random.random() < self.loss:
+                    continue
+                delay = self.delay + self.random.expovariate(1 / self.jitter) if self.jitter else self.delay
+                if sock is self.front:
+                    self.client = addr
+                    target = (self.back, self.master)
+                    delay += self.asym
+                else:
+                    target = (self.front, self.client)
+                with self.cond:
+                    heapq.heappush(self.queue, (time.monotonic() + delay, id(data), data, target))
+                    self.cond.notify()
+
+    def _send(self):
+        while True:
+            with self.cond:
+                while not self.queue or self.queue[0][0] > time.monotonic():
+                    self.cond.wait(self.queue[0][0] - time.monotonic() if self.queue else None)
+                _, _, data, (sock, addr) = heapq.heappop(self.queue)
+            sock.sendto(data, addr)
+
+
+def print_state(prefix, client):
+    e = client.estimator
+    print(f"{prefix}offset {e.offset_us:+12d} us  drift {e.drift * 1e6:+7.2f} ppm  rtt {e.rtt_us:6d} us  "
+          f"residual {e.residual_us:5d} us  rounds {e.fit_rounds:2d}  exchanges {client.exchanges}  "
+          f"timeouts {client.timeouts}")
+
+
+def listen(args):
+    client = SyncClient(args.ip, args.port).start()
+    try:
+        while True:
+            time.sleep(1.0)
+            if client.synced:
+                print_state("", client)
+            else:
+                print(f"waiting for {args.ip}:{args.port}, {client.timeouts} timeouts")
+    except KeyboardInterrupt:
+        client.stop()
+
+
+def simulate(args):
+    boot = now_us()
+    skew = 1 + args.ppm * 1e-6
+
+    jump_us = 0     # added at --jump-at, like a master that restarted
+
+    def master_clock():
+        return args.offset_us + jump_us + int((now_us() - boot) * skew)
+
+    master = Master(clock=master_clock)
+    proxy = DelayProxy(("127.0.0.1", master.port), delay_ms=args.delay_ms, jitter_ms=args.jitter_ms,
+                       asym_ms=args.asym_ms, loss=args.loss)
+    client = SyncClient("127.0.0.1", proxy.port).start()
+    print(f"Master clock {args.offset_us:+d} us, {args.ppm:+.1f} ppm; delay {args.delay_ms} ms + "
+          f"{args.jitter_ms} ms jitter each way, {args.asym_ms} ms asymmetry, {args.loss * 100:.0f}% loss")
+
+    errors = []
+    for second in range(1, args.seconds + 1):
+        time.sleep(1.0)
+        if second == args.jump_at:
+            jump_us = int(args.jump_ms * 1000)
+            print(f"Master clock jumps by {args.jump_ms:+.1f} ms")
+        local = now_us()
+        error = client.to_master(local) - master_clock()
+        if client.synced:
+            print_state(f"{second:3d} s  error {error:+7d} us  ", client)
+            settling = second <= args.settle or (args.jump_at and 0 <= second - args.jump_at < args.settle)
+            if not settling:
+                errors.append(error)
+    client.stop()
+
+    if not errors:
+        print("Never synchronized")
+        sys.exit(1)
+    rms = math.sqrt(sum(e * e for e in errors) / len(errors))
+    worst = max(abs(e) for e in errors)
+    drift_error = client.estimator.drift * 1e6 - args.ppm
+    # The asymmetry shifts the offset by half of it, nothing can measure that
+    bound = args.tolerance_us + args.asym_ms * 1000 / 2
+    print(f"After {args.settle} s: rms error {rms:.0f} us, worst {worst} us, drift error {drift_error:+.2f} ppm "
+          f"(tolerance {bound:.0f} us)")
+    if args.jump_at and client.estimator.jumps != 1:
+        print(f"The jump restarted the estimator {client.estimator.jumps} times, expected once")
+        sys.exit(1)
+    if worst > bound:
+        sys.exit(1)
+
+
+def proxy(args):
+    p = DelayProxy((args.master, args.port), listen_port=args.listen, delay_ms=args.delay_ms,
+                   jitter_ms=args.jitter_ms, asym_ms=args.asym_ms, loss=args.loss)
+    print(f"Relaying UDP {p.port} -> {args.master}:{args.port}, Ctrl-C to stop")
+    try:
+        while True:
+            time.sleep(1.0)
+    except KeyboardInterrupt:
+        pass
+
+
+def add_network(parser, delay_ms):
+    parser.add_argument("--delay-ms", type=float, default=delay_ms, help="fixed delay each way")
+    parser.add_argument("--jitter-ms", type=float, default=1.0, help="mean of the exponential extra delay")
+    parser.add_argument("--asym-ms", type=float, default=0.0, help="extra delay towards the master only")
+    parser.add_argument("--loss", type=float, default=0.0, help="share of packets dropped, 0-1")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Time synchronization with the Eye")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("listen", help="synchronize with the Eye and print the estimate")
+    p.add_argument("--ip", default=ESP32_IP)
+    p.add_argument("--port", type=int, default=PORT)
+    p.set_defaults(func=listen)
+
+    p = sub.add_parser("simulate", help="run against a simulated master over a delaying proxy")
+    p.add_argument("--ppm", type=float, default=40.0, help="master clock error against the host")
+    p.add_argument("--offset-us", type=int, default=123_456_789, help="master clock minus host clock")
+    p.add_argument("--seconds", type=int, default=40)
+    p.add_argument("--settle", type=int, default=8, help="seconds before the error counts")
+    p.add_argument("--tolerance-us", type=int, default=500)
+    p.add_argument("--jump-at", type=int, default=0, help="second at which the master clock jumps, 0 never")
+    p.add_argument("--jump-ms", type=float, default=2000.0, help="size of that jump")
+    add_network(p, 2.0)
+    p.set_defaults(func=simulate)
+
+    p = sub.add_parser("proxy", help="relay to a real master with added delay")
+    p.add_argument("--master", default=ESP32_IP)
+    p.add_argument("--port", type=int, default=PORT)
+    p.add_argument("--listen", type=int, default=PORT + 1)
+    add_network(p, 2.0)
+    p.set_defaults(func=proxy)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()